@@ -5,9 +5,17 @@ attribute vec4 a_color;
 
 uniform vec3 u_camera_position;
 
+#ifdef USE_INSTANCING
+attribute mat4 u_model; //one per instance
+#else
 uniform mat4 u_model;
+#endif
 uniform mat4 u_viewprojection;
 
+#ifdef USE_ATLAS
+uniform vec4 u_uv_transform; //sub-texture in the page of an atlas
+#endif
+
 //this will store the color for the pixel shader
 varying vec3 v_position;
 varying vec3 v_world_position;
@@ -29,6 +37,9 @@ void main()
 
 	//store the texture coordinates
 	v_uv = a_uv;
+#ifdef USE_ATLAS
+	v_uv = a_uv * u_uv_transform.xy + u_uv_transform.zw;
+#endif
 
 	//calcule the position of the vertex using the matrices
 	gl_Position = u_viewprojection * vec4( v_world_position, 1.0 );
@@ -0,0 +1,156 @@
+#define RECIPROCAL_PI 0.3183098861837697
+
+// resolves the G-buffer written by pbr.fs with USE_GBUFFER: adds the direct lights to the indirect one
+varying vec2 v_uv;
+
+uniform sampler2D u_gb_albedo; // linear albedo
+uniform sampler2D u_gb_normal; // world normal
+uniform sampler2D u_gb_material; // roughness, metalness, f0
+uniform sampler2D u_gb_indirect; // ibl and emissive
+uniform sampler2D u_depth_texture;
+
+uniform mat4 u_inverse_viewprojection;
+uniform vec3 u_camera_position;
+uniform int u_output; // like Application::output: complete, albedo, roughness, metalness, normals
+
+#ifdef USE_CLUSTERED
+// only the lights of the cluster of the pixel (the lists are computed by LightClusters)
+uniform samplerBuffer u_lights_data; // 3 texels per light: position and radius, difuse, specular
+uniform isamplerBuffer u_cluster_grid; // per cluster: first index and number of lights
+uniform isamplerBuffer u_cluster_lights;
+uniform vec3 u_cluster_dims;
+uniform vec2 u_cluster_depth; // slice = log(depth) * x + y
+uniform vec4 u_cluster_viewport;
+uniform vec3 u_camera_front;
+
+ivec2 getCluster(vec3 world_position)
+{
+	float depth = max(dot(world_position - u_camera_position, u_camera_front), 0.0001);
+	vec3 cell = vec3((gl_FragCoord.xy - u_cluster_viewport.xy) / u_cluster_viewport.zw * u_cluster_dims.xy, log(depth) * u_cluster_depth.x + u_cluster_depth.y);
+	ivec3 c = ivec3(clamp(floor(cell), vec3(0.0), u_cluster_dims - vec3(1.0)));
+	ivec3 dims = ivec3(u_cluster_dims);
+	return texelFetchBuffer(u_cluster_grid, (c.z * dims.y + c.y) * dims.x + c.x).xy;
+}
+#else
+// all the visible lights (MAX_LIGHTS is defined by the renderer)
+uniform vec3 u_lights_pos[MAX_LIGHTS];
+uniform vec3 u_lights_id[MAX_LIGHTS];
+uniform float u_lights_radius[MAX_LIGHTS];
+uniform int u_num_lights;
+#endif
+
+vec3 gamma_to_linear(vec3 color)
+{
+	return pow(color, vec3(2.2));
+}
+
+vec3 linear_to_gamma(vec3 color)
+{
+	return pow(color, vec3(1.0 / 2.2));
+}
+
+// Uncharted 2 tone map, the same as pbr.fs
+vec3 toneMapUncharted2Impl(vec3 color)
+{
+	const float A = 0.15;
+	const float B = 0.50;
+	const float C = 0.10;
+	const float D = 0.20;
+	const float E = 0.02;
+	const float F = 0.30;
+	return ((color*(A*color+C*B)+D*E)/(color*(A*color+B)+D*F))-E/F;
+}
+
+vec3 toneMapUncharted(vec3 color)
+{
+	const float W = 11.2;
+	color = toneMapUncharted2Impl(color * 2.0);
+	vec3 whiteScale = 1.0 / toneMapUncharted2Impl(vec3(W));
+	return color * whiteScale;
+}
+
+float G1(float dot_product, float roughness)
+{
+	float k = pow(roughness + 1.0, 2.0) / 8.0;
+	return dot_product / (dot_product * (1.0 - k) + k);
+}
+
+float Distribution(float NdotH, float roughness)
+{
+	float alpha2 = pow(roughness, 4.0);
+	return (alpha2 * RECIPROCAL_PI) / pow(pow(NdotH, 2.0) * (alpha2 - 1.0) + 1.0, 2.0);
+}
+
+// direct light of one light, the same BSDF as computeDirect of pbr.fs
+vec3 computeDirect(vec3 P, vec3 N, vec3 V, vec3 albedo, float roughness, float metalness, vec3 F0, vec3 light_pos, vec3 intensity, float radius)
+{
+	vec3 L = normalize(light_pos - P);
+	vec3 H = (V + L) / 2.0;
+	float NdotL = clamp(dot(N, L), 0.0, 1.0);
+	float NdotV = clamp(dot(N, V), 0.01, 0.99);
+	float NdotH = clamp(dot(N, H), 0.0, 1.0);
+	float HdotL = clamp(dot(H, L), 0.0, 1.0);
+	float HdotV = clamp(dot(H, V), 0.0, 1.0);
+
+	float attenuation = 1.0;
+	if (radius > 0.0)
+	{
+		attenuation = clamp(1.0 - length(light_pos - P) / radius, 0.0, 1.0);
+		attenuation *= attenuation;
+	}
+
+	vec3 f_diffuse = mix(vec3(0.0), albedo, metalness) * RECIPROCAL_PI;
+	vec3 F = F0 + (vec3(1.0) - F0) * pow(1.0 - HdotL, 5.0);
+	float G = G1(HdotL, roughness) * G1(HdotV, roughness);
+	float D = Distribution(NdotH, roughness);
+	vec3 f_specular = (F * G * D) / (4.0 * NdotL * NdotV + 1e-6);
+
+	return (f_diffuse + f_specular) * gamma_to_linear(intensity) * NdotL * attenuation;
+}
+
+void main()
+{
+	float depth = texture2D(u_depth_texture, v_uv).x;
+	if (depth >= 1.0)
+		discard; // nothing was written, keep the background
+	gl_FragDepth = depth;
+
+	vec3 albedo = texture2D(u_gb_albedo, v_uv).xyz;
+	vec3 N = normalize(texture2D(u_gb_normal, v_uv).xyz);
+	vec3 material = texture2D(u_gb_material, v_uv).xyz;
+
+	// debug view of the G-buffer
+	if (u_output == 1) { gl_FragColor = vec4(linear_to_gamma(albedo), 1.0); return; }
+	if (u_output == 2) { gl_FragColor = vec4(vec3(material.x), 1.0); return; }
+	if (u_output == 3) { gl_FragColor = vec4(vec3(material.y), 1.0); return; }
+	if (u_output == 4) { gl_FragColor = vec4(N * 0.5 + vec3(0.5), 1.0); return; }
+
+	// world position from the depth
+	vec4 position = u_inverse_viewprojection * vec4(v_uv * 2.0 - vec2(1.0), depth * 2.0 - 1.0, 1.0);
+	vec3 P = position.xyz / position.w;
+	vec3 V = normalize(u_camera_position - P);
+	float roughness = material.x;
+	float metalness = material.y;
+	vec3 F0 = mix(vec3(material.z), albedo, metalness);
+
+	vec3 color = texture2D(u_gb_indirect, v_uv).xyz;
+#ifdef USE_CLUSTERED
+	ivec2 cluster = getCluster(P);
+	for (int i = 0; i < cluster.y; ++i)
+	{
+		int light = texelFetchBuffer(u_cluster_lights, cluster.x + i).x * 3;
+		vec4 pos = texelFetchBuffer(u_lights_data, light);
+		color += computeDirect(P, N, V, albedo, roughness, metalness, F0, pos.xyz, texelFetchBuffer(u_lights_data, light + 1).xyz, pos.w);
+	}
+#else
+	for (int i = 0; i < MAX_LIGHTS; ++i)
+	{
+		if (i >= u_num_lights)
+			break;
+		color += computeDirect(P, N, V, albedo, roughness, metalness, F0, u_lights_pos[i], u_lights_id[i], u_lights_radius[i]);
+	}
+#endif
+
+	color = linear_to_gamma(toneMapUncharted(color));
+	gl_FragColor = vec4(color, 1.0);
+}
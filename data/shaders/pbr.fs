@@ -15,6 +15,7 @@ varying vec3 v_normal;
 uniform vec3 u_camera_position;
 uniform vec3 u_light_pos;
 uniform vec3 u_light_intensity;
+uniform float u_light_radius;
 uniform vec3 u_f0;
 uniform float u_roughness_factor;
 uniform float u_metalness_factor;
@@ -28,6 +29,36 @@ uniform sampler2D u_2DLUT;
 uniform sampler2D u_emissive;
 uniform sampler2D u_opacity;
 uniform bool u_use_metal;
+uniform bool u_normal_rg; // BC5 normal map, only XY are stored
+
+#ifdef USE_CLUSTERED
+// only the lights of the cluster of the fragment (the lists are computed by LightClusters)
+uniform samplerBuffer u_lights_data; // 3 texels per light: position and radius, difuse, specular
+uniform isamplerBuffer u_cluster_grid; // per cluster: first index and number of lights
+uniform isamplerBuffer u_cluster_lights;
+uniform vec3 u_cluster_dims;
+uniform vec2 u_cluster_depth; // slice = log(depth) * x + y
+uniform vec4 u_cluster_viewport;
+uniform vec3 u_camera_front;
+
+ivec2 getCluster()
+{
+	float depth = max(dot(v_world_position - u_camera_position, u_camera_front), 0.0001);
+	vec3 cell = vec3((gl_FragCoord.xy - u_cluster_viewport.xy) / u_cluster_viewport.zw * u_cluster_dims.xy, log(depth) * u_cluster_depth.x + u_cluster_depth.y);
+	ivec3 c = ivec3(clamp(floor(cell), vec3(0.0), u_cluster_dims - vec3(1.0)));
+	ivec3 dims = ivec3(u_cluster_dims);
+	return texelFetchBuffer(u_cluster_grid, (c.z * dims.y + c.y) * dims.x + c.x).xy;
+}
+#endif
+
+// radius 0 means no attenuation
+float getAttenuation(vec3 light_pos, float radius)
+{
+	if (radius <= 0.0)
+		return 1.0;
+	float attenuation = clamp(1.0 - length(light_pos - v_world_position) / radius, 0.0, 1.0);
+	return attenuation * attenuation;
+}
 
 const float GAMMA = 2.2;
 const float INV_GAMMA = 1.0 / GAMMA;
@@ -169,6 +200,11 @@ void computeVectors(inout PBRMat material){
 	// agafem els vectors normals de la textura->passem els valors de 0..1 a -1..1
 	vec3 normal;
 	normal = texture2D(u_normal_texture, v_uv).xyz;	
+	if (u_normal_rg){
+		// Z is reconstructed, it is always positive in tangent space
+		vec2 xy = normal.xy * 255./127. - 128./127.;
+		normal.z = (sqrt(max(0.0, 1.0 - dot(xy, xy))) + 128./127.) * 127./255.;
+	}
 	material.N = perturbNormal( v_normal, material.V, v_uv, normal);
 	material.R = normalize(reflect(-material.V, material.N)); 
 }
@@ -224,6 +260,18 @@ vec3 computeDirect(PBRMat material){
 	return direct;
 }
 
+// direct light of another light, the material is a copy
+vec3 computeDirectLight(PBRMat material, vec3 light_pos, vec3 intensity, float radius){
+	material.L = normalize(light_pos - v_world_position);
+	material.H = (material.V + material.L) / 2.0;
+	material.NdotL = clamp(dot(material.N, material.L), 0.0, 1.0);
+	material.NdotH = clamp(dot(material.N, material.H), 0.0, 1.0);
+	material.HdotL = clamp(dot(material.H, material.L), 0.0, 1.0);
+	material.HdotV = clamp(dot(material.H, material.V), 0.0, 1.0);
+	material.light = gamma_to_linear(intensity) * getAttenuation(light_pos, radius);
+	return computeDirect(material);
+}
+
 vec3 computeIBL(PBRMat material){
 	// IBL SPECULAR
 	vec3 specularSample = getReflectionColor(material.R, material.roughness);
@@ -239,7 +287,18 @@ vec3 computeIBL(PBRMat material){
 }
 
 vec4 getPixelColor(PBRMat material){
-	vec3 direct = computeDirect(material);
+#ifdef USE_CLUSTERED
+	vec3 direct = vec3(0.0);
+	ivec2 cluster = getCluster();
+	for (int i = 0; i < cluster.y; ++i)
+	{
+		int light = texelFetchBuffer(u_cluster_lights, cluster.x + i).x * 3;
+		vec4 pos = texelFetchBuffer(u_lights_data, light);
+		direct += computeDirectLight(material, pos.xyz, texelFetchBuffer(u_lights_data, light + 1).xyz, pos.w);
+	}
+#else
+	vec3 direct = computeDirect(material) * getAttenuation(u_light_pos, u_light_radius);
+#endif
 	vec3 ibl = computeIBL(material);
 	return vec4(direct + ibl + material.emissive, material.opacity);
 }
@@ -254,6 +313,13 @@ void main()
 	computeVectors(material);
 	computeMaterialProperties(material);
 
+#ifdef USE_GBUFFER
+	// deferred: only the surface and the indirect light, the direct lights are added when the G-buffer is resolved
+	gl_FragData[0] = vec4(material.albedo * u_color.xyz, 1.0);
+	gl_FragData[1] = vec4(material.N, 1.0);
+	gl_FragData[2] = vec4(material.roughness, material.metalness, u_f0.x, 1.0);
+	gl_FragData[3] = vec4(computeIBL(material) + material.emissive, 1.0);
+#else
 	// 3. Shade (Direct + Indirect)
 	vec4 color = getPixelColor(material);
 
@@ -267,4 +333,5 @@ void main()
 	color.xyz = linear_to_gamma(color.xyz);
 
 	gl_FragColor = color;
+#endif
 }
\ No newline at end of file
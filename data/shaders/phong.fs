@@ -8,6 +8,7 @@ varying vec4 v_color;
 uniform sampler2D u_texture;
 uniform sampler2D u_normal_texture;
 uniform bool u_use_normal;
+uniform bool u_normal_rg; // BC5 normal map, only XY are stored
 
 // material
 uniform vec3 u_ka;
@@ -17,13 +18,64 @@ uniform float u_alpha;
 
 // llum
 uniform vec3 u_ia;
+#if defined(USE_CLUSTERED)
+// nomes les llums del cluster del fragment (les llistes les calcula LightClusters)
+uniform samplerBuffer u_lights_data; // 3 texels per llum: posicio i radi, difusa, especular
+uniform isamplerBuffer u_cluster_grid; // per cluster: primer index i numero de llums
+uniform isamplerBuffer u_cluster_lights;
+uniform vec3 u_cluster_dims;
+uniform vec2 u_cluster_depth; // slice = log(profunditat) * x + y
+uniform vec4 u_cluster_viewport;
+uniform vec3 u_camera_front;
+#elif defined(USE_LIGHT_ARRAY)
+// totes les llums en una sola passada (MAX_LIGHTS el defineix el material)
+uniform vec3 u_lights_pos[MAX_LIGHTS];
+uniform vec3 u_lights_id[MAX_LIGHTS];
+uniform vec3 u_lights_is[MAX_LIGHTS];
+uniform float u_lights_radius[MAX_LIGHTS];
+uniform int u_num_lights;
+#else
 uniform vec3 u_id;
 uniform vec3 u_is;
 uniform vec3 u_light_pos;
+uniform float u_light_radius;
+#endif
 
 // camera
 uniform vec3 u_camera_position;
 
+// component difusa i especular d'una llum (radi 0 vol dir que no s'atenua)
+vec3 phong(vec3 N, vec3 V, vec3 light_pos, vec3 id, vec3 is, float radius)
+{
+	vec3 L = light_pos - v_world_position;
+	float attenuation = 1.0;
+	if (radius > 0.0)
+	{
+		attenuation = clamp(1.0 - length(L) / radius, 0.0, 1.0);
+		attenuation *= attenuation;
+	}
+	L = normalize(L);
+	float LdotN = clamp(dot(L,N), 0.0, 1.0);
+	vec3 difuse = u_kd * LdotN * id;
+	
+	vec3 R = normalize(reflect(-L, N));
+	float RdotV = clamp(dot(R,V), 0.0, 1.0);
+	vec3 specular = u_ks * pow(RdotV, u_alpha) * is;
+	return (difuse + specular) * attenuation;
+}
+
+#ifdef USE_CLUSTERED
+// primer index i numero de llums del cluster del fragment
+ivec2 getCluster()
+{
+	float depth = max(dot(v_world_position - u_camera_position, u_camera_front), 0.0001);
+	vec3 cell = vec3((gl_FragCoord.xy - u_cluster_viewport.xy) / u_cluster_viewport.zw * u_cluster_dims.xy, log(depth) * u_cluster_depth.x + u_cluster_depth.y);
+	ivec3 c = ivec3(clamp(floor(cell), vec3(0.0), u_cluster_dims - vec3(1.0)));
+	ivec3 dims = ivec3(u_cluster_dims);
+	return texelFetchBuffer(u_cluster_grid, (c.z * dims.y + c.y) * dims.x + c.x).xy;
+}
+#endif
+
 void main()
 {
 	vec3 albedo = texture2D(u_texture, v_uv).xyz;	
@@ -31,23 +83,34 @@ void main()
 	if (u_use_normal){
 		// agafem els vectors normals de la textura->passem els valors de 0..1 a -1..1
 		normal = 2.0*texture2D(u_normal_texture, v_uv).xyz - vec3(1.0);	
+		if (u_normal_rg)
+			normal.z = sqrt(max(0.0, 1.0 - dot(normal.xy, normal.xy)));
 	}
 	
 	vec3 ambient = u_ka * u_ia; // component ambient
 
-	// component difusa
 	vec3 N = normalize(normal);
-	vec3 L = normalize(u_light_pos - v_world_position);
-	float LdotN = clamp(dot(L,N), 0.0, 1.0);
-	vec3 difuse = u_kd * LdotN * u_id;
-	
-	// component especular
 	vec3 V = normalize(u_camera_position - v_world_position);
-	vec3 R = normalize(reflect(-L, N));
-	float RdotV = clamp(dot(R,V), 0.0, 1.0);
-	vec3 specular = u_ks * pow(RdotV, u_alpha) * u_is;
-	
+
 	// total
-	vec3 ip = ambient + difuse + specular;
+	vec3 ip = ambient;
+#if defined(USE_CLUSTERED)
+	ivec2 cluster = getCluster();
+	for (int i = 0; i < cluster.y; ++i)
+	{
+		int light = texelFetchBuffer(u_cluster_lights, cluster.x + i).x * 3;
+		vec4 pos = texelFetchBuffer(u_lights_data, light);
+		ip += phong(N, V, pos.xyz, texelFetchBuffer(u_lights_data, light + 1).xyz, texelFetchBuffer(u_lights_data, light + 2).xyz, pos.w);
+	}
+#elif defined(USE_LIGHT_ARRAY)
+	for (int i = 0; i < MAX_LIGHTS; ++i)
+	{
+		if (i >= u_num_lights)
+			break;
+		ip += phong(N, V, u_lights_pos[i], u_lights_id[i], u_lights_is[i], u_lights_radius[i]);
+	}
+#else
+	ip += phong(N, V, u_light_pos, u_id, u_is, u_light_radius);
+#endif
 	gl_FragColor = vec4(ip * albedo, 1.0);
-}
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+attribute vec3 a_vertex;
+
+//full screen quad (Mesh::getQuad goes from -1 to 1)
+varying vec2 v_uv;
+
+void main()
+{	
+	v_uv = a_vertex.xy * 0.5 + vec2(0.5);
+	gl_Position = vec4(a_vertex.xy, 0.0, 1.0);
+}
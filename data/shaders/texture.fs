@@ -5,12 +5,21 @@ varying vec3 v_normal;
 varying vec2 v_uv;
 varying vec4 v_color;
 
+#ifdef USE_ATLAS_ARRAY
+uniform sampler2DArray u_texture; //the pages of the atlas are the layers
+uniform float u_atlas_layer;
+#else
 uniform sampler2D u_texture;
+#endif
 uniform vec3 u_camera_position; // camera
 
 void main()
 {
+#ifdef USE_ATLAS_ARRAY
+	vec3 albedo = texture2DArray(u_texture, vec3(v_uv, u_atlas_layer)).xyz;
+#else
 	vec3 albedo = texture2D(u_texture, v_uv).xyz;	
+#endif
 	
 	gl_FragColor = vec4(albedo, 1.0) ;
 	
@@ -15,6 +15,7 @@ uniform float u_threshold;
 uniform sampler2D u_noise_text;
 uniform bool u_use_jittering;
 uniform float u_texture_width;
+uniform float u_jitter_frame; //progressive accumulation, every frame uses other noise
 // Transfer Function
 uniform sampler2D u_tf_text;
 uniform bool u_use_tf;
@@ -36,7 +37,9 @@ void main(){
 
 	// Jittering
 	if (u_use_jittering){
-		float random_offset = texture(u_noise_text, gl_FragCoord.xy / u_texture_width).x;
+		//the noise is shifted by a 2D golden ratio sequence and its value by the golden ratio, frame 0 is the plain noise
+		vec2 noise_shift = floor(u_texture_width * fract(u_jitter_frame * vec2(0.7548776662, 0.5698402910)));
+		float random_offset = fract(texture(u_noise_text, (gl_FragCoord.xy + noise_shift) / u_texture_width).x + u_jitter_frame * 0.6180339887);
 		sample_pos += random_offset * direction.xyz;
 	}
 
@@ -0,0 +1,13 @@
+//adds a frame of the volumes to the running average (the weight is the blend constant)
+//the alpha becomes the coverage, so the pixels discarded in some frames are not darker
+
+varying vec2 v_uv;
+
+uniform sampler2D u_texture;
+
+void main()
+{
+	vec4 color = texture2D(u_texture, v_uv);
+	float covered = color.a > 0.0 ? 1.0 : 0.0;
+	gl_FragColor = vec4(color.rgb * covered, covered);
+}
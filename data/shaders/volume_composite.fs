@@ -0,0 +1,59 @@
+//composite of the volumes rendered at reduced resolution (or accumulated), drawn with the meshes of the volumes
+//bilateral upsampling: the 4 nearest texels weighted by bilinear and by how close their depth is to this fragment
+
+uniform sampler2D u_volume_texture; //color, alpha 0 where the volume was not drawn or discarded
+uniform sampler2D u_volume_depth;
+uniform vec2 u_volume_size;
+uniform vec2 u_viewport_size;
+uniform vec2 u_camera_nearfar;
+
+float linearDepth(float z)
+{
+	float n = u_camera_nearfar.x;
+	float f = u_camera_nearfar.y;
+	return 2.0 * n * f / (f + n - (z * 2.0 - 1.0) * (f - n));
+}
+
+void main()
+{
+	vec2 uv = gl_FragCoord.xy / u_viewport_size;
+
+#ifdef USE_ACCUMULATION
+	//same resolution, the average of the frames: color premultiplied by the coverage and the coverage
+	vec4 accumulated = texture2D(u_volume_texture, uv);
+	if (accumulated.a <= 0.0)
+		discard;
+	gl_FragColor = vec4(accumulated.rgb / accumulated.a, accumulated.a);
+#else
+	vec2 p = uv * u_volume_size - vec2(0.5);
+	vec2 base = floor(p);
+	vec2 f = p - base;
+	float depth = linearDepth(gl_FragCoord.z);
+
+	vec3 color = vec3(0.0);
+	float covered = 0.0;
+	float total = 0.0;
+	for (int i = 0; i < 4; i++)
+	{
+		vec2 offset = vec2(float(i - (i / 2) * 2), float(i / 2));
+		vec2 texel_uv = clamp((base + offset + vec2(0.5)) / u_volume_size, vec2(0.0), vec2(1.0));
+		vec2 bilinear = mix(vec2(1.0) - f, f, offset);
+		float texel_depth = linearDepth(texture2D(u_volume_depth, texel_uv).x);
+		//relative to the depth so it works at any distance, the epsilon keeps a bit of bilinear on flat areas
+		float w = bilinear.x * bilinear.y / (0.001 + abs(texel_depth - depth) / depth);
+		vec4 texel = texture2D(u_volume_texture, texel_uv);
+		total += w;
+		if (texel.a > 0.0)
+		{
+			color += texel.rgb * w;
+			covered += w;
+		}
+	}
+
+	float coverage = covered / max(total, 0.00001);
+	if (coverage <= 0.0)
+		discard;
+
+	gl_FragColor = vec4(color / covered, coverage); //blended with the alpha, fully covered pixels replace like the full resolution pass
+#endif
+}
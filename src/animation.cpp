@@ -217,6 +217,22 @@ void Animation::operator = (Animation* anim)
 	this->keyframes = NULL;
 }
 
+//if the bin itself is requested, the source is the same name without the extension (it could not exist)
+static void getABINSourceAndBin(const std::string& name, std::string& source, std::string& binfilename)
+{
+	std::string ext = name.substr(name.find_last_of(".") + 1);
+	if (ext == "abin" || ext == "ABIN")
+	{
+		source = name.substr(0, name.find_last_of("."));
+		binfilename = getCacheFolder().size() ? getCacheFilename(source, ".abin") : name;
+	}
+	else
+	{
+		source = name;
+		binfilename = getCacheFilename(source, ".abin");
+	}
+}
+
 bool Animation::load(const char* filename)
 {
 	struct stat stbuffer;
@@ -226,27 +242,20 @@ bool Animation::load(const char* filename)
 
 	char file_format = 0;
 	std::string name = filename;
-	std::string ext = name.substr(name.find_last_of(".") + 1);
-	if (ext == "abin" || ext == "ABIN")
-	{
-		if( !loadABIN(filename) )
-			return false;
-	}
-	else //not a bin
+	std::string source, binfilename;
+	getABINSourceAndBin(name, source, binfilename);
+
+	if (!loadABIN(binfilename.c_str(), source.c_str())) //not found or outdated
 	{
-		std::string binfilename = name + ".abin";
-		if (!loadABIN(binfilename.c_str())) //not found
+		//try to load in ASCII
+		if (!loadSKANIM(source.c_str()))
 		{
-			//try to load in ASCII
-			if (!loadSKANIM(filename))
-			{
-				std::cout << " [ERROR]: File not found" << std::endl;
-				return false;
-			}
-
-			std::cout << "[Writing .ABIN] ... ";
-			writeABIN( filename );
+			std::cout << " [ERROR]: File not found" << std::endl;
+			return false;
 		}
+
+		std::cout << "[Writing .ABIN] ... ";
+		writeABIN( source.c_str() );
 	}
 
 	std::cout << "[OK] Num. Bones: " << skeleton.num_bones << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
@@ -262,13 +271,14 @@ struct sAnimHeader {
 	int num_keyframes;
 	int num_bones;
 	int8 bones_map[128];
+	int padding; //to align the cache info
+	sCacheInfo cache; //size, date and hash of the source used to generate it
 	char extra[16];
 };
 
 bool Animation::writeABIN(const char* filename)
 {
-	std::string s_filename = filename;
-	s_filename += ".abin";
+	std::string s_filename = getCacheFilename(filename, ".abin");
 
 	FILE* f = fopen(s_filename.c_str(), "wb");
 	if (f == NULL)
@@ -281,6 +291,7 @@ bool Animation::writeABIN(const char* filename)
 	fwrite("ABIN", sizeof(char), 4, f);
 
 	sAnimHeader header;
+	memset(&header, 0, sizeof(header));
 	header.version = ANIM_BIN_VERSION;
 	header.header_bytes = sizeof(header);
 	header.duration = duration;
@@ -289,6 +300,7 @@ bool Animation::writeABIN(const char* filename)
 	header.num_keyframes = num_keyframes;
 	header.num_bones = skeleton.num_bones;
 	memcpy( header.bones_map, bones_map, sizeof(bones_map)  );
+	computeCacheInfo(filename, header.cache);
 
 	//write header
 	fwrite((void*)&header, sizeof(sAnimHeader), 1, f);
@@ -303,7 +315,44 @@ bool Animation::writeABIN(const char* filename)
 	return true;
 }
 
-bool Animation::loadABIN(const char* filename)
+static void updateABINHeaderDate(const char* filename, const char* source, sAnimHeader& header)
+{
+	unsigned long long size;
+	if (!getFileInfo(source, size, header.cache.source_mtime))
+		return;
+	FILE* f = fopen(filename, "r+b");
+	if (!f)
+		return;
+	fseek(f, 4, SEEK_SET);
+	fwrite((void*)&header, sizeof(sAnimHeader), 1, f);
+	fclose(f);
+}
+
+bool Animation::isABINUpToDate(const char* filename)
+{
+	std::string source, binfilename;
+	getABINSourceAndBin(filename, source, binfilename);
+
+	//only the header is needed
+	FILE* f = fopen(binfilename.c_str(), "rb");
+	if (!f)
+		return false;
+	char watermark[4];
+	sAnimHeader header;
+	bool ok = fread(watermark, 4, 1, f) == 1 && fread(&header, sizeof(sAnimHeader), 1, f) == 1;
+	fclose(f);
+	if (!ok || memcmp(watermark, "ABIN", 4) != 0 || header.version != ANIM_BIN_VERSION || header.header_bytes != sizeof(sAnimHeader))
+		return false;
+
+	bool touched = false;
+	if (!isCacheValid(source.c_str(), header.cache, touched))
+		return false;
+	if (touched)
+		updateABINHeaderDate(binfilename.c_str(), source.c_str(), header);
+	return true;
+}
+
+bool Animation::loadABIN(const char* filename, const char* source)
 {
 	FILE *f;
 	assert(filename);
@@ -335,9 +384,21 @@ bool Animation::loadABIN(const char* filename)
 	if (header.version != ANIM_BIN_VERSION || header.header_bytes != sizeof(sAnimHeader))
 	{
 		std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
+		delete[] data;
 		return false;
 	}
 
+	//check it was generated from the current version of the source
+	bool touched = false;
+	if (source && !isCacheValid(source, header.cache, touched))
+	{
+		std::cout << "[WARN] loading BIN: outdated: " << filename << std::endl;
+		delete[] data;
+		return false;
+	}
+	if (touched) //same content, store the new date so next time there is no need to hash it
+		updateABINHeaderDate(filename, source, header);
+
 	//extract header
 	duration = header.duration;
 	samples_per_second = header.samples_per_second;
@@ -481,7 +542,10 @@ Animation* Animation::Get(const char* filename)
 	//check if loaded
 	auto it = sAnimationsLoaded.find(filename);
 	if (it != sAnimationsLoaded.end())
+	{
+		it->second->touch();
 		return it->second;
+	}
 
 	//load it
 	Animation* anim = new Animation();
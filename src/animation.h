@@ -4,7 +4,7 @@
 
 class Camera;
 
-#define ANIM_BIN_VERSION 3
+#define ANIM_BIN_VERSION 4
 
 //defined layers for every body
 enum BODY_LAYERS {
@@ -56,7 +56,7 @@ public:
 void blendSkeleton(Skeleton* a, Skeleton* b, float w, Skeleton* result, uint8 layer = 0xFF);
 
 //This class contains one animation loaded from a file (it also uses a skeleton to store the current snapshot)
-class Animation {
+class Animation : public Asset {
 public:
 
 	Skeleton skeleton;
@@ -78,11 +78,13 @@ public:
 	//storage
 	bool load(const char* filename);
 	bool loadSKANIM(const char* filename);
-	bool loadABIN(const char* filename);
-	bool writeABIN(const char* filename);
+	bool loadABIN(const char* filename, const char* source = NULL); //if source is given the bin is rejected when it is outdated
+	bool writeABIN(const char* filename); //filename is the source, the bin goes to getCacheFilename(filename,".abin")
+	static bool isABINUpToDate(const char* filename); //only reads the header
 
 	static std::map<std::string, Animation*> sAnimationsLoaded;
 	static Animation* Get(const char* filename);
+	size_t getBytes() { return sizeof(Animation) + (size_t)num_keyframes * num_animated_bones * sizeof(Matrix44); } //for the AssetCache
 
 	//copy operator to copy the keyframes
 	void operator = (Animation* anim);
@@ -7,12 +7,14 @@
 #include "shader.h"
 #include "input.h"
 #include "animation.h"
+#include "texturestreamer.h"
 #include "extra/hdre.h"
 #include "extra/imgui/imgui.h"
 #include "extra/imgui/imgui_impl_sdl.h"
 #include "extra/imgui/imgui_impl_opengl3.h"
 
 #include <cmath>
+#include <sstream>
 
 #define PATH "data/models/helmet"
 bool render_wireframe = false;
@@ -37,6 +39,14 @@ Application::Application(int window_width, int window_height, SDL_Window* window
 	scene_exposure = 1;
 	output = 0;
 	ambient_light = Vector3(1.0, 0.6, 0.3);
+	use_instancing = true;
+	use_culling = true;
+	num_nodes_visible = num_nodes_culled = 0;
+	use_clustered_lights = true;
+	use_deferred = false;
+	use_reduced_volumes = false;
+	use_progressive_volumes = false;
+	must_benchmark_lights = false;
 
 	// OpenGL flags
 	glEnable( GL_CULL_FACE ); //render both sides of every triangle
@@ -56,7 +66,7 @@ Application::Application(int window_width, int window_height, SDL_Window* window
 		Matrix44 sky_model;
 		sky_model.translate(camera->eye.x, camera->eye.y, camera->eye.z);
 		//sky_model.scale(10.0, 10.0, 10.0);
-		skybox->model = sky_model;
+		skybox->setModel(sky_model);
 		skybox->visible = false;
 
 		SkyboxMaterial* mat_skybox = new SkyboxMaterial();									 // Definim el material de la skybox
@@ -79,7 +89,7 @@ Application::Application(int window_width, int window_height, SDL_Window* window
 		standard_node->visible = false;
 
 		TextureMaterial* standard_mat = new TextureMaterial();				// Definim en stardardmaterial
-		standard_mat->texture = Texture::Get("data/models/bench/albedo.png");   // Li assignem la textura corresponent
+		standard_mat->texture = Texture::GetAsync("data/models/bench/albedo.png");   // Li assignem la textura corresponent
 		
 		standard_node->material = standard_mat;   // Li assignem el material al node
 		node_list.push_back(standard_node);
@@ -91,7 +101,7 @@ Application::Application(int window_width, int window_height, SDL_Window* window
 		node->visible = false;
 
 		PhongMaterial* mat = new PhongMaterial();						   // Definim un phong material
-		Texture* albedo = Texture::Get("data/models/helmet/albedo.png");
+		Texture* albedo = Texture::GetAsync("data/models/helmet/albedo.png");
 		mat->texture = albedo;									           // Li assignem la textura correpsonent
 		//Texture* normal = Texture::Get("data/models/helmet/normal.png");
 		//mat->normal_texture = normal;
@@ -141,12 +151,13 @@ Application::Application(int window_width, int window_height, SDL_Window* window
 		pbr_node->model.setTranslation(0.0, 0.0, 2.0);
 		pbr_node->visible = false;
 
+		//the maps are decoded in background and show a white (or black) texture till they are uploaded
 		PBRMaterial* pbr_mat = new PBRMaterial();						// El definim amb el material PBR
-		pbr_mat->albedo = Texture::Get(PATH "/albedo.png");				// Li assignem la textura albedo
-		pbr_mat->normal = Texture::Get(PATH  "/normal.png");			// Li assignem la textura normal
-		pbr_mat->roughness = Texture::Get(PATH  "/roughness.png");		// Li assignem la textura roughness
-		pbr_mat->metalness = Texture::Get(PATH "/metalness.png");		// Li assignem la textura metalness
-		pbr_mat->emissive = Texture::Get(PATH "/emissive.png");			// Li assignem la textura emissive
+		pbr_mat->albedo = Texture::GetAsync(PATH "/albedo.png");			// Li assignem la textura albedo
+		pbr_mat->normal = Texture::GetAsync(PATH  "/normal.png");		// Li assignem la textura normal
+		pbr_mat->roughness = Texture::GetAsync(PATH  "/roughness.png");	// Li assignem la textura roughness
+		pbr_mat->metalness = Texture::GetAsync(PATH "/metalness.png");	// Li assignem la textura metalness
+		pbr_mat->emissive = Texture::GetAsync(PATH "/emissive.png", nullptr, true, GL_REPEAT, true);	// Li assignem la textura emissive
 		//pbr_mat->opacity = Texture::Get(PATH "/opacity.png");			// Li assignem la textura opacity
 		pbr_mat->brdfLUT = Texture::Get("data/brdfLUT.png");			// Li assignem la textura LUT 2D
 		pbr_mat->use_metal = false;
@@ -212,6 +223,11 @@ Application::Application(int window_width, int window_height, SDL_Window* window
 //what to do when the image has to be draw
 void Application::render(void)
 {
+	if (must_benchmark_lights) {
+		benchmarkLights();
+		must_benchmark_lights = false;
+	}
+
 	//set the clear color (the background color)
 	glClearColor(.1,.1,.1, 1.0);
 
@@ -228,16 +244,190 @@ void Application::render(void)
 	glEnable(GL_DEPTH_TEST);
 	glDisable(GL_CULL_FACE);
 
-	for (size_t i = 0; i < node_list.size(); i++) {
-		if (node_list[i]->visible) node_list[i]->render(camera);
+	renderNodes();
 
-		if(render_wireframe)
+	if (render_wireframe)
+		for (size_t i = 0; i < node_list.size(); i++)
 			node_list[i]->renderWireframe(camera);
-	}
 
 	//Draw the floor grid
 	if(render_debug)
 		drawGrid();
+
+	//leave the attributes clean for the GUI
+	Mesh::resetBufferBindings();
+	Mesh::nextInstancesFrame();
+}
+
+//times the scene with 1, 8 and 64 lights, with clustered lights, with all the lights in a single pass and with one pass per light
+void Application::benchmarkLights(void)
+{
+	const int light_counts[] = { 1, 8, 64 };
+	const int num_frames = 30;
+	std::vector<Light*> scene_lights = light_list;
+	bool single_pass = PhongMaterial::use_single_pass;
+	bool clustered = use_clustered_lights;
+
+	std::stringstream ss;
+	ss << "Lights (ms/frame): ";
+	for (int c = 0; c < 3; c++) {
+		int num_lights = light_counts[c];
+		light_list.clear();
+		for (int i = 0; i < num_lights; i++) {
+			float angle = i * 2.0f * PI / num_lights;
+			Light* light = new Light("benchmark light");
+			light->position = Vector3(cos(angle) * 50.0f, 30.0f, sin(angle) * 50.0f);
+			light->radius = 100.0f;
+			light->difuse = Vector3(1.0f, 1.0f, 1.0f) * (1.0f / num_lights);
+			light->specular = light->difuse;
+			light_list.push_back(light);
+		}
+
+		double ms[3];
+		for (int mode = 0; mode < 3; mode++) {
+			use_clustered_lights = mode == 0;
+			PhongMaterial::use_single_pass = mode == 1;
+			camera->enable();
+			glEnable(GL_DEPTH_TEST);
+			glDisable(GL_CULL_FACE);
+			renderNodes(); //warm up
+			glFinish();
+			double start = getTimeMs();
+			for (int f = 0; f < num_frames; f++) {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				renderNodes();
+				Mesh::nextInstancesFrame();
+			}
+			glFinish();
+			ms[mode] = (getTimeMs() - start) / num_frames;
+		}
+		ss << num_lights << ": " << ms[0] << " clustered / " << ms[1] << " single / " << ms[2] << " multipass  ";
+		if (num_lights > MAX_SINGLE_PASS_LIGHTS)
+			ss << "(single pass falls back to multipass) ";
+
+		for (size_t i = 0; i < light_list.size(); i++)
+			delete light_list[i];
+	}
+
+	light_list = scene_lights;
+	PhongMaterial::use_single_pass = single_pass;
+	use_clustered_lights = clustered;
+	lights_benchmark = ss.str();
+	std::cout << " + " << lights_benchmark << std::endl;
+}
+
+//fills the render queue with the visible nodes and executes it sorted by state and depth
+//opaque nodes sharing mesh and material are grouped in a single instanced item
+void Application::renderNodes(void)
+{
+	render_queue.clear();
+
+	//world matrices of the hierarchy, only the subtrees that moved are recomputed
+	if (scene_graph.needsRebuild(node_list)) {
+		scene_graph.build(node_list);
+		spatial_index.clear();
+	}
+	scene_graph.update();
+	spatial_index.sync(scene_graph);
+
+	//frustum culling of the world bounding boxes, all at once
+	std::vector<SceneNode*> nodes;
+	std::vector<Matrix44*> models;
+	for (size_t i = 0; i < scene_graph.nodes.size(); i++) {
+		SceneNode* node = scene_graph.nodes[i];
+		if (scene_graph.visible[i] && node->mesh && node->material) {
+			nodes.push_back(node);
+			models.push_back(&scene_graph.world_matrices[i]);
+		}
+	}
+	std::vector<unsigned char> in_frustum(nodes.size(), 1);
+	if (use_culling && nodes.size()) {
+		std::vector<float> boxes(nodes.size() * 6);
+		float* center_x = &boxes[0];
+		float* center_y = center_x + nodes.size();
+		float* center_z = center_y + nodes.size();
+		float* halfsize_x = center_z + nodes.size();
+		float* halfsize_y = halfsize_x + nodes.size();
+		float* halfsize_z = halfsize_y + nodes.size();
+		for (size_t i = 0; i < nodes.size(); i++) {
+			BoundingBox box = transformBoundingBox(*models[i], nodes[i]->mesh->box);
+			if (nodes[i]->material->getRenderPass() == PASS_BACKGROUND || !nodes[i]->mesh->isLoaded())
+				box.halfsize = Vector3(1e10f, 1e10f, 1e10f); //never culled
+			center_x[i] = box.center.x; center_y[i] = box.center.y; center_z[i] = box.center.z;
+			halfsize_x[i] = box.halfsize.x; halfsize_y[i] = box.halfsize.y; halfsize_z[i] = box.halfsize.z;
+		}
+		camera->testBoxesInFrustum((int)nodes.size(), center_x, center_y, center_z, halfsize_x, halfsize_y, halfsize_z, &in_frustum[0]);
+	}
+	num_nodes_visible = num_nodes_culled = 0;
+
+	std::map<std::pair<Mesh*, Material*>, std::vector<Matrix44> > groups;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		SceneNode* node = nodes[i];
+		if (!in_frustum[i]) {
+			num_nodes_culled++;
+			continue;
+		}
+		num_nodes_visible++;
+		requestTextures(node, *models[i]);
+		if (use_instancing && node->material->instanced_shader && !node->material->isTransparent())
+			groups[std::make_pair(node->mesh, node->material)].push_back(*models[i]);
+		else
+			render_queue.add(node->mesh, node->material, *models[i], camera);
+	}
+
+	for (std::map<std::pair<Mesh*, Material*>, std::vector<Matrix44> >::iterator it = groups.begin(); it != groups.end(); ++it) {
+		std::vector<Matrix44>& models = it->second;
+		if (models.size() == 1)
+			render_queue.add(it->first.first, it->first.second, models[0], camera);
+		else
+			render_queue.addInstanced(it->first.first, it->first.second, &models[0], (int)models.size(), camera);
+	}
+
+	//lights of every cluster of the view, for the phong and pbr shaders
+	light_clusters.ready = false;
+	if (use_clustered_lights) {
+		light_clusters.build(camera, light_list);
+		light_clusters.upload();
+	}
+
+	render_queue.sort();
+
+	//volumes at reduced resolution while the camera moves or accumulated while nothing changes, composited after the rest
+	bool volumes_apart = volume_compositor.update(camera, &render_queue, use_reduced_volumes, use_progressive_volumes);
+	render_queue.skip_volumes = volumes_apart;
+
+	//deferred: G-buffer, background, lighting of the G-buffer (with its depth) and the forward items on top
+	if (use_deferred && !deferred.begin(window_width, window_height))
+		use_deferred = false; //begin says why, it can be enabled again from the debugger
+	if (use_deferred) {
+		render_queue.execute(camera, QUEUE_GBUFFER);
+		deferred.end();
+		render_queue.execute(camera, QUEUE_BACKGROUND);
+		deferred.resolve(camera, &light_clusters, output);
+		render_queue.execute(camera, QUEUE_FORWARD);
+	}
+	else
+		render_queue.execute(camera);
+
+	if (volumes_apart)
+		volume_compositor.render(camera, &render_queue, window_width, window_height);
+}
+
+//the mips of the textures of the node from its size on screen (the radius of the mesh scaled by the model)
+void Application::requestTextures(SceneNode* node, Matrix44& model)
+{
+	TextureStreamer* streamer = TextureStreamer::getGlobal();
+	if (streamer->textures.empty() || node->material->getRenderPass() != PASS_MAIN)
+		return;
+
+	Vector3 center = model * node->mesh->box.center;
+	float scale = std::max(model.rightVector().length(), std::max(model.topVector().length(), model.frontVector().length()));
+	float size = camera->getProjectedScale(center, node->mesh->radius * scale) * window_width / 100.0f; //it is calibrated for 200 pixels
+
+	std::vector<Texture*> textures;
+	node->material->getTextures(textures);
+	for (size_t i = 0; i < textures.size(); i++)
+		streamer->request(textures[i], size);
 }
 
 void Application::update(double seconds_elapsed)
@@ -249,6 +439,7 @@ void Application::update(double seconds_elapsed)
 	float angle = seconds_elapsed * 10.f * DEG2RAD;
 	/*for (int i = 0; i < root.size(); i++) {
 		root[i]->model.rotate(angle, Vector3(0,1,0));
+		root[i]->markDirty();
 	}*/
 
 	//mouse input to rotate the cam
@@ -273,6 +464,7 @@ void Application::update(double seconds_elapsed)
 
 	//Actualitzem el centre de la box segons la posició de la càmera
 	skybox->model.setTranslation(camera->eye.x, camera->eye.y, camera->eye.z);
+	skybox->markDirty();
 }
 
 //Keyboard event handler (sync input)
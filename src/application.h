@@ -9,6 +9,12 @@
 #include "camera.h"
 #include "utils.h"
 #include "scenenode.h"
+#include "renderqueue.h"
+#include "scenegraph.h"
+#include "spatialindex.h"
+#include "lightclusters.h"
+#include "deferred.h"
+#include "volumecompositor.h"
 
 enum EOutput {
 	COMPLETE,
@@ -23,7 +29,9 @@ class Application
 public:
 	static Application* instance;
 
-	std::vector< SceneNode* > node_list;
+	std::vector< SceneNode* > node_list; //root nodes, the children are reached through them
+	SceneGraph scene_graph; //world matrices of all the nodes
+	SpatialIndex spatial_index; //world bounds of all the nodes, for frustum, sphere, box and ray queries
 	std::vector< Light* > light_list;
 	SceneNode* skybox;
 
@@ -42,6 +50,20 @@ public:
 	float scene_exposure;
 	int output;
 	Vector3 ambient_light;
+	bool use_instancing; //visible nodes sharing mesh and material are drawn with a single instanced call
+	RenderQueue render_queue; //visible nodes sorted by pass, shader, material and depth
+	bool use_culling; //nodes outside the camera frustum are not rendered
+	int num_nodes_visible;
+	int num_nodes_culled;
+	bool use_clustered_lights; //the shaders only loop over the lights of the cluster of the fragment
+	LightClusters light_clusters;
+	bool use_deferred; //the materials that can write the G-buffer are lit in a full screen pass
+	DeferredRenderer deferred;
+	bool use_reduced_volumes; //the volumes are ray marched at reduced resolution while the camera moves
+	bool use_progressive_volumes; //while nothing changes the jittered frames of the volumes are averaged
+	VolumeCompositor volume_compositor;
+	bool must_benchmark_lights; //done at the start of the next frame
+	std::string lights_benchmark; //result of the last one
 
 	//some vars
 	static Camera* camera; //our GLOBAL camera
@@ -52,6 +74,9 @@ public:
 	//main functions
 	void render( void );
 	void update( double dt );
+	void renderNodes( void );
+	void requestTextures(SceneNode* node, Matrix44& model); //mips of its textures for the TextureStreamer
+	void benchmarkLights( void );
 
 	//events
 	void onKeyDown( SDL_KeyboardEvent event );
@@ -0,0 +1,193 @@
+#include "assetcache.h"
+#include "texture.h"
+#include "texturestreamer.h"
+#include "mesh.h"
+#include "animation.h"
+#include "extra/hdre.h"
+#include "includes.h"
+
+#include <map>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#define MB (1024 * 1024)
+
+long Asset::frame = 0;
+
+AssetCache::AssetCache()
+{
+	enabled = true;
+	cpu_budget[ASSET_TEXTURE] = 512 * MB; //the images kept after the upload
+	gpu_budget[ASSET_TEXTURE] = 1024 * MB;
+	cpu_budget[ASSET_MESH] = 1024 * MB;
+	gpu_budget[ASSET_MESH] = 512 * MB;
+	cpu_budget[ASSET_HDRE] = 512 * MB;
+	gpu_budget[ASSET_HDRE] = 0; //the cubemaps made from them are not in the manager
+	cpu_budget[ASSET_ANIMATION] = 256 * MB;
+	gpu_budget[ASSET_ANIMATION] = 0;
+	min_unused_frames = 120;
+	memset(stats, 0, sizeof(stats));
+}
+
+AssetCache* AssetCache::getGlobal()
+{
+	static AssetCache* cache = NULL;
+	if (!cache)
+		cache = new AssetCache();
+	return cache;
+}
+
+const char* AssetCache::getTypeName(eAssetType type)
+{
+	switch (type)
+	{
+	case ASSET_TEXTURE: return "Textures";
+	case ASSET_MESH: return "Meshes";
+	case ASSET_HDRE: return "HDREs";
+	case ASSET_ANIMATION: return "Animations";
+	default: return "?";
+	}
+}
+
+//the same accounting and eviction for the four managers
+static size_t getAssetCPUBytes(Texture* texture) { return texture->getCPUBytes(); }
+static size_t getAssetCPUBytes(Mesh* mesh) { return mesh->getCPUBytes(); }
+static size_t getAssetCPUBytes(HDRE* hdre) { return hdre->getBytes(); }
+static size_t getAssetCPUBytes(Animation* anim) { return anim->getBytes(); }
+static size_t getAssetGPUBytes(Texture* texture) { return texture->getGPUBytes(); }
+static size_t getAssetGPUBytes(Mesh* mesh) { return mesh->getGPUBytes(); }
+static size_t getAssetGPUBytes(HDRE* hdre) { return 0; }
+static size_t getAssetGPUBytes(Animation* anim) { return 0; }
+
+//not while it is uploading or a worker reads its levels
+static bool canEvictAsset(Texture* texture)
+{
+	if (!texture->isLoaded())
+		return false;
+	TextureStreamer* streamer = TextureStreamer::getGlobal();
+	std::map<Texture*, sStreamedTexture>::iterator it = streamer->textures.find(texture);
+	return it == streamer->textures.end() || !it->second.loading;
+}
+static bool canEvictAsset(Mesh* mesh) { return mesh->isLoaded(); }
+static bool canEvictAsset(HDRE* hdre) { return true; }
+static bool canEvictAsset(Animation* anim) { return true; }
+
+static bool isOverBudget(const sAssetStats& stats, size_t cpu_budget, size_t gpu_budget)
+{
+	return (cpu_budget && stats.cpu_bytes > cpu_budget) || (gpu_budget && stats.gpu_bytes > gpu_budget);
+}
+
+template<class T> void countAssets(std::map<std::string, T*>& assets, sAssetStats& stats)
+{
+	stats.num = (int)assets.size();
+	stats.cpu_bytes = 0;
+	stats.gpu_bytes = 0;
+	for (typename std::map<std::string, T*>::iterator it = assets.begin(); it != assets.end(); ++it)
+	{
+		stats.cpu_bytes += getAssetCPUBytes(it->second);
+		stats.gpu_bytes += getAssetGPUBytes(it->second);
+	}
+}
+
+template<class T> void evictAssets(std::map<std::string, T*>& assets, sAssetStats& stats, size_t cpu_budget, size_t gpu_budget, int min_unused_frames)
+{
+	typedef typename std::map<std::string, T*>::iterator tIterator;
+	std::vector<tIterator> candidates;
+	for (tIterator it = assets.begin(); it != assets.end(); ++it)
+	{
+		T* asset = it->second;
+		if (!asset->ref_count && Asset::frame - asset->last_used >= min_unused_frames && canEvictAsset(asset))
+			candidates.push_back(it);
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const tIterator& a, const tIterator& b) { return a->second->last_used < b->second->last_used; });
+
+	for (size_t i = 0; i < candidates.size() && isOverBudget(stats, cpu_budget, gpu_budget); ++i)
+	{
+		T* asset = candidates[i]->second;
+		stats.cpu_bytes -= getAssetCPUBytes(asset);
+		stats.gpu_bytes -= getAssetGPUBytes(asset);
+		stats.num--;
+		stats.num_evicted++;
+		std::cout << " + Asset evicted: " << candidates[i]->first << std::endl;
+		assets.erase(candidates[i]);
+		delete asset;
+	}
+}
+
+void AssetCache::update()
+{
+	Asset::frame++;
+
+	countAssets(Texture::sTexturesLoaded, stats[ASSET_TEXTURE]);
+	countAssets(Mesh::sMeshesLoaded, stats[ASSET_MESH]);
+	countAssets(HDRE::sHDRELoaded, stats[ASSET_HDRE]);
+	countAssets(Animation::sAnimationsLoaded, stats[ASSET_ANIMATION]);
+	if (!enabled)
+		return;
+
+	if (isOverBudget(stats[ASSET_TEXTURE], cpu_budget[ASSET_TEXTURE], gpu_budget[ASSET_TEXTURE]))
+		evictAssets(Texture::sTexturesLoaded, stats[ASSET_TEXTURE], cpu_budget[ASSET_TEXTURE], gpu_budget[ASSET_TEXTURE], min_unused_frames);
+	if (isOverBudget(stats[ASSET_MESH], cpu_budget[ASSET_MESH], gpu_budget[ASSET_MESH]))
+		evictAssets(Mesh::sMeshesLoaded, stats[ASSET_MESH], cpu_budget[ASSET_MESH], gpu_budget[ASSET_MESH], min_unused_frames);
+	if (isOverBudget(stats[ASSET_HDRE], cpu_budget[ASSET_HDRE], gpu_budget[ASSET_HDRE]))
+		evictAssets(HDRE::sHDRELoaded, stats[ASSET_HDRE], cpu_budget[ASSET_HDRE], gpu_budget[ASSET_HDRE], min_unused_frames);
+	if (isOverBudget(stats[ASSET_ANIMATION], cpu_budget[ASSET_ANIMATION], gpu_budget[ASSET_ANIMATION]))
+		evictAssets(Animation::sAnimationsLoaded, stats[ASSET_ANIMATION], cpu_budget[ASSET_ANIMATION], gpu_budget[ASSET_ANIMATION], min_unused_frames);
+}
+
+size_t AssetCache::getCPUBytes()
+{
+	size_t bytes = 0;
+	for (int i = 0; i < NUM_ASSET_TYPES; ++i)
+		bytes += stats[i].cpu_bytes;
+	return bytes;
+}
+
+size_t AssetCache::getGPUBytes()
+{
+	size_t bytes = 0;
+	for (int i = 0; i < NUM_ASSET_TYPES; ++i)
+		bytes += stats[i].gpu_bytes;
+	return bytes;
+}
+
+std::string AssetCache::getStats()
+{
+	int num = 0;
+	for (int i = 0; i < NUM_ASSET_TYPES; ++i)
+		num += stats[i].num;
+	return "Assets: " + std::to_string(num) + " VRAM: " + std::to_string(int(getGPUBytes() / MB)) + "MBs RAM: " + std::to_string(int(getCPUBytes() / MB)) + "MBs";
+}
+
+void AssetCache::renderInMenu()
+{
+	ImGui::Checkbox("Evict over the budgets", &enabled);
+	ImGui::SliderInt("Frames unused before evicting", &min_unused_frames, 1, 1000);
+
+	for (int i = 0; i < NUM_ASSET_TYPES; ++i)
+	{
+		sAssetStats& s = stats[i];
+		ImGui::PushID(i);
+		ImGui::Text("%s: %d loaded, %d evicted", getTypeName((eAssetType)i), s.num, s.num_evicted);
+
+		int budget_mb = (int)(cpu_budget[i] / MB);
+		if (ImGui::SliderInt("RAM budget (MB, 0 no limit)", &budget_mb, 0, 4096))
+			cpu_budget[i] = (size_t)budget_mb * MB;
+		char overlay[64];
+		sprintf(overlay, "RAM %.1f / %d MB", s.cpu_bytes / (float)MB, budget_mb);
+		ImGui::ProgressBar(cpu_budget[i] ? std::min(1.0f, (float)s.cpu_bytes / cpu_budget[i]) : 0.0f, ImVec2(-1, 0), overlay);
+
+		if (i == ASSET_TEXTURE || i == ASSET_MESH) //the others are only in RAM
+		{
+			budget_mb = (int)(gpu_budget[i] / MB);
+			if (ImGui::SliderInt("VRAM budget (MB, 0 no limit)", &budget_mb, 0, 4096))
+				gpu_budget[i] = (size_t)budget_mb * MB;
+			sprintf(overlay, "VRAM %.1f / %d MB", s.gpu_bytes / (float)MB, budget_mb);
+			ImGui::ProgressBar(gpu_budget[i] ? std::min(1.0f, (float)s.gpu_bytes / gpu_budget[i]) : 0.0f, ImVec2(-1, 0), overlay);
+		}
+		ImGui::PopID();
+	}
+}
@@ -0,0 +1,88 @@
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include <cstddef>
+#include <cassert>
+#include <string>
+
+enum eAssetType { ASSET_TEXTURE, ASSET_MESH, ASSET_HDRE, ASSET_ANIMATION, NUM_ASSET_TYPES };
+
+//Asset
+//base of the assets kept by the managers (Texture, Mesh, HDRE and Animation): how many AssetRef hold it and the last
+//frame it was got or used to render, so the AssetCache knows which ones can be freed
+class Asset {
+public:
+	static long frame; //increased by AssetCache::update
+
+	int ref_count;
+	long last_used;
+
+	Asset() { ref_count = 0; last_used = frame; }
+	Asset(const Asset& asset) { ref_count = 0; last_used = frame; } //the references are of the original
+	Asset& operator = (const Asset& asset) { return *this; }
+
+	void addRef() { ref_count++; }
+	void release() { assert(ref_count > 0 && "released more times than referenced"); ref_count--; }
+	void touch() { last_used = frame; }
+};
+
+//AssetRef
+//pointer that keeps the asset loaded, use it for the members that store assets from the managers (materials, nodes...)
+//the raw pointers returned by Get are only safe during the frame, unless the asset is referenced somewhere else
+template<class T> class AssetRef {
+public:
+	AssetRef() { ptr = NULL; }
+	AssetRef(T* asset) { ptr = asset; if (ptr) ptr->addRef(); }
+	AssetRef(const AssetRef& ref) { ptr = ref.ptr; if (ptr) ptr->addRef(); }
+	~AssetRef() { if (ptr) ptr->release(); }
+
+	AssetRef& operator = (T* asset) { if (asset) asset->addRef(); if (ptr) ptr->release(); ptr = asset; return *this; }
+	AssetRef& operator = (const AssetRef& ref) { return *this = ref.ptr; }
+
+	operator T* () const { return ptr; }
+	T* operator -> () const { assert(ptr); return ptr; }
+	T* get() const { return ptr; }
+
+private:
+	T* ptr;
+};
+
+struct sAssetStats {
+	int num;
+	size_t cpu_bytes;
+	size_t gpu_bytes; //estimated from the sizes and formats, the driver can pad them
+	int num_evicted; //since the start
+};
+
+//AssetCache
+//accounting of the memory used by the assets of the managers (Texture::sTexturesLoaded, Mesh::sMeshesLoaded,
+//HDRE::sHDRELoaded and Animation::sAnimationsLoaded), that otherwise keep everything till the app is closed.
+//Every update adds the CPU and GPU bytes of each type, and when a type goes over one of its budgets the least recently
+//used ones are deleted: only the ones without any AssetRef, not used in the last min_unused_frames and not loading.
+//A Get of an evicted one simply loads it again. Every asset must be registered with only one name.
+
+class AssetCache {
+public:
+	bool enabled; //off: only the accounting, nothing is freed
+	size_t cpu_budget[NUM_ASSET_TYPES]; //bytes, 0 is no limit
+	size_t gpu_budget[NUM_ASSET_TYPES];
+	int min_unused_frames; //the ones got with Get and used without AssetRef need some margin
+
+	sAssetStats stats[NUM_ASSET_TYPES];
+
+	AssetCache();
+
+	//once per frame, before rendering: updates the stats and evicts the assets over the budgets
+	void update();
+
+	size_t getCPUBytes(); //of all the types
+	size_t getGPUBytes();
+	std::string getStats(); //one line with the totals, shown next to the VRAM of getGPUStats
+
+	void renderInMenu();
+
+	static const char* getTypeName(eAssetType type);
+	static AssetCache* getGlobal();
+};
+
+#endif
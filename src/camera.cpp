@@ -3,6 +3,12 @@
 
 #include "includes.h"
 #include <iostream>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define USE_SSE_CULLING
+	#include <xmmintrin.h>
+#endif
 
 Camera* Camera::last_enabled = NULL;
 
@@ -364,3 +370,66 @@ char Camera::testBoxInFrustum(const Vector3& center, const Vector3& halfsize)
 	return o == 0 ? CLIP_INSIDE : CLIP_OVERLAP;
 }
 
+
+int Camera::testBoxesInFrustum(int num_boxes, const float* center_x, const float* center_y, const float* center_z,
+	const float* halfsize_x, const float* halfsize_y, const float* halfsize_z, unsigned char* visible)
+{
+	int num_visible = 0;
+	int i = 0;
+
+#ifdef USE_SSE_CULLING
+	//planes broadcasted once, then every iteration tests 4 boxes against the 6 planes
+	__m128 plane[6][4];
+	__m128 plane_abs[6][3];
+	for (int p = 0; p < 6; ++p)
+		for (int k = 0; k < 4; ++k)
+		{
+			plane[p][k] = _mm_set1_ps(frustum[p][k]);
+			if (k < 3)
+				plane_abs[p][k] = _mm_set1_ps(fabsf(frustum[p][k]));
+		}
+
+	for (; i + 4 <= num_boxes; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(center_x + i);
+		__m128 cy = _mm_loadu_ps(center_y + i);
+		__m128 cz = _mm_loadu_ps(center_z + i);
+		__m128 hx = _mm_loadu_ps(halfsize_x + i);
+		__m128 hy = _mm_loadu_ps(halfsize_y + i);
+		__m128 hz = _mm_loadu_ps(halfsize_z + i);
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < 6; ++p)
+		{
+			//same test as planeBoxOverlap: outside if distance <= -radius
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane[p][0], cx), _mm_mul_ps(plane[p][1], cy)), _mm_add_ps(_mm_mul_ps(plane[p][2], cz), plane[p][3]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane_abs[p][0], hx), _mm_mul_ps(plane_abs[p][1], hy)), _mm_mul_ps(plane_abs[p][2], hz));
+			outside = _mm_or_ps(outside, _mm_cmple_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+		int mask = _mm_movemask_ps(outside);
+		for (int k = 0; k < 4; ++k)
+		{
+			visible[i + k] = (mask & (1 << k)) ? 0 : 1;
+			num_visible += visible[i + k];
+		}
+	}
+#endif
+
+	//the rest (or all of them without SSE)
+	for (; i < num_boxes; ++i)
+	{
+		visible[i] = 1;
+		for (int p = 0; p < 6; ++p)
+		{
+			float distance = frustum[p][0] * center_x[i] + frustum[p][1] * center_y[i] + frustum[p][2] * center_z[i] + frustum[p][3];
+			float radius = fabsf(frustum[p][0]) * halfsize_x[i] + fabsf(frustum[p][1]) * halfsize_y[i] + fabsf(frustum[p][2]) * halfsize_z[i];
+			if (distance + radius <= 0.0f)
+			{
+				visible[i] = 0;
+				break;
+			}
+		}
+		num_visible += visible[i];
+	}
+
+	return num_visible;
+}
@@ -79,6 +79,10 @@ public:
 	bool testPointInFrustum( Vector3 v );
 	char testSphereInFrustum( const Vector3& v, float radius);
 	char testBoxInFrustum( const Vector3& center, const Vector3& halfsize);
+	//tests many boxes at once (4 per iteration with SSE), boxes are given as separate arrays (SoA)
+	//visible[i] is set to 0 if the box is outside, returns the number of visible boxes
+	int testBoxesInFrustum( int num_boxes, const float* center_x, const float* center_y, const float* center_z,
+		const float* halfsize_x, const float* halfsize_y, const float* halfsize_z, unsigned char* visible );
 };
 
 
@@ -0,0 +1,111 @@
+#include "deferred.h"
+#include "fbo.h"
+#include "shader.h"
+#include "camera.h"
+#include "mesh.h"
+#include "material.h"
+#include "lightclusters.h"
+#include "renderqueue.h"
+
+#include <iostream>
+
+DeferredRenderer::DeferredRenderer()
+{
+	gbuffer = NULL;
+	resolve_shader = NULL;
+	clustered_resolve_shader = NULL;
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+	delete gbuffer;
+}
+
+bool DeferredRenderer::begin(int width, int height)
+{
+	if (gbuffer && (gbuffer->width != width || gbuffer->height != height))
+	{
+		delete gbuffer;
+		gbuffer = NULL;
+	}
+	if (!gbuffer)
+	{
+		//half floats so the normals and the indirect light keep their range
+		gbuffer = new FBO();
+		if (!gbuffer->create(width, height, GL_RGBA, GL_HALF_FLOAT, 4, GL_RGBA16F))
+		{
+			std::cout << "[WARN] G-buffer could not be created, deferred path disabled" << std::endl;
+			delete gbuffer; //otherwise the next frames of the same size would use it
+			gbuffer = NULL;
+			return false;
+		}
+	}
+	if (!resolve_shader)
+	{
+		resolve_shader = Shader::Get("data/shaders/quad.vs", "data/shaders/deferred.fs", LIGHT_ARRAY_MACROS);
+		clustered_resolve_shader = Shader::Get("data/shaders/quad.vs", "data/shaders/deferred.fs", CLUSTERED_MACROS);
+	}
+	if (!resolve_shader)
+		return false;
+
+	gbuffer->bind();
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	return true;
+}
+
+void DeferredRenderer::end()
+{
+	gbuffer->unbind();
+}
+
+void DeferredRenderer::resolve(Camera* camera, LightClusters* clusters, int output)
+{
+	bool clustered = clusters && clusters->ready && clustered_resolve_shader;
+	Shader* shader = clustered ? clustered_resolve_shader : resolve_shader;
+
+	//every pixel is written once, the depth of the G-buffer replaces the one of the background
+	RenderQueue::invalidateState();
+	RenderQueue::setBlending(false);
+	RenderQueue::setCulling(false);
+	RenderQueue::setDepthFunc(GL_ALWAYS);
+
+	Matrix44 inverse_viewprojection = camera->viewprojection_matrix;
+	inverse_viewprojection.inverse();
+
+	shader->enable();
+	shader->setUniform("u_gb_albedo", gbuffer->color_textures[0], 0);
+	shader->setUniform("u_gb_normal", gbuffer->color_textures[1], 1);
+	shader->setUniform("u_gb_material", gbuffer->color_textures[2], 2);
+	shader->setUniform("u_gb_indirect", gbuffer->color_textures[3], 3);
+	shader->setUniform("u_depth_texture", gbuffer->depth_texture, 4);
+	shader->setUniform("u_inverse_viewprojection", inverse_viewprojection);
+	shader->setUniform("u_camera_position", camera->eye);
+	shader->setUniform1("u_output", output);
+
+	if (clustered)
+		clusters->setUniforms(shader);
+	else
+	{
+		//more lights than fit in the arrays are ignored, the clusters don't have this limit
+		Vector3 positions[MAX_SINGLE_PASS_LIGHTS];
+		Vector3 difuse[MAX_SINGLE_PASS_LIGHTS];
+		Vector3 specular[MAX_SINGLE_PASS_LIGHTS];
+		float radius[MAX_SINGLE_PASS_LIGHTS];
+		int num_lights = gatherLights(positions, difuse, specular, radius, MAX_SINGLE_PASS_LIGHTS);
+		if (num_lights > MAX_SINGLE_PASS_LIGHTS)
+			num_lights = MAX_SINGLE_PASS_LIGHTS;
+		shader->setUniform1("u_num_lights", num_lights);
+		if (num_lights)
+		{
+			shader->setUniform3Array("u_lights_pos", (float*)positions, num_lights);
+			shader->setUniform3Array("u_lights_id", (float*)difuse, num_lights);
+			shader->setUniform1Array("u_lights_radius", radius, num_lights);
+		}
+	}
+
+	Mesh::getQuad()->render(GL_TRIANGLES);
+	shader->disable();
+
+	RenderQueue::resetState();
+}
@@ -0,0 +1,32 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include "framework.h"
+
+class FBO;
+class Shader;
+class Camera;
+class LightClusters;
+
+//DeferredRenderer
+//optional deferred path: the opaque materials with a gbuffer_shader write their surface once to the G-buffer
+//(albedo, normal, roughness/metalness, indirect light and emissive), then the direct lights are computed in a
+//full screen pass, so the fragments hidden by the overdraw don't pay the lighting
+
+class DeferredRenderer {
+public:
+	FBO* gbuffer; //4 RGBA16F targets and the depth
+	Shader* resolve_shader; //lights in uniform arrays
+	Shader* clustered_resolve_shader; //lights of the clusters
+
+	DeferredRenderer();
+	~DeferredRenderer();
+
+	bool begin(int width, int height); //binds and clears the G-buffer (created or resized if needed), false if it can't be used
+	void end();
+	//lights the G-buffer into the current framebuffer and writes its depth, so the forward items are occluded
+	//output shows the G-buffer like Application::output
+	void resolve(Camera* camera, LightClusters* clusters, int output);
+};
+
+#endif
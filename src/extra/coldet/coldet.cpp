@@ -261,6 +261,155 @@ bool CollisionModel3DImpl::rayCollision(float origin[3],
   return false;
 }
 
+bool CollisionModel3DImpl::rayCollisionModelSpace(const float origin[3],
+                                                  const float direction[3],
+                                                  bool closest,
+                                                  float segmax,
+                                                  float point[3],
+                                                  float* triangle,
+                                                  int& triangle_index,
+                                                  float& tparm)
+{
+  // same traversal than rayCollision but without touching the model state
+  Vector3D O=*(const Vector3D*)origin;
+  Vector3D D=*(const Vector3D*)direction;
+  if (segmax<0.0f)
+  {
+    D=-D;
+    segmax=-segmax;
+  }
+  float t;
+  Vector3D col_point;
+  BoxedTriangle* best=NULL;
+  BoxTreeNode* stack[64];
+  std::vector<BoxTreeNode*> overflow;
+  int top=0;
+  stack[top++]=&m_Root;
+  while (top || !overflow.empty())
+  {
+    BoxTreeNode* b;
+    if (!overflow.empty()) { b=overflow.back(); overflow.pop_back(); }
+    else b=stack[--top];
+    if (!b->intersect(O,D,segmax)) continue;
+    int sons=b->getSonsNumber();
+    if (sons)
+    {
+      while (sons--)
+        if (top<64) stack[top++]=b->getSon(sons);
+        else overflow.push_back(b->getSon(sons));
+      continue;
+    }
+    int tri=b->getTrianglesNumber();
+    while (tri--)
+    {
+      BoxedTriangle* bt=b->getTriangle(tri);
+      if (!static_cast<Triangle*>(bt)->intersect(O,D,col_point,t,segmax))
+        continue;
+      best=bt;
+      tparm=t;
+      *(Vector3D*)point=col_point;
+      if (!closest) break;
+      segmax=t; // farther boxes and triangles can be discarded from now on
+    }
+    if (best && !closest) break;
+  }
+  if (!best)
+  {
+    triangle_index=-1;
+    return false;
+  }
+  triangle_index=getTriangleIndex(best);
+  if (triangle)
+  {
+    *((Vector3D*)&triangle[0]) = best->v1;
+    *((Vector3D*)&triangle[3]) = best->v2;
+    *((Vector3D*)&triangle[6]) = best->v3;
+  }
+  return true;
+}
+
+int CollisionModel3DImpl::rayPacketCollisionModelSpace(int num_rays,
+                                                       const float* origins,
+                                                       const float* directions,
+                                                       const float* segmax,
+                                                       bool closest,
+                                                       float* points,
+                                                       int* triangle_indices,
+                                                       float* tparms)
+{
+  if (num_rays>32) num_rays=32;
+  Vector3D O[32],D[32];
+  float smax[32];
+  unsigned int pending=0;
+  for(int i=0;i<num_rays;i++)
+  {
+    O[i]=((const Vector3D*)origins)[i];
+    D[i]=((const Vector3D*)directions)[i];
+    smax[i]=segmax[i];
+    if (smax[i]<0.0f)
+    {
+      D[i]=-D[i];
+      smax[i]=-smax[i];
+    }
+    triangle_indices[i]=-1;
+    pending|=1u<<i;
+  }
+  // every node in the stack carries the mask of the rays that reached it, the vector is only used if it overflows
+  BoxTreeNode* stack[64];
+  unsigned int masks[64];
+  std::vector< std::pair<BoxTreeNode*,unsigned int> > overflow;
+  int top=0;
+  stack[top]=&m_Root;
+  masks[top++]=pending;
+  float t;
+  Vector3D col_point;
+  while ((top || !overflow.empty()) && pending)
+  {
+    BoxTreeNode* b;
+    unsigned int mask;
+    if (!overflow.empty()) { b=overflow.back().first; mask=overflow.back().second; overflow.pop_back(); }
+    else { --top; b=stack[top]; mask=masks[top]; }
+    mask&=pending;
+    unsigned int inside=0;
+    for(int i=0;i<num_rays;i++)
+      if ((mask & (1u<<i)) && b->intersect(O[i],D[i],smax[i]))
+        inside|=1u<<i;
+    if (!inside) continue;
+    int sons=b->getSonsNumber();
+    if (sons)
+    {
+      while (sons--)
+        if (top<64) { stack[top]=b->getSon(sons); masks[top++]=inside; }
+        else overflow.push_back(std::make_pair(b->getSon(sons),inside));
+      continue;
+    }
+    int tri=b->getTrianglesNumber();
+    while (tri--)
+    {
+      BoxedTriangle* bt=b->getTriangle(tri);
+      Triangle* tr=static_cast<Triangle*>(bt);
+      for(int i=0;i<num_rays;i++)
+      {
+        if (!(inside & (1u<<i))) continue;
+        if (!tr->intersect(O[i],D[i],col_point,t,smax[i])) continue;
+        triangle_indices[i]=getTriangleIndex(bt);
+        tparms[i]=t;
+        ((Vector3D*)points)[i]=col_point;
+        if (closest) smax[i]=t;
+        else
+        {
+          inside&=~(1u<<i);
+          pending&=~(1u<<i);
+        }
+      }
+    }
+  }
+  int hits=0;
+  for(int i=0;i<num_rays;i++)
+    if (triangle_indices[i]!=-1) hits++;
+  return hits;
+}
+
 bool CollisionModel3DImpl::sphereCollision(float origin[3], float radius)
 {
   m_ColType=Sphere;
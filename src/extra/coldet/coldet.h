@@ -102,6 +102,39 @@ public:
                             float segmin=0.0f,
                             float segmax=3.4e+38F) = 0;
 
+  /** Reentrant version of rayCollision().
+      The ray must be given in model space and the results are
+      returned in the output parameters instead of being stored
+      in the model, so several threads can query the same model
+      at the same time.
+      tparm is the distance along the ray in units of direction.
+      triangle (9 floats) can be NULL.
+  */
+  virtual bool rayCollisionModelSpace(const float origin[3],
+                                      const float direction[3],
+                                      bool closest,
+                                      float segmax,
+                                      float point[3],
+                                      float* triangle,
+                                      int& triangle_index,
+                                      float& tparm) = 0;
+
+  /** Tests a packet of up to 32 rays (in model space) traversing the
+      tree only once for all of them, useful when the rays are coherent.
+      origins, directions and points are arrays of 3*num_rays floats,
+      segmax, tparms and triangle_indices have num_rays elements.
+      Rays that do not collide get a triangle index of -1.
+      Returns the number of rays that collided. Reentrant.
+  */
+  virtual int rayPacketCollisionModelSpace(int num_rays,
+                                           const float* origins,
+                                           const float* directions,
+                                           const float* segmax,
+                                           bool closest,
+                                           float* points,
+                                           int* triangle_indices,
+                                           float* tparms) = 0;
+
   /** Returns true if the given sphere collides with the model.
       getCollidingTriangles() and getCollisionPoint() can be
       used to retrieve information about a collision.
@@ -64,6 +64,13 @@ public:
 
   bool rayCollision(float origin[3], float direction[3], bool closest,
                     float segmin, float segmax);
+  bool rayCollisionModelSpace(const float origin[3], const float direction[3],
+                              bool closest, float segmax, float point[3],
+                              float* triangle, int& triangle_index, float& tparm);
+  int rayPacketCollisionModelSpace(int num_rays, const float* origins,
+                                   const float* directions, const float* segmax,
+                                   bool closest, float* points,
+                                   int* triangle_indices, float* tparms);
   bool sphereCollision(float origin[3], float radius);
 
   bool getCollidingTriangles(float t1[9], float t2[9], bool ModelSpace);
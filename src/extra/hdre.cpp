@@ -10,7 +10,7 @@ std::map<std::string, HDRE*> HDRE::sHDRELoaded;
 
 HDRE::HDRE()
 {
-	
+	data = NULL; //clean checks it
 }
 
 HDRE::~HDRE()
@@ -53,7 +53,10 @@ HDRE* HDRE::Get(const char* filename)
 
 	auto it = sHDRELoaded.find(filename);
 	if (it != sHDRELoaded.end())
+	{
+		it->second->touch();
 		return it->second;
+	}
 
 	HDRE* hdre = new HDRE();
 	if (!hdre->load(filename))
@@ -62,9 +65,24 @@ HDRE* HDRE::Get(const char* filename)
 		return NULL;
 	}
 
+	hdre->setName(filename);
 	return hdre;
 }
 
+// the data is stored three times: all together, per level and per face
+size_t HDRE::getBytes()
+{
+	if (!data)
+		return 0;
+	size_t floats = 0;
+	for (int i = 0; i < N_LEVELS; i++)
+	{
+		int w = getLevel(i).width;
+		floats += (size_t)w * w * N_FACES * numChannels;
+	}
+	return floats * sizeof(float) * 3;
+}
+
 void flipYsides(float ** data, unsigned int size, short num_channels)
 {
 	// std::cout << "Flipping Y sides" << std::endl;
@@ -243,17 +261,18 @@ bool HDRE::clean()
 
 	try
 	{
-		delete data;
+		delete[] data;
 
 		for (int i = 0; i < N_LEVELS; i++)
 		{
-			delete faces_array[i];
+			delete[] faces_array[i];
 
 			for (int j = 0; j < N_FACES; j++)
 			{
-				delete pixels[i][j];
+				delete[] pixels[i][j];
 			}
 		}
+		data = NULL;
 
 		return true;
 	}
@@ -5,6 +5,8 @@
 #include <string>
 #include <cassert>
 
+#include "../assetcache.h"
+
 #define N_LEVELS 6
 #define N_FACES 6
 
@@ -42,7 +44,7 @@ typedef struct {
 
 } sHDRELevel;
 
-class HDRE {
+class HDRE : public Asset {
 
 private:
 
@@ -87,4 +89,5 @@ public:
 	float** getFaces(int level = 0);		// [[]]: Array per face with all level data
 
 	sHDRELevel getLevel(int level = 0);
+	size_t getBytes(); //of all the levels in memory, for the AssetCache
 };
\ No newline at end of file
@@ -35,7 +35,7 @@ FBO::~FBO()
 		glDeleteRenderbuffersEXT(1, &renderbuffer_depth);
 }
 
-bool FBO::create( int width, int height, int format, int type, int num_textures )
+bool FBO::create( int width, int height, int format, int type, int num_textures, int internal_format )
 {
 	assert(glGetError() == GL_NO_ERROR);
 	assert(width &&& height);
@@ -48,10 +48,14 @@ bool FBO::create( int width, int height, int format, int type, int num_textures
 	this->height = height;
 	owns_textures = true;
 
-	//create textures
+	//create textures (the storage is allocated by the upload without data)
 	for (int i = 0; i < num_textures; ++i)
-		color_textures[i] = new Texture(width, height, format, type, false );
+	{
+		color_textures[i] = new Texture(width, height, format, type, false, NULL, internal_format);
+		color_textures[i]->upload(format, type, false, NULL, internal_format);
+	}
 	depth_texture = new Texture(width, height, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, false);
+	depth_texture->upload(GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, false, NULL);
 
 	glGenFramebuffersEXT(1, &fbo_id);
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_id);
@@ -24,7 +24,7 @@ public:
 	FBO();
 	~FBO();
 
-	bool create(int width, int height, int format = GL_RGB, int type = GL_UNSIGNED_BYTE, int num_textures = 1);
+	bool create(int width, int height, int format = GL_RGB, int type = GL_UNSIGNED_BYTE, int num_textures = 1, int internal_format = 0);
 	bool createFromTextures(Texture* color, Texture* colorB = NULL, Texture* depth = NULL);
 	bool createDepthOnly(int width, int height); //use this for shadowmaps
 	
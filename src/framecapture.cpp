@@ -0,0 +1,291 @@
+#include "framecapture.h"
+#include "imagekernels.h"
+#include "pngdecoder.h"
+#include "utils.h"
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+
+FrameCapture::FrameCapture()
+{
+	screenshot_format = CAPTURE_TGA;
+	sequence_format = CAPTURE_TGA;
+	max_queued = 16;
+	num_written = 0;
+	num_dropped = 0;
+	num_failed = 0;
+	encode_ms = 0.0f;
+	next_readback = 0;
+	recording = false;
+	sequence_frame = 0;
+	num_sequences = 0;
+	encoding = false;
+	must_exit = false;
+	encoder = std::thread(&FrameCapture::encoderLoop, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		must_exit = true;
+	}
+	frame_queued.notify_all();
+	encoder.join(); //the queued frames are written before
+	for (size_t i = 0; i < free_frames.size(); ++i)
+		delete free_frames[i];
+	for (int i = 0; i < 2; ++i)
+	{
+		if (readbacks[i].fence)
+			glDeleteSync(readbacks[i].fence);
+		if (readbacks[i].buffer_id)
+			glDeleteBuffers(1, &readbacks[i].buffer_id);
+	}
+}
+
+FrameCapture* FrameCapture::getGlobal()
+{
+	static FrameCapture* capture = NULL;
+	if (!capture)
+		capture = new FrameCapture();
+	return capture;
+}
+
+void FrameCapture::screenshot(const char* filename)
+{
+	assert(filename);
+	pending_screenshot = filename;
+}
+
+void FrameCapture::startSequence(const char* folder)
+{
+	assert(folder);
+	if (!createFolder(folder))
+	{
+		std::cout << "[ERROR] cannot create the folder of the sequence: " << folder << std::endl;
+		return;
+	}
+	sequence_folder = folder;
+	sequence_frame = 0;
+	num_dropped = 0;
+	recording = true;
+	std::cout << " + Recording frames to " << folder << std::endl;
+}
+
+void FrameCapture::stopSequence()
+{
+	if (!recording)
+		return;
+	recording = false;
+	std::cout << " + Recording stopped: " << sequence_frame << " frames, " << num_dropped << " dropped" << std::endl;
+}
+
+int FrameCapture::getNumQueued()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return (int)queue.size() + (encoding ? 1 : 0);
+}
+
+bool FrameCapture::collect(sReadback& readback, bool wait)
+{
+	if (glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+	{
+		if (!wait)
+			return false;
+		while (glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(readback.fence);
+	readback.fence = NULL;
+
+	sFrame* frame = NULL;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (free_frames.size())
+		{
+			frame = free_frames.back();
+			free_frames.pop_back();
+		}
+	}
+	if (!frame)
+		frame = new sFrame();
+	frame->filename = readback.filename;
+	frame->format = readback.format;
+	frame->width = readback.width;
+	frame->height = readback.height;
+	size_t size = (size_t)readback.width * readback.height * 4;
+	frame->pixels.resize(size);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer_id);
+	void* ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	bool mapped = ptr != NULL;
+	if (mapped)
+	{
+		memcpy(&frame->pixels[0], ptr, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!mapped)
+	{
+		num_failed++;
+		free_frames.push_back(frame);
+		return true;
+	}
+	queue.push_back(frame);
+	frame_queued.notify_one();
+	return true;
+}
+
+void FrameCapture::update(int width, int height)
+{
+	//the readbacks of the previous frames that are done
+	for (int i = 0; i < 2; ++i)
+		if (readbacks[i].fence)
+			collect(readbacks[i], false);
+
+	std::string filename;
+	eCaptureFormat format;
+	if (pending_screenshot.size())
+	{
+		filename = pending_screenshot;
+		std::string ext = filename.size() > 4 ? filename.substr(filename.size() - 4) : "";
+		format = (ext == ".png" || ext == ".PNG") ? CAPTURE_PNG : CAPTURE_TGA;
+		pending_screenshot.clear();
+	}
+	else if (recording)
+	{
+		char name[32];
+		sprintf(name, "/frame_%05d", sequence_frame++);
+		format = sequence_format;
+		filename = sequence_folder + name + (format == CAPTURE_PNG ? ".png" : ".tga");
+		if (getNumQueued() >= max_queued)
+		{
+			num_dropped++; //the encoder is behind, better a missing frame than a stutter
+			return;
+		}
+	}
+	else
+		return;
+
+	//only if the GPU didn't finish the one of two frames ago
+	sReadback& readback = readbacks[next_readback];
+	next_readback = (next_readback + 1) % 2;
+	if (readback.fence)
+		collect(readback, true);
+
+	GLsizeiptr size = (GLsizeiptr)width * height * 4;
+	if (!readback.buffer_id)
+		glGenBuffers(1, &readback.buffer_id);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer_id);
+	if (readback.size < size)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		readback.size = size;
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, format == CAPTURE_TGA ? GL_BGRA : GL_RGBA, GL_UNSIGNED_BYTE, NULL); //to the buffer, it returns at once
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.filename = filename;
+	readback.format = format;
+	readback.width = width;
+	readback.height = height;
+}
+
+void FrameCapture::flush()
+{
+	for (int i = 0; i < 2; ++i)
+		if (readbacks[i].fence)
+			collect(readbacks[i], true);
+	std::unique_lock<std::mutex> lock(mutex);
+	frame_written.wait(lock, [this]() { return queue.empty() && !encoding; });
+}
+
+void FrameCapture::encoderLoop()
+{
+	while (true)
+	{
+		sFrame* frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			frame_queued.wait(lock, [this]() { return must_exit || queue.size(); });
+			if (queue.empty())
+				return;
+			frame = queue.front();
+			queue.pop_front();
+			encoding = true;
+		}
+
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		bool written = writeFrame(frame);
+		float ms = (float)std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		if (!written)
+			std::cout << "[ERROR] cannot write the captured frame: " << frame->filename << std::endl;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			encoding = false;
+			encode_ms = ms;
+			if (written)
+				num_written++;
+			else
+				num_failed++;
+			free_frames.push_back(frame);
+		}
+		frame_written.notify_all();
+	}
+}
+
+//the alpha of the framebuffer is not the one of the image, only RGB is written
+bool FrameCapture::writeFrame(sFrame* frame)
+{
+	size_t num_pixels = (size_t)frame->width * frame->height;
+	ImageKernels::swizzle(&frame->pixels[0], &frame->pixels[0], num_pixels, 4, "rgb"); //BGR for the TGA
+
+	FILE* file = fopen(frame->filename.c_str(), "wb");
+	if (!file)
+		return false;
+	bool written;
+	if (frame->format == CAPTURE_PNG)
+	{
+		std::vector<unsigned char> png;
+		written = encodePNG(png, &frame->pixels[0], frame->width, frame->height, 3, true) && fwrite(&png[0], 1, png.size(), file) == png.size();
+	}
+	else
+	{
+		//the rows from the bottom, like glReadPixels
+		unsigned char header[18] = { 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+		header[12] = (unsigned char)frame->width;
+		header[13] = (unsigned char)(frame->width >> 8);
+		header[14] = (unsigned char)frame->height;
+		header[15] = (unsigned char)(frame->height >> 8);
+		header[16] = 24;
+		written = fwrite(header, 1, 18, file) == 18 && fwrite(&frame->pixels[0], 1, num_pixels * 3, file) == num_pixels * 3;
+	}
+	fclose(file);
+	return written;
+}
+
+void FrameCapture::renderInMenu()
+{
+	ImGui::Combo("Screenshot format", (int*)&screenshot_format, "TGA\0PNG\0");
+	ImGui::Combo("Sequence format", (int*)&sequence_format, "TGA\0PNG\0");
+	if (!recording && ImGui::Button("Record frames"))
+	{
+		std::string folder = "data/screenshots/sequence_" + std::to_string(num_sequences++);
+		startSequence(folder.c_str());
+	}
+	else if (recording && ImGui::Button("Stop recording"))
+		stopSequence();
+	if (recording)
+		ImGui::Text("Recording %s: %d frames", sequence_folder.c_str(), sequence_frame);
+	ImGui::SliderInt("Max frames queued", &max_queued, 1, 64);
+	int queued = getNumQueued();
+	std::unique_lock<std::mutex> lock(mutex);
+	ImGui::Text("%d written, %d queued, %d dropped, %d failed, last encode %.1fms", num_written, queued, num_dropped, num_failed, encode_ms);
+}
@@ -0,0 +1,91 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include "includes.h"
+#include "framework.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+enum eCaptureFormat { CAPTURE_TGA, CAPTURE_PNG };
+
+//FrameCapture
+//screenshots and sequences of frames read back without stalling the GPU: glReadPixels writes to a pixel pack buffer
+//(a pair of them used in turns) and its fence tells when the copy is done, usually in the next frame. Then the pixels are
+//copied to memory and a background thread encodes them and writes the file, so the render thread never waits for the
+//disk. The TGA frames are read as BGRA, they only lose the alpha before being written.
+//A sequence captures every frame, when the encoder can't keep up the frames are dropped (and counted) instead of stuttering.
+
+class FrameCapture {
+public:
+	eCaptureFormat screenshot_format; //of the filenames made by the GUI
+	eCaptureFormat sequence_format; //TGA is the one that keeps up at full rate
+	int max_queued; //frames waiting for the encoder, over it the frames of a sequence are dropped
+
+	//stats, written by the encoder thread (read them under the lock, see renderInMenu)
+	int num_written;
+	int num_dropped;
+	int num_failed;
+	float encode_ms; //of the last frame
+
+	FrameCapture();
+	~FrameCapture();
+
+	void screenshot(const char* filename); //of the next frame, the format comes from the extension (.png or .tga)
+	void startSequence(const char* folder); //folder/frame_00000.tga, one per frame till stopSequence (the dropped ones leave a gap)
+	void stopSequence();
+	bool isRecording() { return recording; }
+	int getNumQueued();
+
+	//once per frame after rendering it (the GUI is not captured): starts the readback requested and queues the finished ones
+	void update(int width, int height);
+	void flush(); //waits for every readback and every file, before destroying the context
+
+	void renderInMenu();
+
+	static FrameCapture* getGlobal();
+
+private:
+	struct sReadback {
+		GLuint buffer_id = 0;
+		GLsizeiptr size = 0;
+		GLsync fence = NULL; //NULL if it is free
+		std::string filename;
+		eCaptureFormat format = CAPTURE_TGA;
+		int width = 0;
+		int height = 0;
+	};
+	struct sFrame {
+		std::string filename;
+		eCaptureFormat format;
+		int width;
+		int height;
+		std::vector<uint8> pixels; //BGRA for TGA, RGBA for PNG, from the bottom row
+	};
+
+	sReadback readbacks[2];
+	int next_readback;
+	std::string pending_screenshot;
+	bool recording;
+	std::string sequence_folder;
+	int sequence_frame;
+	int num_sequences;
+
+	std::thread encoder;
+	std::mutex mutex;
+	std::condition_variable frame_queued;
+	std::condition_variable frame_written;
+	std::deque<sFrame*> queue; //waiting for the encoder
+	std::vector<sFrame*> free_frames; //reused, so the pixels are not allocated every frame
+	bool encoding;
+	bool must_exit;
+
+	bool collect(sReadback& readback, bool wait); //false if the GPU didn't finish and we don't want to wait
+	void encoderLoop();
+	bool writeFrame(sFrame* frame);
+};
+
+#endif
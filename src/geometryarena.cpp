@@ -0,0 +1,162 @@
+#include "geometryarena.h"
+#include "includes.h"
+#include "utils.h"
+#include "mesh.h"
+
+#include <cassert>
+
+std::vector<GeometryArena*> GeometryArena::arenas;
+unsigned int GeometryArena::default_vertex_capacity = 1 << 20; //32MBs with the interleaved layout
+unsigned int GeometryArena::default_index_capacity = 3 << 20; //12MBs
+
+//first fit
+static bool allocateRange(std::vector<GeometryArena::sRange>& free_list, unsigned int size, unsigned int& offset)
+{
+	if (size == 0)
+	{
+		offset = 0;
+		return true;
+	}
+	for (size_t i = 0; i < free_list.size(); ++i)
+	{
+		GeometryArena::sRange& range = free_list[i];
+		if (range.size < size)
+			continue;
+		offset = range.offset;
+		range.offset += size;
+		range.size -= size;
+		if (range.size == 0)
+			free_list.erase(free_list.begin() + i);
+		return true;
+	}
+	return false;
+}
+
+static void releaseRange(std::vector<GeometryArena::sRange>& free_list, unsigned int offset, unsigned int size)
+{
+	if (size == 0)
+		return;
+	size_t i = 0;
+	while (i < free_list.size() && free_list[i].offset < offset)
+		++i;
+	GeometryArena::sRange range = { offset, size };
+	free_list.insert(free_list.begin() + i, range);
+
+	//merge with the next one and with the previous one
+	if (i + 1 < free_list.size() && free_list[i].offset + free_list[i].size == free_list[i + 1].offset)
+	{
+		free_list[i].size += free_list[i + 1].size;
+		free_list.erase(free_list.begin() + i + 1);
+	}
+	if (i > 0 && free_list[i - 1].offset + free_list[i - 1].size == free_list[i].offset)
+	{
+		free_list[i - 1].size += free_list[i].size;
+		free_list.erase(free_list.begin() + i);
+	}
+}
+
+GeometryArena::GeometryArena(unsigned int vertex_stride, unsigned int vertex_capacity, unsigned int index_capacity)
+{
+	this->vertex_stride = vertex_stride;
+	this->vertex_capacity = vertex_capacity;
+	this->index_capacity = index_capacity;
+	used_vertices = used_indices = 0;
+
+	sRange all_vertices = { 0, vertex_capacity };
+	free_vertices.push_back(all_vertices);
+	sRange all_indices = { 0, index_capacity };
+	free_indices.push_back(all_indices);
+
+	glGenBuffersARB(1, &vertices_vbo_id);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, vertices_vbo_id);
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB, (GLsizeiptr)vertex_capacity * vertex_stride, NULL, GL_STATIC_DRAW_ARB);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+
+	indices_vbo_id = 0;
+	if (index_capacity)
+	{
+		glGenBuffersARB(1, &indices_vbo_id);
+		glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
+		glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)index_capacity * sizeof(unsigned int), NULL, GL_STATIC_DRAW_ARB);
+		glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+	checkGLErrors();
+}
+
+GeometryArena::~GeometryArena()
+{
+	for (std::map<unsigned int, unsigned int>::iterator it = vaos.begin(); it != vaos.end(); ++it)
+		glDeleteVertexArrays(1, &it->second);
+	if (vertices_vbo_id)
+		glDeleteBuffersARB(1, &vertices_vbo_id);
+	if (indices_vbo_id)
+		glDeleteBuffersARB(1, &indices_vbo_id);
+}
+
+bool GeometryArena::allocate(unsigned int num_vertices, unsigned int num_indices, unsigned int& vertex_offset, unsigned int& index_offset)
+{
+	if (!allocateRange(free_vertices, num_vertices, vertex_offset))
+		return false;
+	if (!allocateRange(free_indices, num_indices, index_offset))
+	{
+		releaseRange(free_vertices, vertex_offset, num_vertices);
+		return false;
+	}
+	used_vertices += num_vertices;
+	used_indices += num_indices;
+	return true;
+}
+
+void GeometryArena::release(unsigned int vertex_offset, unsigned int num_vertices, unsigned int index_offset, unsigned int num_indices)
+{
+	releaseRange(free_vertices, vertex_offset, num_vertices);
+	releaseRange(free_indices, index_offset, num_indices);
+	used_vertices -= num_vertices;
+	used_indices -= num_indices;
+}
+
+void GeometryArena::uploadVertices(unsigned int vertex_offset, const void* data, unsigned int num_vertices)
+{
+	assert(vertex_offset + num_vertices <= vertex_capacity);
+	Mesh::resetBufferBindings(); //no VAO bound and the arena kept bound by the draws is unbound
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, vertices_vbo_id);
+	glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, (GLintptr)vertex_offset * vertex_stride, (GLsizeiptr)num_vertices * vertex_stride, data);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+void GeometryArena::uploadIndices(unsigned int index_offset, const unsigned int* data, unsigned int num_indices)
+{
+	assert(index_offset + num_indices <= index_capacity);
+	Mesh::resetBufferBindings(); //otherwise it would replace the element buffer of the bound VAO
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
+	glBufferSubDataARB(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)index_offset * sizeof(unsigned int), (GLsizeiptr)num_indices * sizeof(unsigned int), data);
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+GeometryArena* GeometryArena::allocateInArenas(unsigned int vertex_stride, unsigned int num_vertices, unsigned int num_indices, unsigned int& vertex_offset, unsigned int& index_offset)
+{
+	for (size_t i = 0; i < arenas.size(); ++i)
+		if (arenas[i]->vertex_stride == vertex_stride && arenas[i]->allocate(num_vertices, num_indices, vertex_offset, index_offset))
+			return arenas[i];
+
+	//no room, create a new one (big meshes get an arena of their size)
+	GeometryArena* arena = new GeometryArena(vertex_stride,
+		num_vertices > default_vertex_capacity ? num_vertices : default_vertex_capacity,
+		num_indices > default_index_capacity ? num_indices : default_index_capacity);
+	arenas.push_back(arena);
+	bool ok = arena->allocate(num_vertices, num_indices, vertex_offset, index_offset);
+	assert(ok);
+	return arena;
+}
+
+std::string GeometryArena::getStats()
+{
+	unsigned int used = 0, total = 0;
+	for (size_t i = 0; i < arenas.size(); ++i)
+	{
+		GeometryArena* arena = arenas[i];
+		used += arena->used_vertices * arena->vertex_stride + arena->used_indices * sizeof(unsigned int);
+		total += arena->vertex_capacity * arena->vertex_stride + arena->index_capacity * sizeof(unsigned int);
+	}
+	return "Arenas: " + std::to_string(arenas.size()) + " (" + std::to_string(int(used / (1024 * 1024))) + "MBs / " + std::to_string(int(total / (1024 * 1024))) + "MBs)";
+}
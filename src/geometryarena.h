@@ -0,0 +1,52 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <vector>
+#include <string>
+#include <map>
+
+//GeometryArena
+//big vertex and index buffers shared by many meshes with the same vertex layout
+//every mesh stores the range it got and draws with base vertex calls, so meshes in the same arena
+//can be rendered one after another without rebinding buffers or attributes
+
+class GeometryArena {
+public:
+	struct sRange {
+		unsigned int offset;
+		unsigned int size;
+	};
+
+	unsigned int vertices_vbo_id;
+	unsigned int indices_vbo_id;
+	unsigned int vertex_stride; //in bytes
+	unsigned int vertex_capacity; //in vertices
+	unsigned int index_capacity; //in indices (unsigned int)
+	unsigned int used_vertices;
+	unsigned int used_indices;
+
+	//free ranges sorted by offset (first fit, neighbours are merged when released)
+	std::vector<sRange> free_vertices;
+	std::vector<sRange> free_indices;
+
+	std::map<unsigned int, unsigned int> vaos; //shader attribute layout -> VAO, shared by all the meshes in the arena
+
+	GeometryArena(unsigned int vertex_stride, unsigned int vertex_capacity, unsigned int index_capacity);
+	~GeometryArena();
+
+	//reserves room for a mesh, false if it doesnt fit
+	bool allocate(unsigned int num_vertices, unsigned int num_indices, unsigned int& vertex_offset, unsigned int& index_offset);
+	void release(unsigned int vertex_offset, unsigned int num_vertices, unsigned int index_offset, unsigned int num_indices);
+
+	void uploadVertices(unsigned int vertex_offset, const void* data, unsigned int num_vertices);
+	void uploadIndices(unsigned int index_offset, const unsigned int* data, unsigned int num_indices);
+
+	//global arenas, one list per vertex stride, a new arena is created when the others are full
+	static std::vector<GeometryArena*> arenas;
+	static unsigned int default_vertex_capacity;
+	static unsigned int default_index_capacity;
+	static GeometryArena* allocateInArenas(unsigned int vertex_stride, unsigned int num_vertices, unsigned int num_indices, unsigned int& vertex_offset, unsigned int& index_offset);
+	static std::string getStats();
+};
+
+#endif
@@ -0,0 +1,984 @@
+#include "imagekernels.h"
+#include "workerpool.h"
+#include "utils.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <functional>
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define USE_SIMD_KERNELS
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+//gcc and clang only accept the intrinsics inside functions compiled for them, msvc always does
+#if defined(__GNUC__) || defined(__clang__)
+	#define TARGET_SSE41 __attribute__((target("sse4.1")))
+	#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define TARGET_SSE41
+	#define TARGET_AVX2
+#endif
+
+eSimdLevel ImageKernels::level = ImageKernels::getSupportedLevel();
+
+namespace {
+
+// CPU *************************
+
+#ifdef USE_SIMD_KERNELS
+void cpuid(int regs[4], int leaf)
+{
+#ifdef _MSC_VER
+	__cpuidex(regs, leaf, 0);
+#else
+	unsigned int a, b, c, d;
+	__cpuid_count(leaf, 0, a, b, c, d);
+	regs[0] = (int)a; regs[1] = (int)b; regs[2] = (int)c; regs[3] = (int)d;
+#endif
+}
+
+//registers saved by the OS on context switches
+unsigned long long xgetbv()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+// SWIZZLE *************************
+
+//source of every output channel, -1 is 0 and -2 is 255
+int parseOrder(const char* order, int in_channels, int* source)
+{
+	const char* names = "rgba";
+	int out_channels = (int)strlen(order);
+	assert(out_channels >= 1 && out_channels <= 4 && "swizzle order must have 1 to 4 channels");
+	for (int i = 0; i < out_channels; ++i)
+	{
+		const char* pos = strchr(names, order[i]);
+		source[i] = order[i] == '0' ? -1 : order[i] == '1' ? -2 : pos ? (int)(pos - names) : -1;
+		assert((order[i] == '0' || order[i] == '1' || (pos && source[i] < in_channels)) && "wrong swizzle channel");
+	}
+	return out_channels;
+}
+
+void swizzleScalar(const uint8* in, uint8* out, size_t num_pixels, int in_channels, int out_channels, const int* source)
+{
+	for (size_t i = 0; i < num_pixels; ++i, in += in_channels, out += out_channels)
+	{
+		uint8 pixel[4]; //in and out can be the same
+		for (int c = 0; c < out_channels; ++c)
+			pixel[c] = source[c] >= 0 ? in[source[c]] : source[c] == -2 ? 255 : 0;
+		memcpy(out, pixel, out_channels);
+	}
+}
+
+#ifdef USE_SIMD_KERNELS
+//pshufb mask of a block of 4 pixels, the bytes after the block copy the input so it can be done in place
+void buildSwizzleMask(int in_channels, int out_channels, const int* source, uint8* shuffle, uint8* constant)
+{
+	for (int i = 0; i < 16; ++i)
+	{
+		shuffle[i] = (uint8)i;
+		constant[i] = 0;
+	}
+	for (int p = 0; p < 4; ++p)
+		for (int c = 0; c < out_channels; ++c)
+		{
+			int pos = p * out_channels + c;
+			shuffle[pos] = source[c] >= 0 ? (uint8)(p * in_channels + source[c]) : 0x80;
+			constant[pos] = source[c] == -2 ? 255 : 0;
+		}
+}
+
+//returns the pixels done, the rest are done by the scalar code
+TARGET_SSE41 size_t swizzleSSE(const uint8* in, uint8* out, size_t num_pixels, int in_channels, int out_channels, const uint8* shuffle, const uint8* constant)
+{
+	__m128i mask = _mm_loadu_si128((const __m128i*)shuffle);
+	__m128i ones = _mm_loadu_si128((const __m128i*)constant);
+	size_t max_channels = std::max(in_channels, out_channels);
+	size_t i = 0;
+	for (; (num_pixels - i) * max_channels >= 16; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(in + i * in_channels));
+		_mm_storeu_si128((__m128i*)(out + i * out_channels), _mm_or_si128(_mm_shuffle_epi8(v, mask), ones));
+	}
+	return i;
+}
+
+//only RGBA to RGBA, the pshufb of AVX2 works inside every half of 16 bytes
+TARGET_AVX2 size_t swizzleAVX2(const uint8* in, uint8* out, size_t num_pixels, const uint8* shuffle, const uint8* constant)
+{
+	__m128i mask128 = _mm_loadu_si128((const __m128i*)shuffle);
+	__m128i ones128 = _mm_loadu_si128((const __m128i*)constant);
+	__m256i mask = _mm256_inserti128_si256(_mm256_castsi128_si256(mask128), mask128, 1);
+	__m256i ones = _mm256_inserti128_si256(_mm256_castsi128_si256(ones128), ones128, 1);
+	size_t i = 0;
+	for (; i + 8 <= num_pixels; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(in + i * 4));
+		_mm256_storeu_si256((__m256i*)(out + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(v, mask), ones));
+	}
+	return i;
+}
+#endif
+
+// CONVERSION *************************
+
+void convertToFloatScalar(const uint8* in, float* out, size_t count, float scale)
+{
+	for (size_t i = 0; i < count; ++i)
+		out[i] = in[i] * scale;
+}
+
+void convertToBytesScalar(const float* in, uint8* out, size_t count, float scale)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		float v = std::min(std::max(in[i] * scale, 0.0f), 255.0f);
+		out[i] = (uint8)std::nearbyint(v); //to the nearest even like cvtps
+	}
+}
+
+#ifdef USE_SIMD_KERNELS
+TARGET_SSE41 size_t convertToFloatSSE(const uint8* in, float* out, size_t count, float scale)
+{
+	__m128 s = _mm_set1_ps(scale);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(v)), s));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4))), s));
+		_mm_storeu_ps(out + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 8))), s));
+		_mm_storeu_ps(out + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 12))), s));
+	}
+	return i;
+}
+
+TARGET_AVX2 size_t convertToFloatAVX2(const uint8* in, float* out, size_t count, float scale)
+{
+	__m256 s = _mm256_set1_ps(scale);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i)))), s));
+		_mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i + 8)))), s));
+	}
+	return i;
+}
+
+TARGET_SSE41 size_t convertToBytesSSE(const float* in, uint8* out, size_t count, float scale)
+{
+	__m128 s = _mm_set1_ps(scale);
+	__m128 zero = _mm_setzero_ps();
+	__m128 max = _mm_set1_ps(255.0f);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), s), zero), max));
+		__m128i b = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), s), zero), max));
+		__m128i c = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 8), s), zero), max));
+		__m128i d = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 12), s), zero), max));
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+	}
+	return i;
+}
+
+TARGET_AVX2 size_t convertToBytesAVX2(const float* in, uint8* out, size_t count, float scale)
+{
+	__m256 s = _mm256_set1_ps(scale);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 max = _mm256_set1_ps(255.0f);
+	__m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7); //the packs work inside the halves
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		__m256i a = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), s), zero), max));
+		__m256i b = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), s), zero), max));
+		__m256i c = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 16), s), zero), max));
+		__m256i d = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 24), s), zero), max));
+		__m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_permutevar8x32_epi32(bytes, order));
+	}
+	return i;
+}
+#endif
+
+// RESIZE *************************
+
+//source pixels and weights of every destination pixel in one axis
+struct sResizeTaps {
+	std::vector<int> start;
+	std::vector<int> count;
+	std::vector<int> index;
+	std::vector<float> weight;
+};
+
+void computeResizeTaps(int size, int new_size, eResizeFilter filter, sResizeTaps& taps)
+{
+	float scale = (float)size / new_size;
+	for (int i = 0; i < new_size; ++i)
+	{
+		int start = (int)taps.index.size();
+		if (filter == RESIZE_BILINEAR)
+		{
+			//centers of the pixels aligned
+			float center = std::min(std::max((i + 0.5f) * scale - 0.5f, 0.0f), (float)(size - 1));
+			int i0 = (int)center;
+			float f = center - i0;
+			taps.index.push_back(i0);
+			taps.weight.push_back(1.0f - f);
+			if (f > 0.0f && i0 + 1 < size)
+			{
+				taps.index.push_back(i0 + 1);
+				taps.weight.push_back(f);
+			}
+		}
+		else
+		{
+			//coverage of every source pixel
+			float a = i * scale;
+			float b = (i + 1) * scale;
+			for (int j = (int)a; j < b && j < size; ++j)
+			{
+				float w = (std::min(b, j + 1.0f) - std::max(a, (float)j)) / scale;
+				if (w <= 0.0f)
+					continue;
+				taps.index.push_back(j);
+				taps.weight.push_back(w);
+			}
+		}
+		taps.start.push_back(start);
+		taps.count.push_back((int)taps.index.size() - start);
+	}
+}
+
+void filterRowScalar(const float* row, float* out, int out_width, int channels, const sResizeTaps& taps)
+{
+	for (int x = 0; x < out_width; ++x)
+	{
+		const int* index = &taps.index[taps.start[x]];
+		const float* weight = &taps.weight[taps.start[x]];
+		for (int c = 0; c < channels; ++c)
+		{
+			float acc = 0.0f;
+			for (int i = 0; i < taps.count[x]; ++i)
+				acc += row[index[i] * channels + c] * weight[i];
+			out[x * channels + c] = acc;
+		}
+	}
+}
+
+void addScaledRowScalar(float* acc, const float* row, float weight, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+		acc[i] += row[i] * weight;
+}
+
+#ifdef USE_SIMD_KERNELS
+//RGBA, a pixel in every register (the taps of every pixel are different)
+TARGET_SSE41 void filterRowSSE(const float* row, float* out, int out_width, const sResizeTaps& taps)
+{
+	for (int x = 0; x < out_width; ++x)
+	{
+		const int* index = &taps.index[taps.start[x]];
+		const float* weight = &taps.weight[taps.start[x]];
+		__m128 acc = _mm_setzero_ps();
+		for (int i = 0; i < taps.count[x]; ++i)
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(row + index[i] * 4), _mm_set1_ps(weight[i])));
+		_mm_storeu_ps(out + x * 4, acc);
+	}
+}
+
+TARGET_SSE41 size_t addScaledRowSSE(float* acc, const float* row, float weight, size_t count)
+{
+	__m128 w = _mm_set1_ps(weight);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(_mm_loadu_ps(row + i), w)));
+	return i;
+}
+
+TARGET_AVX2 size_t addScaledRowAVX2(float* acc, const float* row, float weight, size_t count)
+{
+	__m256 w = _mm256_set1_ps(weight);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(_mm256_loadu_ps(row + i), w)));
+	return i;
+}
+#endif
+
+void filterRow(const float* row, float* out, int out_width, int channels, const sResizeTaps& taps)
+{
+#ifdef USE_SIMD_KERNELS
+	if (channels == 4 && ImageKernels::level >= SIMD_SSE41)
+	{
+		filterRowSSE(row, out, out_width, taps);
+		return;
+	}
+#endif
+	filterRowScalar(row, out, out_width, channels, taps);
+}
+
+void addScaledRow(float* acc, const float* row, float weight, size_t count)
+{
+	size_t done = 0;
+#ifdef USE_SIMD_KERNELS
+	if (ImageKernels::level >= SIMD_AVX2)
+		done = addScaledRowAVX2(acc, row, weight, count);
+	else if (ImageKernels::level >= SIMD_SSE41)
+		done = addScaledRowSSE(acc, row, weight, count);
+#endif
+	addScaledRowScalar(acc + done, row + done, weight, count - done);
+}
+
+// FLIP *************************
+
+void swapBytesScalar(uint8* a, uint8* b, size_t size)
+{
+	for (size_t i = 0; i < size; ++i)
+		std::swap(a[i], b[i]);
+}
+
+void flipRowScalar(uint8* row, int width, int channels)
+{
+	if (width < 2)
+		return;
+	uint8* left = row;
+	uint8* right = row + (size_t)(width - 1) * channels;
+	for (; left < right; left += channels, right -= channels)
+		swapBytesScalar(left, right, channels);
+}
+
+#ifdef USE_SIMD_KERNELS
+TARGET_SSE41 size_t swapBytesSSE(uint8* a, uint8* b, size_t size)
+{
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+		_mm_storeu_si128((__m128i*)(a + i), vb);
+		_mm_storeu_si128((__m128i*)(b + i), va);
+	}
+	return i;
+}
+
+TARGET_AVX2 size_t swapBytesAVX2(uint8* a, uint8* b, size_t size)
+{
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32)
+	{
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+		_mm256_storeu_si256((__m256i*)(a + i), vb);
+		_mm256_storeu_si256((__m256i*)(b + i), va);
+	}
+	return i;
+}
+
+//RGBA, blocks from both ends reversed and swapped, returns the pixels done at every side
+TARGET_SSE41 int flipRowSSE(uint8* row, int width)
+{
+	int done = 0;
+	for (; width - done * 2 >= 8; done += 4)
+	{
+		__m128i* left = (__m128i*)(row + done * 4);
+		__m128i* right = (__m128i*)(row + (width - done - 4) * 4);
+		__m128i l = _mm_shuffle_epi32(_mm_loadu_si128(left), _MM_SHUFFLE(0, 1, 2, 3));
+		__m128i r = _mm_shuffle_epi32(_mm_loadu_si128(right), _MM_SHUFFLE(0, 1, 2, 3));
+		_mm_storeu_si128(left, r);
+		_mm_storeu_si128(right, l);
+	}
+	return done;
+}
+
+TARGET_AVX2 int flipRowAVX2(uint8* row, int width)
+{
+	__m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	int done = 0;
+	for (; width - done * 2 >= 16; done += 8)
+	{
+		__m256i* left = (__m256i*)(row + done * 4);
+		__m256i* right = (__m256i*)(row + (width - done - 8) * 4);
+		__m256i l = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(left), reverse);
+		__m256i r = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(right), reverse);
+		_mm256_storeu_si256(left, r);
+		_mm256_storeu_si256(right, l);
+	}
+	return done;
+}
+#endif
+
+// PREMULTIPLY *************************
+
+//exact rounding of c * a / 255
+inline uint8 multiplyAlpha(int c, int a)
+{
+	int x = c * a + 128;
+	return (uint8)((x + (x >> 8)) >> 8);
+}
+
+void premultiplyAlphaScalar(uint8* rgba, size_t num_pixels)
+{
+	for (size_t i = 0; i < num_pixels; ++i, rgba += 4)
+	{
+		rgba[0] = multiplyAlpha(rgba[0], rgba[3]);
+		rgba[1] = multiplyAlpha(rgba[1], rgba[3]);
+		rgba[2] = multiplyAlpha(rgba[2], rgba[3]);
+	}
+}
+
+#ifdef USE_SIMD_KERNELS
+//two pixels in 16 bits per register, the alpha is multiplied by 255 so it stays the same
+TARGET_SSE41 __m128i multiplyAlphaSSE(__m128i v)
+{
+	__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	alpha = _mm_blend_epi16(alpha, _mm_set1_epi16(255), 0x88);
+	__m128i x = _mm_add_epi16(_mm_mullo_epi16(v, alpha), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+TARGET_SSE41 size_t premultiplyAlphaSSE(uint8* rgba, size_t num_pixels)
+{
+	__m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= num_pixels; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(rgba + i * 4));
+		__m128i lo = multiplyAlphaSSE(_mm_unpacklo_epi8(v, zero));
+		__m128i hi = multiplyAlphaSSE(_mm_unpackhi_epi8(v, zero));
+		_mm_storeu_si128((__m128i*)(rgba + i * 4), _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+
+TARGET_AVX2 __m256i multiplyAlphaAVX2(__m256i v)
+{
+	__m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	alpha = _mm256_blend_epi16(alpha, _mm256_set1_epi16(255), 0x88);
+	__m256i x = _mm256_add_epi16(_mm256_mullo_epi16(v, alpha), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+TARGET_AVX2 size_t premultiplyAlphaAVX2(uint8* rgba, size_t num_pixels)
+{
+	__m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 8 <= num_pixels; i += 8)
+	{
+		//unpack and pack work inside the halves, so the order is kept
+		__m256i v = _mm256_loadu_si256((const __m256i*)(rgba + i * 4));
+		__m256i lo = multiplyAlphaAVX2(_mm256_unpacklo_epi8(v, zero));
+		__m256i hi = multiplyAlphaAVX2(_mm256_unpackhi_epi8(v, zero));
+		_mm256_storeu_si256((__m256i*)(rgba + i * 4), _mm256_packus_epi16(lo, hi));
+	}
+	return i;
+}
+#endif
+
+// BILINEAR *************************
+
+//the two pixels and the weight of the second, the vectorized versions do the same operations
+inline void getBilinearTaps(float x, int size, bool repeat, int& i0, int& i1, float& f)
+{
+	if (repeat)
+	{
+		float fl = floorf(x);
+		f = x - fl;
+		i0 = (int)(fl - floorf(fl * (1.0f / size)) * size);
+		if (i0 >= size) i0 -= size;
+		if (i0 < 0) i0 += size;
+		i1 = i0 + 1 == size ? 0 : i0 + 1;
+	}
+	else
+	{
+		x = std::min(std::max(x, 0.0f), (float)(size - 1));
+		float fl = floorf(x);
+		f = x - fl;
+		i0 = (int)fl;
+		i1 = std::min(i0 + 1, size - 1);
+	}
+}
+
+inline void fetchPixel(const uint8* data, size_t index, int channels, float* out)
+{
+	const uint8* p = data + index * channels;
+	out[0] = p[0];
+	out[1] = channels >= 3 ? p[1] : p[0];
+	out[2] = channels >= 3 ? p[2] : p[0];
+	out[3] = channels == 4 ? p[3] : channels == 2 ? p[1] : 255.0f;
+}
+
+void sampleBilinearScalar(const uint8* data, int width, int height, int channels, const Vector2* coords, size_t count, Vector4* out, bool repeat)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		int x0, x1, y0, y1;
+		float fx, fy;
+		getBilinearTaps(coords[i].x, width, repeat, x0, x1, fx);
+		getBilinearTaps(coords[i].y, height, repeat, y0, y1, fy);
+		float p00[4], p10[4], p01[4], p11[4];
+		fetchPixel(data, (size_t)y0 * width + x0, channels, p00);
+		fetchPixel(data, (size_t)y0 * width + x1, channels, p10);
+		fetchPixel(data, (size_t)y1 * width + x0, channels, p01);
+		fetchPixel(data, (size_t)y1 * width + x1, channels, p11);
+		for (int c = 0; c < 4; ++c)
+		{
+			float top = p00[c] + (p10[c] - p00[c]) * fx;
+			float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+			out[i].v[c] = top + (bottom - top) * fy;
+		}
+	}
+}
+
+#ifdef USE_SIMD_KERNELS
+TARGET_SSE41 void getBilinearTapsSSE(__m128 x, int size, bool repeat, __m128i& i0, __m128i& i1, __m128& f)
+{
+	__m128i vsize = _mm_set1_epi32(size);
+	if (repeat)
+	{
+		__m128 fl = _mm_floor_ps(x);
+		f = _mm_sub_ps(x, fl);
+		__m128 wraps = _mm_floor_ps(_mm_mul_ps(fl, _mm_set1_ps(1.0f / size)));
+		i0 = _mm_cvttps_epi32(_mm_sub_ps(fl, _mm_mul_ps(wraps, _mm_set1_ps((float)size))));
+		i0 = _mm_sub_epi32(i0, _mm_and_si128(_mm_cmpgt_epi32(i0, _mm_set1_epi32(size - 1)), vsize));
+		i0 = _mm_add_epi32(i0, _mm_and_si128(_mm_cmplt_epi32(i0, _mm_setzero_si128()), vsize));
+		i1 = _mm_add_epi32(i0, _mm_set1_epi32(1));
+		i1 = _mm_andnot_si128(_mm_cmpeq_epi32(i1, vsize), i1);
+	}
+	else
+	{
+		x = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps((float)(size - 1)));
+		__m128 fl = _mm_floor_ps(x);
+		f = _mm_sub_ps(x, fl);
+		i0 = _mm_cvttps_epi32(fl);
+		i1 = _mm_min_epi32(_mm_add_epi32(i0, _mm_set1_epi32(1)), _mm_set1_epi32(size - 1));
+	}
+}
+
+TARGET_SSE41 __m128 fetchPixelSSE(const uint8* data, int index)
+{
+	int texel;
+	memcpy(&texel, data + (size_t)index * 4, 4);
+	return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(texel)));
+}
+
+//RGBA, the taps of 4 coordinates at once and a sample in every register
+TARGET_SSE41 size_t sampleBilinearSSE(const uint8* data, int width, int height, const Vector2* coords, size_t count, Vector4* out, bool repeat)
+{
+	__m128i vwidth = _mm_set1_epi32(width);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 a = _mm_loadu_ps(&coords[i].x);
+		__m128 b = _mm_loadu_ps(&coords[i + 2].x);
+		__m128i x0, x1, y0, y1;
+		__m128 fx, fy;
+		getBilinearTapsSSE(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), width, repeat, x0, x1, fx);
+		getBilinearTapsSSE(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), height, repeat, y0, y1, fy);
+		y0 = _mm_mullo_epi32(y0, vwidth);
+		y1 = _mm_mullo_epi32(y1, vwidth);
+
+		int i00[4], i10[4], i01[4], i11[4];
+		float wx[4], wy[4];
+		_mm_storeu_si128((__m128i*)i00, _mm_add_epi32(y0, x0));
+		_mm_storeu_si128((__m128i*)i10, _mm_add_epi32(y0, x1));
+		_mm_storeu_si128((__m128i*)i01, _mm_add_epi32(y1, x0));
+		_mm_storeu_si128((__m128i*)i11, _mm_add_epi32(y1, x1));
+		_mm_storeu_ps(wx, fx);
+		_mm_storeu_ps(wy, fy);
+		for (int k = 0; k < 4; ++k)
+		{
+			__m128 p00 = fetchPixelSSE(data, i00[k]);
+			__m128 p01 = fetchPixelSSE(data, i01[k]);
+			__m128 vx = _mm_set1_ps(wx[k]);
+			__m128 top = _mm_add_ps(p00, _mm_mul_ps(_mm_sub_ps(fetchPixelSSE(data, i10[k]), p00), vx));
+			__m128 bottom = _mm_add_ps(p01, _mm_mul_ps(_mm_sub_ps(fetchPixelSSE(data, i11[k]), p01), vx));
+			_mm_storeu_ps(out[i + k].v, _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(wy[k]))));
+		}
+	}
+	return i;
+}
+
+TARGET_AVX2 void getBilinearTapsAVX2(__m256 x, int size, bool repeat, __m256i& i0, __m256i& i1, __m256& f)
+{
+	__m256i vsize = _mm256_set1_epi32(size);
+	if (repeat)
+	{
+		__m256 fl = _mm256_floor_ps(x);
+		f = _mm256_sub_ps(x, fl);
+		__m256 wraps = _mm256_floor_ps(_mm256_mul_ps(fl, _mm256_set1_ps(1.0f / size)));
+		i0 = _mm256_cvttps_epi32(_mm256_sub_ps(fl, _mm256_mul_ps(wraps, _mm256_set1_ps((float)size))));
+		i0 = _mm256_sub_epi32(i0, _mm256_and_si256(_mm256_cmpgt_epi32(i0, _mm256_set1_epi32(size - 1)), vsize));
+		i0 = _mm256_add_epi32(i0, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), i0), vsize));
+		i1 = _mm256_add_epi32(i0, _mm256_set1_epi32(1));
+		i1 = _mm256_andnot_si256(_mm256_cmpeq_epi32(i1, vsize), i1);
+	}
+	else
+	{
+		x = _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps((float)(size - 1)));
+		__m256 fl = _mm256_floor_ps(x);
+		f = _mm256_sub_ps(x, fl);
+		i0 = _mm256_cvttps_epi32(fl);
+		i1 = _mm256_min_epi32(_mm256_add_epi32(i0, _mm256_set1_epi32(1)), _mm256_set1_epi32(size - 1));
+	}
+}
+
+TARGET_AVX2 __m256 getChannelAVX2(__m256i texels, int channel)
+{
+	return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(texels, channel * 8), _mm256_set1_epi32(255)));
+}
+
+//RGBA, 8 coordinates with gathers of the 4 pixels, every channel in its own register and transposed at the end
+TARGET_AVX2 size_t sampleBilinearAVX2(const uint8* data, int width, int height, const Vector2* coords, size_t count, Vector4* out, bool repeat)
+{
+	const int* texels = (const int*)data;
+	__m256i vwidth = _mm256_set1_epi32(width);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		//x0 y0 x1 y1 ... to x0 x1 x2 ... and y0 y1 y2 ...
+		__m256 a = _mm256_loadu_ps(&coords[i].x);
+		__m256 b = _mm256_loadu_ps(&coords[i + 4].x);
+		__m256 xs = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+		__m256 ys = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+
+		__m256i x0, x1, y0, y1;
+		__m256 fx, fy;
+		getBilinearTapsAVX2(xs, width, repeat, x0, x1, fx);
+		getBilinearTapsAVX2(ys, height, repeat, y0, y1, fy);
+		y0 = _mm256_mullo_epi32(y0, vwidth);
+		y1 = _mm256_mullo_epi32(y1, vwidth);
+		__m256i t00 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(y0, x0), 4);
+		__m256i t10 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(y0, x1), 4);
+		__m256i t01 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(y1, x0), 4);
+		__m256i t11 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(y1, x1), 4);
+
+		__m256 channels[4];
+		for (int c = 0; c < 4; ++c)
+		{
+			__m256 p00 = getChannelAVX2(t00, c);
+			__m256 p01 = getChannelAVX2(t01, c);
+			__m256 top = _mm256_add_ps(p00, _mm256_mul_ps(_mm256_sub_ps(getChannelAVX2(t10, c), p00), fx));
+			__m256 bottom = _mm256_add_ps(p01, _mm256_mul_ps(_mm256_sub_ps(getChannelAVX2(t11, c), p01), fx));
+			channels[c] = _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), fy));
+		}
+
+		//rrrr gggg bbbb aaaa to rgba rgba ...
+		__m256 rg_lo = _mm256_unpacklo_ps(channels[0], channels[1]);
+		__m256 rg_hi = _mm256_unpackhi_ps(channels[0], channels[1]);
+		__m256 ba_lo = _mm256_unpacklo_ps(channels[2], channels[3]);
+		__m256 ba_hi = _mm256_unpackhi_ps(channels[2], channels[3]);
+		__m256 s04 = _mm256_shuffle_ps(rg_lo, ba_lo, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s15 = _mm256_shuffle_ps(rg_lo, ba_lo, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s26 = _mm256_shuffle_ps(rg_hi, ba_hi, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s37 = _mm256_shuffle_ps(rg_hi, ba_hi, _MM_SHUFFLE(3, 2, 3, 2));
+		float* dst = out[i].v;
+		_mm256_storeu_ps(dst, _mm256_permute2f128_ps(s04, s15, 0x20));
+		_mm256_storeu_ps(dst + 8, _mm256_permute2f128_ps(s26, s37, 0x20));
+		_mm256_storeu_ps(dst + 16, _mm256_permute2f128_ps(s04, s15, 0x31));
+		_mm256_storeu_ps(dst + 24, _mm256_permute2f128_ps(s26, s37, 0x31));
+	}
+	return i;
+}
+#endif
+
+// BENCHMARK *************************
+
+//runs the kernel with every level, the first run after reset is compared with the scalar one
+bool benchmarkKernel(const char* name, size_t bytes, const std::function<void()>& reset, const std::function<void()>& run,
+	const void* result, size_t result_size, bool floats, float tolerance)
+{
+	eSimdLevel supported = ImageKernels::getSupportedLevel();
+	std::vector<uint8> reference;
+	float max_error = 0.0f;
+	double scalar_speed = 0.0;
+	std::cout << "\t" << name << ":";
+	for (int l = SIMD_NONE; l <= supported; ++l)
+	{
+		ImageKernels::level = (eSimdLevel)l;
+		reset();
+		run();
+		if (l == SIMD_NONE)
+			reference.assign((const uint8*)result, (const uint8*)result + result_size);
+		else if (floats)
+			for (size_t i = 0; i < result_size / sizeof(float); ++i)
+				max_error = std::max(max_error, fabsf(((const float*)result)[i] - ((const float*)&reference[0])[i]));
+		else
+			for (size_t i = 0; i < result_size; ++i)
+				max_error = std::max(max_error, (float)abs((int)((const uint8*)result)[i] - (int)reference[i]));
+
+		int runs = 0;
+		double start = getTimeMs();
+		do {
+			run();
+			runs++;
+		} while (getTimeMs() - start < 200.0);
+		double speed = bytes / (1024.0 * 1024.0) / ((getTimeMs() - start) * 0.001 / runs);
+		if (l == SIMD_NONE)
+			scalar_speed = speed;
+		std::cout << " " << ImageKernels::getLevelName((eSimdLevel)l) << " " << (int)speed << "MB/s";
+		if (l != SIMD_NONE)
+			std::cout << " (" << speed / scalar_speed << "x)";
+	}
+	ImageKernels::level = supported;
+
+	bool same = max_error <= tolerance;
+	if (!same)
+		std::cout << " [ERROR] max difference " << max_error;
+	std::cout << std::endl;
+	return same;
+}
+
+} //namespace
+
+eSimdLevel ImageKernels::getSupportedLevel()
+{
+#ifdef USE_SIMD_KERNELS
+	int regs[4];
+	cpuid(regs, 0);
+	int max_leaf = regs[0];
+	cpuid(regs, 1);
+	bool sse41 = (regs[2] & (1 << 19)) != 0;
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	bool avx = (regs[2] & (1 << 28)) != 0;
+	if (!sse41)
+		return SIMD_NONE;
+	if (max_leaf >= 7 && osxsave && avx && (xgetbv() & 6) == 6)
+	{
+		cpuid(regs, 7);
+		if (regs[1] & (1 << 5))
+			return SIMD_AVX2;
+	}
+	return SIMD_SSE41;
+#else
+	return SIMD_NONE;
+#endif
+}
+
+const char* ImageKernels::getLevelName(eSimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_SSE41: return "SSE4.1";
+	case SIMD_AVX2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+void ImageKernels::swizzle(const uint8* in, uint8* out, size_t num_pixels, int in_channels, const char* order)
+{
+	assert(in_channels >= 1 && in_channels <= 4);
+	int source[4];
+	int out_channels = parseOrder(order, in_channels, source);
+	assert((in != out || out_channels <= in_channels) && "the swizzle can't add channels in place");
+	size_t done = 0;
+#ifdef USE_SIMD_KERNELS
+	if (level >= SIMD_SSE41)
+	{
+		uint8 shuffle[16], constant[16];
+		buildSwizzleMask(in_channels, out_channels, source, shuffle, constant);
+		if (level >= SIMD_AVX2 && in_channels == 4 && out_channels == 4)
+			done = swizzleAVX2(in, out, num_pixels, shuffle, constant);
+		done += swizzleSSE(in + done * in_channels, out + done * out_channels, num_pixels - done, in_channels, out_channels, shuffle, constant);
+	}
+#endif
+	swizzleScalar(in + done * in_channels, out + done * out_channels, num_pixels - done, in_channels, out_channels, source);
+}
+
+void ImageKernels::convertToFloat(const uint8* in, float* out, size_t count, float scale)
+{
+	size_t done = 0;
+#ifdef USE_SIMD_KERNELS
+	if (level >= SIMD_AVX2)
+		done = convertToFloatAVX2(in, out, count, scale);
+	else if (level >= SIMD_SSE41)
+		done = convertToFloatSSE(in, out, count, scale);
+#endif
+	convertToFloatScalar(in + done, out + done, count - done, scale);
+}
+
+void ImageKernels::convertToBytes(const float* in, uint8* out, size_t count, float scale)
+{
+	size_t done = 0;
+#ifdef USE_SIMD_KERNELS
+	if (level >= SIMD_AVX2)
+		done = convertToBytesAVX2(in, out, count, scale);
+	else if (level >= SIMD_SSE41)
+		done = convertToBytesSSE(in, out, count, scale);
+#endif
+	convertToBytesScalar(in + done, out + done, count - done, scale);
+}
+
+void ImageKernels::resize(const uint8* in, int width, int height, int channels, uint8* out, int out_width, int out_height, eResizeFilter filter)
+{
+	assert(in && out && width > 0 && height > 0 && out_width > 0 && out_height > 0 && channels >= 1 && channels <= 4);
+	sResizeTaps taps_x, taps_y;
+	computeResizeTaps(width, out_width, filter, taps_x);
+	computeResizeTaps(height, out_height, filter, taps_y);
+
+	//only the rows used by the vertical pass (bilinear reductions skip most of them)
+	std::vector<char> used(height, 0);
+	for (size_t i = 0; i < taps_y.index.size(); ++i)
+		used[taps_y.index[i]] = 1;
+
+	size_t in_row = (size_t)width * channels;
+	size_t out_row = (size_t)out_width * channels;
+	std::vector<float> temp(out_row * height);
+	WorkerPool* pool = WorkerPool::getGlobal();
+	pool->parallelFor(height, 16, [&](int start, int end) {
+		std::vector<float> row(in_row);
+		for (int y = start; y < end; ++y)
+			if (used[y])
+			{
+				convertToFloat(in + y * in_row, &row[0], in_row, 1.0f);
+				filterRow(&row[0], &temp[y * out_row], out_width, channels, taps_x);
+			}
+	});
+
+	pool->parallelFor(out_height, 16, [&](int start, int end) {
+		std::vector<float> acc(out_row);
+		for (int y = start; y < end; ++y)
+		{
+			std::fill(acc.begin(), acc.end(), 0.0f);
+			for (int i = taps_y.start[y]; i < taps_y.start[y] + taps_y.count[y]; ++i)
+				addScaledRow(&acc[0], &temp[taps_y.index[i] * out_row], taps_y.weight[i], out_row);
+			convertToBytes(&acc[0], out + y * out_row, out_row, 1.0f);
+		}
+	});
+}
+
+void ImageKernels::flipX(uint8* data, int width, int height, int channels)
+{
+	assert(data && channels >= 1 && channels <= 4);
+	size_t row_size = (size_t)width * channels;
+	for (int y = 0; y < height; ++y)
+	{
+		uint8* row = data + y * row_size;
+		int done = 0;
+#ifdef USE_SIMD_KERNELS
+		if (channels == 4 && level >= SIMD_AVX2)
+			done = flipRowAVX2(row, width);
+		if (channels == 4 && level >= SIMD_SSE41)
+			done += flipRowSSE(row + done * 4, width - done * 2);
+#endif
+		flipRowScalar(row + done * channels, width - done * 2, channels);
+	}
+}
+
+void ImageKernels::flipY(uint8* data, int width, int height, int channels)
+{
+	assert(data && channels >= 1 && channels <= 4);
+	size_t row_size = (size_t)width * channels;
+	for (int y = 0; y < height / 2; ++y)
+	{
+		uint8* a = data + y * row_size;
+		uint8* b = data + (height - y - 1) * row_size;
+		size_t done = 0;
+#ifdef USE_SIMD_KERNELS
+		if (level >= SIMD_AVX2)
+			done = swapBytesAVX2(a, b, row_size);
+		if (level >= SIMD_SSE41)
+			done += swapBytesSSE(a + done, b + done, row_size - done);
+#endif
+		swapBytesScalar(a + done, b + done, row_size - done);
+	}
+}
+
+void ImageKernels::premultiplyAlpha(uint8* rgba, size_t num_pixels)
+{
+	size_t done = 0;
+#ifdef USE_SIMD_KERNELS
+	if (level >= SIMD_AVX2)
+		done = premultiplyAlphaAVX2(rgba, num_pixels);
+	else if (level >= SIMD_SSE41)
+		done = premultiplyAlphaSSE(rgba, num_pixels);
+#endif
+	premultiplyAlphaScalar(rgba + done * 4, num_pixels - done);
+}
+
+void ImageKernels::sampleBilinear(const uint8* data, int width, int height, int channels, const Vector2* coords, size_t count, Vector4* out, bool repeat)
+{
+	assert(data && width > 0 && height > 0 && channels >= 1 && channels <= 4);
+	size_t done = 0;
+#ifdef USE_SIMD_KERNELS
+	if (channels == 4 && level >= SIMD_AVX2)
+		done = sampleBilinearAVX2(data, width, height, coords, count, out, repeat);
+	else if (channels == 4 && level >= SIMD_SSE41)
+		done = sampleBilinearSSE(data, width, height, coords, count, out, repeat);
+#endif
+	sampleBilinearScalar(data, width, height, channels, coords + done, count - done, out + done, repeat);
+}
+
+int ImageKernels::benchmark()
+{
+	const int size = 2048;
+	const size_t num_pixels = (size_t)size * size;
+	const size_t num_samples = 1 << 20;
+	srand(size);
+
+	std::vector<uint8> rgba(num_pixels * 4), rgb(num_pixels * 3);
+	for (size_t i = 0; i < rgba.size(); ++i)
+		rgba[i] = (uint8)(rand() & 255);
+	memcpy(&rgb[0], &rgba[0], rgb.size());
+	std::vector<uint8> work(rgba.size());
+	std::vector<uint8> small((size_t)(size / 3) * (size / 3) * 4);
+	std::vector<uint8> big((size_t)(size + size / 2) * (size + size / 2) * 4);
+	std::vector<float> floats(rgba.size());
+	std::vector<Vector2> coords(num_samples);
+	for (size_t i = 0; i < num_samples; ++i)
+		coords[i] = Vector2(rand() * (size * 1.5f / RAND_MAX) - size * 0.25f, rand() * (size * 1.5f / RAND_MAX) - size * 0.25f);
+	std::vector<Vector4> samples(num_samples);
+
+	std::cout << " + Image kernels benchmark: " << size << "x" << size << ", supported: " << getLevelName(getSupportedLevel()) << std::endl;
+	std::function<void()> none = []() {};
+	std::function<void()> copy_rgba = [&]() { work = rgba; };
+	int num_different = 0;
+
+	num_different += !benchmarkKernel("swizzle RGBA to BGRA", rgba.size(), none,
+		[&]() { swizzle(&rgba[0], &work[0], num_pixels, 4, "bgra"); }, &work[0], work.size(), false, 0.0f);
+	num_different += !benchmarkKernel("swizzle BGR to RGB in place (TGA)", rgb.size(), [&]() { memcpy(&work[0], &rgb[0], rgb.size()); },
+		[&]() { swizzle(&work[0], &work[0], num_pixels, 3, "bgr"); }, &work[0], rgb.size(), false, 0.0f);
+	num_different += !benchmarkKernel("swizzle RGB to RGBA", rgb.size(), none,
+		[&]() { swizzle(&rgb[0], &work[0], num_pixels, 3, "rgb1"); }, &work[0], work.size(), false, 0.0f);
+	num_different += !benchmarkKernel("bytes to float", rgba.size(), none,
+		[&]() { convertToFloat(&rgba[0], &floats[0], rgba.size()); }, &floats[0], floats.size() * sizeof(float), true, 0.0f);
+	num_different += !benchmarkKernel("float to bytes", rgba.size() * sizeof(float), none,
+		[&]() { convertToBytes(&floats[0], &work[0], floats.size()); }, &work[0], work.size(), false, 0.0f);
+	num_different += !benchmarkKernel("flip X", rgba.size(), copy_rgba,
+		[&]() { flipX(&work[0], size, size, 4); }, &work[0], work.size(), false, 0.0f);
+	num_different += !benchmarkKernel("flip Y", rgba.size(), copy_rgba,
+		[&]() { flipY(&work[0], size, size, 4); }, &work[0], work.size(), false, 0.0f);
+	num_different += !benchmarkKernel("premultiply alpha", rgba.size(), copy_rgba,
+		[&]() { premultiplyAlpha(&work[0], num_pixels); }, &work[0], work.size(), false, 0.0f);
+	num_different += !benchmarkKernel("resize area to a third", rgba.size(), none,
+		[&]() { resize(&rgba[0], size, size, 4, &small[0], size / 3, size / 3, RESIZE_AREA); }, &small[0], small.size(), false, 1.0f);
+	num_different += !benchmarkKernel("resize bilinear x1.5", rgba.size(), none,
+		[&]() { resize(&rgba[0], size, size, 4, &big[0], size + size / 2, size + size / 2, RESIZE_BILINEAR); }, &big[0], big.size(), false, 1.0f);
+	num_different += !benchmarkKernel("bilinear samples clamped (MB of coords)", num_samples * sizeof(Vector2), none,
+		[&]() { sampleBilinear(&rgba[0], size, size, 4, &coords[0], num_samples, &samples[0], false); }, &samples[0], samples.size() * sizeof(Vector4), true, 0.01f);
+	num_different += !benchmarkKernel("bilinear samples repeat (MB of coords)", num_samples * sizeof(Vector2), none,
+		[&]() { sampleBilinear(&rgba[0], size, size, 4, &coords[0], num_samples, &samples[0], true); }, &samples[0], samples.size() * sizeof(Vector4), true, 0.01f);
+
+	std::cout << " + Image kernels: " << num_different << " different from the scalar code" << std::endl;
+	return num_different;
+}
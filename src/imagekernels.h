@@ -0,0 +1,47 @@
+#ifndef IMAGEKERNELS_H
+#define IMAGEKERNELS_H
+
+#include "framework.h"
+
+enum eSimdLevel { SIMD_NONE, SIMD_SSE41, SIMD_AVX2 };
+enum eResizeFilter { RESIZE_BILINEAR, RESIZE_AREA };
+
+//ImageKernels
+//vectorized versions of the per pixel work done with the images (loaders, atlas, tools): swizzle of the channels,
+//conversion between bytes and floats, resize, flips, premultiplied alpha and bilinear sampling of many coordinates.
+//The instructions are chosen at runtime with cpuid (AVX2, SSE4.1 or the scalar code, which is also the reference of the
+//benchmark), so the project doesn't need /arch:AVX2 to use them.
+//The buffers are packed rows of 1 to 4 bytes per pixel. The swizzle and the vertical passes work with any of them,
+//the rest only vectorize the 4 channels images (the other ones use the scalar code).
+
+class ImageKernels {
+public:
+	static eSimdLevel level; //used by all the kernels, it can be lowered for testing (never over getSupportedLevel)
+
+	static eSimdLevel getSupportedLevel(); //by the cpu, and for AVX2 the OS must save the registers
+	static const char* getLevelName(eSimdLevel level);
+
+	//order: one char per output channel, "rgba" picks an input channel, '0' and '1' are constants (0 and 255)
+	//ex: "bgra" swaps red and blue, "rrr1" gray to RGBA. in and out can be the same if it doesn't add channels
+	static void swizzle(const uint8* in, uint8* out, size_t num_pixels, int in_channels, const char* order);
+
+	static void convertToFloat(const uint8* in, float* out, size_t count, float scale = 1.0f / 255.0f);
+	static void convertToBytes(const float* in, uint8* out, size_t count, float scale = 255.0f); //clamped and rounded
+
+	//separable, in parallel. Area averages all the pixels covered by the new one (use it for big reductions)
+	static void resize(const uint8* in, int width, int height, int channels, uint8* out, int out_width, int out_height, eResizeFilter filter);
+
+	static void flipX(uint8* data, int width, int height, int channels);
+	static void flipY(uint8* data, int width, int height, int channels);
+
+	static void premultiplyAlpha(uint8* rgba, size_t num_pixels); //rounded like c * a / 255
+
+	//coordinates in pixels like Image::getPixelInterpolatedHigh, values from 0 to 255 (gray is expanded, alpha 255 if there is none)
+	static void sampleBilinear(const uint8* data, int width, int height, int channels, const Vector2* coords, size_t count, Vector4* out, bool repeat = false);
+
+	//runs every kernel with every level available, checks them against the scalar code and prints the MB/s
+	//returns the number of kernels with different results: main --bench-image
+	static int benchmark();
+};
+
+#endif
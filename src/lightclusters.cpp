@@ -0,0 +1,335 @@
+#include "lightclusters.h"
+#include "includes.h"
+#include "camera.h"
+#include "scenenode.h"
+#include "shader.h"
+#include "workerpool.h"
+#include "utils.h"
+
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define USE_SSE_CLUSTERS
+	#include <xmmintrin.h>
+#endif
+
+#define INFINITE_RADIUS 1e18f //for the lights with radius 0
+#define CLUSTER_TEXTURE_SLOT 13 //first of the three texture units used, far from the ones Shader::setTexture rotates
+
+LightClusters::LightClusters(int num_x, int num_y, int num_z)
+{
+	this->num_x = num_x;
+	this->num_y = num_y;
+	this->num_z = num_z;
+	num_lights = 0;
+	ready = false;
+	fov = aspect = near_plane = far_plane = 0.0f;
+	buffers[0] = buffers[1] = buffers[2] = 0;
+	textures[0] = textures[1] = textures[2] = 0;
+}
+
+LightClusters::~LightClusters()
+{
+	if (buffers[0])
+	{
+		glDeleteTextures(3, textures);
+		glDeleteBuffers(3, buffers);
+	}
+}
+
+void LightClusters::computeBounds(Camera* camera)
+{
+	fov = camera->fov;
+	aspect = camera->aspect;
+	near_plane = camera->near_plane;
+	far_plane = camera->far_plane;
+
+	int num_clusters = num_x * num_y * num_z;
+	cluster_min.resize(num_clusters);
+	cluster_max.resize(num_clusters);
+
+	float tan_y = tan(fov * float(DEG2RAD) * 0.5f);
+	float tan_x = tan_y * aspect;
+	for (int z = 0; z < num_z; ++z)
+	{
+		//exponential slices, so the clusters are more or less cubic at any distance
+		float d0 = near_plane * pow(far_plane / near_plane, z / (float)num_z);
+		float d1 = near_plane * pow(far_plane / near_plane, (z + 1) / (float)num_z);
+		for (int y = 0; y < num_y; ++y)
+		{
+			float y0 = (-1.0f + 2.0f * y / num_y) * tan_y;
+			float y1 = (-1.0f + 2.0f * (y + 1) / num_y) * tan_y;
+			for (int x = 0; x < num_x; ++x)
+			{
+				float x0 = (-1.0f + 2.0f * x / num_x) * tan_x;
+				float x1 = (-1.0f + 2.0f * (x + 1) / num_x) * tan_x;
+				int c = getCluster(x, y, z);
+				cluster_min[c] = Vector3(std::min(x0 * d0, x0 * d1), std::min(y0 * d0, y0 * d1), d0);
+				cluster_max[c] = Vector3(std::max(x1 * d0, x1 * d1), std::max(y1 * d0, y1 * d1), d1);
+			}
+		}
+	}
+}
+
+void LightClusters::build(Camera* camera, const std::vector<Light*>& lights)
+{
+	ready = false;
+	if (camera->fov != fov || camera->aspect != aspect || camera->near_plane != near_plane || camera->far_plane != far_plane || cluster_min.size() != (size_t)(num_x * num_y * num_z))
+		computeBounds(camera);
+	eye = camera->eye;
+	front = (camera->center - camera->eye).normalize();
+
+	//visible lights to view space
+	light_x.clear();
+	light_y.clear();
+	light_depth.clear();
+	light_radius.clear();
+	light_data.clear();
+	for (size_t i = 0; i < lights.size(); ++i)
+	{
+		Light* light = lights[i];
+		if (!light->visible)
+			continue;
+		Vector3 pos = camera->view_matrix * light->position;
+		light_x.push_back(pos.x);
+		light_y.push_back(pos.y);
+		light_depth.push_back(-pos.z);
+		light_radius.push_back(light->radius > 0.0f ? light->radius : INFINITE_RADIUS);
+		light_data.push_back(Vector4(light->position.x, light->position.y, light->position.z, light->radius));
+		light_data.push_back(Vector4(light->difuse.x, light->difuse.y, light->difuse.z, 1.0f));
+		light_data.push_back(Vector4(light->specular.x, light->specular.y, light->specular.z, 1.0f));
+	}
+	num_lights = (int)light_x.size();
+
+	//every depth slice in parallel, each one writes its own list
+	grid.resize(num_x * num_y * num_z * 2);
+	slice_indices.resize(num_z);
+	WorkerPool::getGlobal()->parallelFor(num_z, 1, [this](int start, int end) { assignSlices(start, end); });
+
+	//join the lists
+	light_indices.clear();
+	for (int z = 0; z < num_z; ++z)
+	{
+		int base = (int)light_indices.size();
+		for (int c = getCluster(0, 0, z); c < getCluster(0, 0, z + 1); ++c)
+			grid[c * 2] += base;
+		light_indices.insert(light_indices.end(), slice_indices[z].begin(), slice_indices[z].end());
+	}
+}
+
+//clusters of the depth slices [start,end), the offsets in grid are relative to the list of the slice
+void LightClusters::assignSlices(int start, int end)
+{
+	std::vector<float> cx, cy, cz, cr2; //lights touching the slice, padded to 4
+	std::vector<int> candidates;
+
+	for (int z = start; z < end; ++z)
+	{
+		std::vector<int>& out = slice_indices[z];
+		out.clear();
+
+		float slice_near = cluster_min[getCluster(0, 0, z)].z;
+		float slice_far = cluster_max[getCluster(0, 0, z)].z;
+		cx.clear(); cy.clear(); cz.clear(); cr2.clear();
+		candidates.clear();
+		for (int i = 0; i < num_lights; ++i)
+		{
+			float radius = light_radius[i];
+			if (light_depth[i] + radius < slice_near || light_depth[i] - radius > slice_far)
+				continue;
+			cx.push_back(light_x[i]);
+			cy.push_back(light_y[i]);
+			cz.push_back(light_depth[i]);
+			cr2.push_back(radius * radius);
+			candidates.push_back(i);
+		}
+		int num_candidates = (int)candidates.size();
+		while (cx.size() % 4)
+		{
+			//never passes the test
+			cx.push_back(0.0f); cy.push_back(0.0f); cz.push_back(0.0f); cr2.push_back(-1.0f);
+		}
+
+		for (int y = 0; y < num_y; ++y)
+			for (int x = 0; x < num_x; ++x)
+			{
+				int c = getCluster(x, y, z);
+				const Vector3& min = cluster_min[c];
+				const Vector3& max = cluster_max[c];
+				int offset = (int)out.size();
+				int i = 0;
+
+#ifdef USE_SSE_CLUSTERS
+				//sphere vs box for 4 lights at once: squared distance from the center to the box
+				__m128 min_x = _mm_set1_ps(min.x), min_y = _mm_set1_ps(min.y), min_z = _mm_set1_ps(min.z);
+				__m128 max_x = _mm_set1_ps(max.x), max_y = _mm_set1_ps(max.y), max_z = _mm_set1_ps(max.z);
+				__m128 zero = _mm_setzero_ps();
+				for (; i < num_candidates; i += 4)
+				{
+					__m128 px = _mm_loadu_ps(&cx[i]);
+					__m128 py = _mm_loadu_ps(&cy[i]);
+					__m128 pz = _mm_loadu_ps(&cz[i]);
+					__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_x, px), _mm_sub_ps(px, max_x)), zero);
+					__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_y, py), _mm_sub_ps(py, max_y)), zero);
+					__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_z, pz), _mm_sub_ps(pz, max_z)), zero);
+					__m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					int mask = _mm_movemask_ps(_mm_cmple_ps(dist2, _mm_loadu_ps(&cr2[i])));
+					for (int k = 0; mask; ++k, mask >>= 1)
+						if (mask & 1)
+							out.push_back(candidates[i + k]);
+				}
+#endif
+				//the rest (or all of them without SSE)
+				for (; i < num_candidates; ++i)
+				{
+					float dx = std::max(std::max(min.x - cx[i], cx[i] - max.x), 0.0f);
+					float dy = std::max(std::max(min.y - cy[i], cy[i] - max.y), 0.0f);
+					float dz = std::max(std::max(min.z - cz[i], cz[i] - max.z), 0.0f);
+					if (dx * dx + dy * dy + dz * dz <= cr2[i])
+						out.push_back(candidates[i]);
+				}
+
+				grid[c * 2] = offset;
+				grid[c * 2 + 1] = (int)out.size() - offset;
+			}
+	}
+}
+
+bool LightClusters::upload()
+{
+	static int supported = -1;
+	if (supported == -1)
+	{
+		supported = SDL_GL_ExtensionSupported("GL_ARB_texture_buffer_object") && SDL_GL_ExtensionSupported("GL_EXT_gpu_shader4");
+		if (!supported)
+			std::cout << "[WARN] buffer textures not supported, clustered lights disabled" << std::endl;
+	}
+	if (!supported)
+		return false;
+
+	if (!buffers[0])
+	{
+		glGenBuffers(3, buffers);
+		glGenTextures(3, textures);
+	}
+
+	//empty buffers are not valid
+	if (light_indices.empty())
+		light_indices.push_back(0);
+	if (light_data.empty())
+		light_data.resize(3);
+
+	GLenum formats[3] = { GL_RGBA32F, GL_RG32I, GL_R32I };
+	const void* data[3] = { &light_data[0], &grid[0], &light_indices[0] };
+	GLsizeiptr sizes[3] = { (GLsizeiptr)(light_data.size() * sizeof(Vector4)), (GLsizeiptr)(grid.size() * sizeof(int)), (GLsizeiptr)(light_indices.size() * sizeof(int)) };
+	for (int i = 0; i < 3; ++i)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizes[i], data[i], GL_STREAM_DRAW); //the driver orphans the old one
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	viewport = Vector4((float)vp[0], (float)vp[1], (float)vp[2], (float)vp[3]);
+
+	ready = true;
+	return true;
+}
+
+void LightClusters::setUniforms(Shader* shader)
+{
+	assert(ready);
+	const char* names[3] = { "u_lights_data", "u_cluster_grid", "u_cluster_lights" };
+	for (int i = 0; i < 3; ++i)
+	{
+		glActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_SLOT + i);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		shader->setUniform1(names[i], CLUSTER_TEXTURE_SLOT + i);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	//slice = log(depth) * scale + bias
+	float log_ratio = log(far_plane / near_plane);
+	shader->setUniform("u_cluster_dims", Vector3((float)num_x, (float)num_y, (float)num_z));
+	shader->setUniform("u_cluster_depth", Vector2(num_z / log_ratio, -num_z * log(near_plane) / log_ratio));
+	shader->setUniform("u_cluster_viewport", viewport);
+	shader->setUniform("u_camera_front", front);
+}
+
+std::string LightClusters::getStats()
+{
+	int num_clusters = num_x * num_y * num_z;
+	int max_count = 0;
+	for (int c = 0; c < num_clusters; ++c)
+		max_count = std::max(max_count, grid.size() ? grid[c * 2 + 1] : 0);
+	return "Light clusters: " + std::to_string(num_lights) + " lights, " + std::to_string(light_indices.size()) + " indices, max " + std::to_string(max_count) + " per cluster";
+}
+
+// *********************************
+
+static float randomFloat(float min, float max) { return min + (max - min) * (rand() / (float)RAND_MAX); }
+
+void LightClusters::benchmark(int num_lights)
+{
+	const int num_builds = 20;
+	srand(num_lights);
+
+	Camera camera;
+	camera.lookAt(Vector3(0, 0, 0), Vector3(0, 0, -1), Vector3(0, 1, 0));
+	camera.setPerspective(45.f, 16.f / 9.f, 0.1f, 1000.f);
+
+	std::vector<Light*> lights(num_lights);
+	for (int i = 0; i < num_lights; ++i)
+	{
+		lights[i] = new Light("bench");
+		lights[i]->position = Vector3(randomFloat(-300, 300), randomFloat(-150, 150), randomFloat(-1000, 50));
+		lights[i]->radius = randomFloat(2, 40);
+	}
+
+	std::cout << " + Light clusters benchmark: " << num_lights << " lights" << std::endl;
+
+	LightClusters clusters;
+	clusters.build(&camera, lights); //warm up, computes the bounds
+	double start = getTimeMs();
+	for (int i = 0; i < num_builds; ++i)
+		clusters.build(&camera, lights);
+	std::cout << "\tbuild: " << (getTimeMs() - start) / num_builds << "ms (" << clusters.light_indices.size() << " indices, "
+		<< clusters.num_x << "x" << clusters.num_y << "x" << clusters.num_z << " clusters)" << std::endl;
+
+	//brute force, every light against every cluster
+	int num_clusters = clusters.num_x * clusters.num_y * clusters.num_z;
+	int num_wrong = 0;
+	start = getTimeMs();
+	std::vector<int> expected;
+	for (int c = 0; c < num_clusters; ++c)
+	{
+		expected.clear();
+		for (int i = 0; i < num_lights; ++i)
+		{
+			Vector3 pos = camera.view_matrix * lights[i]->position;
+			pos.z = -pos.z;
+			float dist2 = 0.0f;
+			for (int k = 0; k < 3; ++k)
+			{
+				float d = std::max(std::max(clusters.cluster_min[c].v[k] - pos.v[k], pos.v[k] - clusters.cluster_max[c].v[k]), 0.0f);
+				dist2 += d * d;
+			}
+			if (dist2 <= lights[i]->radius * lights[i]->radius)
+				expected.push_back(i);
+		}
+		int offset = clusters.grid[c * 2];
+		int count = clusters.grid[c * 2 + 1];
+		if (count != (int)expected.size() || !std::equal(expected.begin(), expected.end(), clusters.light_indices.begin() + offset))
+			num_wrong++;
+	}
+	std::cout << "\tbrute force: " << (getTimeMs() - start) << "ms, " << num_wrong << " clusters differ" << std::endl;
+
+	for (int i = 0; i < num_lights; ++i)
+		delete lights[i];
+}
@@ -0,0 +1,65 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include "framework.h"
+#include <vector>
+#include <string>
+
+class Camera;
+class Light;
+class Shader;
+
+//LightClusters
+//clustered forward shading: the view frustum is split in a grid of clusters (tiles of the screen and exponential depth slices)
+//and every cluster stores the lights whose sphere touches it, so the shaders only loop over the lights near the fragment.
+//build() is CPU only (it can be tested and benchmarked without a window), upload() sends the lists to buffer textures
+
+class LightClusters {
+public:
+	int num_x; //tiles of the screen
+	int num_y;
+	int num_z; //depth slices
+
+	//view space bounds of every cluster (depth is positive), recomputed when the projection changes
+	std::vector<Vector3> cluster_min;
+	std::vector<Vector3> cluster_max;
+
+	//result of build: for every cluster the first index in light_indices and how many lights it has
+	std::vector<int> grid; //offset, count, offset, count...
+	std::vector<int> light_indices;
+	std::vector<Vector4> light_data; //3 texels per light: position and radius, difuse, specular
+	int num_lights;
+
+	bool ready; //uploaded this frame, the shaders can use it
+
+	LightClusters(int num_x = 16, int num_y = 9, int num_z = 24);
+	~LightClusters();
+
+	//assigns the visible lights to the clusters of the camera, lights with radius 0 reach every cluster
+	void build(Camera* camera, const std::vector<Light*>& lights);
+	bool upload(); //false if buffer textures are not supported
+	void setUniforms(Shader* shader);
+
+	int getCluster(int x, int y, int z) { return (z * num_y + y) * num_x + x; }
+	std::string getStats();
+
+	//prints the time of the build with num_lights random lights and checks the lists against a brute force assignment
+	static void benchmark(int num_lights);
+
+private:
+	float fov, aspect, near_plane, far_plane; //of the cluster bounds
+	Vector3 eye, front; //to compute the depth in the shader
+	Vector4 viewport;
+	std::vector<float> light_x; //visible lights in view space (depth is positive)
+	std::vector<float> light_y;
+	std::vector<float> light_depth;
+	std::vector<float> light_radius;
+	std::vector< std::vector<int> > slice_indices; //written in parallel, one per depth slice
+	unsigned int buffers[3];
+	unsigned int textures[3];
+
+	void computeBounds(Camera* camera);
+	void assignSlices(int start, int end);
+};
+
+#endif
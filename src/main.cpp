@@ -17,8 +17,20 @@
 #include "application.h"
 #include "extra/directory_watcher.h"
 #include "texture.h"
+#include "texturestreamer.h"
+#include "animation.h"
+#include "workerpool.h"
+#include "geometryarena.h"
+#include "pngdecoder.h"
+#include "texturecompressor.h"
+#include "imagekernels.h"
+#include "textureatlas.h"
+#include "framecapture.h"
+#include "assetcache.h"
 
 #include <iostream> //to output
+#include <atomic>
+#include <algorithm>
 
 long last_time = 0; //this is used to calcule the elapsed time between frames
 unsigned int sc_counter = 0;
@@ -77,6 +89,15 @@ SDL_Window* createWindow(const char* caption, int width, int height, bool fullsc
 		glewInit();
 	#endif
 
+	//block compression of the textures: BC1/BC3 need S3TC, BC7 the BPTC extension (core in 4.2), otherwise BC1/BC3 are used
+	if (!SDL_GL_ExtensionSupported("GL_EXT_texture_compression_s3tc"))
+		Texture::use_compression = false;
+	TextureCompressor::use_bc7 = SDL_GL_ExtensionSupported("GL_ARB_texture_compression_bptc") == SDL_TRUE;
+
+	//VAOs are core since GL 3.0, before it they need the extension
+	const char* gl_version = (const char*)glGetString(GL_VERSION);
+	Mesh::vao_supported = (gl_version && gl_version[0] >= '3' && gl_version[0] <= '9') || SDL_GL_ExtensionSupported("GL_ARB_vertex_array_object");
+
 	int window_width, window_height;
 	SDL_GetWindowSize(sdl_window, &window_width, &window_height);
 	std::cout << " * Window size: " << window_width << " x " << window_height << std::endl;
@@ -100,19 +121,64 @@ void renderGUI(SDL_Window* window, Application * game)
 
 		//System stats
 		ImGui::Text(getGPUStats().c_str());					   // Display some text (you can use a format strings too)
+		ImGui::Text(AssetCache::getGlobal()->getStats().c_str()); //the part of the VRAM used by the managers
+		ImGui::Text(GeometryArena::getStats().c_str());
+		ImGui::Checkbox("Use VAOs", &Mesh::use_vao);
+		ImGui::Checkbox("Auto instancing", &Application::instance->use_instancing);
+		ImGui::Text("Render queue: %d items, %d binds, %d batched", (int)Application::instance->render_queue.items.size(), Application::instance->render_queue.num_binds, Application::instance->render_queue.num_batched);
+		ImGui::Checkbox("Frustum culling", &Application::instance->use_culling);
+		ImGui::Text("Nodes: %d visible, %d culled, %d transforms updated", Application::instance->num_nodes_visible, Application::instance->num_nodes_culled, Application::instance->scene_graph.num_updated);
+		ImGui::Text(Application::instance->spatial_index.getStats().c_str());
+		ImGui::Checkbox("Single pass lights", &PhongMaterial::use_single_pass);
+		ImGui::Checkbox("Clustered lights", &Application::instance->use_clustered_lights);
+		ImGui::Checkbox("Deferred shading", &Application::instance->use_deferred);
+		ImGui::Checkbox("Reduced resolution volumes", &Application::instance->use_reduced_volumes);
+		if (Application::instance->use_reduced_volumes) {
+			VolumeCompositor& compositor = Application::instance->volume_compositor;
+			int quarter = compositor.moving_scale == 4;
+			if (ImGui::Combo("Resolution when moving", &quarter, "Half\0Quarter\0"))
+				compositor.moving_scale = quarter ? 4 : 2;
+			ImGui::Text("Volumes at 1/%d resolution", compositor.scale);
+		}
+		ImGui::Checkbox("Progressive volumes", &Application::instance->use_progressive_volumes);
+		if (Application::instance->use_progressive_volumes) {
+			VolumeCompositor& compositor = Application::instance->volume_compositor;
+			ImGui::SliderInt("Accumulated frames", &compositor.accumulation_frames, 1, 64);
+			ImGui::Text("Volumes: %d frames accumulated", compositor.num_accumulated);
+		}
+		if (Application::instance->use_clustered_lights)
+			ImGui::Text(Application::instance->light_clusters.getStats().c_str());
+		if (ImGui::Button("Benchmark lights"))
+			Application::instance->must_benchmark_lights = true;
+		if (Application::instance->lights_benchmark.size())
+			ImGui::Text(Application::instance->lights_benchmark.c_str());
 		
 		// Download Screenshot
 		bool pressed;
 		pressed = ImGui::Button("Screenshot");
 		if (pressed) {
-			Image screenshot;
-			screenshot.fromScreen(Application::instance->window_width, Application::instance->window_height);
-			std::string filename = "data/screenshots/screenshot_" + std::to_string(sc_counter) + ".tga";
-			const char* c = filename.c_str();
-			screenshot.saveTGA(c);
+			//read back and written in the background (see FrameCapture)
+			FrameCapture* capture = FrameCapture::getGlobal();
+			std::string filename = "data/screenshots/screenshot_" + std::to_string(sc_counter) + (capture->screenshot_format == CAPTURE_PNG ? ".png" : ".tga");
+			capture->screenshot(filename.c_str());
 			sc_counter++;
 		}
 
+		if (ImGui::TreeNode("Frame capture")) {
+			FrameCapture::getGlobal()->renderInMenu();
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Texture streaming")) {
+			TextureStreamer::getGlobal()->renderInMenu();
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Asset cache")) {
+			AssetCache::getGlobal()->renderInMenu();
+			ImGui::TreePop();
+		}
+
 		if (ImGui::TreeNode("Scene")) {
 			ImGui::DragFloat("Exposure", &Application::instance->scene_exposure, 0.01f,-2, 2);
 			ImGui::Combo("Output", &Application::instance->output, "COMPLETE\0ALBEDO\0ROUGHNESS\0\METALNESS\0NORMALS\0");
@@ -181,7 +247,7 @@ void mainLoop(SDL_Window* window)
 		{
 			switch (sdlEvent.type)
 			{
-			case SDL_QUIT: return; break; //EVENT for when the user clicks the [x] in the corner
+			case SDL_QUIT: FrameCapture::getGlobal()->flush(); return; break; //EVENT for when the user clicks the [x] in the corner
 			case SDL_MOUSEBUTTONDOWN: //EXAMPLE OF sync mouse input
 				Input::mouse_state |= SDL_BUTTON(sdlEvent.button.button);
 				game->onMouseButtonDown(sdlEvent.button);
@@ -246,6 +312,12 @@ void mainLoop(SDL_Window* window)
 		//update game logic
 		game->update(elapsed_time);
 
+		//upload the meshes and textures loaded in background
+		Mesh::processPendingUploads();
+		Texture::processPendingUploads();
+		TextureStreamer::getGlobal()->update();
+		AssetCache::getGlobal()->update(); //frees the unused assets over the budgets
+
 		// Start the Dear ImGui frame
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplSDL2_NewFrame(window);
@@ -254,6 +326,9 @@ void mainLoop(SDL_Window* window)
 		//render frame
 		game->render();
 
+		//screenshots and recorded frames, without the GUI
+		FrameCapture::getGlobal()->update(game->window_width, game->window_height);
+
 		renderGUI(window, game);
 
 		//check errors in opengl only when working in debug
@@ -264,6 +339,8 @@ void mainLoop(SDL_Window* window)
 		ImGui::EndFrame();
 	}
 
+	FrameCapture::getGlobal()->flush();
+
 	SDL_GL_DeleteContext(glcontext);
 	SDL_DestroyWindow(game->window);
 	SDL_Quit();
@@ -271,8 +348,101 @@ void mainLoop(SDL_Window* window)
 	return;
 }
 
+// *********************************
+//rebuilds in parallel the outdated binary caches (.mbin, .abin) of every asset inside folder
+//it doesnt need a window, used before deploying: main --warm-cache data
+int warmCache(const char* folder)
+{
+	std::vector<std::string> files, meshes, animations;
+	listFiles(folder, files);
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		std::string ext = files[i].substr(files[i].find_last_of(".") + 1);
+		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+		if (ext == "obj" || ext == "ase" || ext == "mesh")
+			meshes.push_back(files[i]);
+		else if (ext == "skanim")
+			animations.push_back(files[i]);
+	}
+
+	std::cout << " + Warming cache: " << folder << " (" << meshes.size() << " meshes, " << animations.size() << " animations)" << std::endl;
+	long time = getTime();
+	Mesh::auto_upload_to_vram = false; //there is no GL context
+
+	std::atomic<int> num_rebuilt(0);
+	std::atomic<int> num_failed(0);
+	int num_meshes = (int)meshes.size();
+	WorkerPool::getGlobal()->parallelFor(num_meshes + (int)animations.size(), 1, [&](int start, int end) {
+		for (int i = start; i < end; ++i)
+		{
+			bool ok = true;
+			bool rebuilt = false;
+			if (i < num_meshes)
+				ok = Mesh::updateBin(meshes[i].c_str(), rebuilt);
+			else if (!Animation::isABINUpToDate(animations[i - num_meshes].c_str()))
+			{
+				Animation anim;
+				ok = rebuilt = anim.load(animations[i - num_meshes].c_str());
+			}
+			if (!ok)
+				num_failed++;
+			else if (rebuilt)
+				num_rebuilt++;
+		}
+	});
+
+	std::cout << " + Cache ready: " << num_rebuilt << " rebuilt, " << num_meshes + (int)animations.size() - num_rebuilt - num_failed << " up to date, " << num_failed << " failed. Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+	return num_failed ? 1 : 0;
+}
+
 int main(int argc, char **argv)
 {
+	//command line options
+	const char* warm_cache_folder = NULL;
+	bool bench_spatial = false;
+	bool bench_clusters = false;
+	const char* bench_png_folder = NULL;
+	bool bench_image = false;
+	bool bench_atlas = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--cache-folder" && i + 1 < argc)
+			setCacheFolder(argv[++i]);
+		else if (arg == "--warm-cache")
+			warm_cache_folder = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : "data";
+		else if (arg == "--bench-spatial")
+			bench_spatial = true;
+		else if (arg == "--bench-clusters")
+			bench_clusters = true;
+		else if (arg == "--bench-png")
+			bench_png_folder = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : "data";
+		else if (arg == "--bench-image")
+			bench_image = true;
+		else if (arg == "--bench-atlas")
+			bench_atlas = true; //needs the window, it runs once the Application is created
+	}
+	if (warm_cache_folder)
+		return warmCache(warm_cache_folder);
+	if (bench_spatial)
+	{
+		SpatialIndex::benchmark(1000);
+		SpatialIndex::benchmark(10000);
+		SpatialIndex::benchmark(100000);
+		return 0;
+	}
+	if (bench_clusters)
+	{
+		LightClusters::benchmark(100);
+		LightClusters::benchmark(1000);
+		LightClusters::benchmark(10000);
+		return 0;
+	}
+	if (bench_png_folder)
+		return benchmarkPNGDecoder(bench_png_folder) ? 1 : 0;
+	if (bench_image)
+		return ImageKernels::benchmark() ? 1 : 0;
+
 	std::cout << "Initiating game..." << std::endl;
 
 	//prepare SDL
@@ -309,6 +479,8 @@ int main(int argc, char **argv)
 
 	//launch the game (game is a global variable)
 	game = new Application(window_width, window_height, window);
+	if (bench_atlas)
+		return TextureAtlas::checkBatching() ? 0 : 1;
 
 	SDL_SysWMinfo  wmInfo;
 	SDL_VERSION(&wmInfo.version);
@@ -3,14 +3,85 @@
 #include "application.h"
 #include "extra/hdre.h"
 #include "volume.h"
+#include "volumecompositor.h"
+#include "textureatlas.h"
 
 unsigned int volume_selected = 0;
 unsigned int tf_selected = 0;
 
+
+unsigned int Material::last_id = 0;
+
+Material::Material()
+{
+	id = last_id++;
+}
+
+void Material::renderInstanced(Mesh* mesh, const Matrix44* models, int num_instances, Camera* camera)
+{
+	if (!instanced_shader)
+	{
+		for (int i = 0; i < num_instances; ++i)
+			render(mesh, models[i], camera);
+		return;
+	}
+
+	if (mesh)
+	{
+		RenderQueue::invalidateState();
+		bind(camera, true);
+		drawInstanced(mesh, models, num_instances);
+		unbind();
+		shader->disable();
+	}
+}
+
+void Material::bind(Camera* camera, bool instanced)
+{
+	bound_camera = camera;
+	if (instanced && instanced_shader)
+	{
+		//setUniforms works with the instanced shader (u_model is an attribute there so it is skipped)
+		regular_shader = shader;
+		shader = instanced_shader;
+	}
+}
+
+void Material::bindGBuffer(Camera* camera)
+{
+	assert(gbuffer_shader);
+	bound_camera = camera;
+	regular_shader = shader;
+	shader = gbuffer_shader;
+	shader->enable();
+	setUniforms(camera, Matrix44());
+}
+
+void Material::draw(Mesh* mesh, const Matrix44& model)
+{
+	render(mesh, model, bound_camera);
+}
+
+void Material::drawInstanced(Mesh* mesh, const Matrix44* models, int num_instances)
+{
+	for (int i = 0; i < num_instances; ++i)
+		draw(mesh, models[i]);
+}
+
+void Material::unbind()
+{
+	if (regular_shader)
+	{
+		shader = regular_shader;
+		regular_shader = NULL;
+	}
+}
+
 StandardMaterial::StandardMaterial()
 {
 	color = vec4(1.f, 1.f, 1.f, 1.f);
 	shader = Shader::Get("data/shaders/basic.vs", "data/shaders/flat.fs");
+	instanced_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/flat.fs", INSTANCING_MACROS);
 }
 
 StandardMaterial::~StandardMaterial()
@@ -38,20 +109,38 @@ void StandardMaterial::render(Mesh* mesh, Matrix44 model, Camera* camera)
 {
 	if (mesh && shader)
 	{
-		//enable shader
-		shader->enable();
+		RenderQueue::invalidateState();
 
-		//upload uniforms
-		setUniforms(camera, model);
+		//enable shader and upload uniforms
+		bind(camera);
 
 		//do the draw call
-		mesh->render(GL_TRIANGLES);
+		draw(mesh, model);
 
 		//disable shader
+		unbind();
 		shader->disable();
 	}
 }
 
+void StandardMaterial::bind(Camera* camera, bool instanced)
+{
+	Material::bind(camera, instanced);
+	shader->enable();
+	setUniforms(camera, Matrix44());
+}
+
+void StandardMaterial::draw(Mesh* mesh, const Matrix44& model)
+{
+	shader->setUniform("u_model", model);
+	mesh->render(GL_TRIANGLES);
+}
+
+void StandardMaterial::drawInstanced(Mesh* mesh, const Matrix44* models, int num_instances)
+{
+	mesh->renderInstanced(GL_TRIANGLES, models, num_instances);
+}
+
 void StandardMaterial::renderInMenu()
 {
 	ImGui::ColorEdit3("Color", (float*)&color); // Edit 3 floats representing a color
@@ -61,6 +150,7 @@ WireframeMaterial::WireframeMaterial()
 {
 	color = vec4(1.f, 1.f, 1.f, 1.f);
 	shader = Shader::Get("data/shaders/basic.vs", "data/shaders/flat.fs");
+	instanced_shader = NULL;
 }
 
 WireframeMaterial::~WireframeMaterial()
@@ -90,17 +180,85 @@ void WireframeMaterial::render(Mesh* mesh, Matrix44 model, Camera * camera)
 TextureMaterial::TextureMaterial()
 {
 	shader = Shader::Get("data/shaders/basic.vs", "data/shaders/texture.fs");
+	instanced_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/texture.fs", INSTANCING_MACROS);
+	uv_transform = Vector4(1.0f, 1.0f, 0.0f, 0.0f);
+	atlas_layer = -1;
 }
 
 TextureMaterial::~TextureMaterial()
 {
 }
 
+void TextureMaterial::setAtlasTexture(TextureAtlas* atlas, const char* name)
+{
+	sAtlasEntry* entry = atlas->get(name);
+	if (!entry)
+	{
+		std::cout << "[ERROR] Texture not found in the atlas: " << name << std::endl;
+		return;
+	}
+	texture = atlas->getTexture(entry);
+	uv_transform = entry->uv_transform;
+	atlas_layer = atlas->use_array ? entry->page : -1;
+
+	std::string macros = atlas->use_array ? ATLAS_ARRAY_MACROS : ATLAS_MACROS; //the #extension goes first
+	shader = Shader::Get("data/shaders/basic.vs", "data/shaders/texture.fs", macros.c_str());
+	instanced_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/texture.fs", (macros + INSTANCING_MACROS).c_str());
+}
+
+void TextureMaterial::setUniforms(Camera* camera, Matrix44 model)
+{
+	StandardMaterial::setUniforms(camera, model);
+	shader->setUniform("u_uv_transform", uv_transform);
+	shader->setUniform("u_atlas_layer", (float)atlas_layer);
+}
+
+bool TextureMaterial::canBatchWith(Material* other)
+{
+	TextureMaterial* material = dynamic_cast<TextureMaterial*>(other);
+	Shader* regular = regular_shader ? regular_shader : shader; //this one is bound, maybe with a variant
+	return material && material->shader == regular && material->instanced_shader == instanced_shader && material->texture == texture;
+}
+
+void TextureMaterial::bindBatched(Camera* camera, bool instanced)
+{
+	Material::bind(camera, instanced);
+	assert(Shader::current == shader && "the shader must be bound by the previous material");
+	shader->setUniform("u_color", color);
+	shader->setUniform("u_uv_transform", uv_transform);
+	shader->setUniform("u_atlas_layer", (float)atlas_layer);
+}
+
+bool PhongMaterial::use_single_pass = true;
+
+int gatherLights(Vector3* positions, Vector3* difuse, Vector3* specular, float* radius, int max_lights)
+{
+	std::vector<Light*>& lights = Application::instance->light_list;
+	int num = 0;
+	for (size_t i = 0; i < lights.size(); i++) {
+		if (!lights[i]->visible)
+			continue;
+		if (num < max_lights) {
+			positions[num] = lights[i]->position;
+			difuse[num] = lights[i]->difuse;
+			specular[num] = lights[i]->specular;
+			radius[num] = lights[i]->radius;
+		}
+		num++;
+	}
+	return num;
+}
+
 PhongMaterial::PhongMaterial()
 {
 	color = vec4(1.f, 1.f, 1.f, 1.f);
 	shader = Shader::Get("data/shaders/basic.vs", "data/shaders/phong.fs");
-
+	instanced_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/phong.fs", INSTANCING_MACROS);
+	light_array_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/phong.fs", LIGHT_ARRAY_MACROS);
+	light_array_instanced_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/phong.fs", INSTANCING_MACROS LIGHT_ARRAY_MACROS);
+	clustered_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/phong.fs", CLUSTERED_MACROS);
+	clustered_instanced_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/phong.fs", INSTANCING_MACROS CLUSTERED_MACROS);
+	single_pass = false;
 }
 
 PhongMaterial::~PhongMaterial()
@@ -135,44 +293,146 @@ void PhongMaterial::setUniforms(Camera* camera, Matrix44 model)
 		use_normal = true;
 	}
 	shader->setUniform("u_use_normal", use_normal);
+	shader->setUniform("u_normal_rg", normal_texture && normal_texture->internal_format == GL_COMPRESSED_RG_RGTC2);
 }
 
 void PhongMaterial::render(Mesh* mesh, Matrix44 model, Camera* camera)
 {
 	if (mesh && shader)
 	{
-		//enable shader
-		shader->enable();
+		RenderQueue::invalidateState();
 
-		//upload uniforms
-		setUniforms(camera, model);
-	
-		// Fem un for per afegir cada llum a l'escena
-		for (int i = 0; i < Application::instance->light_list.size(); i++) {
-			if (i == 1) {
-				//Habilitem el blending
-				glEnable(GL_BLEND);
-				glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-				glDepthFunc(GL_LEQUAL);
-				
-				shader->setUniform("u_ia", Vector3(0,0,0));
-			}
+		//enable shader and upload uniforms
+		bind(camera);
 
-			if (Application::instance->light_list[i]->visible) Application::instance->light_list[i]->setUniforms(shader);
-			
-			//do the draw call
-			mesh->render(GL_TRIANGLES);
-		}
-		
-		// Deshabilitem el blending
-		glDisable(GL_BLEND);
-		glDepthFunc(GL_LESS); //as default
+		draw(mesh, model);
 
 		//disable shader
+		unbind();
 		shader->disable();
 	}
 }
 
+void PhongMaterial::bind(Camera* camera, bool instanced)
+{
+	Material::bind(camera, instanced);
+
+	//the lights of the clusters if they were computed this frame, otherwise all the visible lights at once,
+	//unless they don't fit in the arrays of the shader
+	LightClusters& clusters = Application::instance->light_clusters;
+	Vector3 positions[MAX_SINGLE_PASS_LIGHTS];
+	Vector3 difuse[MAX_SINGLE_PASS_LIGHTS];
+	Vector3 specular[MAX_SINGLE_PASS_LIGHTS];
+	float radius[MAX_SINGLE_PASS_LIGHTS];
+	int num_lights = 0;
+	Shader* single_pass_shader = instanced ? clustered_instanced_shader : clustered_shader;
+	if (!clusters.ready || !single_pass_shader) {
+		num_lights = gatherLights(positions, difuse, specular, radius, MAX_SINGLE_PASS_LIGHTS);
+		single_pass_shader = use_single_pass && num_lights <= MAX_SINGLE_PASS_LIGHTS ? (instanced ? light_array_instanced_shader : light_array_shader) : NULL;
+	}
+	single_pass = single_pass_shader != NULL;
+	if (single_pass) {
+		if (!regular_shader)
+			regular_shader = shader;
+		shader = single_pass_shader;
+	}
+
+	shader->enable();
+	setUniforms(camera, Matrix44());
+
+	if (shader == clustered_shader || shader == clustered_instanced_shader)
+		clusters.setUniforms(shader);
+	else if (single_pass) {
+		shader->setUniform1("u_num_lights", num_lights);
+		if (num_lights) {
+			shader->setUniform3Array("u_lights_pos", (float*)positions, num_lights);
+			shader->setUniform3Array("u_lights_id", (float*)difuse, num_lights);
+			shader->setUniform3Array("u_lights_is", (float*)specular, num_lights);
+			shader->setUniform1Array("u_lights_radius", radius, num_lights);
+		}
+	}
+}
+
+void PhongMaterial::draw(Mesh* mesh, const Matrix44& model)
+{
+	shader->setUniform("u_model", model);
+	if (!single_pass) {
+		renderLightPasses(mesh, NULL, 0);
+		return;
+	}
+	RenderQueue::setBlending(false);
+	RenderQueue::setDepthFunc(GL_LESS);
+	mesh->render(GL_TRIANGLES);
+}
+
+void PhongMaterial::drawInstanced(Mesh* mesh, const Matrix44* models, int num_instances)
+{
+	if (!single_pass) {
+		renderLightPasses(mesh, models, num_instances);
+		return;
+	}
+	RenderQueue::setBlending(false);
+	RenderQueue::setDepthFunc(GL_LESS);
+	mesh->renderInstanced(GL_TRIANGLES, models, num_instances);
+}
+
+void PhongMaterial::unbind()
+{
+	// Deshabilitem el blending
+	RenderQueue::setBlending(false);
+	RenderQueue::setDepthFunc(GL_LESS); //as default
+	Material::unbind();
+}
+
+void PhongMaterial::getTextures(std::vector<Texture*>& textures)
+{
+	Material::getTextures(textures);
+	if (normal_texture)
+		textures.push_back(normal_texture);
+}
+
+void PhongMaterial::renderLightPasses(Mesh* mesh, const Matrix44* models, int num_instances)
+{
+	// Fem un for per afegir cada llum visible a l'escena (com a minim una passada per l'ambient)
+	std::vector<Light*>& lights = Application::instance->light_list;
+	int pass = 0;
+	for (size_t i = 0; i <= lights.size(); i++) {
+		if (i < lights.size() && !lights[i]->visible)
+			continue;
+		if (i == lights.size() && pass > 0)
+			break;
+
+		if (pass == 0) {
+			//the first light is not blended (the previous mesh could have left it enabled)
+			RenderQueue::setBlending(false);
+			RenderQueue::setDepthFunc(GL_LESS);
+			shader->setUniform("u_ia", Application::instance->ambient_light);
+		}
+		if (pass == 1) {
+			//Habilitem el blending
+			RenderQueue::setBlending(true, GL_SRC_ALPHA, GL_ONE);
+			RenderQueue::setDepthFunc(GL_LEQUAL);
+			
+			shader->setUniform("u_ia", Vector3(0,0,0));
+		}
+
+		if (i < lights.size())
+			lights[i]->setUniforms(shader);
+		else {
+			//no visible lights, only the ambient
+			shader->setUniform("u_id", Vector3(0, 0, 0));
+			shader->setUniform("u_is", Vector3(0, 0, 0));
+		}
+		pass++;
+		
+		//do the draw call
+		if (models)
+			mesh->renderInstanced(GL_TRIANGLES, models, num_instances);
+		else
+			mesh->render(GL_TRIANGLES);
+	}
+}
+
 void PhongMaterial::renderInMenu()
 {
 	// creem sliders per modificar les constants del material
@@ -236,6 +496,7 @@ ReflectiveMaterial::ReflectiveMaterial()
 {
 	color = vec4(1.f, 1.f, 1.f, 1.f);
 	shader = Shader::Get("data/shaders/basic.vs", "data/shaders/reflective.fs"); 
+	instanced_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/reflective.fs", INSTANCING_MACROS);
 }
 
 ReflectiveMaterial::~ReflectiveMaterial()
@@ -258,20 +519,38 @@ void ReflectiveMaterial::render(Mesh* mesh, Matrix44 model, Camera* camera)
 {
 	if (mesh && shader)
 	{
-		//enable shader
-		shader->enable();
+		RenderQueue::invalidateState();
 
-		//upload uniforms
-		setUniforms(camera, model);
+		//enable shader and upload uniforms
+		bind(camera);
 
 		//do the draw call
-		mesh->render(GL_TRIANGLES);
+		draw(mesh, model);
 
 		//disable shader
+		unbind();
 		shader->disable();
 	}
 }
 
+void ReflectiveMaterial::bind(Camera* camera, bool instanced)
+{
+	Material::bind(camera, instanced);
+	shader->enable();
+	setUniforms(camera, Matrix44());
+}
+
+void ReflectiveMaterial::draw(Mesh* mesh, const Matrix44& model)
+{
+	shader->setUniform("u_model", model);
+	mesh->render(GL_TRIANGLES);
+}
+
+void ReflectiveMaterial::drawInstanced(Mesh* mesh, const Matrix44* models, int num_instances)
+{
+	mesh->renderInstanced(GL_TRIANGLES, models, num_instances);
+}
+
 void ReflectiveMaterial::renderInMenu()
 {
 }
@@ -279,7 +558,11 @@ void ReflectiveMaterial::renderInMenu()
 PBRMaterial::PBRMaterial()
 {
 	shader = Shader::Get("data/shaders/basic.vs", "data/shaders/pbr.fs");
+	instanced_shader = NULL; //the opacity blending needs the meshes one by one
+	clustered_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/pbr.fs", CLUSTERED_MACROS);
+	gbuffer_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/pbr.fs", GBUFFER_MACROS);
 	f0 = Vector3(0.04, 0.04, 0.04);
+	albedo = normal = roughness = metalness = brdfLUT = NULL;
 	emissive = Texture::getBlackTexture();
 	opacity = NULL;
 	prem_0 = new Texture();
@@ -310,12 +593,14 @@ void PBRMaterial::setUniforms(Camera* camera, Matrix44 model)
 	// material
 	if (albedo) shader->setUniform("u_texture", albedo, 0);
 	if (normal) shader->setUniform("u_normal_texture", normal, 1);
+	shader->setUniform("u_normal_rg", normal && normal->internal_format == GL_COMPRESSED_RG_RGTC2);
 	if (roughness) shader->setUniform("u_rough_texture", roughness, 2);
 	if (metalness) shader->setUniform("u_metal_texture", metalness, 3);
 
 	// light
 	shader->setUniform("u_light_pos", Application::instance->light_list[0]->position);
 	shader->setUniform("u_light_intensity", Application::instance->light_list[0]->difuse);
+	shader->setUniform("u_light_radius", Application::instance->light_list[0]->radius);
 	shader->setUniform("u_use_metal", use_metal);
 
 	// ibl
@@ -340,30 +625,64 @@ void PBRMaterial::render(Mesh* mesh, Matrix44 model, Camera* camera)
 {
 	if (mesh && shader)
 	{
-		//enable shader
-		shader->enable();
+		RenderQueue::invalidateState();
 
-		//upload uniforms
-		setUniforms(camera, model);
-		if (opacity) {
-			glEnable(GL_BLEND);
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-			glEnable(GL_CULL_FACE);
-			glCullFace(GL_FRONT);
-			glFrontFace(GL_CW);
-		}
+		//enable shader and upload uniforms
+		bind(camera);
 
 		//do the draw call
-		mesh->render(GL_TRIANGLES);
-
-		glDisable(GL_BLEND);
-		glDisable(GL_CULL_FACE);
+		draw(mesh, model);
 
 		//disable shader
+		unbind();
 		shader->disable();
 	}
 }
 
+void PBRMaterial::bind(Camera* camera, bool instanced)
+{
+	Material::bind(camera, instanced);
+
+	//all the lights of the clusters instead of only the first one
+	LightClusters& clusters = Application::instance->light_clusters;
+	if (clusters.ready && clustered_shader) {
+		if (!regular_shader)
+			regular_shader = shader;
+		shader = clustered_shader;
+	}
+
+	shader->enable();
+	setUniforms(camera, Matrix44());
+	if (shader == clustered_shader)
+		clusters.setUniforms(shader);
+	if (opacity) {
+		RenderQueue::setBlending(true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		RenderQueue::setCulling(true, GL_FRONT, GL_CW);
+	}
+}
+
+void PBRMaterial::draw(Mesh* mesh, const Matrix44& model)
+{
+	shader->setUniform("u_model", model);
+	mesh->render(GL_TRIANGLES);
+}
+
+void PBRMaterial::unbind()
+{
+	RenderQueue::setBlending(false);
+	RenderQueue::setCulling(false);
+	Material::unbind();
+}
+
+//the LUT and the prefiltered environment are not mapped on the mesh
+void PBRMaterial::getTextures(std::vector<Texture*>& textures)
+{
+	Texture* maps[] = { albedo, normal, roughness, metalness, emissive, opacity };
+	for (int i = 0; i < 6; ++i)
+		if (maps[i])
+			textures.push_back(maps[i]);
+}
+
 void PBRMaterial::renderInMenu()
 {
 	ImGui::ColorEdit3("F0", (float*)&f0); // Edit 3 floats representing a color
@@ -373,10 +692,14 @@ void PBRMaterial::renderInMenu()
 	ImGui::SliderFloat("Metalness Factor", &metalness_factor, 0.0, 1.0);
 }
 
+VolumeCompositor* VolumeMaterial::compositor = NULL;
+int VolumeMaterial::accumulation_frame = -1;
+
 VolumeMaterial::VolumeMaterial()
 {
 	color = vec4(1.f, 1.f, 1.f, 1.f);
 	shader = Shader::Get("data/shaders/basic.vs", "data/shaders/volume.fs");
+	instanced_shader = NULL; //needs u_iModel per node
 	step = 0.01;
 	brightness = 1.0;
 	threshold = 0.01;
@@ -412,7 +735,8 @@ void VolumeMaterial::setUniforms(Camera* camera, Matrix44 model)
 		shader->setUniform("u_noise_text", noise_texture, 1);
 		shader->setUniform("u_texture_width", noise_texture->width);
 	}
-	shader->setUniform("u_use_jittering", use_jittering);
+	shader->setUniform("u_use_jittering", use_jittering || accumulation_frame >= 0);
+	shader->setUniform("u_jitter_frame", (float)(accumulation_frame >= 0 ? accumulation_frame : 0));
 
 	shader->setUniform("u_use_tf", use_tf);
 	if (tf_text) shader->setUniform("u_tf_text", tf_text, 2);
@@ -425,25 +749,64 @@ void VolumeMaterial::render(Mesh* mesh, Matrix44 model, Camera* camera)
 {
 	if (mesh && shader)
 	{
-		//enable shader
-		shader->enable();
-
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
-		glFrontFace(GL_CW);
+		RenderQueue::invalidateState();
 
-		//upload uniforms
-		setUniforms(camera, model);
+		//enable shader
+		bind(camera);
 
-		//do the draw call
-		mesh->render(GL_TRIANGLES);
+		//upload uniforms and do the draw call
+		draw(mesh, model);
 
 		//disable shader
+		unbind();
 		shader->disable();
+	}
+}
 
-		glDisable(GL_CULL_FACE);
+void VolumeMaterial::bind(Camera* camera, bool instanced)
+{
+	Material::bind(camera, instanced);
+	enableShader();
+	RenderQueue::setCulling(true, GL_FRONT, GL_CW);
+}
 
+void VolumeMaterial::enableShader()
+{
+	if (!compositor)
+	{
+		shader->enable();
+		return;
 	}
+	//the mesh is drawn again to place the reduced resolution (or accumulated) result, unbind restores the shader
+	regular_shader = shader;
+	shader = compositor->getCompositeShader();
+	shader->enable();
+	compositor->setUniforms(shader);
+	RenderQueue::setBlending(true);
+	RenderQueue::setDepthFunc(GL_LESS);
+}
+
+void VolumeMaterial::draw(Mesh* mesh, const Matrix44& model)
+{
+	setUniforms(bound_camera, model);
+	mesh->render(GL_TRIANGLES);
+}
+
+void VolumeMaterial::unbind()
+{
+	RenderQueue::setCulling(false);
+	Material::unbind();
+}
+
+unsigned long long VolumeMaterial::getStateHash()
+{
+	//the parameters are copied to arrays without padding, so only their values change the hash
+	float values[] = { step, brightness, threshold, color.x, color.y, color.z, color.w, plane.x, plane.y, plane.z, plane.w };
+	const void* textures[] = { texture.get(), tf_text.get() };
+	unsigned int flags[] = { volume_selected, use_jittering, use_tf, use_clipping }; //the same texture is reloaded with other volume
+	unsigned long long hash = hashData(values, sizeof(values));
+	hash = hashData(textures, sizeof(textures), hash);
+	return hashData(flags, sizeof(flags), hash);
 }
 
 void VolumeMaterial::renderInMenu()
@@ -553,39 +916,86 @@ void IsoVolumeMaterial::render(Mesh* mesh, Matrix44 model, Camera* camera)
 {
 	if (mesh && shader)
 	{
+		RenderQueue::invalidateState();
+
 		//enable shader
-		shader->enable();
+		bind(camera);
 
-		//upload uniforms
-		setUniforms(camera, model);
+		//upload uniforms and do the draw calls
+		draw(mesh, model);
 
-		// Fem un for per afegir cada llum a l'escena
-		for (int i = 0; i < Application::instance->light_list.size(); i++) {
-			if (i == 1) {
-				//Habilitem el blending
-				glEnable(GL_BLEND);
-				glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-				glDepthFunc(GL_LEQUAL);
+		//disable shader
+		unbind();
+		shader->disable();
+	}
+}
 
-				shader->setUniform("u_ia", Vector3(0, 0, 0));
-			}
+void IsoVolumeMaterial::bind(Camera* camera, bool instanced)
+{
+	Material::bind(camera, instanced);
+	enableShader();
+}
 
-			if (Application::instance->light_list[i]->visible) {
-				Application::instance->light_list[i]->setUniforms(shader);
-				//do the draw call
-				mesh->render(GL_TRIANGLES);
-			}
+void IsoVolumeMaterial::draw(Mesh* mesh, const Matrix44& model)
+{
+	//upload uniforms
+	setUniforms(bound_camera, model);
+
+	if (compositor) {
+		mesh->render(GL_TRIANGLES); //the lights were added at reduced resolution
+		return;
+	}
+
+	// Fem un for per afegir cada llum a l'escena
+	for (int i = 0; i < Application::instance->light_list.size(); i++) {
+		if (i == 0) {
+			RenderQueue::setBlending(false);
+			RenderQueue::setDepthFunc(GL_LESS);
 		}
+		if (i == 1) {
+			//Habilitem el blending
+			RenderQueue::setBlending(true, GL_SRC_ALPHA, GL_ONE);
+			RenderQueue::setDepthFunc(GL_LEQUAL);
 
-		// Deshabilitem el blending
-		glDisable(GL_BLEND);
-		glDepthFunc(GL_LESS); //as default
+			shader->setUniform("u_ia", Vector3(0, 0, 0));
+		}
 
-		//disable shader
-		shader->disable();
+		if (Application::instance->light_list[i]->visible) {
+			Application::instance->light_list[i]->setUniforms(shader);
+			//do the draw call
+			mesh->render(GL_TRIANGLES);
+		}
 	}
 }
 
+void IsoVolumeMaterial::unbind()
+{
+	// Deshabilitem el blending
+	RenderQueue::setBlending(false);
+	RenderQueue::setDepthFunc(GL_LESS); //as default
+	Material::unbind();
+}
+
+
+unsigned long long IsoVolumeMaterial::getStateHash()
+{
+	float values[] = { iso_val, h, k_alpha, k_ambient.x, k_ambient.y, k_ambient.z, k_difuse.x, k_difuse.y, k_difuse.z,
+		k_specular.x, k_specular.y, k_specular.z, show_normals ? 1.0f : 0.0f };
+	unsigned long long hash = hashData(values, sizeof(values), VolumeMaterial::getStateHash());
+
+	//one pass per light
+	std::vector<Light*>& lights = Application::instance->light_list;
+	hash = hashData(&Application::instance->ambient_light, sizeof(Vector3), hash);
+	for (size_t i = 0; i < lights.size(); i++) {
+		Light* light = lights[i];
+		if (!light->visible)
+			continue;
+		hash = hashData(&light->position, sizeof(Vector3), hash);
+		hash = hashData(&light->difuse, sizeof(Vector3), hash);
+		hash = hashData(&light->specular, sizeof(Vector3), hash);
+	}
+	return hash;
+}
 
 void IsoVolumeMaterial::renderInMenu()
 {
@@ -5,18 +5,72 @@
 #include "shader.h"
 #include "camera.h"
 #include "mesh.h"
+#include "texture.h"
+#include "renderqueue.h"
 #include "extra/hdre.h"
 
+class VolumeCompositor;
+class TextureAtlas;
+
+#define MAX_SINGLE_PASS_LIGHTS 64 //size of the light arrays of phong.fs
+
+//macros of the shader variants, MAX_LIGHTS must match MAX_SINGLE_PASS_LIGHTS
+#define INSTANCING_MACROS "#define USE_INSTANCING\n"
+#define LIGHT_ARRAY_MACROS "#define USE_LIGHT_ARRAY\n#define MAX_LIGHTS 64\n"
+#define CLUSTERED_MACROS "#extension GL_EXT_gpu_shader4 : enable\n#define USE_CLUSTERED\n" //the light lists are read from buffer textures
+#define GBUFFER_MACROS "#define USE_GBUFFER\n"
+#define ATLAS_MACROS "#define USE_ATLAS\n" //the uvs are transformed to the sub-texture (see TextureAtlas)
+#define ATLAS_ARRAY_MACROS "#extension GL_EXT_texture_array : enable\n#define USE_ATLAS\n#define USE_ATLAS_ARRAY\n"
+
+//the visible lights of the application packed for the uniform arrays, returns how many there are (it can be more than max_lights)
+int gatherLights(Vector3* positions, Vector3* difuse, Vector3* specular, float* radius, int max_lights);
+
 class Material {
 public:
 
+	static unsigned int last_id;
+	unsigned int id; //to sort the draw calls by material
+
 	Shader* shader = NULL;
-	Texture* texture = NULL;
+	AssetRef<Texture> texture; //the textures of the materials keep them in the AssetCache
 	vec4 color;
 
+	//same shader compiled with USE_INSTANCING (u_model as attribute), NULL if the material can't be instanced
+	Shader* instanced_shader = NULL;
+	//same shader compiled with USE_GBUFFER (writes the surface for the deferred path), NULL if the material is forward only
+	Shader* gbuffer_shader = NULL;
+
+	Material();
+
 	virtual void setUniforms(Camera* camera, Matrix44 model) = 0;
 	virtual void render(Mesh* mesh, Matrix44 model, Camera * camera) = 0;
+	//draws the mesh once per model, one render per instance if there is no instanced_shader
+	virtual void renderInstanced(Mesh* mesh, const Matrix44* models, int num_instances, Camera* camera);
 	virtual void renderInMenu() = 0;
+
+	//split render used by the RenderQueue: bind when the material changes, draw every item, unbind before the next material
+	//by default bind only stores the camera and draw calls render
+	virtual void bind(Camera* camera, bool instanced = false);
+	virtual void draw(Mesh* mesh, const Matrix44& model);
+	virtual void drawInstanced(Mesh* mesh, const Matrix44* models, int num_instances);
+	virtual void unbind();
+	virtual bool isTransparent() { return false; } //drawn after the opaque ones and back to front
+	virtual eRenderPass getRenderPass() { return PASS_MAIN; }
+	virtual bool isVolume() { return false; } //ray marched, can be rendered at reduced resolution by the VolumeCompositor
+	//textures mapped on the surface of the mesh, their mips are streamed from the size of the node on screen
+	virtual void getTextures(std::vector<Texture*>& textures) { if (texture) textures.push_back(texture); }
+	//true if other uses the same shader and textures (like another sub-texture of an atlas page), then the RenderQueue
+	//draws it after this one with bindBatched, that only uploads the uniforms of the material
+	virtual bool canBatchWith(Material* other) { return false; }
+	virtual void bindBatched(Camera* camera, bool instanced = false) { bind(camera, instanced); }
+
+	//like bind but with the gbuffer_shader, draw and unbind are the same
+	virtual void bindGBuffer(Camera* camera);
+	bool writesGBuffer() { return gbuffer_shader && !isTransparent() && getRenderPass() == PASS_MAIN; }
+
+protected:
+	Camera* bound_camera = NULL;
+	Shader* regular_shader = NULL; //while bound as instanced (or to the G-buffer), shader points to the variant
 };
 
 class StandardMaterial : public Material {
@@ -28,20 +82,31 @@ public:
 	void setUniforms(Camera* camera, Matrix44 model);
 	void render(Mesh* mesh, Matrix44 model, Camera * camera);
 	void renderInMenu();
+
+	void bind(Camera* camera, bool instanced = false);
+	void draw(Mesh* mesh, const Matrix44& model);
+	void drawInstanced(Mesh* mesh, const Matrix44* models, int num_instances);
 };
 
 class TextureMaterial : public StandardMaterial {
 public:
+	Vector4 uv_transform; //uv * xy + zw, the sub-texture when it is in an atlas
+	int atlas_layer; //layer of the sub-texture if the atlas is an array, -1 otherwise
 
 	TextureMaterial();
 	~TextureMaterial();
+
+	void setAtlasTexture(TextureAtlas* atlas, const char* name); //also changes the shaders
+	void setUniforms(Camera* camera, Matrix44 model);
+	bool canBatchWith(Material* other);
+	void bindBatched(Camera* camera, bool instanced = false);
 };
 
 // Definim una subclasse pel Phong 
 class PhongMaterial : public Material {
 public: 
 	
-	Texture* normal_texture = NULL;
+	AssetRef<Texture> normal_texture;
 	bool use_normal = false;	// Controlem si utilitzem una textura amb les normals 
 	// Definim les variables de la llum
 	Vector3 k_ambient;
@@ -49,13 +114,28 @@ public:
 	Vector3 k_specular;
 	float k_alpha;
 
+	Shader* light_array_shader = NULL; //all the lights in a single pass
+	Shader* light_array_instanced_shader = NULL;
+	Shader* clustered_shader = NULL; //only the lights of the cluster of every fragment (see LightClusters)
+	Shader* clustered_instanced_shader = NULL;
+	static bool use_single_pass; //when false, or with more lights than MAX_SINGLE_PASS_LIGHTS, one pass per light
+
 	PhongMaterial();
 	~PhongMaterial();
 	
 	void setUniforms(Camera* camera, Matrix44 model);
 	void render(Mesh* mesh, Matrix44 model, Camera* camera);
 	void renderInMenu();
-	
+
+	void bind(Camera* camera, bool instanced = false);
+	void draw(Mesh* mesh, const Matrix44& model);
+	void drawInstanced(Mesh* mesh, const Matrix44* models, int num_instances);
+	void unbind();
+	void getTextures(std::vector<Texture*>& textures);
+
+private:
+	bool single_pass; //decided in bind, depending on the visible lights
+	void renderLightPasses(Mesh* mesh, const Matrix44* models, int num_instances); //one pass per light, instanced if models is not NULL
 };
 
 class WireframeMaterial : public StandardMaterial {
@@ -77,6 +157,7 @@ public:
 	void setUniforms(Camera* camera, Matrix44 model);
 	void render(Mesh* mesh, Matrix44 model, Camera* camera);
 	void renderInMenu();
+	eRenderPass getRenderPass() { return PASS_BACKGROUND; }
 };
 
 // Definim una subclasse pel material reflectant
@@ -89,6 +170,10 @@ public:
 	void setUniforms(Camera* camera, Matrix44 model);
 	void render(Mesh* mesh, Matrix44 model, Camera* camera);
 	void renderInMenu();
+
+	void bind(Camera* camera, bool instanced = false);
+	void draw(Mesh* mesh, const Matrix44& model);
+	void drawInstanced(Mesh* mesh, const Matrix44* models, int num_instances);
 };
 
 // Definim una subclasse pel material PBR
@@ -98,19 +183,21 @@ public:
 	PBRMaterial();
 	~PBRMaterial();
 
-	Texture* albedo;
-	Texture* normal;
-	Texture* roughness;
-	Texture* metalness;
-	Texture* emissive;
-	Texture* opacity;
-	Texture* brdfLUT;
-	Texture* prem_0;
-	Texture* prem_1;
-	Texture* prem_2;
-	Texture* prem_3;
-	Texture* prem_4;
+	AssetRef<Texture> albedo;
+	AssetRef<Texture> normal;
+	AssetRef<Texture> roughness;
+	AssetRef<Texture> metalness;
+	AssetRef<Texture> emissive;
+	AssetRef<Texture> opacity;
+	AssetRef<Texture> brdfLUT;
+	AssetRef<Texture> prem_0;
+	AssetRef<Texture> prem_1;
+	AssetRef<Texture> prem_2;
+	AssetRef<Texture> prem_3;
+	AssetRef<Texture> prem_4;
 	
+	Shader* clustered_shader = NULL; //all the lights of the clusters (see LightClusters)
+
 	Vector3 f0;
 	bool use_metal;
 	float roughness_factor;
@@ -119,25 +206,47 @@ public:
 	void setUniforms(Camera* camera, Matrix44 model);
 	void render(Mesh* mesh, Matrix44 model, Camera* camera);
 	void renderInMenu();
+
+	void bind(Camera* camera, bool instanced = false);
+	void draw(Mesh* mesh, const Matrix44& model);
+	void unbind();
+	bool isTransparent() { return opacity != NULL; }
+	void getTextures(std::vector<Texture*>& textures);
 };
 class VolumeMaterial : public StandardMaterial {
 public:
 	float step;
 	float brightness;
 	float threshold;
-	Texture* noise_texture;
+	AssetRef<Texture> noise_texture;
 	bool use_jittering;
 	bool use_tf;
-	Texture* tf_text;
+	AssetRef<Texture> tf_text;
 	bool use_clipping;
 	Vector4 plane;
 
+	//while set, bind uses its composite shader and draw only draws the mesh once
+	static VolumeCompositor* compositor;
+	//frame of the progressive accumulation (forces the jittering and changes the noise every frame), -1 if not accumulating
+	static int accumulation_frame;
+
 	VolumeMaterial();
 	~VolumeMaterial();
 
 	void setUniforms(Camera* camera, Matrix44 model);
 	void render(Mesh* mesh, Matrix44 model, Camera* camera);
 	void renderInMenu();
+
+	void bind(Camera* camera, bool instanced = false);
+	void draw(Mesh* mesh, const Matrix44& model); //uniforms depend on the model (u_iModel)
+	void unbind();
+	bool isTransparent() { return true; }
+	bool isVolume() { return true; }
+	//of everything that changes the image (the accumulation restarts when it changes)
+	virtual unsigned long long getStateHash();
+
+protected:
+	void enableShader(); //the shader of the material or the composite one
 };
 
 class IsoVolumeMaterial : public VolumeMaterial {
@@ -154,6 +263,11 @@ public:
 	void setUniforms(Camera* camera, Matrix44 model);
 	void render(Mesh* mesh, Matrix44 model, Camera* camera);
 	void renderInMenu();
+
+	void bind(Camera* camera, bool instanced = false);
+	void draw(Mesh* mesh, const Matrix44& model);
+	void unbind();
+	unsigned long long getStateHash(); //also the lights
 };
 
 #endif
\ No newline at end of file
@@ -9,18 +9,31 @@
 #include <iostream>
 #include <limits>
 #include <sys/stat.h>
+#include <sstream>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 
 #include "camera.h"
 #include "texture.h"
 #include "animation.h"
 #include "extra/coldet/coldet.h"
+#include "workerpool.h"
+#include "geometryarena.h"
 
 std::map<std::string, Mesh*> Mesh::sMeshesLoaded;
 bool Mesh::use_binary = true;
 bool Mesh::auto_upload_to_vram = true;
 bool Mesh::interleave_meshes = true;
+bool Mesh::use_geometry_arena = true;
 long Mesh::num_meshes_rendered = 0;
 long Mesh::num_triangles_rendered = 0;
+long Mesh::num_gl_calls = 0;
+bool Mesh::use_vao = true;
+bool Mesh::vao_supported = true;
+
+//every GL call done to draw a mesh is counted to show it in the stats
+#define GL_COUNT(call) (Mesh::num_gl_calls++, call)
 
 #define FORMAT_ASE 1
 #define FORMAT_OBJ 2
@@ -32,6 +45,9 @@ Mesh::Mesh()
 	radius = 0;
 	vertices_vbo_id = uvs_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = bones_vbo_id = weights_vbo_id = 0;
 	collision_model = NULL;
+	load_state = LOADED;
+	arena = NULL;
+	arena_vertex_offset = arena_index_offset = arena_num_vertices = arena_num_indices = 0;
 	clear();
 }
 
@@ -61,6 +77,9 @@ void Mesh::clear()
 	if (weights_vbo_id)
 		glDeleteBuffersARB(1, &weights_vbo_id);
 
+	deleteVAOs();
+	releaseFromArena();
+
 	//VBOs ids
 	vertices_vbo_id = uvs_vbo_id = normals_vbo_id = colors_vbo_id = interleaved_vbo_id = indices_vbo_id = weights_vbo_id = bones_vbo_id = 0;
 
@@ -85,7 +104,144 @@ int color_location = -1;
 int bones_location = -1;
 int weights_location = -1;
 
-void Mesh::enableBuffers(Shader* sh)
+//arena kept bound between draws so consecutive meshes of the same arena dont need to rebind anything
+static GeometryArena* bound_arena = NULL;
+static Shader* bound_arena_shader = NULL;
+
+//vao bound by the last draw, it is kept bound till a draw needs another one
+static unsigned int bound_vao = 0;
+
+void Mesh::resetBufferBindings()
+{
+	if (bound_vao)
+	{
+		GL_COUNT(glBindVertexArray(0));
+		bound_vao = 0;
+	}
+	if (!bound_arena)
+		return;
+	GL_COUNT(glDisableVertexAttribArray(vertex_location));
+	if (normal_location != -1) GL_COUNT(glDisableVertexAttribArray(normal_location));
+	if (uv_location != -1) GL_COUNT(glDisableVertexAttribArray(uv_location));
+	GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, 0));
+	GL_COUNT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+	bound_arena = NULL;
+	bound_arena_shader = NULL;
+}
+
+void Mesh::enableArenaBuffers(Shader* sh)
+{
+	if (bound_arena == arena && bound_arena_shader == sh && !bound_vao)
+		return; //same buffers and attributes already bound
+
+	resetBufferBindings();
+	GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, arena->vertices_vbo_id));
+	GL_COUNT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->indices_vbo_id));
+	setupArenaAttributes(sh);
+	bound_arena = arena;
+	bound_arena_shader = sh;
+}
+
+//expects the arena buffers to be bound
+void Mesh::setupArenaAttributes(Shader* sh)
+{
+	vertex_location = sh->getAttribLocation("a_vertex");
+	assert(vertex_location != -1 && "No a_vertex found in shader");
+	if (vertex_location == -1)
+		return;
+	normal_location = sh->getAttribLocation("a_normal");
+	uv_location = sh->getAttribLocation("a_uv");
+	color_location = bones_location = weights_location = -1;
+
+	//the pointers start at the beginning of the arena, every mesh uses its base vertex
+	int spacing = sizeof(tInterleaved);
+	GL_COUNT(glEnableVertexAttribArray(vertex_location));
+	GL_COUNT(glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, 0));
+	if (normal_location != -1)
+	{
+		GL_COUNT(glEnableVertexAttribArray(normal_location));
+		GL_COUNT(glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, (void*)sizeof(Vector3)));
+	}
+	if (uv_location != -1)
+	{
+		GL_COUNT(glEnableVertexAttribArray(uv_location));
+		GL_COUNT(glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, (void*)(sizeof(Vector3) * 2)));
+	}
+	assert(glGetError() == GL_NO_ERROR);
+}
+
+//the VAO stores the whole attribute setup, so drawing is just binding it
+//there is one per attribute layout (shaders using the same locations share it), arena meshes share the one of the arena
+void Mesh::bindVAO(Shader* sh)
+{
+	std::map<unsigned int, unsigned int>& table = arena ? arena->vaos : vaos;
+	unsigned int key = sh->getAttribLayoutKey();
+	std::map<unsigned int, unsigned int>::iterator it = table.find(key);
+	if (it != table.end() && it->second == bound_vao)
+		return;
+
+	if (bound_arena)
+		resetBufferBindings();
+
+	if (it != table.end())
+	{
+		GL_COUNT(glBindVertexArray(it->second));
+		bound_vao = it->second;
+		return;
+	}
+
+	//first time with this layout, record it
+	unsigned int vao = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	if (arena)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, arena->vertices_vbo_id);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena->indices_vbo_id);
+		setupArenaAttributes(sh);
+	}
+	else
+	{
+		setupAttributes(sh);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	table[key] = vao;
+	bound_vao = vao;
+}
+
+void Mesh::deleteVAOs()
+{
+	for (std::map<unsigned int, unsigned int>::iterator it = vaos.begin(); it != vaos.end(); ++it)
+	{
+		if (it->second == bound_vao)
+			resetBufferBindings();
+		glDeleteVertexArrays(1, &it->second);
+	}
+	vaos.clear();
+}
+
+void Mesh::enableBuffers(Shader* sh, bool allow_vao)
+{
+	//VAOs only when the buffers are in VRAM
+	if (use_vao && vao_supported && allow_vao && (arena || interleaved_vbo_id || vertices_vbo_id))
+	{
+		bindVAO(sh);
+		return;
+	}
+
+	if (arena)
+	{
+		enableArenaBuffers(sh);
+		return;
+	}
+
+	resetBufferBindings();
+	setupAttributes(sh);
+}
+
+//sets the pointers of every attribute, used without VAOs or to fill one
+void Mesh::setupAttributes(Shader* sh)
 {
 	vertex_location = sh->getAttribLocation("a_vertex");
 	assert(vertex_location != -1 && "No a_vertex found in shader");
@@ -104,15 +260,15 @@ void Mesh::enableBuffers(Shader* sh)
 		offset_uv = sizeof(Vector3) + sizeof(Vector3);
 	}
 
-	glEnableVertexAttribArray(vertex_location);
+	GL_COUNT(glEnableVertexAttribArray(vertex_location));
 
 	if (vertices_vbo_id || interleaved_vbo_id)
 	{
-		glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : vertices_vbo_id);
-		glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, 0);
+		GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : vertices_vbo_id));
+		GL_COUNT(glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, 0));
 	}
 	else
-		glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].vertex : &vertices[0]);
+		GL_COUNT(glVertexAttribPointer(vertex_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].vertex : &vertices[0]));
 
 	normal_location = -1;
 	if (normals.size() || spacing)
@@ -120,14 +276,14 @@ void Mesh::enableBuffers(Shader* sh)
 		normal_location = sh->getAttribLocation("a_normal");
 		if (normal_location != -1)
 		{
-			glEnableVertexAttribArray(normal_location);
+			GL_COUNT(glEnableVertexAttribArray(normal_location));
 			if (normals_vbo_id || interleaved_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id);
-				glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, (void*)offset_normal);
+				GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : normals_vbo_id));
+				GL_COUNT(glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, (void*)offset_normal));
 			}
 			else
-				glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].normal : &normals[0]);
+				GL_COUNT(glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].normal : &normals[0]));
 		}
 	}
 
@@ -137,14 +293,14 @@ void Mesh::enableBuffers(Shader* sh)
 		uv_location = sh->getAttribLocation("a_uv");
 		if (uv_location != -1)
 		{
-			glEnableVertexAttribArray(uv_location);
+			GL_COUNT(glEnableVertexAttribArray(uv_location));
 			if (uvs_vbo_id || interleaved_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id);
-				glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, (void*)offset_uv);
+				GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, interleaved_vbo_id ? interleaved_vbo_id : uvs_vbo_id));
+				GL_COUNT(glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, (void*)offset_uv));
 			}
 			else
-				glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].uv : &uvs[0]);
+				GL_COUNT(glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, spacing, interleaved.size() ? &interleaved[0].uv : &uvs[0]));
 		}
 	}
 
@@ -154,14 +310,14 @@ void Mesh::enableBuffers(Shader* sh)
 		color_location = sh->getAttribLocation("a_color");
 		if (color_location != -1)
 		{
-			glEnableVertexAttribArray(color_location);
+			GL_COUNT(glEnableVertexAttribArray(color_location));
 			if (colors_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, colors_vbo_id);
-				glVertexAttribPointer(color_location, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+				GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, colors_vbo_id));
+				GL_COUNT(glVertexAttribPointer(color_location, 4, GL_FLOAT, GL_FALSE, 0, NULL));
 			}
 			else
-				glVertexAttribPointer(color_location, 4, GL_FLOAT, GL_FALSE, 0, &colors[0]);
+				GL_COUNT(glVertexAttribPointer(color_location, 4, GL_FLOAT, GL_FALSE, 0, &colors[0]));
 		}
 	}
 
@@ -171,14 +327,14 @@ void Mesh::enableBuffers(Shader* sh)
 		bones_location = sh->getAttribLocation("a_bones");
 		if (bones_location != -1)
 		{
-			glEnableVertexAttribArray(bones_location);
+			GL_COUNT(glEnableVertexAttribArray(bones_location));
 			if (bones_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, bones_vbo_id);
-				glVertexAttribPointer(bones_location, 4, GL_UNSIGNED_BYTE, GL_FALSE, 0, NULL);
+				GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, bones_vbo_id));
+				GL_COUNT(glVertexAttribPointer(bones_location, 4, GL_UNSIGNED_BYTE, GL_FALSE, 0, NULL));
 			}
 			else
-				glVertexAttribPointer(bones_location, 4, GL_UNSIGNED_BYTE, GL_FALSE, 0, &bones[0]);
+				GL_COUNT(glVertexAttribPointer(bones_location, 4, GL_UNSIGNED_BYTE, GL_FALSE, 0, &bones[0]));
 		}
 	}
 	weights_location = -1;
@@ -187,14 +343,14 @@ void Mesh::enableBuffers(Shader* sh)
 		weights_location = sh->getAttribLocation("a_weights");
 		if (weights_location != -1)
 		{
-			glEnableVertexAttribArray(weights_location);
+			GL_COUNT(glEnableVertexAttribArray(weights_location));
 			if (weights_vbo_id)
 			{
-				glBindBuffer(GL_ARRAY_BUFFER, weights_vbo_id);
-				glVertexAttribPointer(weights_location, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+				GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, weights_vbo_id));
+				GL_COUNT(glVertexAttribPointer(weights_location, 4, GL_FLOAT, GL_FALSE, 0, NULL));
 			}
 			else
-				glVertexAttribPointer(weights_location, 4, GL_FLOAT, GL_FALSE, 0, &weights[0]);
+				GL_COUNT(glVertexAttribPointer(weights_location, 4, GL_FLOAT, GL_FALSE, 0, &weights[0]));
 		}
 	}
 
@@ -204,6 +360,10 @@ void Mesh::enableBuffers(Shader* sh)
 
 void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
 {
+	if (load_state != LOADED) //still loading in background
+		return;
+	touch();
+
 	Shader* shader = Shader::current;
 	if (!shader || !shader->compiled)
 	{
@@ -212,8 +372,8 @@ void Mesh::render(unsigned int primitive, int submesh_id, int num_instances)
 	}
 	assert((interleaved.size() || vertices.size()) && "No vertices in this mesh");
 
-	//bind buffers to attribute locations
-	enableBuffers(shader);
+	//bind buffers to attribute locations (instancing sets its own attributes so it doesnt use the VAOs)
+	enableBuffers(shader, num_instances == 0);
 
 	//draw call
 	drawCall(primitive, submesh_id, num_instances);
@@ -240,33 +400,51 @@ void Mesh::drawCall(unsigned int primitive, int submesh_id, int num_instances)
 	}
 
 	//DRAW
-	if (indices.size())
+	if (arena)
+	{
+		//arena buffers are already bound, just offset by our range
+		if (indices.size())
+		{
+			void* offset = (void*)(arena_index_offset * sizeof(unsigned int) + start * sizeof(Vector3));
+			if (num_instances > 0)
+				GL_COUNT(glDrawElementsInstancedBaseVertex(primitive, size * 3, GL_UNSIGNED_INT, offset, num_instances, arena_vertex_offset));
+			else
+				GL_COUNT(glDrawElementsBaseVertex(primitive, size * 3, GL_UNSIGNED_INT, offset, arena_vertex_offset));
+		}
+		else if (num_instances > 0)
+			GL_COUNT(glDrawArraysInstanced(primitive, arena_vertex_offset + start, size, num_instances));
+		else
+			GL_COUNT(glDrawArrays(primitive, arena_vertex_offset + start, size));
+	}
+	else if (indices.size())
 	{
 		if (num_instances > 0)
 		{
 			assert(indices_vbo_id && "indices must be uploaded to the GPU");
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
-			glDrawElementsInstanced(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start + sizeof(Vector3)), num_instances);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			GL_COUNT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id));
+			GL_COUNT(glDrawElementsInstanced(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start * sizeof(Vector3)), num_instances));
+			GL_COUNT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
 		}
 		else
 		{
-			if (indices_vbo_id)
+			if (bound_vao) //the VAO already has the indices bound
+				GL_COUNT(glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start * sizeof(Vector3))));
+			else if (indices_vbo_id)
 			{
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id);
-				glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start * sizeof(Vector3)));
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+				GL_COUNT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo_id));
+				GL_COUNT(glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(start * sizeof(Vector3))));
+				GL_COUNT(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
 			}
 			else
-				glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(&indices[0] + start)); //no multiply, its a vector3u pointer)
+				GL_COUNT(glDrawElements(primitive, size * 3, GL_UNSIGNED_INT, (void*)(&indices[0] + start))); //no multiply, its a vector3u pointer)
 		}
 	}
 	else
 	{
 		if (num_instances > 0)
-			glDrawArraysInstanced(primitive, start, size, num_instances);
+			GL_COUNT(glDrawArraysInstanced(primitive, start, size, num_instances));
 		else
-			glDrawArrays(primitive, start, size);
+			GL_COUNT(glDrawArrays(primitive, start, size));
 	}
 
 	assert(glGetError() == GL_NO_ERROR);
@@ -277,45 +455,161 @@ void Mesh::drawCall(unsigned int primitive, int submesh_id, int num_instances)
 
 void Mesh::disableBuffers(Shader* shader)
 {
-	glDisableVertexAttribArray(vertex_location);
-	if (normal_location != -1) glDisableVertexAttribArray(normal_location);
-	if (uv_location != -1) glDisableVertexAttribArray(uv_location);
-	if (color_location != -1) glDisableVertexAttribArray(color_location);
-	if (bones_location != -1) glDisableVertexAttribArray(bones_location);
-	if (weights_location != -1) glDisableVertexAttribArray(weights_location);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);    //if crashes here, COMMENT THIS LINE ****************************
+	if (arena || bound_vao)
+		return; //stays bound for the next mesh, see resetBufferBindings
+
+	GL_COUNT(glDisableVertexAttribArray(vertex_location));
+	if (normal_location != -1) GL_COUNT(glDisableVertexAttribArray(normal_location));
+	if (uv_location != -1) GL_COUNT(glDisableVertexAttribArray(uv_location));
+	if (color_location != -1) GL_COUNT(glDisableVertexAttribArray(color_location));
+	if (bones_location != -1) GL_COUNT(glDisableVertexAttribArray(bones_location));
+	if (weights_location != -1) GL_COUNT(glDisableVertexAttribArray(weights_location));
+	GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, 0));    //if crashes here, COMMENT THIS LINE ****************************
 	assert(glGetError() == GL_NO_ERROR);
 }
 
-GLuint instances_buffer_id = 0;
+//instance data goes to a ring split in one region per frame in flight, every region is fenced when its frame ends
+//so the CPU never writes matrices the GPU may still be reading. It is persistently mapped when the driver supports
+//buffer storage, otherwise every write maps its range unsynchronized (safe because of the fences)
+#define INSTANCE_RING_FRAMES 3
+struct sInstanceRing {
+	GLuint buffer_id;
+	Uint8* mapped; //NULL if not persistent
+	unsigned int region_size; //in bytes
+	int region; //region of the current frame
+	unsigned int offset; //used bytes in the current region
+	GLsync fences[INSTANCE_RING_FRAMES];
+	bool persistent;
+};
+static sInstanceRing instance_ring = { 0, NULL, 0, 0, 0, { NULL, NULL, NULL }, false };
+
+static void waitInstanceFence(int region)
+{
+	GLsync& fence = instance_ring.fences[region];
+	if (!fence)
+		return;
+	while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+	glDeleteSync(fence);
+	fence = NULL;
+}
+
+static void createInstanceRing(unsigned int region_size)
+{
+	sInstanceRing& ring = instance_ring;
+	if (ring.buffer_id)
+	{
+		//wait for the GPU to be done with the old one
+		for (int i = 0; i < INSTANCE_RING_FRAMES; ++i)
+			waitInstanceFence(i);
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, ring.buffer_id);
+		if (ring.mapped)
+			glUnmapBuffer(GL_ARRAY_BUFFER_ARB);
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		glDeleteBuffersARB(1, &ring.buffer_id);
+	}
+
+	ring.region_size = region_size;
+	ring.region = 0;
+	ring.offset = 0;
+	ring.mapped = NULL;
+	ring.persistent = SDL_GL_ExtensionSupported("GL_ARB_buffer_storage") == SDL_TRUE;
+
+	GLsizeiptr total_size = (GLsizeiptr)region_size * INSTANCE_RING_FRAMES;
+	glGenBuffersARB(1, &ring.buffer_id);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, ring.buffer_id);
+	if (ring.persistent)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER_ARB, total_size, NULL, flags);
+		ring.mapped = (Uint8*)glMapBufferRange(GL_ARRAY_BUFFER_ARB, 0, total_size, flags);
+		if (!ring.mapped)
+		{
+			std::cout << "[WARN] instance ring could not be mapped persistently" << std::endl;
+			ring.persistent = false;
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+			glDeleteBuffersARB(1, &ring.buffer_id);
+			glGenBuffersARB(1, &ring.buffer_id);
+			glBindBufferARB(GL_ARRAY_BUFFER_ARB, ring.buffer_id);
+		}
+	}
+	if (!ring.persistent)
+		glBufferDataARB(GL_ARRAY_BUFFER_ARB, total_size, NULL, GL_STREAM_DRAW_ARB);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	checkGLErrors();
+}
+
+//copies the matrices to the ring and returns their offset in the buffer
+static unsigned int writeInstances(const Matrix44* instanced_models, int num_instances)
+{
+	sInstanceRing& ring = instance_ring;
+	unsigned int size = num_instances * sizeof(Matrix44);
+	if (!ring.buffer_id || ring.offset + size > ring.region_size)
+	{
+		//doesnt fit in this frame, grow (wastes the rest of the frame, only happens while the scene grows)
+		unsigned int region_size = ring.region_size ? ring.region_size : 64 * 1024;
+		while (region_size < (ring.offset + size) * 2)
+			region_size *= 2;
+		createInstanceRing(region_size);
+	}
+
+	unsigned int offset = ring.region * ring.region_size + ring.offset;
+	if (ring.mapped)
+		memcpy(ring.mapped + offset, instanced_models, size);
+	else
+	{
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, ring.buffer_id);
+		void* ptr = glMapBufferRange(GL_ARRAY_BUFFER_ARB, offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		if (ptr)
+		{
+			memcpy(ptr, instanced_models, size);
+			glUnmapBuffer(GL_ARRAY_BUFFER_ARB);
+		}
+		else
+			glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, offset, size, instanced_models);
+	}
+	ring.offset += (size + 255) & ~255; //keep every block aligned
+	return offset;
+}
+
+void Mesh::nextInstancesFrame()
+{
+	sInstanceRing& ring = instance_ring;
+	if (!ring.buffer_id || !ring.offset)
+		return; //nothing was written this frame, the region can be reused
+
+	ring.fences[ring.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring.region = (ring.region + 1) % INSTANCE_RING_FRAMES;
+	ring.offset = 0;
+	waitInstanceFence(ring.region); //only blocks if the GPU is more than two frames behind
+}
 
-//should be faster but in some system it is slower
 void Mesh::renderInstanced(unsigned int primitive, const Matrix44* instanced_models, int num_instances)
 {
-	if (!num_instances)
+	if (!num_instances || load_state != LOADED)
 		return;
+	touch();
 
 	Shader* shader = Shader::current;
 	assert(shader && "shader must be enabled");
 
-	if (instances_buffer_id == 0)
-		glGenBuffersARB(1, &instances_buffer_id);
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB, instances_buffer_id);
-	glBufferDataARB(GL_ARRAY_BUFFER_ARB, num_instances * sizeof(Matrix44), instanced_models, GL_STREAM_DRAW_ARB);
-
 	int attribLocation = shader->getAttribLocation("u_model");
 	assert(attribLocation != -1 && "shader must have attribute mat4 u_model (not a uniform)");
 	if (attribLocation == -1)
 		return; //this shader doesnt support instanced model
 
+	//the instance attributes must not end inside a VAO
+	resetBufferBindings();
+
+	unsigned int offset = writeInstances(instanced_models, num_instances);
+	GL_COUNT(glBindBufferARB(GL_ARRAY_BUFFER_ARB, instance_ring.buffer_id));
+
 	//mat4 count as 4 different attributes of vec4... (thanks opengl...)
 	for (int k = 0; k < 4; ++k)
 	{
-		glEnableVertexAttribArray(attribLocation + k );
-		int offset = sizeof(float) * 4 * k;
-		const Uint8* addr = (Uint8*) offset;
-		glVertexAttribPointer(attribLocation + k, 4, GL_FLOAT, false, sizeof(Matrix44), addr); 
-		glVertexAttribDivisor(attribLocation + k, 1); // This makes it instanced!
+		GL_COUNT(glEnableVertexAttribArray(attribLocation + k));
+		const Uint8* addr = (Uint8*)NULL + offset + sizeof(float) * 4 * k;
+		GL_COUNT(glVertexAttribPointer(attribLocation + k, 4, GL_FLOAT, false, sizeof(Matrix44), addr));
+		GL_COUNT(glVertexAttribDivisor(attribLocation + k, 1)); // This makes it instanced!
 	}
 
 	//regular render
@@ -324,14 +618,15 @@ void Mesh::renderInstanced(unsigned int primitive, const Matrix44* instanced_mod
 	//disable instanced attribs
 	for (int k = 0; k < 4; ++k)
 	{
-		glDisableVertexAttribArray(attribLocation + k);
-		glVertexAttribDivisor(attribLocation + k, 0);
+		GL_COUNT(glDisableVertexAttribArray(attribLocation + k));
+		GL_COUNT(glVertexAttribDivisor(attribLocation + k, 0));
 	}
 }
 
 //super obsolete rendering method, do not use
 void Mesh::renderFixedPipeline(int primitive)
 {
+	resetBufferBindings();
 	assert((vertices.size() || interleaved.size()) && "No vertices in this mesh");
 
 	int interleave_offset = interleaved.size() ? sizeof(tInterleaved) : 0;
@@ -424,6 +719,17 @@ void Mesh::uploadToVRAM()
 		exit(0);
 	}
 
+	//buffers could change
+	deleteVAOs();
+
+	//meshes with the common layout go to the shared arenas
+	if (use_geometry_arena && interleaved.size() && !colors.size() && !bones.size() && !weights.size())
+	{
+		uploadToArena();
+		return;
+	}
+	releaseFromArena();
+
 	if (interleaved.size())
 	{
 		// Vertex,Normal,UV
@@ -502,6 +808,68 @@ void Mesh::uploadToVRAM()
 	//clear buffers to save memory
 }
 
+void Mesh::uploadToArena()
+{
+	unsigned int num_vertices = interleaved.size();
+	unsigned int num_indices = indices.size() * 3;
+
+	//reuse the range if the size didnt change
+	if (arena && (num_vertices != arena_num_vertices || num_indices != arena_num_indices))
+		releaseFromArena();
+	if (!arena)
+	{
+		arena = GeometryArena::allocateInArenas(sizeof(tInterleaved), num_vertices, num_indices, arena_vertex_offset, arena_index_offset);
+		arena_num_vertices = num_vertices;
+		arena_num_indices = num_indices;
+	}
+
+	arena->uploadVertices(arena_vertex_offset, &interleaved[0], num_vertices);
+	if (num_indices)
+		arena->uploadIndices(arena_index_offset, (const unsigned int*)&indices[0], num_indices);
+
+	checkGLErrors();
+}
+
+void Mesh::releaseFromArena()
+{
+	if (!arena)
+		return;
+	arena->release(arena_vertex_offset, arena_num_vertices, arena_index_offset, arena_num_indices);
+	arena = NULL;
+	arena_vertex_offset = arena_index_offset = arena_num_vertices = arena_num_indices = 0;
+}
+
+size_t Mesh::getCPUBytes()
+{
+	return vertices.capacity() * sizeof(Vector3) + normals.capacity() * sizeof(Vector3) + uvs.capacity() * sizeof(Vector2) + colors.capacity() * sizeof(Vector4)
+		+ interleaved.capacity() * sizeof(tInterleaved) + indices.capacity() * sizeof(Vector3u) + bones.capacity() * sizeof(Vector4ub) + weights.capacity() * sizeof(Vector4);
+}
+
+size_t Mesh::getGPUBytes()
+{
+	if (arena)
+		return (size_t)arena_num_vertices * sizeof(tInterleaved) + (size_t)arena_num_indices * sizeof(unsigned int);
+	size_t bytes = 0;
+	if (interleaved_vbo_id) bytes += interleaved.size() * sizeof(tInterleaved);
+	if (vertices_vbo_id) bytes += vertices.size() * sizeof(Vector3);
+	if (normals_vbo_id) bytes += normals.size() * sizeof(Vector3);
+	if (uvs_vbo_id) bytes += uvs.size() * sizeof(Vector2);
+	if (colors_vbo_id) bytes += colors.size() * sizeof(Vector4);
+	if (bones_vbo_id) bytes += bones.size() * sizeof(Vector4ub);
+	if (weights_vbo_id) bytes += weights.size() * sizeof(Vector4);
+	if (indices_vbo_id) bytes += indices.size() * sizeof(Vector3u);
+	return bytes;
+}
+
+//the lazy creation of the queries, two threads can query the same mesh for the first time
+static std::mutex collision_mutex;
+
+bool Mesh::ensureCollisionModel()
+{
+	std::lock_guard<std::mutex> lock(collision_mutex);
+	return collision_model || createCollisionModel();
+}
+
 bool Mesh::createCollisionModel(bool is_static)
 {
 	if (collision_model)
@@ -565,9 +933,8 @@ bool Mesh::createCollisionModel(bool is_static)
 //help: model is the transform of the mesh, ray origin and direction, a Vector3 where to store the collision if found, a Vector3 where to store the normal if there was a collision, max ray distance in case the ray should go to infintiy, and in_object_space to get the collision point in object space or world space
 bool Mesh::testRayCollision(Matrix44 model, Vector3 start, Vector3 front, Vector3& collision, Vector3& normal, float max_ray_dist, bool in_object_space )
 {
-	if (!this->collision_model)
-		if (!createCollisionModel())
-			return false;
+	if (!ensureCollisionModel())
+		return false;
 
 	CollisionModel3D* collision_model = (CollisionModel3D*)this->collision_model;
 	assert(collision_model && "CollisionModel3D must be created before using it, call createCollisionModel");
@@ -592,11 +959,125 @@ bool Mesh::testRayCollision(Matrix44 model, Vector3 start, Vector3 front, Vector
 	return true;
 }
 
+//returns the vertices of the triangle in the same order they were added to the collision model
+static void getCollisionTriangle(Mesh* mesh, int index, Vector3& a, Vector3& b, Vector3& c)
+{
+	if (mesh->indices.size())
+	{
+		Vector3u& tri = mesh->indices[index];
+		if (mesh->interleaved.size())
+		{
+			a = mesh->interleaved[tri.x].vertex;
+			b = mesh->interleaved[tri.y].vertex;
+			c = mesh->interleaved[tri.z].vertex;
+		}
+		else
+		{
+			a = mesh->vertices[tri.x];
+			b = mesh->vertices[tri.y];
+			c = mesh->vertices[tri.z];
+		}
+	}
+	else if (mesh->interleaved.size())
+	{
+		a = mesh->interleaved[index * 3].vertex;
+		b = mesh->interleaved[index * 3 + 1].vertex;
+		c = mesh->interleaved[index * 3 + 2].vertex;
+	}
+	else
+	{
+		a = mesh->vertices[index * 3];
+		b = mesh->vertices[index * 3 + 1];
+		c = mesh->vertices[index * 3 + 2];
+	}
+}
+
+#define RAY_PACKET_SIZE 16 //coldet supports up to 32
+
+int Mesh::testRayCollisionBatch(const Matrix44& model, const sRay* rays, int num_rays, sRayHit* hits, bool in_object_space, bool use_packets)
+{
+	if (!num_rays)
+		return 0;
+
+	if (!ensureCollisionModel())
+		return 0;
+
+	CollisionModel3D* collision_model = (CollisionModel3D*)this->collision_model;
+	assert(collision_model && "CollisionModel3D must be created before using it, call createCollisionModel");
+
+	//rays to object space, only once per batch
+	//directions are not normalized so distances remain in the same units than the input rays
+	Matrix44 inv = model;
+	inv.inverse();
+	std::vector<Vector3> origins(num_rays);
+	std::vector<Vector3> directions(num_rays);
+	std::vector<float> max_dists(num_rays);
+	for (int i = 0; i < num_rays; ++i)
+	{
+		origins[i] = inv * rays[i].origin;
+		directions[i] = inv.rotateVector(rays[i].direction);
+		max_dists[i] = rays[i].max_dist;
+	}
+
+	std::vector<int> triangles(num_rays, -1);
+	std::vector<float> tparms(num_rays);
+	std::vector<Vector3> points(num_rays);
+
+	//every job processes whole packets
+	int grain_size = use_packets ? RAY_PACKET_SIZE * 4 : 64;
+	WorkerPool::getGlobal()->parallelFor(num_rays, grain_size, [&](int start, int end) {
+		if (use_packets)
+		{
+			for (int i = start; i < end; i += RAY_PACKET_SIZE)
+			{
+				int num = end - i < RAY_PACKET_SIZE ? end - i : RAY_PACKET_SIZE;
+				collision_model->rayPacketCollisionModelSpace(num, origins[i].v, directions[i].v, &max_dists[i], true, points[i].v, &triangles[i], &tparms[i]);
+			}
+		}
+		else
+		{
+			for (int i = start; i < end; ++i)
+				collision_model->rayCollisionModelSpace(origins[i].v, directions[i].v, true, max_dists[i], points[i].v, NULL, triangles[i], tparms[i]);
+		}
+	});
+
+	int num_hits = 0;
+	for (int i = 0; i < num_rays; ++i)
+	{
+		sRayHit& hit = hits[i];
+		hit.triangle = triangles[i];
+		hit.hit = hit.triangle != -1;
+		if (!hit.hit)
+			continue;
+		num_hits++;
+		hit.distance = tparms[i];
+
+		Vector3 a, b, c;
+		getCollisionTriangle(this, hit.triangle, a, b, c);
+		if (in_object_space)
+			hit.collision = points[i];
+		else
+		{
+			hit.collision = rays[i].origin + rays[i].direction * tparms[i];
+			a = model * a;
+			b = model * b;
+			c = model * c;
+		}
+		//same normal than testRayCollision
+		Vector3 v1 = b - a;
+		Vector3 v2 = c - a;
+		v1.normalize();
+		v2.normalize();
+		hit.normal = v1.cross(v2);
+	}
+
+	return num_hits;
+}
+
 bool Mesh::testSphereCollision(Matrix44 model, Vector3 center, float radius, Vector3& collision, Vector3& normal)
 {
-	if (!this->collision_model)
-		if (!createCollisionModel())
-			return false;
+	if (!ensureCollisionModel())
+		return false;
 
 	CollisionModel3D* collision_model = (CollisionModel3D*)this->collision_model;
 	assert(collision_model && "CollisionModel3D must be created before using it, call createCollisionModel");
@@ -659,10 +1140,24 @@ typedef struct
 	int material_range[4];
 	Matrix44 bind_matrix;
 	char streams[8]; //Normal|Uvs|Color|Indices|Bones|Weights|Extra
-	char extra[32]; //unused
+	sCacheInfo cache; //size, date and hash of the source used to generate it
+	char extra[8]; //unused
 } sMeshInfo;
 
-bool Mesh::readBin(const char* filename)
+static void updateBinHeaderDate(const char* filename, const char* source, sMeshInfo& info)
+{
+	unsigned long long size;
+	if (!getFileInfo(source, size, info.cache.source_mtime))
+		return;
+	FILE* f = fopen(filename, "r+b");
+	if (!f)
+		return;
+	fseek(f, 4, SEEK_SET);
+	fwrite((void*)&info, sizeof(sMeshInfo), 1, f);
+	fclose(f);
+}
+
+bool Mesh::readBin(const char* filename, const char* source)
 {
 	FILE *f;
 	assert(filename);
@@ -694,8 +1189,20 @@ bool Mesh::readBin(const char* filename)
 	if(info.version != MESH_BIN_VERSION || info.header_bytes != sizeof(sMeshInfo) )
 	{
 		std::cout << "[WARN] loading BIN: old version: " << filename << std::endl;
+		delete[] data;
+		return false;
+	}
+
+	//check it was generated from the current version of the source
+	bool touched = false;
+	if (source && !isCacheValid(source, info.cache, touched))
+	{
+		std::cout << "[WARN] loading BIN: outdated: " << filename << std::endl;
+		delete[] data;
 		return false;
 	}
+	if (touched) //same content, store the new date so next time there is no need to hash it
+		updateBinHeaderDate(filename, source, info);
 
 	if (info.streams[0] == 'I')
 	{
@@ -782,8 +1289,7 @@ bool Mesh::readBin(const char* filename)
 bool Mesh::writeBin(const char* filename)
 {
 	assert( vertices.size() || interleaved.size() );
-	std::string s_filename = filename;
-	s_filename += ".mbin";
+	std::string s_filename = getCacheFilename(filename, ".mbin");
 
 	FILE* f = fopen(s_filename.c_str(),"wb");
 	if (f == NULL)
@@ -817,6 +1323,8 @@ bool Mesh::writeBin(const char* filename)
 	info.streams[5] = bones.size() ? 'B' : ' ';
 	info.streams[6] = weights.size() ? 'W' : ' ';
 
+	computeCacheInfo(filename, info.cache); //zeros if the source doesnt exist
+
 	for (unsigned int i = 0; i < 4; i++)
 		info.material_range[i] = material_range.size() > i ? material_range[i] : -1;
 
@@ -1359,6 +1867,9 @@ Mesh* wire_box = NULL;
 
 void Mesh::renderBounding( const Matrix44& model, bool world_bounding )
 {
+	if (load_state != LOADED)
+		return;
+
 	if (!wire_box)
 	{
 		wire_box = new Mesh();
@@ -1420,82 +1931,120 @@ Mesh* Mesh::getCube()
 }
 
 
-Mesh* Mesh::Get(const char* filename)
+static char getMeshFormat(const std::string& name)
 {
-	assert(filename);
-	std::map<std::string, Mesh*>::iterator it = sMeshesLoaded.find(filename);
-	if (it != sMeshesLoaded.end())
-		return it->second;
-
-	Mesh* m = new Mesh();
-	std::string name = filename;
-
-	//detect format
-	char file_format = 0;
 	std::string ext = name.substr(name.find_last_of(".")+1);
 	if (ext == "ase" || ext == "ASE")
-		file_format = FORMAT_ASE;
-	else if (ext == "obj" || ext == "OBJ")
-		file_format = FORMAT_OBJ;
-	else if (ext == "mbin" || ext == "MBIN")
-		file_format = FORMAT_MBIN;
-	else if (ext == "mesh" || ext == "MESH")
-		file_format = FORMAT_MESH;
+		return FORMAT_ASE;
+	if (ext == "obj" || ext == "OBJ")
+		return FORMAT_OBJ;
+	if (ext == "mbin" || ext == "MBIN")
+		return FORMAT_MBIN;
+	if (ext == "mesh" || ext == "MESH")
+		return FORMAT_MESH;
+	return 0;
+}
+
+//if the bin itself is requested, the source is the same name without the extension (it could not exist)
+static void getMeshSourceAndBin(const std::string& name, std::string& source, std::string& binfilename)
+{
+	if (getMeshFormat(name) == FORMAT_MBIN)
+	{
+		source = name.substr(0, name.find_last_of("."));
+		binfilename = getCacheFolder().size() ? getCacheFilename(source, ".mbin") : name;
+	}
 	else
 	{
-		std::cerr << "Unknown mesh format: " << filename << std::endl;
-		return NULL;
+		source = name;
+		binfilename = getCacheFilename(source, ".mbin");
 	}
+}
 
-	//stats
-	long time = getTime();
-	std::cout << " + Mesh loading: " << filename << " ... ";
-	std::string binfilename = filename;
+//loads the data from the binary or the ascii file, interleaves it and writes the binary version
+//it doesnt do any GL call so it can be executed from a worker thread
+bool Mesh::loadData(const char* filename, std::stringstream& log)
+{
+	std::string name = filename;
+	if (!getMeshFormat(name))
+	{
+		log << "[ERROR]: Unknown mesh format";
+		return false;
+	}
 
-	if (file_format != FORMAT_MBIN)
-		binfilename = binfilename + ".mbin";
+	std::string source, binfilename;
+	getMeshSourceAndBin(name, source, binfilename);
+	char file_format = getMeshFormat(source);
 
-	//try loading the binary version
-	if ( m->readBin(binfilename.c_str()) && use_binary )
+	//try loading the binary version, only if it is up to date with the source
+	if ( use_binary && readBin(binfilename.c_str(), source.c_str()) )
 	{
-		if(interleave_meshes && m->interleaved.size() == 0)
+		if(interleave_meshes && interleaved.size() == 0)
 		{
-			std::cout << "[INTERL] ";
-			m->interleaveBuffers();
+			log << "[INTERL] ";
+			interleaveBuffers();
 		}
-
-		if (auto_upload_to_vram)
-		{
-			std::cout << "[VRAM] ";
-			m->uploadToVRAM();
-		}
-
-		std::cout << "[OK BIN]  Faces: " << (m->interleaved.size() ? m->interleaved.size() : m->vertices.size()) / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
-		sMeshesLoaded[filename] = m;
-		return m;
+		log << "[OK BIN]  Faces: " << (interleaved.size() ? interleaved.size() : vertices.size()) / 3 << " ";
+		return true;
 	}
 
 	//load the ascii version
 	bool loaded = false;
 	if (file_format == FORMAT_OBJ)
-		loaded = m->loadOBJ(filename);
+		loaded = loadOBJ(source.c_str());
 	else if (file_format == FORMAT_ASE)
-		loaded = m->loadASE(filename);
+		loaded = loadASE(source.c_str());
 	else if (file_format == FORMAT_MESH)
-		loaded = m->loadMESH(filename);
+		loaded = loadMESH(source.c_str());
 
 	if (!loaded)
 	{
-		delete m;
-		std::cout << "[ERROR]: Mesh not found" << std::endl;
-		return NULL;
+		log << "[ERROR]: Mesh not found";
+		return false;
 	}
 
+	log << "[OK]  Faces: " << vertices.size() / 3 << " ";
+
 	//to optimize, interleave the meshes
 	if (interleave_meshes)
 	{
-		std::cout << "[INTERL] ";
-		m->interleaveBuffers();
+		log << "[INTERL] ";
+		interleaveBuffers();
+	}
+
+	if (use_binary)
+	{
+		log << "[BIN WRITTEN] ";
+		writeBin(source.c_str());
+	}
+
+	return true;
+}
+
+Mesh* Mesh::Get(const char* filename)
+{
+	assert(filename);
+	std::map<std::string, Mesh*>::iterator it = sMeshesLoaded.find(filename);
+	if (it != sMeshesLoaded.end())
+	{
+		Mesh* m = it->second;
+		m->touch();
+		if (m->load_state == LOADING) //requested with GetAsync and still in flight
+			m->waitAsyncLoad();
+		return m->load_state == LOADED ? m : NULL;
+	}
+
+	Mesh* m = new Mesh();
+
+	//stats
+	long time = getTime();
+	std::stringstream log;
+	bool loaded = m->loadData(filename, log);
+	std::cout << " + Mesh loading: " << filename << " ... " << log.str();
+	if (!loaded)
+	{
+		std::cout << std::endl;
+		delete m;
+		return NULL;
 	}
 
 	//and upload them to VRAM
@@ -1505,18 +2054,180 @@ Mesh* Mesh::Get(const char* filename)
 		m->uploadToVRAM();
 	}
 
-	std::cout << "[OK]  Faces: " << m->vertices.size() / 3 << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
-	if (use_binary)
+	std::cout << "Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+	m->registerMesh(filename);
+	return m;
+}
+
+//async loading *************************************
+
+struct sAsyncMeshLoad {
+	Mesh* mesh;
+	bool loaded;
+	std::string log;
+	long start_time;
+};
+
+static std::mutex async_mutex;
+static std::condition_variable async_loaded; //signaled when a job finishes
+static std::deque<sAsyncMeshLoad> async_finished; //meshes loaded in the workers waiting for the upload
+static int async_in_flight = 0;
+
+Mesh* Mesh::GetAsync(const char* filename)
+{
+	assert(filename);
+	std::map<std::string, Mesh*>::iterator it = sMeshesLoaded.find(filename);
+	if (it != sMeshesLoaded.end())
 	{
-		std::cout << "\t\t Writing .BIN ... ";
-		m->writeBin(filename);
-		std::cout << "[OK]" << std::endl;
+		it->second->touch();
+		return it->second; //already loaded or in flight, same handle
 	}
 
-	m->registerMesh(name);
+	//registered now so requesting it again returns this same handle
+	Mesh* m = new Mesh();
+	m->load_state = LOADING;
+	m->registerMesh(filename);
+
+	{
+		std::unique_lock<std::mutex> lock(async_mutex);
+		async_in_flight++;
+	}
+
+	std::string name = filename;
+	WorkerPool::getGlobal()->addJob([m, name]() {
+		sAsyncMeshLoad job;
+		job.mesh = m;
+		job.start_time = getTime();
+		std::stringstream log;
+		job.loaded = m->loadData(name.c_str(), log);
+		job.log = log.str();
+		{
+			std::unique_lock<std::mutex> lock(async_mutex);
+			async_finished.push_back(job);
+		}
+		async_loaded.notify_all();
+	});
+
 	return m;
 }
 
+//called from the main thread once the worker has finished with the mesh
+static void finishAsyncLoad(sAsyncMeshLoad& job)
+{
+	Mesh* m = job.mesh;
+	std::cout << " + Mesh loading (async): " << m->name << " ... " << job.log;
+	if (!job.loaded)
+	{
+		//remove it so it can be requested again, the handle remains valid but empty
+		std::cout << std::endl;
+		m->load_state = Mesh::LOAD_FAILED;
+		std::map<std::string, Mesh*>::iterator it = Mesh::sMeshesLoaded.find(m->name);
+		if (it != Mesh::sMeshesLoaded.end() && it->second == m)
+			Mesh::sMeshesLoaded.erase(it);
+		return;
+	}
+
+	if (Mesh::auto_upload_to_vram)
+	{
+		std::cout << "[VRAM] ";
+		m->uploadToVRAM();
+	}
+	m->load_state = Mesh::LOADED;
+	std::cout << "Time: " << (getTime() - job.start_time) * 0.001 << "sec" << std::endl;
+}
+
+void Mesh::waitAsyncLoad()
+{
+	while (load_state == LOADING)
+	{
+		sAsyncMeshLoad job;
+		{
+			std::unique_lock<std::mutex> lock(async_mutex);
+			std::deque<sAsyncMeshLoad>::iterator it;
+			async_loaded.wait(lock, [this, &it]() {
+				for (it = async_finished.begin(); it != async_finished.end(); ++it)
+					if (it->mesh == this)
+						return true;
+				return false;
+			});
+			job = *it;
+			async_finished.erase(it);
+			async_in_flight--;
+		}
+		finishAsyncLoad(job);
+	}
+}
+
+int Mesh::processPendingUploads(float budget_ms)
+{
+	long start = getTime();
+	int num = 0;
+	while (true)
+	{
+		sAsyncMeshLoad job;
+		{
+			std::unique_lock<std::mutex> lock(async_mutex);
+			if (async_finished.empty())
+				break;
+			job = async_finished.front();
+			async_finished.pop_front();
+			async_in_flight--;
+		}
+		finishAsyncLoad(job);
+		num++;
+
+		//at least one per frame, the rest while we have time
+		if ((getTime() - start) >= budget_ms)
+			break;
+	}
+	return num;
+}
+
+int Mesh::getNumAsyncLoads()
+{
+	std::unique_lock<std::mutex> lock(async_mutex);
+	return async_in_flight;
+}
+
+bool Mesh::isBinUpToDate(const char* filename)
+{
+	std::string source, binfilename;
+	getMeshSourceAndBin(filename, source, binfilename);
+
+	//only the header is needed
+	FILE* f = fopen(binfilename.c_str(), "rb");
+	if (!f)
+		return false;
+	char watermark[4];
+	sMeshInfo info;
+	bool ok = fread(watermark, 4, 1, f) == 1 && fread(&info, sizeof(sMeshInfo), 1, f) == 1;
+	fclose(f);
+	if (!ok || memcmp(watermark, "MBIN", 4) != 0 || info.version != MESH_BIN_VERSION || info.header_bytes != sizeof(sMeshInfo))
+		return false;
+
+	bool touched = false;
+	if (!isCacheValid(source.c_str(), info.cache, touched))
+		return false;
+	if (touched)
+		updateBinHeaderDate(binfilename.c_str(), source.c_str(), info);
+	return true;
+}
+
+bool Mesh::updateBin(const char* filename, bool& rebuilt)
+{
+	rebuilt = false;
+	if (isBinUpToDate(filename))
+		return true;
+
+	//loadData writes the bin when it parses the source
+	Mesh mesh;
+	std::stringstream log;
+	if (!mesh.loadData(filename, log))
+		return false;
+	rebuilt = true;
+	return true;
+}
+
 void Mesh::registerMesh( std::string name )
 {
 	this->name = name;
@@ -3,33 +3,62 @@
 
 #include <vector>
 #include "framework.h"
+#include "assetcache.h"
 
 #include <map>
 #include <string>
+#include <sstream>
 
 class Shader; //for binding
 class Image; //for displace
 class Skeleton; //for skinned meshes
+class GeometryArena; //for shared buffers
 
-#define MESH_BIN_VERSION 7 //this is used to regenerate bins if the format changes
+#define MESH_BIN_VERSION 8 //this is used to regenerate bins if the format changes
+
+//for batched ray queries
+struct sRay {
+	Vector3 origin;
+	Vector3 direction;
+	float max_dist;
+	sRay() { max_dist = 3.4e+38F; }
+	sRay(const Vector3& o, const Vector3& d, float max_dist = 3.4e+38F) { origin = o; direction = d; this->max_dist = max_dist; }
+};
+
+struct sRayHit {
+	bool hit;
+	int triangle; //index of the triangle hit, -1 if none
+	float distance; //in units of the ray direction
+	Vector3 collision;
+	Vector3 normal;
+};
 
 struct BoneInfo {
 	char name[32]; //max 32 chars per bone name
 	Matrix44 bind_pose;
 };
 
-class Mesh
+class Mesh : public Asset
 {
 public:
 	static std::map<std::string, Mesh*> sMeshesLoaded;
 	static bool use_binary; //always load the binary version of a mesh when possible
 	static bool interleave_meshes; //loaded meshes will me automatically interleaved
 	static bool auto_upload_to_vram; //loaded meshes will be stored in the VRAM
+	static bool use_geometry_arena; //interleaved meshes (without colors or bones) are uploaded to the shared arenas
 	static long num_meshes_rendered;
 	static long num_triangles_rendered;
+	static long num_gl_calls; //done to draw the meshes (binds, pointers and draws)
+	static bool use_vao; //cache the attribute setup in VAOs
+	static bool vao_supported; //set at startup from the GL version or GL_ARB_vertex_array_object
 
 	std::string name;
 
+	//meshes requested with GetAsync are not ready till the upload is done
+	enum eLoadState { LOADED, LOADING, LOAD_FAILED };
+	eLoadState load_state;
+	bool isLoaded() { return load_state == LOADED; }
+
 	std::vector<std::string> material_name; 
 	std::vector<unsigned int> material_range; 
 
@@ -70,6 +99,15 @@ public:
 	unsigned int bones_vbo_id;
 	unsigned int weights_vbo_id;
 
+	//when stored in a shared arena instead of in its own VBOs
+	GeometryArena* arena;
+	unsigned int arena_vertex_offset; //base vertex
+	unsigned int arena_index_offset;
+	unsigned int arena_num_vertices;
+	unsigned int arena_num_indices;
+
+	std::map<unsigned int, unsigned int> vaos; //shader attribute layout -> VAO (not used when in an arena, the arena has them)
+
 	Mesh();
 	~Mesh();
 
@@ -77,16 +115,22 @@ public:
 
 	void render( unsigned int primitive, int submesh_id = 0, int num_instances = 0 );
 	void renderInstanced(unsigned int primitive, const Matrix44* instanced_models, int number);
+	static void nextInstancesFrame(); //call it once the frame is rendered, the instance matrices go to a triple buffered ring
 	void renderBounding( const Matrix44& model, bool world_bounding = true );
 	void renderFixedPipeline(int primitive); //sloooooooow
 	void renderAnimated(unsigned int primitive, Skeleton *sk);
 
-	void enableBuffers(Shader* shader);
+	void enableBuffers(Shader* shader, bool allow_vao = true);
 	void drawCall(unsigned int primitive, int submesh_id, int num_instances);
 	void disableBuffers(Shader* shader);
+	static void resetBufferBindings(); //arena buffers stay bound between draws, call it before touching the attributes from outside
 
-	bool readBin(const char* filename);
-	bool writeBin(const char* filename);
+	bool readBin(const char* filename, const char* source = NULL); //if source is given the bin is rejected when it is outdated
+	bool writeBin(const char* filename); //filename is the source, the bin goes to getCacheFilename(filename,".mbin")
+
+	//asset cache
+	static bool isBinUpToDate(const char* filename); //only reads the header
+	static bool updateBin(const char* filename, bool& rebuilt); //regenerates the bin if it is outdated, no GL calls
 
 	unsigned int getNumSubmaterials() { return material_name.size(); }
 	unsigned int getNumSubmeshes() { return material_range.size(); }
@@ -95,12 +139,23 @@ public:
 	//collision testing
 	void* collision_model;
 	bool createCollisionModel(bool is_static = false); //is_static sets if the inv matrix should be computed after setTransform (true) or before rayCollision (false)
+	bool ensureCollisionModel(); //creates it under a lock if it doesn't exist, the queries call it
 	//help: model is the transform of the mesh, ray origin and direction, a Vector3 where to store the collision if found, a Vector3 where to store the normal if there was a collision, max ray distance in case the ray should go to infintiy, and in_object_space to get the collision point in object space or world space
 	bool testRayCollision( Matrix44 model, Vector3 ray_origin, Vector3 ray_direction, Vector3& collision, Vector3& normal, float max_ray_dist = 3.4e+38F, bool in_object_space = false );
 	bool testSphereCollision(Matrix44 model, Vector3 center, float radius, Vector3& collision, Vector3& normal);
+	//tests many rays at once, rays are transformed once to object space and split among the worker threads
+	//use_packets traverses the tree with groups of rays, faster when they are coherent (like AO or visibility samples from the same point)
+	//it is thread safe (the collision model is created under a lock) and returns the number of rays that collided
+	int testRayCollisionBatch(const Matrix44& model, const sRay* rays, int num_rays, sRayHit* hits, bool in_object_space = false, bool use_packets = true);
 
 	//loader
-	static Mesh* Get(const char* filename);
+	static Mesh* Get(const char* filename); //if the mesh is being loaded async it waits for it
+	//returns the handle immediately, the file is loaded in a worker and uploaded from processPendingUploads
+	static Mesh* GetAsync(const char* filename);
+	//call it once per frame from the main thread, uploads the meshes already loaded (at least one) while there is time left
+	static int processPendingUploads(float budget_ms = 2.0f);
+	static int getNumAsyncLoads(); //meshes still in flight
+	void waitAsyncLoad();
 	void registerMesh(std::string name);
 
 	//create help meshes
@@ -118,9 +173,21 @@ public:
 
 	//optimize meshes
 	void uploadToVRAM();
+	void uploadToArena();
+	void releaseFromArena();
 	bool interleaveBuffers();
 
+	//memory for the AssetCache
+	size_t getCPUBytes();
+	size_t getGPUBytes(); //of its VBOs or its ranges in the arena
+
 private:
+	void enableArenaBuffers(Shader* shader);
+	void setupArenaAttributes(Shader* shader);
+	void setupAttributes(Shader* shader);
+	void bindVAO(Shader* shader);
+	void deleteVAOs();
+	bool loadData(const char* filename, std::stringstream& log); //no GL calls, thread safe
 	bool loadASE(const char* filename);
 	bool loadOBJ(const char* filename);
 	bool loadMESH(const char* filename); //personal format used for animations
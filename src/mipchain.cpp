@@ -0,0 +1,213 @@
+#include "mipchain.h"
+#include "texture.h"
+#include "workerpool.h"
+#include "pngdecoder.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define USE_SSE_MIPS
+	#include <emmintrin.h>
+#endif
+
+namespace {
+
+const int MAX_TAPS = 16;
+const float FILTER_WIDTH = 2.0f; //in pixels of the destination
+const float KAISER_ALPHA = 4.0f;
+
+//taps of the filter for one pixel of the destination (indices already wrapped or clamped)
+struct sFilterTaps {
+	int count;
+	int index[MAX_TAPS];
+	float weight[MAX_TAPS];
+};
+
+float bessel0(float x)
+{
+	float sum = 1.0f, term = 1.0f;
+	for (int k = 1; k < 16; ++k)
+	{
+		float f = x / (2.0f * k);
+		term *= f * f;
+		sum += term;
+	}
+	return sum;
+}
+
+float kaiserSinc(float t)
+{
+	if (std::abs(t) >= FILTER_WIDTH)
+		return 0.0f;
+	float sinc = t == 0.0f ? 1.0f : sinf((float)PI * t) / ((float)PI * t);
+	float r = t / FILTER_WIDTH;
+	return sinc * bessel0(KAISER_ALPHA * sqrtf(1.0f - r * r)) / bessel0(KAISER_ALPHA);
+}
+
+void computeTaps(int src_size, int dst_size, bool repeat, std::vector<sFilterTaps>& taps)
+{
+	taps.resize(dst_size);
+	float scale = (float)src_size / dst_size;
+	for (int x = 0; x < dst_size; ++x)
+	{
+		sFilterTaps& t = taps[x];
+		t.count = 0;
+		if (src_size == dst_size) //the other axis is already 1 pixel
+		{
+			t.count = 1;
+			t.index[0] = x;
+			t.weight[0] = 1.0f;
+			continue;
+		}
+		float center = (x + 0.5f) * scale;
+		int first = (int)floorf(center - FILTER_WIDTH * scale);
+		int last = (int)ceilf(center + FILTER_WIDTH * scale);
+		float total = 0.0f;
+		for (int i = first; i <= last && t.count < MAX_TAPS; ++i)
+		{
+			float w = kaiserSinc((i + 0.5f - center) / scale);
+			if (w == 0.0f)
+				continue;
+			int index = repeat ? ((i % src_size) + src_size) % src_size : std::min(std::max(i, 0), src_size - 1);
+			t.index[t.count] = index;
+			t.weight[t.count] = w;
+			t.count++;
+			total += w;
+		}
+		for (int i = 0; i < t.count; ++i)
+			t.weight[i] /= total;
+	}
+}
+
+//acc[i] += row[i] * w
+inline void addScaledRow(float* acc, const float* row, float w, int num)
+{
+	int i = 0;
+#ifdef USE_SSE_MIPS
+	__m128 weight = _mm_set1_ps(w);
+	for (; i + 4 <= num; i += 4)
+		_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(_mm_loadu_ps(row + i), weight)));
+#endif
+	for (; i < num; ++i)
+		acc[i] += row[i] * w;
+}
+
+//half of the size: horizontal pass to a temporary buffer and vertical pass to dst, both in bands of rows
+void reduce(const std::vector<float>& src, int width, int height, std::vector<float>& dst, int dst_width, int dst_height, bool repeat)
+{
+	std::vector<sFilterTaps> taps_x, taps_y;
+	computeTaps(width, dst_width, repeat, taps_x);
+	computeTaps(height, dst_height, repeat, taps_y);
+
+	std::vector<float> temp((size_t)dst_width * height * 4);
+	WorkerPool* pool = WorkerPool::getGlobal();
+	pool->parallelFor(height, 16, [&](int start, int end) {
+		for (int y = start; y < end; ++y)
+		{
+			const float* row = &src[(size_t)y * width * 4];
+			float* out = &temp[(size_t)y * dst_width * 4];
+			for (int x = 0; x < dst_width; ++x)
+			{
+				const sFilterTaps& t = taps_x[x];
+#ifdef USE_SSE_MIPS
+				__m128 acc = _mm_setzero_ps();
+				for (int i = 0; i < t.count; ++i)
+					acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(row + t.index[i] * 4), _mm_set1_ps(t.weight[i])));
+				_mm_storeu_ps(out + x * 4, acc);
+#else
+				float acc[4] = { 0, 0, 0, 0 };
+				for (int i = 0; i < t.count; ++i)
+					for (int c = 0; c < 4; ++c)
+						acc[c] += row[t.index[i] * 4 + c] * t.weight[i];
+				memcpy(out + x * 4, acc, sizeof(acc));
+#endif
+			}
+		}
+	});
+
+	dst.assign((size_t)dst_width * dst_height * 4, 0.0f);
+	pool->parallelFor(dst_height, 16, [&](int start, int end) {
+		for (int y = start; y < end; ++y)
+		{
+			const sFilterTaps& t = taps_y[y];
+			float* out = &dst[(size_t)y * dst_width * 4];
+			for (int i = 0; i < t.count; ++i)
+				addScaledRow(out, &temp[(size_t)t.index[i] * dst_width * 4], t.weight[i], dst_width * 4);
+			//the negative lobes can go out of range
+			for (int i = 0; i < dst_width * 4; ++i)
+				out[i] = std::min(1.0f, std::max(0.0f, out[i]));
+		}
+	});
+}
+
+float srgbToLinear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float c)
+{
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+} //namespace
+
+void MipChain::build(Image* image, eTextureRole role, bool repeat)
+{
+	assert(image && image->data);
+	width = image->width;
+	height = image->height;
+	levels.clear();
+
+	//the first level is the image itself
+	size_t num_pixels = (size_t)width * height;
+	levels.push_back(std::vector<uint8>(num_pixels * 4));
+	expandToRGBA(image->data, &levels[0][0], num_pixels, image->bytes_per_pixel);
+
+	bool srgb = role == ROLE_COLOR;
+	float to_float[256];
+	for (int i = 0; i < 256; ++i)
+		to_float[i] = srgb ? srgbToLinear(i / 255.0f) : i / 255.0f;
+
+	std::vector<float> current(num_pixels * 4);
+	for (size_t i = 0; i < num_pixels * 4; ++i)
+		current[i] = (i & 3) == 3 ? levels[0][i] / 255.0f : to_float[levels[0][i]]; //alpha is always linear
+
+	int w = width;
+	int h = height;
+	std::vector<float> next;
+	while (w > 1 || h > 1)
+	{
+		int next_w = std::max(1, w / 2);
+		int next_h = std::max(1, h / 2);
+		reduce(current, w, h, next, next_w, next_h, repeat);
+		current.swap(next);
+		w = next_w;
+		h = next_h;
+
+		levels.push_back(std::vector<uint8>((size_t)w * h * 4));
+		uint8* out = &levels.back()[0];
+		WorkerPool::getGlobal()->parallelFor(h, 16, [&](int start, int end) {
+			for (size_t i = (size_t)start * w; i < (size_t)end * w; ++i)
+			{
+				float* p = &current[i * 4];
+				if (role == ROLE_NORMAL) //the average of the normals is shorter, the next level is made from the unit ones
+				{
+					float n[3] = { p[0] * 2.0f - 1.0f, p[1] * 2.0f - 1.0f, p[2] * 2.0f - 1.0f };
+					float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+					if (length > 1e-5f)
+						for (int c = 0; c < 3; ++c)
+							p[c] = n[c] / length * 0.5f + 0.5f;
+				}
+				for (int c = 0; c < 4; ++c)
+				{
+					float v = srgb && c < 3 ? linearToSrgb(p[c]) : p[c];
+					out[i * 4 + c] = (uint8)(v * 255.0f + 0.5f);
+				}
+			}
+		});
+	}
+}
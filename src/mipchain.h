@@ -0,0 +1,31 @@
+#ifndef MIPCHAIN_H
+#define MIPCHAIN_H
+
+#include "framework.h"
+#include "texturecompressor.h"
+#include <vector>
+
+class Image;
+
+//MipChain
+//mips of an image computed on the CPU, so they can be stored in the texture cache instead of using glGenerateMipmap:
+//every level is the previous one reduced to the half with a separable Kaiser windowed sinc (sharper than the box filter
+//and without its aliasing). The color maps are sRGB so they are filtered in linear space, and the normals are renormalized.
+//The levels are kept in floats between steps, the passes use SSE over the RGBA of a pixel and bands of rows in parallel.
+
+class MipChain {
+public:
+	int width;
+	int height;
+	std::vector< std::vector<uint8> > levels; //RGBA, from the full size to 1x1 (every size is the half rounded down)
+
+	MipChain() { width = height = 0; }
+
+	//repeat: the filter wraps around the borders (tiled textures), otherwise the borders are clamped
+	void build(Image* image, eTextureRole role, bool repeat);
+
+	static int getLevelSize(int size, int level) { size >>= level; return size > 0 ? size : 1; }
+	int getNumLevels() { return (int)levels.size(); }
+};
+
+#endif
@@ -0,0 +1,992 @@
+#include "pngdecoder.h"
+#include "framework.h"
+#include "utils.h"
+#include "extra/picopng.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define USE_SSE_PNG
+	#include <emmintrin.h>
+#endif
+
+namespace {
+
+// INFLATE *************************
+
+const int FAST_BITS = 9; //codes up to this length are decoded with a single lookup
+
+struct sHuffman {
+	uint16 fast[1 << FAST_BITS]; //(length << 9) | symbol, 0 if the code is longer than FAST_BITS
+	uint16 firstcode[16];
+	int maxcode[17]; //first code of the next length, shifted to 16 bits
+	uint16 firstsymbol[16];
+	uint8 size[288];
+	uint16 value[288];
+};
+
+const int length_base[31] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258,0,0 };
+const int length_extra[31] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0,0,0 };
+const int dist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577,0,0 };
+const int dist_extra[32] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13,0,0 };
+
+inline int bitReverse16(int v)
+{
+	v = ((v & 0xAAAA) >> 1) | ((v & 0x5555) << 1);
+	v = ((v & 0xCCCC) >> 2) | ((v & 0x3333) << 2);
+	v = ((v & 0xF0F0) >> 4) | ((v & 0x0F0F) << 4);
+	v = ((v & 0xFF00) >> 8) | ((v & 0x00FF) << 8);
+	return v;
+}
+
+//canonical huffman from the code lengths (like zlib and stb_image)
+bool buildHuffman(sHuffman& h, const uint8* lengths, int num)
+{
+	int sizes[17];
+	int next_code[16];
+	memset(sizes, 0, sizeof(sizes));
+	memset(h.fast, 0, sizeof(h.fast));
+	for (int i = 0; i < num; ++i)
+		++sizes[lengths[i]];
+	sizes[0] = 0;
+	for (int i = 1; i < 16; ++i)
+		if (sizes[i] > (1 << i))
+			return false;
+
+	int code = 0;
+	int k = 0;
+	for (int i = 1; i < 16; ++i)
+	{
+		next_code[i] = code;
+		h.firstcode[i] = (uint16)code;
+		h.firstsymbol[i] = (uint16)k;
+		code += sizes[i];
+		if (sizes[i] && code - 1 >= (1 << i))
+			return false; //oversubscribed
+		h.maxcode[i] = code << (16 - i);
+		code <<= 1;
+		k += sizes[i];
+	}
+	h.maxcode[16] = 0x10000;
+
+	for (int i = 0; i < num; ++i)
+	{
+		int s = lengths[i];
+		if (!s)
+			continue;
+		int c = next_code[s] - h.firstcode[s] + h.firstsymbol[s];
+		h.size[c] = (uint8)s;
+		h.value[c] = (uint16)i;
+		if (s <= FAST_BITS)
+		{
+			//the bits are read from the lowest, so the code is reversed and every entry that starts with it is filled
+			for (int j = bitReverse16(next_code[s]) >> (16 - s); j < (1 << FAST_BITS); j += (1 << s))
+				h.fast[j] = (uint16)((s << 9) | i);
+		}
+		++next_code[s];
+	}
+	return true;
+}
+
+struct sInflater {
+	const uint8* pos;
+	const uint8* end;
+	unsigned long long bits; //the next bits are the lowest
+	int num_bits;
+	int overrun; //zero bytes added after the end of the data
+	uint8* out;
+	uint8* out_start;
+	uint8* out_end; //the buffer has 8 bytes more, the copies of the matches write in blocks of 8
+
+	void refill()
+	{
+		if (end - pos >= 8)
+		{
+			//as many whole bytes as fit (little endian, like every platform the framework runs on)
+			unsigned long long v;
+			memcpy(&v, pos, 8);
+			bits |= v << num_bits;
+			int n = (63 - num_bits) >> 3;
+			pos += n;
+			num_bits += n << 3;
+			return;
+		}
+		while (num_bits <= 56)
+		{
+			if (pos < end)
+				bits |= (unsigned long long)*pos++ << num_bits;
+			else
+				overrun++;
+			num_bits += 8;
+		}
+	}
+
+	inline int getBits(int n)
+	{
+		if (num_bits < n)
+			refill();
+		int v = (int)(bits & ((1ULL << n) - 1));
+		bits >>= n;
+		num_bits -= n;
+		return v;
+	}
+
+	inline int decode(const sHuffman& h)
+	{
+		if (num_bits < 16)
+			refill();
+		int entry = h.fast[bits & ((1 << FAST_BITS) - 1)];
+		if (entry)
+		{
+			int s = entry >> 9;
+			bits >>= s;
+			num_bits -= s;
+			return entry & 511;
+		}
+		//longer code, compare with the first code of every length
+		int k = bitReverse16((int)(bits & 0xFFFF));
+		int s = FAST_BITS + 1;
+		while (k >= h.maxcode[s])
+			++s;
+		if (s >= 16)
+			return -1;
+		int b = (k >> (16 - s)) - h.firstcode[s] + h.firstsymbol[s];
+		if (b >= 288 || h.size[b] != s)
+			return -1;
+		bits >>= s;
+		num_bits -= s;
+		return h.value[b];
+	}
+
+	bool storedBlock()
+	{
+		//back to the byte where the block starts
+		bits >>= num_bits & 7;
+		num_bits -= num_bits & 7;
+		int buffered = (num_bits >> 3) - overrun;
+		if (buffered < 0)
+			return false;
+		pos -= buffered;
+		bits = 0;
+		num_bits = 0;
+		overrun = 0;
+
+		if (end - pos < 4)
+			return false;
+		int len = pos[0] | (pos[1] << 8);
+		int nlen = pos[2] | (pos[3] << 8);
+		pos += 4;
+		if (len != (~nlen & 0xFFFF) || end - pos < len || out_end - out < len)
+			return false;
+		memcpy(out, pos, len);
+		pos += len;
+		out += len;
+		return true;
+	}
+
+	bool huffmanBlock(const sHuffman& lit, const sHuffman& dist)
+	{
+		for (;;)
+		{
+			if (num_bits < 48)
+				refill();
+			int sym = decode(lit);
+			if (sym < 256)
+			{
+				if (sym < 0 || out >= out_end)
+					return false;
+				*out++ = (uint8)sym;
+				continue;
+			}
+			if (sym == 256)
+				return true;
+			sym -= 257;
+			if (sym >= 29)
+				return false;
+			int len = length_base[sym];
+			if (length_extra[sym])
+				len += getBits(length_extra[sym]);
+			int dsym = decode(dist);
+			if (dsym < 0 || dsym >= 30)
+				return false;
+			int d = dist_base[dsym];
+			if (dist_extra[dsym])
+				d += getBits(dist_extra[dsym]);
+			if (d > out - out_start || len > out_end - out)
+				return false;
+
+			uint8* src = out - d;
+			if (d >= 8)
+			{
+				//blocks of 8 never read what they write
+				uint8* copy_end = out + len;
+				do {
+					memcpy(out, src, 8);
+					out += 8;
+					src += 8;
+				} while (out < copy_end);
+				out = copy_end;
+			}
+			else if (d == 1)
+			{
+				memset(out, *src, len);
+				out += len;
+			}
+			else
+			{
+				for (int i = 0; i < len; ++i)
+					out[i] = src[i];
+				out += len;
+			}
+		}
+	}
+
+	bool dynamicTables(sHuffman& lit, sHuffman& dist)
+	{
+		static const uint8 order[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+		int hlit = getBits(5) + 257;
+		int hdist = getBits(5) + 1;
+		int hclen = getBits(4) + 4;
+
+		uint8 code_lengths[19];
+		memset(code_lengths, 0, sizeof(code_lengths));
+		for (int i = 0; i < hclen; ++i)
+			code_lengths[order[i]] = (uint8)getBits(3);
+		sHuffman codes;
+		if (!buildHuffman(codes, code_lengths, 19))
+			return false;
+
+		uint8 lengths[288 + 32];
+		int n = 0;
+		while (n < hlit + hdist)
+		{
+			int c = decode(codes);
+			if (c < 0 || c >= 19)
+				return false;
+			if (c < 16)
+			{
+				lengths[n++] = (uint8)c;
+				continue;
+			}
+			int fill = 0;
+			int repeat;
+			if (c == 16)
+			{
+				if (n == 0)
+					return false;
+				repeat = getBits(2) + 3;
+				fill = lengths[n - 1];
+			}
+			else if (c == 17)
+				repeat = getBits(3) + 3;
+			else
+				repeat = getBits(7) + 11;
+			if (n + repeat > hlit + hdist)
+				return false;
+			memset(lengths + n, fill, repeat);
+			n += repeat;
+		}
+		return buildHuffman(lit, lengths, hlit) && buildHuffman(dist, lengths + hlit, hdist);
+	}
+
+	bool run()
+	{
+		sHuffman lit, dist;
+		int final_block;
+		do {
+			final_block = getBits(1);
+			int type = getBits(2);
+			if (type == 0)
+			{
+				if (!storedBlock())
+					return false;
+				continue;
+			}
+			if (type == 1)
+			{
+				uint8 lengths[288 + 32];
+				memset(lengths, 8, 144);
+				memset(lengths + 144, 9, 112);
+				memset(lengths + 256, 7, 24);
+				memset(lengths + 280, 8, 8);
+				memset(lengths + 288, 5, 32);
+				if (!buildHuffman(lit, lengths, 288) || !buildHuffman(dist, lengths + 288, 32))
+					return false;
+			}
+			else if (type != 2 || !dynamicTables(lit, dist))
+				return false;
+			if (!huffmanBlock(lit, dist))
+				return false;
+		} while (!final_block);
+		return num_bits >= overrun * 8; //the zeros after the end were not used
+	}
+};
+
+//zlib stream (the adler32 is not checked, like picoPNG)
+bool inflateZlib(const uint8* in, size_t size, uint8* out, size_t out_size)
+{
+	if (size < 2)
+		return false;
+	int cmf = in[0];
+	int flg = in[1];
+	if ((cmf * 256 + flg) % 31 != 0 || (cmf & 15) != 8 || (cmf >> 4) > 7 || (flg & 32))
+		return false;
+
+	sInflater inflater;
+	inflater.pos = in + 2;
+	inflater.end = in + size;
+	inflater.bits = 0;
+	inflater.num_bits = 0;
+	inflater.overrun = 0;
+	inflater.out = inflater.out_start = out;
+	inflater.out_end = out + out_size;
+	return inflater.run() && inflater.out == inflater.out_end;
+}
+
+// UNFILTER *************************
+
+inline uint8 paeth(int a, int b, int c)
+{
+	int pa = abs(b - c);
+	int pb = abs(a - c);
+	int pc = abs(a + b - 2 * c);
+	if (pa <= pb && pa <= pc)
+		return (uint8)a;
+	return (uint8)(pb <= pc ? b : c);
+}
+
+//Sub, Avg and Paeth depend on the pixel at the left, the bytes per pixel are a template so the loops are unrolled
+template<int BPP>
+void unfilterPixels(uint8* dst, const uint8* src, const uint8* prev, int filter, int n)
+{
+	//the first pixel has nothing at the left
+	if (filter == 1)
+	{
+		for (int i = 0; i < BPP; ++i)
+			dst[i] = src[i];
+		for (int i = BPP; i < n; ++i)
+			dst[i] = src[i] + dst[i - BPP];
+	}
+	else if (filter == 3)
+	{
+		for (int i = 0; i < BPP; ++i)
+			dst[i] = src[i] + (prev[i] >> 1);
+		for (int i = BPP; i < n; ++i)
+			dst[i] = src[i] + ((dst[i - BPP] + prev[i]) >> 1);
+	}
+	else
+	{
+		for (int i = 0; i < BPP; ++i)
+			dst[i] = src[i] + prev[i];
+		for (int i = BPP; i < n; ++i)
+			dst[i] = src[i] + paeth(dst[i - BPP], prev[i], prev[i - BPP]);
+	}
+}
+
+#ifdef USE_SSE_PNG
+//one pixel (up to 8 bytes) in the lowest lanes, exactly BPP bytes are read and written, without going through the stack
+template<int BPP>
+inline __m128i loadPixel(const uint8* p)
+{
+	if (BPP == 8)
+		return _mm_loadl_epi64((const __m128i*)p);
+	int v;
+	if (BPP == 3)
+		v = p[0] | (p[1] << 8) | (p[2] << 16);
+	else
+		memcpy(&v, p, 4);
+	__m128i x = _mm_cvtsi32_si128(v);
+	if (BPP == 6)
+		x = _mm_insert_epi16(x, p[4] | (p[5] << 8), 2);
+	return x;
+}
+
+template<int BPP>
+inline void storePixel(uint8* p, __m128i x)
+{
+	if (BPP == 8)
+	{
+		_mm_storel_epi64((__m128i*)p, x);
+		return;
+	}
+	int v = _mm_cvtsi128_si32(x);
+	if (BPP == 3)
+	{
+		p[0] = (uint8)v;
+		p[1] = (uint8)(v >> 8);
+		p[2] = (uint8)(v >> 16);
+	}
+	else
+		memcpy(p, &v, 4);
+	if (BPP == 6)
+	{
+		int high = _mm_extract_epi16(x, 2);
+		p[4] = (uint8)high;
+		p[5] = (uint8)(high >> 8);
+	}
+}
+
+inline __m128i abs16(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+inline __m128i selectBits(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+//for 3 bytes or more, all the channels of the pixel at once
+template<int BPP>
+void unfilterPixelsSSE(uint8* dst, const uint8* src, const uint8* prev, int filter, int n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i a = zero;
+	if (filter == 1)
+	{
+		for (int i = 0; i < n; i += BPP)
+		{
+			a = _mm_add_epi8(loadPixel<BPP>(src + i), a);
+			storePixel<BPP>(dst + i, a);
+		}
+	}
+	else if (filter == 3)
+	{
+		__m128i one = _mm_set1_epi8(1);
+		for (int i = 0; i < n; i += BPP)
+		{
+			__m128i b = loadPixel<BPP>(prev + i);
+			//avg_epu8 rounds up, the filter rounds down
+			__m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+			a = _mm_add_epi8(loadPixel<BPP>(src + i), avg);
+			storePixel<BPP>(dst + i, a);
+		}
+	}
+	else
+	{
+		//in 16 bits so a + b - c doesn't overflow
+		__m128i c = zero;
+		__m128i mask = _mm_set1_epi16(0xFF);
+		for (int i = 0; i < n; i += BPP)
+		{
+			__m128i b = _mm_unpacklo_epi8(loadPixel<BPP>(prev + i), zero);
+			__m128i x = _mm_unpacklo_epi8(loadPixel<BPP>(src + i), zero);
+			__m128i pa = _mm_sub_epi16(b, c);
+			__m128i pb = _mm_sub_epi16(a, c);
+			__m128i pc = abs16(_mm_add_epi16(pa, pb));
+			pa = abs16(pa);
+			pb = abs16(pb);
+			__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+			//ties favour a, then b
+			__m128i nearest = selectBits(_mm_cmpeq_epi16(smallest, pa), a, selectBits(_mm_cmpeq_epi16(smallest, pb), b, c));
+			a = _mm_and_si128(_mm_add_epi16(x, nearest), mask);
+			storePixel<BPP>(dst + i, _mm_packus_epi16(a, a));
+			c = b;
+		}
+	}
+}
+#define UNFILTER_PIXELS unfilterPixelsSSE
+#else
+#define UNFILTER_PIXELS unfilterPixels
+#endif
+
+//dst can be src (unfiltered in place), prev is the unfiltered previous row (zeros for the first one)
+//bpp is 1 to 4 bytes for 8 bits images, 2 to 8 for 16 bits
+bool unfilterRow(uint8* dst, const uint8* src, const uint8* prev, int filter, int n, int bpp)
+{
+	if (filter == 0)
+	{
+		if (dst != src)
+			memcpy(dst, src, n);
+		return true;
+	}
+	if (filter == 2)
+	{
+		int i = 0;
+#ifdef USE_SSE_PNG
+		for (; i + 16 <= n; i += 16)
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi8(_mm_loadu_si128((const __m128i*)(src + i)), _mm_loadu_si128((const __m128i*)(prev + i))));
+#endif
+		for (; i < n; ++i)
+			dst[i] = src[i] + prev[i];
+		return true;
+	}
+	if (filter > 4)
+		return false;
+
+	switch (bpp)
+	{
+	case 1: unfilterPixels<1>(dst, src, prev, filter, n); break;
+	case 2: unfilterPixels<2>(dst, src, prev, filter, n); break;
+	case 3: UNFILTER_PIXELS<3>(dst, src, prev, filter, n); break;
+	case 4: UNFILTER_PIXELS<4>(dst, src, prev, filter, n); break;
+	case 6: UNFILTER_PIXELS<6>(dst, src, prev, filter, n); break;
+	case 8: UNFILTER_PIXELS<8>(dst, src, prev, filter, n); break;
+	default: return false;
+	}
+	return true;
+}
+
+inline unsigned int readBE32(const uint8* p)
+{
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+// DEFLATE *************************
+
+const int HASH_BITS = 15;
+const int WINDOW_SIZE = 32768;
+const int MAX_MATCH = 258;
+
+//fixed huffman codes (already reversed, deflate writes them from the high bit) and the codes of every length and distance
+struct sDeflateTables {
+	uint16 lit_code[288];
+	uint8 lit_bits[288];
+	uint8 length_index[MAX_MATCH + 1];
+	uint8 dist_index[512]; //distance - 1 below 256, otherwise 256 + ((distance - 1) >> 7)
+
+	sDeflateTables()
+	{
+		for (int i = 0; i < 288; ++i)
+		{
+			int code, bits;
+			if (i < 144) { code = 0x30 + i; bits = 8; }
+			else if (i < 256) { code = 0x190 + i - 144; bits = 9; }
+			else if (i < 280) { code = i - 256; bits = 7; }
+			else { code = 0xC0 + i - 280; bits = 8; }
+			lit_code[i] = (uint16)(bitReverse16(code) >> (16 - bits));
+			lit_bits[i] = (uint8)bits;
+		}
+		for (int i = 0; i < 29; ++i)
+			for (int l = length_base[i]; l < length_base[i] + (1 << length_extra[i]) && l <= MAX_MATCH; ++l)
+				length_index[l] = (uint8)i;
+		for (int i = 0; i < 30; ++i)
+			for (int d = dist_base[i]; d < dist_base[i] + (1 << dist_extra[i]); ++d)
+				dist_index[d <= 256 ? d - 1 : 256 + ((d - 1) >> 7)] = (uint8)i;
+	}
+	int getDistIndex(int dist) { return dist <= 256 ? dist_index[dist - 1] : dist_index[256 + ((dist - 1) >> 7)]; }
+};
+
+struct sBitWriter {
+	std::vector<uint8>& out;
+	unsigned long long bits;
+	int num_bits;
+
+	sBitWriter(std::vector<uint8>& out) : out(out) { bits = 0; num_bits = 0; }
+	inline void put(unsigned int value, int count)
+	{
+		bits |= (unsigned long long)value << num_bits;
+		num_bits += count;
+		while (num_bits >= 8)
+		{
+			out.push_back((uint8)bits);
+			bits >>= 8;
+			num_bits -= 8;
+		}
+	}
+	void flush() { if (num_bits) out.push_back((uint8)bits); bits = 0; num_bits = 0; }
+};
+
+inline unsigned int hash3(const uint8* p)
+{
+	return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+//one block with the fixed codes, greedy matches with the last position of the same hash (like zlib level 1)
+void deflateFixed(const uint8* in, size_t size, std::vector<uint8>& out)
+{
+	static sDeflateTables tables;
+	sBitWriter writer(out);
+	writer.put(1, 1); //final block
+	writer.put(1, 2); //fixed huffman
+
+	std::vector<int> head(1 << HASH_BITS, -1);
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t length = 0;
+		size_t dist = 0;
+		if (i + 3 <= size)
+		{
+			unsigned int h = hash3(in + i);
+			int candidate = head[h];
+			head[h] = (int)i;
+			if (candidate >= 0 && i - candidate <= WINDOW_SIZE)
+			{
+				size_t max_length = std::min((size_t)MAX_MATCH, size - i);
+				const uint8* a = in + candidate;
+				const uint8* b = in + i;
+				while (length < max_length && a[length] == b[length])
+					length++;
+				dist = i - candidate;
+			}
+		}
+
+		if (length < 3)
+		{
+			writer.put(tables.lit_code[in[i]], tables.lit_bits[in[i]]);
+			i++;
+			continue;
+		}
+
+		int index = tables.length_index[length];
+		writer.put(tables.lit_code[257 + index], tables.lit_bits[257 + index]);
+		writer.put((unsigned int)length - length_base[index], length_extra[index]);
+		index = tables.getDistIndex((int)dist);
+		writer.put(bitReverse16(index) >> 11, 5);
+		writer.put((unsigned int)dist - dist_base[index], dist_extra[index]);
+
+		//the positions inside the match can be found later
+		for (size_t k = 1; k < length && i + k + 3 <= size; ++k)
+			head[hash3(in + i + k)] = (int)(i + k);
+		i += length;
+	}
+	writer.put(tables.lit_code[256], tables.lit_bits[256]); //end of block
+	writer.flush();
+}
+
+unsigned int crc32(const uint8* data, size_t size, unsigned int crc = 0)
+{
+	static unsigned int table[256] = { 0 };
+	if (!table[1])
+		for (unsigned int i = 0; i < 256; ++i)
+		{
+			unsigned int c = i;
+			for (int k = 0; k < 8; ++k)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+		crc = table[(crc ^ data[i]) & 255] ^ (crc >> 8);
+	return ~crc;
+}
+
+unsigned int adler32(const uint8* data, size_t size)
+{
+	unsigned int a = 1, b = 0;
+	while (size)
+	{
+		size_t block = std::min(size, (size_t)5552); //no overflow before the modulo
+		for (size_t i = 0; i < block; ++i)
+		{
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += block;
+		size -= block;
+	}
+	return (b << 16) | a;
+}
+
+inline void writeBE32(std::vector<uint8>& out, unsigned int v)
+{
+	out.push_back((uint8)(v >> 24));
+	out.push_back((uint8)(v >> 16));
+	out.push_back((uint8)(v >> 8));
+	out.push_back((uint8)v);
+}
+
+void writeChunk(std::vector<uint8>& out, const char* type, const uint8* data, size_t size)
+{
+	writeBE32(out, (unsigned int)size);
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	if (size)
+		out.insert(out.end(), data, data + size);
+	writeBE32(out, crc32(&out[start], size + 4));
+}
+
+// FILTER *************************
+
+//the filter with the smallest sum of the differences as signed bytes (the heuristic of libpng), Sub, Up or Paeth
+void filterRow(uint8* dst, const uint8* row, const uint8* prev, size_t size, int bpp)
+{
+	static thread_local std::vector<uint8> candidates[3];
+	int best = 0;
+	unsigned int best_sum = 0;
+	for (size_t i = 0; i < size; ++i)
+		best_sum += abs((int)(signed char)row[i]);
+	for (int f = 0; f < 3; ++f)
+	{
+		std::vector<uint8>& c = candidates[f];
+		c.resize(size);
+		unsigned int sum = 0;
+		for (size_t i = 0; i < size; ++i)
+		{
+			int left = i >= (size_t)bpp ? row[i - bpp] : 0;
+			int up = prev ? prev[i] : 0;
+			int up_left = prev && i >= (size_t)bpp ? prev[i - bpp] : 0;
+			int predicted = f == 0 ? left : f == 1 ? up : paeth(left, up, up_left);
+			c[i] = (uint8)(row[i] - predicted);
+			sum += abs((int)(signed char)c[i]);
+		}
+		if (sum < best_sum)
+		{
+			best_sum = sum;
+			best = f + 1;
+		}
+	}
+	dst[0] = (uint8)(best == 3 ? 4 : best); //Paeth is the filter 4
+	memcpy(dst + 1, best ? &candidates[best - 1][0] : row, size);
+}
+
+}
+
+bool decodePNGFast(std::vector<unsigned char>& out_image, unsigned int& width, unsigned int& height, unsigned int& channels, const unsigned char* in_png, size_t in_size, bool flip_y)
+{
+	static const uint8 signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	if (in_size < 8 + 25 || memcmp(in_png, signature, 8) != 0)
+		return false;
+
+	//chunks
+	const uint8* p = in_png + 8;
+	const uint8* end = in_png + in_size;
+	unsigned int w = 0, h = 0;
+	int color_type = -1;
+	int bit_depth = 8;
+	uint8 palette[256 * 4];
+	int palette_size = 0;
+	bool palette_alpha = false;
+	std::vector<uint8> idat;
+	idat.reserve(in_size);
+	while (end - p >= 12)
+	{
+		unsigned int length = readBE32(p);
+		const uint8* type = p + 4;
+		const uint8* data = p + 8;
+		if (length > (size_t)(end - data) - 4)
+			return false;
+		if (memcmp(type, "IHDR", 4) == 0)
+		{
+			if (length != 13)
+				return false;
+			w = readBE32(data);
+			h = readBE32(data + 4);
+			bit_depth = data[8];
+			color_type = data[9];
+			//8 or 16 bits, deflate, adaptive filters, no interlace
+			if ((bit_depth != 8 && bit_depth != 16) || data[10] != 0 || data[11] != 0 || data[12] != 0)
+				return false;
+			if (color_type != 0 && color_type != 2 && color_type != 3 && color_type != 4 && color_type != 6)
+				return false;
+			if (color_type == 3 && bit_depth != 8)
+				return false;
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			palette_size = length / 3;
+			if (palette_size > 256)
+				return false;
+			for (int i = 0; i < palette_size; ++i)
+			{
+				memcpy(palette + i * 4, data + i * 3, 3);
+				palette[i * 4 + 3] = 255;
+			}
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			if (color_type != 3 || (int)length > palette_size)
+				return false; //color keys are left to picoPNG
+			for (unsigned int i = 0; i < length; ++i)
+				palette[i * 4 + 3] = data[i];
+			palette_alpha = true;
+		}
+		else if (memcmp(type, "IDAT", 4) == 0)
+			idat.insert(idat.end(), data, data + length);
+		else if (memcmp(type, "IEND", 4) == 0)
+			break;
+		p = data + length + 4; //crc
+	}
+	if (color_type == -1 || !w || !h || w > (1 << 24) || h > (1 << 24) || idat.empty())
+		return false;
+
+	static const int file_channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+	int samples = file_channels[color_type];
+	bool indexed = color_type == 3;
+	bool wide = bit_depth == 16; //only the high byte is kept, like picoPNG
+	if (indexed && !palette_size)
+		return false;
+	int bpp = wide ? samples * 2 : samples;
+	channels = indexed ? (palette_alpha ? 4 : 3) : samples;
+	if ((unsigned long long)w * h * channels > 0x7FFFFFFFULL)
+		return false;
+	//the inflated rows are bigger than the output for 16 bits, and deflate can't expand more than 1032:1
+	unsigned long long inflated_size = ((unsigned long long)w * bpp + 1) * h;
+	if (inflated_size > 0x7FFFFFFFULL || inflated_size > (unsigned long long)idat.size() * 1032)
+		return false;
+	size_t stride = (size_t)w * bpp;
+	size_t raw_size = (size_t)inflated_size;
+
+	std::vector<uint8> raw(raw_size + 8);
+	if (!inflateZlib(&idat[0], idat.size(), &raw[0], raw_size))
+		return false;
+
+	//the rows go directly to their place in the image, the palette indices and the 16 bits samples are unfiltered in place and converted
+	out_image.resize((size_t)w * h * channels);
+	size_t out_stride = (size_t)w * channels;
+	std::vector<uint8> zeros(stride, 0);
+	const uint8* prev = &zeros[0];
+	for (unsigned int y = 0; y < h; ++y)
+	{
+		uint8* src = &raw[y * (stride + 1)];
+		uint8* row = &out_image[(flip_y ? h - 1 - y : y) * out_stride];
+		uint8* dst = indexed || wide ? src + 1 : row;
+		if (!unfilterRow(dst, src + 1, prev, src[0], (int)stride, bpp))
+			return false;
+		prev = dst;
+		if (wide)
+		{
+			for (size_t i = 0; i < out_stride; ++i)
+				row[i] = dst[i * 2]; //big endian
+		}
+		else if (indexed)
+		{
+			for (unsigned int x = 0; x < w; ++x, row += channels)
+			{
+				if (dst[x] >= palette_size)
+					return false;
+				memcpy(row, palette + dst[x] * 4, channels);
+			}
+		}
+	}
+
+	width = w;
+	height = h;
+	return true;
+}
+
+bool encodePNG(std::vector<unsigned char>& out_png, const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int channels, bool flip_y)
+{
+	if (!pixels || !width || !height || (channels != 3 && channels != 4))
+		return false;
+
+	//every row starts with its filter
+	size_t stride = (size_t)width * channels;
+	std::vector<uint8> filtered((stride + 1) * height);
+	for (unsigned int y = 0; y < height; ++y)
+	{
+		unsigned int src_y = flip_y ? height - 1 - y : y;
+		const uint8* row = pixels + src_y * stride;
+		const uint8* prev = y == 0 ? NULL : pixels + (flip_y ? src_y + 1 : src_y - 1) * stride;
+		filterRow(&filtered[y * (stride + 1)], row, prev, stride, channels);
+	}
+
+	std::vector<uint8> zlib;
+	zlib.reserve(filtered.size() / 2);
+	zlib.push_back(0x78); //deflate, 32KB window
+	zlib.push_back(0x01);
+	deflateFixed(&filtered[0], filtered.size(), zlib);
+	writeBE32(zlib, adler32(&filtered[0], filtered.size()));
+
+	static const uint8 signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	uint8 header[13];
+	for (int i = 0; i < 4; ++i)
+	{
+		header[i] = (uint8)(width >> (24 - i * 8));
+		header[4 + i] = (uint8)(height >> (24 - i * 8));
+	}
+	header[8] = 8; //bits
+	header[9] = channels == 4 ? 6 : 2; //RGBA or RGB
+	header[10] = header[11] = header[12] = 0; //deflate, filters per row, not interlaced
+
+	out_png.clear();
+	out_png.reserve(zlib.size() + 64);
+	out_png.insert(out_png.end(), signature, signature + 8);
+	writeChunk(out_png, "IHDR", header, 13);
+	writeChunk(out_png, "IDAT", &zlib[0], zlib.size());
+	writeChunk(out_png, "IEND", NULL, 0);
+	return true;
+}
+
+void expandToRGBA(const unsigned char* in, unsigned char* out, size_t num_pixels, unsigned int channels)
+{
+	switch (channels)
+	{
+	case 1:
+		for (size_t i = 0; i < num_pixels; ++i, out += 4)
+		{
+			out[0] = out[1] = out[2] = in[i];
+			out[3] = 255;
+		}
+		break;
+	case 2:
+		for (size_t i = 0; i < num_pixels; ++i, in += 2, out += 4)
+		{
+			out[0] = out[1] = out[2] = in[0];
+			out[3] = in[1];
+		}
+		break;
+	case 3:
+		for (size_t i = 0; i < num_pixels; ++i, in += 3, out += 4)
+		{
+			out[0] = in[0];
+			out[1] = in[1];
+			out[2] = in[2];
+			out[3] = 255;
+		}
+		break;
+	default:
+		memcpy(out, in, num_pixels * 4);
+	}
+}
+
+int benchmarkPNGDecoder(const char* folder)
+{
+	std::vector<std::string> files;
+	listFiles(folder, files);
+
+	int num_files = 0, num_fast = 0, num_different = 0;
+	long long pico_time = 0, fast_time = 0; //in ms
+	size_t pico_bytes = 0, fast_bytes = 0;
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		std::string ext = files[i].substr(files[i].find_last_of(".") + 1);
+		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+		std::string content;
+		if (ext != "png" || !readFile(files[i], content) || content.empty())
+			continue;
+		const unsigned char* bytes = (const unsigned char*)content.data();
+		num_files++;
+
+		std::vector<unsigned char> pico_image;
+		unsigned int pico_width = 0, pico_height = 0;
+		long time = getTime();
+		int error = decodePNG(pico_image, pico_width, pico_height, bytes, content.size(), true);
+		long pico = getTime() - time;
+
+		std::vector<unsigned char> image;
+		unsigned int width = 0, height = 0, channels = 0;
+		time = getTime();
+		bool fast = decodePNGFast(image, width, height, channels, bytes, content.size());
+		long elapsed = getTime() - time;
+
+		if (!fast)
+		{
+			std::cout << "   " << files[i] << ": not supported by the fast path (picoPNG " << (error ? "fails too" : "is used") << ")" << std::endl;
+			continue;
+		}
+		num_fast++;
+		pico_time += pico;
+		fast_time += elapsed;
+		pico_bytes += pico_image.size();
+		fast_bytes += image.size();
+
+		std::vector<unsigned char> rgba(width * height * 4);
+		expandToRGBA(&image[0], &rgba[0], width * height, channels);
+		if (error || width != pico_width || height != pico_height || rgba != pico_image)
+		{
+			num_different++;
+			std::cout << "[ERROR] " << files[i] << ": different from picoPNG" << std::endl;
+		}
+	}
+
+	std::cout << " + PNG: " << num_files << " files, " << num_fast << " decoded by the fast path, " << num_different << " different from picoPNG" << std::endl;
+	std::cout << "   files of the fast path, picoPNG: " << pico_time << "ms " << pico_bytes / 1024 << "KB, fast: " << fast_time << "ms " << fast_bytes / 1024 << "KB" << std::endl;
+	return num_different;
+}
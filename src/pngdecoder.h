@@ -0,0 +1,28 @@
+#ifndef PNGDECODER_H
+#define PNGDECODER_H
+
+#include <vector>
+#include <cstddef>
+
+//PNG decoder used by Image::loadPNG, much faster than picoPNG (which stays as fallback and reference):
+//inflate with table driven huffman (9 bits lookups), unfiltering with SSE2 and the rows written flipped if needed.
+//It keeps the channels of the file (1 gray, 2 gray alpha, 3 RGB, 4 RGBA, palettes become RGB or RGBA)
+//so the single channel maps don't take four times the memory.
+//16 bits images keep the high byte like picoPNG. Only 8 and 16 bits non interlaced images without color key,
+//returns false for the rest (and for corrupt files)
+
+bool decodePNGFast(std::vector<unsigned char>& out_image, unsigned int& width, unsigned int& height, unsigned int& channels, const unsigned char* in_png, size_t in_size, bool flip_y = false);
+
+//PNG encoder for the screenshots and the captured frames (see FrameCapture), 3 or 4 channels. The filter of every row is
+//chosen like libpng does and it is compressed with the fixed huffman codes and greedy matches (like zlib at level 1),
+//the files are bigger than with zlib but it is fast enough to record. flip_y writes the rows from the last (glReadPixels)
+bool encodePNG(std::vector<unsigned char>& out_png, const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int channels, bool flip_y = false);
+
+//converts pixels of 1, 2 or 3 channels to RGBA like picoPNG does (gray to RGB, alpha 255 if there is none)
+void expandToRGBA(const unsigned char* in, unsigned char* out, size_t num_pixels, unsigned int channels);
+
+//decodes every PNG inside folder with both decoders, checks that the RGBA result is the same and prints the times
+//returns the number of files that differ: main --bench-png data
+int benchmarkPNGDecoder(const char* folder);
+
+#endif
@@ -0,0 +1,235 @@
+#include "renderqueue.h"
+#include "mesh.h"
+#include "material.h"
+#include "camera.h"
+#include "shader.h"
+#include "texture.h"
+
+#include <cassert>
+
+//cached GL state, -1 means unknown
+static int state_blending = -1;
+static GLenum state_blend_src = 0;
+static GLenum state_blend_dst = 0;
+static int state_depth_func = -1;
+static int state_culling = -1;
+static GLenum state_cull_face = 0;
+static GLenum state_front_face = 0;
+
+RenderQueue::RenderQueue()
+{
+	num_binds = 0;
+	num_batched = 0;
+	skip_volumes = false;
+}
+
+void RenderQueue::clear()
+{
+	items.clear();
+	instance_models.clear();
+	sorted.clear();
+}
+
+float RenderQueue::getDepth(Mesh* mesh, const Matrix44& model, Camera* camera)
+{
+	Vector3 center = model * mesh->box.center;
+	float depth = (center - camera->eye).length() / camera->far_plane;
+	return depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+}
+
+unsigned long long RenderQueue::computeKey(Material* material, bool instanced, float depth)
+{
+	Shader* shader = instanced && material->instanced_shader ? material->instanced_shader : material->shader;
+	unsigned long long pass = (unsigned long long)material->getRenderPass() & 3;
+	unsigned long long shader_id = (shader ? shader->getProgram() : 0) & 0x3FF;
+	unsigned long long material_id = material->id & 0xFFF;
+	unsigned long long textures = (material->texture ? material->texture->texture_id : 0) & 0xFF;
+	unsigned long long depth_bits = (unsigned long long)(depth * 0xFFFFFF) & 0xFFFFFF;
+	unsigned long long state = (shader_id << 21) | (textures << 13) | (material_id << 1) | (instanced ? 1ULL : 0ULL); //31 bits
+
+	if (material->isTransparent())
+		return (pass << 62) | (1ULL << 61) | ((0xFFFFFF - depth_bits) << 37) | (state << 6);
+	return (pass << 62) | (state << 30) | (depth_bits << 6);
+}
+
+void RenderQueue::add(Mesh* mesh, Material* material, const Matrix44& model, Camera* camera)
+{
+	sDrawItem item;
+	item.mesh = mesh;
+	item.material = material;
+	item.model = model;
+	item.instances_start = -1;
+	item.num_instances = 0;
+	item.key = computeKey(material, false, getDepth(mesh, model, camera));
+	items.push_back(item);
+}
+
+void RenderQueue::addInstanced(Mesh* mesh, Material* material, const Matrix44* models, int num_instances, Camera* camera)
+{
+	assert(material->instanced_shader && "material can't be instanced");
+	float depth = 1.0f;
+	for (int i = 0; i < num_instances; ++i)
+	{
+		float d = getDepth(mesh, models[i], camera);
+		if (d < depth)
+			depth = d;
+	}
+
+	sDrawItem item;
+	item.mesh = mesh;
+	item.material = material;
+	item.instances_start = (int)instance_models.size();
+	item.num_instances = num_instances;
+	item.key = computeKey(material, true, depth);
+	instance_models.insert(instance_models.end(), models, models + num_instances);
+	items.push_back(item);
+}
+
+//LSD radix sort, 8 bits per pass, the passes where all the keys have the same byte are skipped
+void RenderQueue::sort()
+{
+	size_t num = items.size();
+	sorted.resize(num);
+	sort_tmp.resize(num);
+	for (size_t i = 0; i < num; ++i)
+	{
+		sorted[i].key = items[i].key;
+		sorted[i].index = (int)i;
+	}
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		unsigned int count[256] = { 0 };
+		for (size_t i = 0; i < num; ++i)
+			count[(sorted[i].key >> shift) & 0xFF]++;
+		if (num == 0 || count[(sorted[0].key >> shift) & 0xFF] == num)
+			continue;
+
+		unsigned int offset = 0;
+		for (int b = 0; b < 256; ++b)
+		{
+			unsigned int c = count[b];
+			count[b] = offset;
+			offset += c;
+		}
+		for (size_t i = 0; i < num; ++i)
+			sort_tmp[count[(sorted[i].key >> shift) & 0xFF]++] = sorted[i];
+		sorted.swap(sort_tmp);
+	}
+}
+
+void RenderQueue::execute(Camera* camera, eQueueFilter filter)
+{
+	invalidateState();
+	if (filter == QUEUE_ALL || filter == QUEUE_GBUFFER)
+		num_binds = num_batched = 0;
+
+	Material* current = NULL;
+	bool current_instanced = false;
+	for (size_t i = 0; i < sorted.size(); ++i)
+	{
+		sDrawItem& item = items[sorted[i].index];
+		bool instanced = item.instances_start != -1;
+
+		if ((filter == QUEUE_VOLUMES || skip_volumes) && item.material->isVolume() != (filter == QUEUE_VOLUMES))
+			continue;
+		if (filter != QUEUE_ALL && filter != QUEUE_VOLUMES)
+		{
+			bool deferred = item.material->writesGBuffer();
+			bool background = (item.key >> 62) == PASS_BACKGROUND;
+			if ((filter == QUEUE_GBUFFER) != deferred || (filter == QUEUE_BACKGROUND && !background) || (filter == QUEUE_FORWARD && background))
+				continue;
+		}
+
+		//only when the state changes
+		if (item.material != current || instanced != current_instanced)
+		{
+			bool batched = current && instanced == current_instanced && filter != QUEUE_GBUFFER && current->canBatchWith(item.material);
+			if (current)
+				current->unbind();
+			if (batched)
+				item.material->bindBatched(camera, instanced); //the shader and the textures are already bound
+			else if (filter == QUEUE_GBUFFER)
+				item.material->bindGBuffer(camera);
+			else
+				item.material->bind(camera, instanced);
+			current = item.material;
+			current_instanced = instanced;
+			if (batched)
+				num_batched++;
+			else
+				num_binds++;
+		}
+
+		if (instanced && filter == QUEUE_GBUFFER)
+			item.material->Material::drawInstanced(item.mesh, &instance_models[item.instances_start], item.num_instances); //the gbuffer_shader is not instanced
+		else if (instanced)
+			item.material->drawInstanced(item.mesh, &instance_models[item.instances_start], item.num_instances);
+		else
+			item.material->draw(item.mesh, item.model);
+	}
+
+	if (current)
+		current->unbind();
+	if (Shader::current)
+		Shader::current->disable();
+	resetState();
+}
+
+void RenderQueue::setBlending(bool enabled, GLenum src, GLenum dst)
+{
+	if (state_blending != (int)enabled)
+	{
+		if (enabled)
+			glEnable(GL_BLEND);
+		else
+			glDisable(GL_BLEND);
+		state_blending = enabled;
+	}
+	if (enabled && (state_blend_src != src || state_blend_dst != dst))
+	{
+		glBlendFunc(src, dst);
+		state_blend_src = src;
+		state_blend_dst = dst;
+	}
+}
+
+void RenderQueue::setDepthFunc(GLenum func)
+{
+	if (state_depth_func == (int)func)
+		return;
+	glDepthFunc(func);
+	state_depth_func = func;
+}
+
+void RenderQueue::setCulling(bool enabled, GLenum face, GLenum front)
+{
+	if (state_culling != (int)enabled)
+	{
+		if (enabled)
+			glEnable(GL_CULL_FACE);
+		else
+			glDisable(GL_CULL_FACE);
+		state_culling = enabled;
+	}
+	if (enabled && (state_cull_face != face || state_front_face != front))
+	{
+		glCullFace(face);
+		glFrontFace(front);
+		state_cull_face = face;
+		state_front_face = front;
+	}
+}
+
+void RenderQueue::invalidateState()
+{
+	state_blending = state_depth_func = state_culling = -1;
+	state_blend_src = state_blend_dst = state_cull_face = state_front_face = 0;
+}
+
+void RenderQueue::resetState()
+{
+	setBlending(false);
+	setDepthFunc(GL_LESS);
+	setCulling(false);
+}
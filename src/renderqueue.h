@@ -0,0 +1,78 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "includes.h"
+#include "framework.h"
+#include <vector>
+
+class Mesh;
+class Material;
+class Camera;
+
+//RenderQueue
+//materials add draw items with a 64 bits sort key, every frame the items are radix sorted and executed
+//binding a material (shader, textures, blend state) only when it changes from the previous item
+
+enum eRenderPass {
+	PASS_BACKGROUND = 0, //skybox
+	PASS_MAIN = 1,
+	PASS_OVERLAY = 2
+};
+
+//which items execute draws, the deferred path splits the queue
+enum eQueueFilter {
+	QUEUE_ALL = 0,
+	QUEUE_GBUFFER, //only the items whose material writes the G-buffer, bound with bindGBuffer
+	QUEUE_BACKGROUND, //the rest, in the background pass
+	QUEUE_FORWARD, //the rest, in the other passes
+	QUEUE_VOLUMES //only the items of volume materials (when skip_volumes they are rendered apart)
+};
+
+struct sDrawItem {
+	unsigned long long key;
+	Mesh* mesh;
+	Material* material;
+	Matrix44 model;
+	int instances_start; //in instance_models, -1 if it is not instanced
+	int num_instances;
+};
+
+class RenderQueue {
+public:
+	std::vector<sDrawItem> items;
+	std::vector<Matrix44> instance_models; //storage of the instanced items
+	int num_binds; //material binds done in the last execute
+	int num_batched; //materials that only changed their uniforms (same shader and textures as the previous)
+	bool skip_volumes; //the volume items are only executed with QUEUE_VOLUMES
+
+	RenderQueue();
+
+	void clear();
+	void add(Mesh* mesh, Material* material, const Matrix44& model, Camera* camera);
+	void addInstanced(Mesh* mesh, Material* material, const Matrix44* models, int num_instances, Camera* camera);
+	void sort();
+	void execute(Camera* camera, eQueueFilter filter = QUEUE_ALL);
+
+	//opaque:      pass(2) | 0 | shader(10) | textures(8) | material(12) | instanced(1) | depth front to back(24) | unused
+	//transparent: pass(2) | 1 | depth back to front(24) | shader(10) | textures(8) | material(12) | instanced(1) | unused
+	//the textures go before the material so the ones that share an atlas page are consecutive (see Material::canBatchWith)
+	static unsigned long long computeKey(Material* material, bool instanced, float depth);
+
+	//cached GL state, materials use it so the calls are only done when the state changes
+	static void setBlending(bool enabled, GLenum src = GL_SRC_ALPHA, GLenum dst = GL_ONE_MINUS_SRC_ALPHA);
+	static void setDepthFunc(GLenum func);
+	static void setCulling(bool enabled, GLenum face = GL_BACK, GLenum front = GL_CCW);
+	static void invalidateState(); //call it when the state has been changed from outside
+	static void resetState(); //back to the defaults of the application (no blending, GL_LESS, no culling)
+
+private:
+	struct sSortEntry {
+		unsigned long long key;
+		int index;
+	};
+	std::vector<sSortEntry> sorted; //after sort(), the items in the order they are executed
+	std::vector<sSortEntry> sort_tmp;
+	float getDepth(Mesh* mesh, const Matrix44& model, Camera* camera);
+};
+
+#endif
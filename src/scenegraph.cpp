@@ -0,0 +1,140 @@
+#include "scenegraph.h"
+#include "scenenode.h"
+#include "workerpool.h"
+
+#include <algorithm>
+#include <cassert>
+
+SceneGraph::SceneGraph()
+{
+	num_updated = 0;
+	parallel_threshold = 4096;
+	must_update_all = true;
+}
+
+bool SceneGraph::needsRebuild(const std::vector<SceneNode*>& roots)
+{
+	return SceneNode::hierarchy_changed || roots != built_roots;
+}
+
+void SceneGraph::build(const std::vector<SceneNode*>& roots)
+{
+	nodes.clear();
+	parents.clear();
+	level_start.clear();
+
+	//breadth first, so every depth level is contiguous
+	for (size_t i = 0; i < roots.size(); ++i)
+	{
+		if (roots[i]->parent)
+			continue; //it will be added by its parent
+		nodes.push_back(roots[i]);
+		parents.push_back(-1);
+	}
+	size_t start = 0;
+	while (start < nodes.size())
+	{
+		level_start.push_back((int)start);
+		size_t end = nodes.size();
+		for (size_t i = start; i < end; ++i)
+		{
+			std::vector<SceneNode*>& children = nodes[i]->children;
+			for (size_t j = 0; j < children.size(); ++j)
+			{
+				nodes.push_back(children[j]);
+				parents.push_back((int)i);
+			}
+		}
+		start = end;
+	}
+	level_start.push_back((int)nodes.size());
+
+	for (size_t i = 0; i < nodes.size(); ++i)
+		nodes[i]->graph_index = (int)i;
+
+	world_matrices.resize(nodes.size());
+	dirty.assign(nodes.size(), 0);
+	updated.clear();
+	must_update_all = true;
+	visible.resize(nodes.size());
+
+	built_roots = roots;
+	SceneNode::hierarchy_changed = false;
+}
+
+//nodes in [start,end) must be in the same depth level, their parents are already updated
+void SceneGraph::updateRange(int start, int end)
+{
+	for (int i = start; i < end; ++i)
+	{
+		int parent = parents[i];
+		world_matrices[i] = parent == -1 ? nodes[i]->model : nodes[i]->model * world_matrices[parent];
+	}
+}
+
+//the node and all its descendants, its parent is already updated
+void SceneGraph::updateSubtree(int index)
+{
+	stack.push_back(index);
+	while (stack.size())
+	{
+		int i = stack.back();
+		stack.pop_back();
+		int parent = parents[i];
+		world_matrices[i] = parent == -1 ? nodes[i]->model : nodes[i]->model * world_matrices[parent];
+		dirty[i] = 1;
+		updated.push_back(i);
+
+		std::vector<SceneNode*>& children = nodes[i]->children;
+		for (size_t j = 0; j < children.size(); ++j)
+			stack.push_back(children[j]->graph_index);
+	}
+}
+
+void SceneGraph::update()
+{
+	for (size_t i = 0; i < updated.size(); ++i)
+		dirty[updated[i]] = 0;
+	updated.clear();
+
+	if (must_update_all)
+	{
+		for (size_t level = 0; level + 1 < level_start.size(); ++level)
+		{
+			int start = level_start[level];
+			int end = level_start[level + 1];
+			if (parallel_threshold > 0 && end - start > parallel_threshold)
+				WorkerPool::getGlobal()->parallelFor(end - start, 1024, [this, start](int a, int b) { updateRange(start + a, start + b); });
+			else
+				updateRange(start, end);
+		}
+		dirty.assign(nodes.size(), 1);
+		for (size_t i = 0; i < nodes.size(); ++i)
+			updated.push_back((int)i);
+		must_update_all = false;
+	}
+	else
+	{
+		//in graph order, so a dirty parent is updated (with its subtree) before its dirty children
+		std::vector<int> indices;
+		for (size_t i = 0; i < SceneNode::dirty_nodes.size(); ++i)
+		{
+			int index = SceneNode::dirty_nodes[i]->graph_index;
+			if (index >= 0 && index < (int)nodes.size() && nodes[index] == SceneNode::dirty_nodes[i])
+				indices.push_back(index); //not the ones outside the graph
+		}
+		std::sort(indices.begin(), indices.end());
+		for (size_t i = 0; i < indices.size(); ++i)
+			if (!dirty[indices[i]])
+				updateSubtree(indices[i]);
+	}
+
+	for (size_t i = 0; i < SceneNode::dirty_nodes.size(); ++i)
+		SceneNode::dirty_nodes[i]->model_dirty = false;
+	SceneNode::dirty_nodes.clear();
+	num_updated = (int)updated.size();
+
+	//only a byte per node, the visible flags have no dirty tracking
+	for (size_t i = 0; i < nodes.size(); ++i)
+		visible[i] = nodes[i]->visible && (parents[i] == -1 || visible[parents[i]]);
+}
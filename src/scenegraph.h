@@ -0,0 +1,41 @@
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include "framework.h"
+#include <vector>
+
+class SceneNode;
+
+//SceneGraph
+//flattens the node hierarchy in topological order (grouped by depth) and stores the world matrices contiguously,
+//every frame only the nodes marked with SceneNode::setModel/markDirty (and their subtrees) are recomputed
+
+class SceneGraph {
+public:
+	std::vector<SceneNode*> nodes; //parents always before their children
+	std::vector<int> parents; //index in nodes, -1 for the roots
+	std::vector<int> level_start; //first node of every depth level, plus the total at the end
+	std::vector<Matrix44> world_matrices;
+	std::vector<unsigned char> dirty; //recomputed in the last update
+	std::vector<unsigned char> visible; //the node and all its parents are visible
+
+	int num_updated; //world matrices recomputed in the last update
+	int parallel_threshold; //levels with more nodes than this are split among the worker threads when all are updated, 0 to never do it
+
+	SceneGraph();
+
+	//the roots are the nodes without parent (nodes with parent are reached through their parent)
+	void build(const std::vector<SceneNode*>& roots);
+	bool needsRebuild(const std::vector<SceneNode*>& roots); //if nodes were added or the hierarchy changed
+	void update();
+
+private:
+	std::vector<SceneNode*> built_roots;
+	bool must_update_all; //after a build
+	std::vector<int> updated; //the dirty ones, to clear them in the next update
+	std::vector<int> stack;
+	void updateRange(int start, int end);
+	void updateSubtree(int index);
+};
+
+#endif
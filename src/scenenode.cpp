@@ -3,7 +3,12 @@
 #include "texture.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <cassert>
+
 unsigned int SceneNode::lastNameId = 0;
+bool SceneNode::hierarchy_changed = false;
+std::vector<SceneNode*> SceneNode::dirty_nodes;
 unsigned int mesh_selected = 0;
 unsigned int skybox_selected = 0;
 unsigned int material_selected = 0;
@@ -23,19 +28,60 @@ SceneNode::SceneNode(const char * name)
 
 SceneNode::~SceneNode()
 {
+	if (parent)
+		parent->removeChild(this);
+	for (size_t i = 0; i < children.size(); ++i)
+		children[i]->parent = NULL;
+	if (model_dirty)
+		dirty_nodes.erase(std::find(dirty_nodes.begin(), dirty_nodes.end(), this));
+	hierarchy_changed = true;
+}
+
+void SceneNode::markDirty()
+{
+	if (model_dirty)
+		return;
+	model_dirty = true;
+	dirty_nodes.push_back(this);
+}
+
+void SceneNode::addChild(SceneNode* child)
+{
+	assert(child != this && "a node can't be its own child");
+	if (child->parent)
+		child->parent->removeChild(child);
+	child->parent = this;
+	children.push_back(child);
+	hierarchy_changed = true;
+}
+
+void SceneNode::removeChild(SceneNode* child)
+{
+	std::vector<SceneNode*>::iterator it = std::find(children.begin(), children.end(), child);
+	if (it == children.end())
+		return;
+	children.erase(it);
+	child->parent = NULL;
+	hierarchy_changed = true;
+}
 
+Matrix44 SceneNode::getGlobalMatrix()
+{
+	if (parent)
+		return model * parent->getGlobalMatrix();
+	return model;
 }
 
 void SceneNode::render(Camera* camera)
 {
 	if (material)
-		material->render(mesh, model, camera);
+		material->render(mesh, getGlobalMatrix(), camera);
 }
 
 void SceneNode::renderWireframe(Camera* camera)
 {
 	WireframeMaterial mat = WireframeMaterial();
-	mat.render(mesh, model, camera);
+	mat.render(mesh, getGlobalMatrix(), camera);
 }
 
 void SceneNode::renderInMenu()
@@ -46,14 +92,35 @@ void SceneNode::renderInMenu()
 	{
 		float matrixTranslation[3], matrixRotation[3], matrixScale[3];
 		ImGuizmo::DecomposeMatrixToComponents(model.m, matrixTranslation, matrixRotation, matrixScale);
-		ImGui::DragFloat3("Position", matrixTranslation, 0.1f);
-		ImGui::DragFloat3("Rotation", matrixRotation, 0.1f);
-		ImGui::DragFloat3("Scale", matrixScale, 0.1f);
-		ImGuizmo::RecomposeMatrixFromComponents(matrixTranslation, matrixRotation, matrixScale, model.m);
+		bool changed = false;
+		changed |= ImGui::DragFloat3("Position", matrixTranslation, 0.1f);
+		changed |= ImGui::DragFloat3("Rotation", matrixRotation, 0.1f);
+		changed |= ImGui::DragFloat3("Scale", matrixScale, 0.1f);
+		if (changed)
+		{
+			ImGuizmo::RecomposeMatrixFromComponents(matrixTranslation, matrixRotation, matrixScale, model.m);
+			markDirty();
+		}
 		
 		ImGui::TreePop();
 	}
 
+	//Children
+	if (children.size() && ImGui::TreeNode("Children"))
+	{
+		for (size_t i = 0; i < children.size(); ++i)
+		{
+			ImGui::PushID(children[i]);
+			if (ImGui::TreeNode(children[i]->name.c_str()))
+			{
+				children[i]->renderInMenu();
+				ImGui::TreePop();
+			}
+			ImGui::PopID();
+		}
+		ImGui::TreePop();
+	}
+
 	//Material
 	if (material && ImGui::TreeNode("Material"))
 	{
@@ -98,6 +165,7 @@ void SceneNode::renderInMenu()
 			case 3:
 				mesh = Mesh::getCube();
 			}
+			markDirty();
 		}
 
 		ImGui::TreePop();
@@ -107,14 +175,20 @@ void SceneNode::renderInMenu()
 Light::Light(std::string name)
 {
 	this->name = name;
+	radius = 0.0f;
 	visible = true;
 }
 
+Light::~Light()
+{
+}
+
 void Light::renderInMenu()
 {
 	ImGui::DragFloat3("Position", position.v, 0.1f);  //Slider per moure la posicio de la llum
 	ImGui::ColorEdit3("Difuse Color", difuse.v);      //Permet modificar la llum difusa
 	ImGui::ColorEdit3("Specular Color", specular.v);  //Permet modificar la llum especular
+	ImGui::DragFloat("Radius", &radius, 0.5f, 0.0f, 1000.0f); //0 es infinit
 	ImGui::Checkbox("Visible", &visible);
 	
 }
@@ -124,6 +198,7 @@ void Light::setUniforms(Shader* shader)
 	shader->setUniform("u_id", difuse);
 	shader->setUniform("u_is", specular);
 	shader->setUniform("u_light_pos", position);
+	shader->setUniform("u_light_radius", radius);
 
 }
 
@@ -13,11 +13,12 @@ class Light {
 public:
 
 	Light(std::string name);
-	~Light();
+	virtual ~Light();
 
 	Vector3 difuse;
 	Vector3 specular;
 	Vector3 position;
+	float radius; //distance where its contribution reaches zero, 0 means infinite
 
 	std::string name;
 	bool visible;
@@ -33,15 +34,29 @@ public:
 
 	SceneNode();
 	SceneNode(const char* name);
-	~SceneNode();
+	virtual ~SceneNode(); //the SpatialIndex benchmark deletes them through SceneNode*
 
 	Material * material = NULL;
 	std::string name;
 
-	Mesh* mesh = NULL;
-	Matrix44 model;
+	AssetRef<Mesh> mesh; //keeps it in the AssetCache
+	Matrix44 model; //relative to the parent, after changing it directly call markDirty so the SceneGraph updates it
 	bool visible;
 
+	//hierarchy
+	static bool hierarchy_changed; //the SceneGraph must be rebuilt
+	static std::vector<SceneNode*> dirty_nodes; //model changed since the last SceneGraph update
+	bool model_dirty = false; //it is in dirty_nodes
+	SceneNode* parent = NULL;
+	std::vector<SceneNode*> children;
+	int graph_index = -1; //position in the SceneGraph arrays
+
+	void addChild(SceneNode* child);
+	void removeChild(SceneNode* child);
+	Matrix44 getGlobalMatrix(); //model concatenated with the parents
+	void setModel(const Matrix44& m) { model = m; markDirty(); }
+	void markDirty(); //its world matrix and the ones of its children must be recomputed
+
 	virtual void render(Camera* camera);
 	virtual void renderWireframe(Camera* camera);
 	virtual void renderInMenu();
@@ -8,6 +8,7 @@
 #include <locale>
 
 #include "texture.h"
+#include "mesh.h"
 
 std::string Shader::s_shader_atlas_filename;
 std::map<std::string, std::string> Shader::s_shaders_atlas;
@@ -63,6 +64,7 @@ Shader::Shader()
 		Shader::init();
 	compiled = false;
 	from_atlas = false;
+	attrib_layout_key = 0;
 }
 
 Shader::~Shader()
@@ -137,6 +139,7 @@ void Shader::ReloadAll()
 		it->second->recompile();
 	if(!s_shader_atlas_filename.empty())
 		LoadAtlas(s_shader_atlas_filename.c_str());
+	Mesh::resetBufferBindings(); //the arena attributes kept bound were set with the old locations
 	std::cout << "Shaders recompiled" << std::endl;
 }
 
@@ -145,6 +148,7 @@ void Shader::Reload(const std::string& name)
 	Shader* shader = s_Shaders[name];
 	if (shader) {
 		shader->recompile();
+		Mesh::resetBufferBindings();
 	}
 }
 
@@ -343,6 +347,7 @@ bool Shader::compileFromMemory(const std::string& vsm, const std::string& psm)
 	validate();
 #endif
 
+	cacheAttribLocations();
 	compiled = true;
 
 	return true;
@@ -439,6 +444,8 @@ void Shader::release()
 	}
 
 	locations.clear();
+	attrib_locations.clear();
+	attrib_layout_key = 0;
 
 	compiled = false;
 }
@@ -544,8 +551,42 @@ GLint Shader::getLocation(const char* varname,loctable* table)
 	return loc;
 }
 
+//called after linking, attributes cannot change till the next link
+void Shader::cacheAttribLocations()
+{
+	attrib_locations.clear();
+	GLint num_attribs = 0;
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &num_attribs);
+	char name[256];
+	for (int i = 0; i < num_attribs; ++i)
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveAttrib(program, i, sizeof(name), &length, &size, &type, name);
+		attrib_locations[name] = glGetAttribLocation(program, name); //-1 for gl_ builtins
+	}
+
+	//pack the locations of the mesh attributes, 5 bits each (0 means not used)
+	const char* mesh_attribs[] = { "a_vertex", "a_normal", "a_uv", "a_color", "a_bones", "a_weights" };
+	attrib_layout_key = 0;
+	for (int i = 0; i < 6; ++i)
+	{
+		std::map<std::string, int>::iterator it = attrib_locations.find(mesh_attribs[i]);
+		int loc = it == attrib_locations.end() ? -1 : it->second;
+		attrib_layout_key |= (unsigned int)((loc + 1) & 31) << (i * 5);
+	}
+	assert(glGetError() == GL_NO_ERROR);
+}
+
 int Shader::getAttribLocation(const char* varname)
 {
+	if (compiled)
+	{
+		std::map<std::string, int>::iterator it = attrib_locations.find(varname);
+		return it == attrib_locations.end() ? -1 : it->second;
+	}
+
 	int loc = glGetAttribLocation(program, varname);
 	if (loc == -1)
 	{
@@ -576,6 +617,7 @@ void Shader::setTexture(const char* varname, Texture* tex, int slot)
 	}
 
 	glActiveTexture(GL_TEXTURE0 + slot);
+	tex->touch();
 	glBindTexture(tex->texture_type, tex->texture_id);
 	setUniform1(varname, slot);
 	glActiveTexture(GL_TEXTURE0 + slot);
@@ -91,8 +91,10 @@ public:
 	virtual void setTexture(const char* varname, const unsigned int tex) ;
 	virtual void setTexture(const char* varname, Texture* texture, int slot = -1);
 
-	virtual int getAttribLocation(const char* varname);
+	virtual int getAttribLocation(const char* varname); //cached after linking
 	virtual int getUniformLocation(const char* varname);
+	unsigned int getAttribLayoutKey() { return attrib_layout_key; } //packed locations of the mesh attributes, used to share VAOs
+	unsigned int getProgram() { return program; }
 
 	std::string getInfoLog() const;
 	bool hasInfoLog() const;
@@ -134,6 +136,10 @@ protected:
 	GLuint program;
 	std::string log;
 
+	std::map<std::string, int> attrib_locations;
+	unsigned int attrib_layout_key;
+	void cacheAttribLocations();
+
 //this is a hack to speed up shader usage (save info locally)
 private: 
 
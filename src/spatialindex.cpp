@@ -0,0 +1,640 @@
+#include "spatialindex.h"
+#include "scenenode.h"
+#include "scenegraph.h"
+#include "camera.h"
+#include "mesh.h"
+#include "utils.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+static inline Vector3 minVector(const Vector3& a, const Vector3& b) { return Vector3(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z); }
+static inline Vector3 maxVector(const Vector3& a, const Vector3& b) { return Vector3(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z); }
+
+//half of the surface, used as insertion cost
+static inline float boxArea(const Vector3& min, const Vector3& max)
+{
+	Vector3 d = max - min;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+static inline float mergedArea(const SpatialIndex::sTreeNode& a, const SpatialIndex::sTreeNode& b)
+{
+	return boxArea(minVector(a.min, b.min), maxVector(a.max, b.max));
+}
+
+static inline bool boxContains(const Vector3& min, const Vector3& max, const Vector3& inner_min, const Vector3& inner_max)
+{
+	return min.x <= inner_min.x && min.y <= inner_min.y && min.z <= inner_min.z && max.x >= inner_max.x && max.y >= inner_max.y && max.z >= inner_max.z;
+}
+
+static inline bool boxOverlap(const Vector3& a_min, const Vector3& a_max, const Vector3& b_min, const Vector3& b_max)
+{
+	return a_min.x <= b_max.x && a_max.x >= b_min.x && a_min.y <= b_max.y && a_max.y >= b_min.y && a_min.z <= b_max.z && a_max.z >= b_min.z;
+}
+
+static inline float boxSphereDistance2(const Vector3& min, const Vector3& max, const Vector3& center)
+{
+	Vector3 closest = minVector(maxVector(center, min), max);
+	Vector3 d = closest - center;
+	return d.x * d.x + d.y * d.y + d.z * d.z;
+}
+
+//slab test, inv_dir is 1/direction
+static inline bool boxRay(const Vector3& min, const Vector3& max, const Vector3& origin, const Vector3& inv_dir, float max_dist)
+{
+	float t1 = (min.x - origin.x) * inv_dir.x, t2 = (max.x - origin.x) * inv_dir.x;
+	float tmin = t1 < t2 ? t1 : t2, tmax = t1 > t2 ? t1 : t2;
+	t1 = (min.y - origin.y) * inv_dir.y; t2 = (max.y - origin.y) * inv_dir.y;
+	tmin = fmaxf(tmin, t1 < t2 ? t1 : t2); tmax = fminf(tmax, t1 > t2 ? t1 : t2);
+	t1 = (min.z - origin.z) * inv_dir.z; t2 = (max.z - origin.z) * inv_dir.z;
+	tmin = fmaxf(tmin, t1 < t2 ? t1 : t2); tmax = fminf(tmax, t1 > t2 ? t1 : t2);
+	return tmax >= (tmin > 0.0f ? tmin : 0.0f) && tmin <= max_dist;
+}
+
+SpatialIndex::SpatialIndex()
+{
+	margin = 0.1f;
+	clear();
+}
+
+void SpatialIndex::clear()
+{
+	tree.clear();
+	graph_proxies.clear();
+	root = -1;
+	free_list = -1;
+	num_leaves = 0;
+}
+
+int SpatialIndex::allocateNode()
+{
+	if (free_list == -1)
+	{
+		sTreeNode node;
+		node.parent = -1;
+		free_list = (int)tree.size();
+		tree.push_back(node);
+	}
+	int index = free_list;
+	sTreeNode& node = tree[index];
+	free_list = node.parent;
+	node.parent = node.child1 = node.child2 = -1;
+	node.height = 0;
+	node.node = NULL;
+	node.mesh = NULL;
+	return index;
+}
+
+void SpatialIndex::freeNode(int index)
+{
+	tree[index].parent = free_list;
+	tree[index].height = -1;
+	tree[index].node = NULL;
+	free_list = index;
+}
+
+int SpatialIndex::insert(SceneNode* node, const BoundingBox& box)
+{
+	int proxy = allocateNode();
+	sTreeNode& leaf = tree[proxy];
+	leaf.node = node;
+	leaf.mesh = node->mesh;
+	leaf.tight_min = box.center - box.halfsize;
+	leaf.tight_max = box.center + box.halfsize;
+	Vector3 fat = box.halfsize * margin;
+	leaf.min = leaf.tight_min - fat;
+	leaf.max = leaf.tight_max + fat;
+	insertLeaf(proxy);
+	num_leaves++;
+	return proxy;
+}
+
+void SpatialIndex::remove(int proxy)
+{
+	assert(proxy >= 0 && proxy < (int)tree.size() && tree[proxy].child1 == -1);
+	removeLeaf(proxy);
+	freeNode(proxy);
+	num_leaves--;
+}
+
+bool SpatialIndex::update(int proxy, const BoundingBox& box, bool reinsert)
+{
+	sTreeNode& leaf = tree[proxy];
+	leaf.mesh = leaf.node->mesh;
+	leaf.tight_min = box.center - box.halfsize;
+	leaf.tight_max = box.center + box.halfsize;
+	if (!reinsert)
+	{
+		leaf.min = leaf.tight_min;
+		leaf.max = leaf.tight_max;
+		return false;
+	}
+	if (boxContains(leaf.min, leaf.max, leaf.tight_min, leaf.tight_max))
+		return false; //still inside the fat box
+
+	removeLeaf(proxy);
+	Vector3 fat = box.halfsize * margin;
+	tree[proxy].min = tree[proxy].tight_min - fat;
+	tree[proxy].max = tree[proxy].tight_max + fat;
+	insertLeaf(proxy);
+	return true;
+}
+
+void SpatialIndex::insertLeaf(int leaf)
+{
+	if (root == -1)
+	{
+		root = leaf;
+		tree[root].parent = -1;
+		return;
+	}
+
+	//find the best sibling, descending where the increase of area is smaller
+	int index = root;
+	while (tree[index].child1 != -1)
+	{
+		const sTreeNode& node = tree[index];
+		float area = boxArea(node.min, node.max);
+		float combined_area = mergedArea(node, tree[leaf]);
+		float cost = 2.0f * combined_area; //new parent for this node and the leaf
+		float inheritance_cost = 2.0f * (combined_area - area); //minimum cost of pushing the leaf further down
+
+		float cost1 = mergedArea(tree[leaf], tree[node.child1]) + inheritance_cost;
+		if (tree[node.child1].child1 != -1)
+			cost1 -= boxArea(tree[node.child1].min, tree[node.child1].max);
+		float cost2 = mergedArea(tree[leaf], tree[node.child2]) + inheritance_cost;
+		if (tree[node.child2].child1 != -1)
+			cost2 -= boxArea(tree[node.child2].min, tree[node.child2].max);
+
+		if (cost < cost1 && cost < cost2)
+			break;
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+	int sibling = index;
+
+	//new parent for both
+	int old_parent = tree[sibling].parent;
+	int new_parent = allocateNode(); //can reallocate the tree
+	sTreeNode& parent = tree[new_parent];
+	parent.parent = old_parent;
+	parent.min = minVector(tree[leaf].min, tree[sibling].min);
+	parent.max = maxVector(tree[leaf].max, tree[sibling].max);
+	parent.height = tree[sibling].height + 1;
+	parent.child1 = sibling;
+	parent.child2 = leaf;
+	tree[sibling].parent = new_parent;
+	tree[leaf].parent = new_parent;
+	if (old_parent != -1)
+	{
+		if (tree[old_parent].child1 == sibling)
+			tree[old_parent].child1 = new_parent;
+		else
+			tree[old_parent].child2 = new_parent;
+	}
+	else
+		root = new_parent;
+
+	fixUpwards(tree[leaf].parent);
+}
+
+void SpatialIndex::removeLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = -1;
+		return;
+	}
+
+	int parent = tree[leaf].parent;
+	int grand_parent = tree[parent].parent;
+	int sibling = tree[parent].child1 == leaf ? tree[parent].child2 : tree[parent].child1;
+
+	if (grand_parent != -1)
+	{
+		//the sibling takes the place of the parent
+		if (tree[grand_parent].child1 == parent)
+			tree[grand_parent].child1 = sibling;
+		else
+			tree[grand_parent].child2 = sibling;
+		tree[sibling].parent = grand_parent;
+		freeNode(parent);
+		fixUpwards(grand_parent);
+	}
+	else
+	{
+		root = sibling;
+		tree[sibling].parent = -1;
+		freeNode(parent);
+	}
+	tree[leaf].parent = -1;
+}
+
+//rebalances and recomputes boxes and heights till the root
+void SpatialIndex::fixUpwards(int index)
+{
+	while (index != -1)
+	{
+		index = balance(index);
+		sTreeNode& node = tree[index];
+		const sTreeNode& child1 = tree[node.child1];
+		const sTreeNode& child2 = tree[node.child2];
+		node.height = 1 + (child1.height > child2.height ? child1.height : child2.height);
+		node.min = minVector(child1.min, child2.min);
+		node.max = maxVector(child1.max, child2.max);
+		index = node.parent;
+	}
+}
+
+//if one child is two levels taller than the other, it is rotated up. Returns the new root of the subtree
+int SpatialIndex::balance(int index_a)
+{
+	sTreeNode& a = tree[index_a];
+	if (a.child1 == -1 || a.height < 2)
+		return index_a;
+
+	int index_b = a.child1;
+	int index_c = a.child2;
+	sTreeNode& b = tree[index_b];
+	sTreeNode& c = tree[index_c];
+	int diff = c.height - b.height;
+
+	if (diff > 1)
+	{
+		//rotate C up
+		int index_f = c.child1;
+		int index_g = c.child2;
+		sTreeNode& f = tree[index_f];
+		sTreeNode& g = tree[index_g];
+
+		c.child1 = index_a;
+		c.parent = a.parent;
+		a.parent = index_c;
+		if (c.parent != -1)
+		{
+			if (tree[c.parent].child1 == index_a)
+				tree[c.parent].child1 = index_c;
+			else
+				tree[c.parent].child2 = index_c;
+		}
+		else
+			root = index_c;
+
+		sTreeNode& low = f.height > g.height ? g : f; //goes to A
+		int index_high = f.height > g.height ? index_f : index_g;
+		int index_low = f.height > g.height ? index_g : index_f;
+		sTreeNode& high = tree[index_high];
+		c.child2 = index_high;
+		a.child2 = index_low;
+		low.parent = index_a;
+		a.min = minVector(b.min, low.min);
+		a.max = maxVector(b.max, low.max);
+		c.min = minVector(a.min, high.min);
+		c.max = maxVector(a.max, high.max);
+		a.height = 1 + (b.height > low.height ? b.height : low.height);
+		c.height = 1 + (a.height > high.height ? a.height : high.height);
+		return index_c;
+	}
+
+	if (diff < -1)
+	{
+		//rotate B up
+		int index_d = b.child1;
+		int index_e = b.child2;
+		sTreeNode& d = tree[index_d];
+		sTreeNode& e = tree[index_e];
+
+		b.child1 = index_a;
+		b.parent = a.parent;
+		a.parent = index_b;
+		if (b.parent != -1)
+		{
+			if (tree[b.parent].child1 == index_a)
+				tree[b.parent].child1 = index_b;
+			else
+				tree[b.parent].child2 = index_b;
+		}
+		else
+			root = index_b;
+
+		sTreeNode& low = d.height > e.height ? e : d; //goes to A
+		int index_high = d.height > e.height ? index_d : index_e;
+		int index_low = d.height > e.height ? index_e : index_d;
+		sTreeNode& high = tree[index_high];
+		b.child2 = index_high;
+		a.child1 = index_low;
+		low.parent = index_a;
+		a.min = minVector(c.min, low.min);
+		a.max = maxVector(c.max, low.max);
+		b.min = minVector(a.min, high.min);
+		b.max = maxVector(a.max, high.max);
+		a.height = 1 + (c.height > low.height ? c.height : low.height);
+		b.height = 1 + (a.height > high.height ? a.height : high.height);
+		return index_b;
+	}
+
+	return index_a;
+}
+
+void SpatialIndex::refit()
+{
+	if (root == -1)
+		return;
+
+	//post order without recursion: children are pushed after their parent, so the reversed list is bottom-up
+	std::vector<int>& order = stack;
+	order.clear();
+	order.push_back(root);
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		const sTreeNode& node = tree[order[i]];
+		if (node.child1 != -1)
+		{
+			order.push_back(node.child1);
+			order.push_back(node.child2);
+		}
+	}
+	for (int i = (int)order.size() - 1; i >= 0; --i)
+	{
+		sTreeNode& node = tree[order[i]];
+		if (node.child1 == -1)
+			continue;
+		node.min = minVector(tree[node.child1].min, tree[node.child2].min);
+		node.max = maxVector(tree[node.child1].max, tree[node.child2].max);
+	}
+}
+
+void SpatialIndex::sync(SceneGraph& graph)
+{
+	if (graph_proxies.size() != graph.nodes.size())
+	{
+		clear();
+		graph_proxies.resize(graph.nodes.size(), -1);
+	}
+
+	for (size_t i = 0; i < graph.nodes.size(); ++i)
+	{
+		SceneNode* node = graph.nodes[i];
+		int& proxy = graph_proxies[i];
+		if (!node->mesh || !node->mesh->isLoaded())
+		{
+			if (proxy != -1)
+			{
+				remove(proxy);
+				proxy = -1;
+			}
+			continue;
+		}
+		if (proxy != -1 && !graph.dirty[i] && tree[proxy].mesh == node->mesh)
+			continue;
+
+		BoundingBox box = transformBoundingBox(graph.world_matrices[i], node->mesh->box);
+		if (proxy == -1)
+			proxy = insert(node, box);
+		else
+			update(proxy, box);
+	}
+}
+
+void SpatialIndex::addSubtree(int index, std::vector<SceneNode*>& result)
+{
+	size_t base = stack.size();
+	stack.push_back(index);
+	while (stack.size() > base)
+	{
+		const sTreeNode& node = tree[stack.back()];
+		stack.pop_back();
+		if (node.child1 == -1)
+			result.push_back(node.node);
+		else
+		{
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+void SpatialIndex::queryFrustum(Camera* camera, std::vector<SceneNode*>& result)
+{
+	if (root == -1)
+		return;
+	stack.clear();
+	stack.push_back(root);
+	while (stack.size())
+	{
+		int index = stack.back();
+		stack.pop_back();
+		const sTreeNode& node = tree[index];
+		bool leaf = node.child1 == -1;
+		const Vector3& min = leaf ? node.tight_min : node.min;
+		const Vector3& max = leaf ? node.tight_max : node.max;
+		Vector3 halfsize = (max - min) * 0.5f;
+		char clip = camera->testBoxInFrustum(min + halfsize, halfsize);
+		if (clip == CLIP_OUTSIDE)
+			continue;
+		if (leaf)
+			result.push_back(node.node);
+		else if (clip == CLIP_INSIDE)
+			addSubtree(index, result); //no need to test the children
+		else
+		{
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+void SpatialIndex::querySphere(const Vector3& center, float radius, std::vector<SceneNode*>& result)
+{
+	if (root == -1)
+		return;
+	float radius2 = radius * radius;
+	stack.clear();
+	stack.push_back(root);
+	while (stack.size())
+	{
+		const sTreeNode& node = tree[stack.back()];
+		stack.pop_back();
+		if (node.child1 == -1)
+		{
+			if (boxSphereDistance2(node.tight_min, node.tight_max, center) <= radius2)
+				result.push_back(node.node);
+		}
+		else if (boxSphereDistance2(node.min, node.max, center) <= radius2)
+		{
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+void SpatialIndex::queryAABB(const Vector3& min, const Vector3& max, std::vector<SceneNode*>& result)
+{
+	if (root == -1)
+		return;
+	stack.clear();
+	stack.push_back(root);
+	while (stack.size())
+	{
+		const sTreeNode& node = tree[stack.back()];
+		stack.pop_back();
+		if (node.child1 == -1)
+		{
+			if (boxOverlap(node.tight_min, node.tight_max, min, max))
+				result.push_back(node.node);
+		}
+		else if (boxOverlap(node.min, node.max, min, max))
+		{
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+void SpatialIndex::queryRay(const Vector3& origin, const Vector3& direction, float max_dist, std::vector<SceneNode*>& result)
+{
+	if (root == -1)
+		return;
+	Vector3 inv_dir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	stack.clear();
+	stack.push_back(root);
+	while (stack.size())
+	{
+		const sTreeNode& node = tree[stack.back()];
+		stack.pop_back();
+		if (node.child1 == -1)
+		{
+			if (boxRay(node.tight_min, node.tight_max, origin, inv_dir, max_dist))
+				result.push_back(node.node);
+		}
+		else if (boxRay(node.min, node.max, origin, inv_dir, max_dist))
+		{
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+std::string SpatialIndex::getStats()
+{
+	return "Spatial index: " + std::to_string(num_leaves) + " nodes, height " + std::to_string(getHeight());
+}
+
+// *********************************
+
+static float randomFloat(float min, float max) { return min + (max - min) * (rand() / (float)RAND_MAX); }
+
+void SpatialIndex::benchmark(int num_nodes)
+{
+	const int num_queries = 1000;
+	srand(num_nodes);
+
+	//random boxes with the same density whatever the amount
+	float world_size = 10.0f * powf((float)num_nodes, 1.0f / 3.0f);
+	std::vector<SceneNode*> nodes(num_nodes);
+	std::vector<BoundingBox> boxes(num_nodes);
+	for (int i = 0; i < num_nodes; ++i)
+	{
+		nodes[i] = new SceneNode("bench");
+		boxes[i].center = Vector3(randomFloat(0, world_size), randomFloat(0, world_size), randomFloat(0, world_size));
+		boxes[i].halfsize = Vector3(randomFloat(0.2f, 2.0f), randomFloat(0.2f, 2.0f), randomFloat(0.2f, 2.0f));
+	}
+	std::vector<int> proxies(num_nodes);
+
+	std::cout << " + Spatial index benchmark: " << num_nodes << " nodes" << std::endl;
+
+	SpatialIndex index;
+	double start = getTimeMs();
+	for (int i = 0; i < num_nodes; ++i)
+		proxies[i] = index.insert(nodes[i], boxes[i]);
+	std::cout << "\tbuild: " << (getTimeMs() - start) << "ms (height " << index.getHeight() << ")" << std::endl;
+
+	//small movements, most of them stay inside the fat box
+	int reinserted = 0;
+	start = getTimeMs();
+	for (int i = 0; i < num_nodes; ++i)
+	{
+		boxes[i].center = boxes[i].center + Vector3(randomFloat(-0.1f, 0.1f), randomFloat(-0.1f, 0.1f), randomFloat(-0.1f, 0.1f));
+		reinserted += index.update(proxies[i], boxes[i]) ? 1 : 0;
+	}
+	std::cout << "\tupdate (small moves): " << (getTimeMs() - start) << "ms (" << reinserted << " reinserted)" << std::endl;
+
+	SpatialIndex refitted = index;
+	start = getTimeMs();
+	for (int i = 0; i < num_nodes; ++i)
+	{
+		boxes[i].center = boxes[i].center + Vector3(randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1));
+		refitted.update(proxies[i], boxes[i], false);
+	}
+	refitted.refit();
+	std::cout << "\trefit (big moves): " << (getTimeMs() - start) << "ms" << std::endl;
+
+	start = getTimeMs();
+	for (int i = 0; i < num_nodes; ++i)
+		index.update(proxies[i], boxes[i]);
+	std::cout << "\tupdate (big moves): " << (getTimeMs() - start) << "ms" << std::endl;
+
+	//queries, compared with a linear scan
+	std::vector<Vector3> centers(num_queries);
+	for (int q = 0; q < num_queries; ++q)
+		centers[q] = Vector3(randomFloat(0, world_size), randomFloat(0, world_size), randomFloat(0, world_size));
+	std::vector<SceneNode*> result;
+	size_t found = 0;
+	start = getTimeMs();
+	for (int q = 0; q < num_queries; ++q)
+	{
+		result.clear();
+		index.querySphere(centers[q], 5.0f, result);
+		found += result.size();
+	}
+	double tree_ms = (getTimeMs() - start);
+	size_t found_linear = 0;
+	start = getTimeMs();
+	for (int q = 0; q < num_queries; ++q)
+		for (int i = 0; i < num_nodes; ++i)
+			if (boxSphereDistance2(boxes[i].center - boxes[i].halfsize, boxes[i].center + boxes[i].halfsize, centers[q]) <= 25.0f)
+				found_linear++;
+	std::cout << "\t" << num_queries << " sphere queries: " << tree_ms << "ms (" << found << " found), linear scan: " << (getTimeMs() - start) << "ms (" << found_linear << " found)" << std::endl;
+
+	found = 0;
+	start = getTimeMs();
+	for (int q = 0; q < num_queries; ++q)
+	{
+		result.clear();
+		Vector3 min(randomFloat(0, world_size), randomFloat(0, world_size), randomFloat(0, world_size));
+		index.queryAABB(min, min + Vector3(8, 8, 8), result);
+		found += result.size();
+	}
+	std::cout << "\t" << num_queries << " box queries: " << (getTimeMs() - start) << "ms (" << found << " found)" << std::endl;
+
+	found = 0;
+	start = getTimeMs();
+	for (int q = 0; q < num_queries; ++q)
+	{
+		result.clear();
+		Vector3 origin(randomFloat(0, world_size), randomFloat(0, world_size), randomFloat(0, world_size));
+		Vector3 direction(randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1));
+		index.queryRay(origin, direction.normalize(), world_size, result);
+		found += result.size();
+	}
+	std::cout << "\t" << num_queries << " ray queries: " << (getTimeMs() - start) << "ms (" << found << " found)" << std::endl;
+
+	Camera camera;
+	camera.setPerspective(45.f, 16.f / 9.f, 0.1f, world_size * 0.5f);
+	found = 0;
+	start = getTimeMs();
+	for (int q = 0; q < num_queries / 10; ++q)
+	{
+		result.clear();
+		Vector3 eye(randomFloat(0, world_size), randomFloat(0, world_size), randomFloat(0, world_size));
+		camera.lookAt(eye, eye + Vector3(randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1)), Vector3(0, 1, 0));
+		index.queryFrustum(&camera, result);
+		found += result.size();
+	}
+	std::cout << "\t" << num_queries / 10 << " frustum queries: " << (getTimeMs() - start) << "ms (" << found << " found)" << std::endl;
+
+	for (int i = 0; i < num_nodes; ++i)
+		delete nodes[i];
+}
@@ -0,0 +1,76 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include "framework.h"
+#include <vector>
+#include <string>
+
+class SceneNode;
+class Mesh;
+class Camera;
+class SceneGraph;
+
+//SpatialIndex
+//dynamic AABB tree over the world bounds of the scene nodes (like the broadphase of Box2D)
+//leaves store a fat box so small movements don't touch the tree, when a node leaves its fat box it is reinserted
+//the tree is kept balanced with rotations, queries return the nodes whose box passes the test
+
+class SpatialIndex {
+public:
+	struct sTreeNode {
+		Vector3 min; //fat box for the leaves
+		Vector3 max;
+		Vector3 tight_min; //real box of the scene node (only leaves)
+		Vector3 tight_max;
+		int parent; //next free node when it is in the free list
+		int child1; //-1 for leaves
+		int child2;
+		int height; //0 for leaves, -1 when free
+		SceneNode* node;
+		Mesh* mesh; //to detect when the node changes of mesh
+	};
+
+	std::vector<sTreeNode> tree;
+	int root;
+	int free_list;
+	int num_leaves;
+	float margin; //how much bigger are the fat boxes, relative to the size of the box
+
+	SpatialIndex();
+
+	void clear();
+	int insert(SceneNode* node, const BoundingBox& box); //returns the proxy
+	void remove(int proxy);
+	//returns true if the leaf had to be reinserted. With reinsert false only the leaf box is changed,
+	//call refit after moving many of them (faster than reinserting but the tree quality degrades)
+	bool update(int proxy, const BoundingBox& box, bool reinsert = true);
+	void refit();
+
+	//keeps the index in sync with the world matrices of the graph (only the dirty nodes are updated)
+	void sync(SceneGraph& graph);
+
+	//queries, the nodes found are appended to result
+	void queryFrustum(Camera* camera, std::vector<SceneNode*>& result);
+	void querySphere(const Vector3& center, float radius, std::vector<SceneNode*>& result);
+	void queryAABB(const Vector3& min, const Vector3& max, std::vector<SceneNode*>& result);
+	void queryRay(const Vector3& origin, const Vector3& direction, float max_dist, std::vector<SceneNode*>& result);
+
+	int getHeight() { return root == -1 ? 0 : tree[root].height; }
+	std::string getStats();
+
+	//prints the times of build, update, refit and queries with num_nodes random nodes
+	static void benchmark(int num_nodes);
+
+private:
+	std::vector<int> stack;
+	std::vector<int> graph_proxies; //proxy of every node of the SceneGraph, -1 if it is not in the tree
+	int allocateNode();
+	void freeNode(int index);
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	int balance(int index);
+	void fixUpwards(int index);
+	void addSubtree(int index, std::vector<SceneNode*>& result);
+};
+
+#endif
@@ -11,7 +11,15 @@
 #include "mesh.h"
 #include "shader.h"
 #include "extra/picopng.h"
+#include "pngdecoder.h"
+#include "texturecompressor.h"
+#include "texturestreamer.h"
+#include "workerpool.h"
 #include <cassert>
+#include <sstream>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 
 //bilinear interpolation
 Color Image::getPixelInterpolated(float x, float y, bool repeat) {
@@ -46,6 +54,7 @@ Vector4 Image::getPixelInterpolatedHigh(float x, float y, bool repeat) {
 std::map<std::string, Texture*> Texture::sTexturesLoaded;
 int Texture::default_mag_filter = GL_LINEAR;
 int Texture::default_min_filter = GL_LINEAR_MIPMAP_LINEAR;
+bool Texture::use_compression = true;
 FBO* Texture::global_fbo = NULL;
 
 Texture::Texture()
@@ -57,29 +66,35 @@ Texture::Texture()
 	mipmaps = false;
 	format = 0;
 	type = 0;
+	internal_format = 0;
 	texture_type = GL_TEXTURE_2D;
+	load_state = LOADED;
 }
 
 Texture::Texture(unsigned int width, unsigned int height, unsigned int format, unsigned int type, bool mipmaps, Uint8* data, unsigned int internal_format)
 {
 	texture_id = 0;
+	load_state = LOADED;
 	create(width, height, format, type, mipmaps, data, internal_format);
 }
 
 Texture::Texture(Image* img)
 {
 	texture_id = 0;
+	load_state = LOADED;
 	create(img->width, img->height, img->bytes_per_pixel == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, true, img->data);
 }
 
 Texture::~Texture()
 {
 	clear();
+	TextureStreamer::getGlobal()->unregisterTexture(this);
 }
 
 void Texture::clear()
 {
-	glDeleteTextures(1, &texture_id);
+	if (load_state == LOADED) //the async ones still use the id of the placeholder
+		glDeleteTextures(1, &texture_id);
 	glBindTexture(this->texture_type, 0);
 	texture_id = 0;
 }
@@ -167,7 +182,6 @@ bool Texture::cubemapFromHDRE(HDRE* hdre, unsigned int mipLevel)
 
 bool Texture::cubemapFromImages(const char * folder)
 {
-	uint8* faces[6];
 	std::string imgs[6] = {
 		std::string(folder) + "/rt.tga",
 		std::string(folder) + "/lf.tga",
@@ -177,20 +191,31 @@ bool Texture::cubemapFromImages(const char * folder)
 		std::string(folder) + "/ft.tga"
 	};
 
-	Image img;
+	//the six faces are read at the same time, every one in its own image
+	Image images[6];
+	bool loaded[6];
+	WorkerPool::getGlobal()->parallelFor(6, 1, [&](int start, int end) {
+		for (int i = start; i < end; ++i)
+			loaded[i] = images[i].loadTGA(imgs[i].c_str());
+	});
 
+	uint8* faces[6];
 	for (int i = 0; i < 6; ++i)
 	{
-		if (!img.loadTGA(imgs[i].c_str()))
+		if (!loaded[i])
 		{
 			std::cout << imgs[i].c_str() << " not loaded" << std::endl;
 			return false;
 		}
-
-		faces[i] = img.data;
+		if (images[i].width != images[0].width || images[i].height != images[0].height || images[i].bytes_per_pixel != images[0].bytes_per_pixel)
+		{
+			std::cout << "[ERROR] " << imgs[i].c_str() << " is different from the other faces" << std::endl;
+			return false;
+		}
+		faces[i] = images[i].data;
 	}
 
-	createCubemap(img.width, img.height, faces);
+	createCubemap(images[0].width, images[0].height, faces, images[0].bytes_per_pixel == 4 ? GL_RGBA : GL_RGB);
 	setName(folder);
 	return true;
 }
@@ -235,7 +260,13 @@ Texture* Texture::Get(const char* filename, bool mipmaps, unsigned int wrap)
 	//check if loaded
 	auto it = sTexturesLoaded.find(filename);
 	if (it != sTexturesLoaded.end())
-		return it->second;
+	{
+		Texture* texture = it->second;
+		texture->touch();
+		if (texture->load_state == LOADING) //requested with GetAsync and still in flight
+			texture->waitAsyncLoad();
+		return texture->load_state == LOADED ? texture : NULL;
+	}
 
 	//load it
 	Texture* texture = new Texture();
@@ -248,53 +279,546 @@ Texture* Texture::Get(const char* filename, bool mipmaps, unsigned int wrap)
 	return texture;
 }
 
-bool Texture::load(const char* filename, bool mipmaps, unsigned int wrap, unsigned int type)
+//one or two channels textures are read in the shaders like the RGBA that picoPNG gave (gray in RGB, alpha 1 or the second channel)
+static void setGraySwizzle(GLuint texture_id, int channels)
+{
+	GLint swizzle[] = { GL_RED, GL_RED, GL_RED, channels == 2 ? GL_GREEN : GL_ONE };
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+static bool loadImage(const char* filename, Image* image, std::ostream& log)
 {
 	std::string str = filename;
 	std::string ext = str.substr(str.size() - 4, 4);
-	Image* image = NULL;
-	long time = getTime();
-
-	std::cout << " + Texture loading: " << filename << " ... ";
-
-	image = new Image();
 	bool found = false;
 
 	if (ext == ".tga" || ext == ".TGA")
 		found = image->loadTGA(filename);
 	else if (ext == ".png" || ext == ".PNG")
-		found = image->loadPNG(filename, true);
+		found = image->loadPNG(filename, true, true); //grayscale maps stay with one channel
 	else
 	{
-		std::cout << "[ERROR]: unsupported format" << std::endl;
+		log << "[ERROR]: unsupported format";
 		return false; //unsupported file type
 	}
 
 	if (!found) //file not found
 	{
-		std::cout << " [ERROR]: Texture not found " << std::endl;
+		log << " [ERROR]: Texture not found ";
 		return false;
 	}
+	return true;
+}
 
-	this->filename = filename;
+//the part of the load that doesn't use GL, so it can run in a worker: the maps of the materials are block compressed and
+//the mips are made on the CPU (MipChain), both are stored in a .tbin so next runs get all the levels without decoding the source
+static bool loadLevels(const char* filename, bool mipmaps, unsigned int wrap, TextureCompressor& levels, std::ostream& log)
+{
+	eTextureRole role = TextureCompressor::getRole(filename);
+	bool compress = Texture::use_compression && role != ROLE_NONE;
+	bool use_cache = mipmaps || compress;
+	bool repeat = wrap == GL_REPEAT;
+	if (use_cache && levels.readBin(getCacheFilename(filename, ".tbin").c_str(), filename) && levels.isSupported() && levels.repeat == repeat &&
+		(levels.codec == CODEC_NONE ? !compress || levels.width % 4 || levels.height % 4 : compress)) //the sizes not multiple of 4 are not compressed
+	{
+		log << "[OK] Size: " << levels.width << "x" << levels.height << " " << TextureCompressor::getCodecName(levels.codec) << " (cached) " << levels.getSize() / 1024 << "KB ";
+		return true;
+	}
 
-	unsigned int internal_format = 0;
+	Image image;
+	if (!loadImage(filename, &image, log))
+		return false;
 
-	if (type == GL_FLOAT)
-		internal_format = (image->bytes_per_pixel == 3 ? GL_RGB32F : GL_RGBA32F);
+	if (use_cache)
+	{
+		levels.compress(&image, compress ? TextureCompressor::chooseCodec(role, &image) : CODEC_NONE, role, repeat);
+		levels.writeBin(filename);
+	}
+	else //only the pixels of the file
+	{
+		levels.codec = CODEC_NONE;
+		levels.width = image.width;
+		levels.height = image.height;
+		levels.channels = image.bytes_per_pixel;
+		levels.repeat = repeat;
+		levels.levels.resize(1);
+		sCompressedLevel& level = levels.levels[0];
+		level.width = image.width;
+		level.height = image.height;
+		level.data.assign(image.data, image.data + levels.getLevelBytes(level.width, level.height));
+	}
 
-	//upload to VRAM
-	create(image->width, image->height, (image->bytes_per_pixel == 3 ? GL_RGB : GL_RGBA), type, mipmaps, image->data, 0, wrap);
+	log << "[OK] Size: " << levels.width << "x" << levels.height;
+	if (use_cache)
+		log << " " << TextureCompressor::getCodecName(levels.codec) << " " << levels.getSize() / 1024 << "KB";
+	log << " ";
+	return true;
+}
 
-	if (mipmaps)
-		generateMipmaps();
+bool Texture::load(const char* filename, bool mipmaps, unsigned int wrap, unsigned int type)
+{
+	long time = getTime();
+	std::stringstream log;
+
+	std::cout << " + Texture loading: " << filename << " ... ";
+
+	if (type == GL_UNSIGNED_BYTE)
+	{
+		TextureCompressor levels;
+		bool loaded = loadLevels(filename, mipmaps, wrap, levels, log);
+		std::cout << log.str();
+		if (!loaded)
+		{
+			std::cout << std::endl;
+			return false;
+		}
+		//the maps of the materials only upload the small mips, the rest are streamed when needed
+		int first_level = mipmaps ? TextureStreamer::getGlobal()->registerTexture(this, filename, &levels) : 0;
+		createFromLevels(&levels, mipmaps, wrap, first_level);
+	}
+	else
+	{
+		Image image;
+		bool loaded = loadImage(filename, &image, log);
+		std::cout << log.str();
+		if (!loaded)
+		{
+			std::cout << std::endl;
+			return false;
+		}
+
+		unsigned int internal_format = 0;
 
+		if (type == GL_FLOAT)
+			internal_format = (image.bytes_per_pixel == 3 ? GL_RGB32F : GL_RGBA32F);
+
+		unsigned int formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+		assert(image.bytes_per_pixel >= 1 && image.bytes_per_pixel <= 4);
+
+		//upload to VRAM, the rows of 1 or 3 channels are not aligned to 4 bytes
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		create(image.width, image.height, formats[image.bytes_per_pixel - 1], type, mipmaps, image.data, 0, wrap);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		if (image.bytes_per_pixel <= 2)
+			setGraySwizzle(texture_id, image.bytes_per_pixel);
+
+		if (mipmaps)
+			generateMipmaps(); //float textures
+		std::cout << "[OK] Size: " << width << "x" << height << " ";
+	}
+
+	this->filename = filename;
 	this->image.clear();
-	std::cout << "[OK] Size: " << width << "x" << height << " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+	std::cout << "Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
 	setName(filename);
 	return true;
 }
 
+//format, size and wrap of a texture made from the levels of the cache
+static void setLevelsInfo(Texture* texture, TextureCompressor* source, bool mipmaps, unsigned int wrap)
+{
+	texture->width = (float)source->width;
+	texture->height = (float)source->height;
+	texture->depth = 0;
+	texture->format = source->getBaseFormat();
+	texture->internal_format = source->getGLFormat();
+	texture->type = GL_UNSIGNED_BYTE;
+	texture->mipmaps = mipmaps && source->levels.size() > 1;
+	texture->wrapS = texture->wrapT = wrap;
+	texture->texture_type = GL_TEXTURE_2D;
+}
+
+//data is an offset if a pixel unpack buffer is bound
+static void uploadLevel(TextureCompressor* source, int level_index, const void* data)
+{
+	sCompressedLevel& level = source->levels[level_index];
+	if (source->codec == CODEC_NONE)
+		glTexImage2D(GL_TEXTURE_2D, level_index, source->getGLFormat(), level.width, level.height, 0, source->getBaseFormat(), GL_UNSIGNED_BYTE, data);
+	else
+		glCompressedTexImage2D(GL_TEXTURE_2D, level_index, source->getGLFormat(), level.width, level.height, 0, (GLsizei)level.data.size(), data);
+}
+
+static void setLevelsParams(Texture* texture, TextureCompressor* source, int first_level)
+{
+	int num_levels = texture->mipmaps ? (int)source->levels.size() : 1;
+	glBindTexture(GL_TEXTURE_2D, texture->texture_id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, first_level);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, num_levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, Texture::default_mag_filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture->mipmaps ? Texture::default_min_filter : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture->wrapS);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, texture->wrapT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (texture->format == GL_RED || (texture->format == GL_RG && source->codec == CODEC_NONE))
+		setGraySwizzle(texture->texture_id, texture->format == GL_RED ? 1 : 2);
+}
+
+//uploads every level (compressed blocks or pixels), the mips are not generated by the driver.
+//The levels before first_level are left empty, GL_TEXTURE_BASE_LEVEL skips them
+void Texture::createFromLevels(TextureCompressor* source, bool mipmaps, unsigned int wrap, int first_level)
+{
+	assert(source->levels.size() && "nothing to upload");
+
+	if (this->texture_id != 0)
+		clear();
+	setLevelsInfo(this, source, mipmaps, wrap);
+	if (!this->mipmaps)
+		first_level = 0;
+
+	glGenTextures(1, &texture_id);
+	if (this->mipmaps)
+		uploadLevels(source, first_level, (int)source->levels.size() - 1);
+	else
+		uploadLevels(source, 0, 0);
+
+	setLevelsParams(this, source, first_level);
+	assert(checkGLErrors() && "Error uploading texture levels");
+}
+
+void Texture::uploadLevels(TextureCompressor* source, int first_level, int last_level)
+{
+	assert(texture_type == GL_TEXTURE_2D && first_level >= 0 && last_level < (int)source->levels.size());
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = first_level; i <= last_level; ++i)
+		uploadLevel(source, i, &source->levels[i].data[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+//respecifies the levels with 0x0 so the driver releases their memory
+void Texture::freeLevels(int first_level, int last_level)
+{
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+	for (int i = first_level; i <= last_level; ++i)
+	{
+		if (internal_format == format) //uncompressed
+			glTexImage2D(GL_TEXTURE_2D, i, internal_format, 0, 0, 0, format, GL_UNSIGNED_BYTE, NULL);
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, internal_format, 0, 0, 0, 0, NULL);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture::setBaseLevel(int level)
+{
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+//async loading *************************************
+
+size_t Texture::upload_budget = 8 * 1024 * 1024;
+
+struct sAsyncTextureLoad {
+	Texture* texture;
+	bool loaded;
+	TextureCompressor* levels; //deleted once uploaded
+	bool mipmaps;
+	unsigned int wrap;
+	std::string log;
+	long start_time;
+	GLuint upload_id; //filled level by level, it replaces the placeholder when all of them are uploaded
+	int first_level; //the finer ones are streamed later (see TextureStreamer)
+	int next_level;
+};
+
+static std::mutex async_mutex;
+static std::condition_variable async_loaded; //signaled when a job finishes
+static std::deque<sAsyncTextureLoad> async_finished; //decoded in the workers, waiting for the upload
+static int async_in_flight = 0;
+static sAsyncTextureLoad* async_streaming = NULL; //the one being uploaded across frames, only used in the main thread
+static std::map< Texture*, std::vector< std::function<void(Texture*)> > > async_callbacks; //only used in the main thread
+
+//ring of pixel unpack buffers: every level is copied to a mapped buffer and the driver transfers it to the texture
+//without stalling the CPU, the fence of a buffer tells when the GPU is done reading it and it can be written again
+#define TEXTURE_UPLOAD_RING_SIZE 4
+struct sUploadBuffer {
+	GLuint buffer_id;
+	GLsizeiptr size;
+	GLsync fence;
+};
+static sUploadBuffer upload_ring[TEXTURE_UPLOAD_RING_SIZE] = {};
+static int upload_ring_index = 0;
+
+Texture* Texture::GetAsync(const char* filename, std::function<void(Texture*)> on_loaded, bool mipmaps, unsigned int wrap, bool black_placeholder)
+{
+	assert(filename);
+	auto it = sTexturesLoaded.find(filename);
+	if (it != sTexturesLoaded.end()) //already loaded or in flight, same handle
+	{
+		Texture* texture = it->second;
+		texture->touch();
+		if (on_loaded)
+		{
+			if (texture->load_state == LOADING)
+				async_callbacks[texture].push_back(on_loaded);
+			else
+				on_loaded(texture);
+		}
+		return texture;
+	}
+
+	//the handle is registered now and uses the id of the placeholder till the upload is finished
+	Texture* placeholder = black_placeholder ? getBlackTexture() : getWhiteTexture();
+	Texture* texture = new Texture();
+	texture->texture_id = placeholder->texture_id;
+	texture->width = placeholder->width;
+	texture->height = placeholder->height;
+	texture->format = placeholder->format;
+	texture->type = placeholder->type;
+	texture->internal_format = placeholder->internal_format;
+	texture->load_state = LOADING;
+	texture->filename = filename;
+	texture->setName(filename);
+	if (on_loaded)
+		async_callbacks[texture].push_back(on_loaded);
+
+	{
+		std::unique_lock<std::mutex> lock(async_mutex);
+		async_in_flight++;
+	}
+
+	std::string name = filename;
+	WorkerPool::getGlobal()->addJob([texture, name, mipmaps, wrap]() {
+		sAsyncTextureLoad job;
+		job.texture = texture;
+		job.levels = new TextureCompressor();
+		job.mipmaps = mipmaps;
+		job.wrap = wrap;
+		job.upload_id = 0;
+		job.first_level = 0;
+		job.next_level = 0;
+		job.start_time = getTime();
+		std::stringstream log;
+		job.loaded = loadLevels(name.c_str(), mipmaps, wrap, *job.levels, log);
+		job.log = log.str();
+		{
+			std::unique_lock<std::mutex> lock(async_mutex);
+			async_finished.push_back(job);
+		}
+		async_loaded.notify_all();
+	});
+
+	return texture;
+}
+
+static int getNumUploadLevels(sAsyncTextureLoad& job)
+{
+	return job.mipmaps ? (int)job.levels->levels.size() : 1;
+}
+
+//before the first level is uploaded, the maps of the materials start with the small mips
+static void beginAsyncUpload(sAsyncTextureLoad& job)
+{
+	if (job.mipmaps)
+		job.first_level = TextureStreamer::getGlobal()->registerTexture(job.texture, job.texture->filename.c_str(), job.levels);
+	job.next_level = job.first_level;
+}
+
+//copies the next level to a buffer of the ring and starts its transfer,
+//false if the GPU is still reading that buffer and we don't want to wait
+static bool streamNextLevel(sAsyncTextureLoad& job, bool wait)
+{
+	sUploadBuffer& ring_buffer = upload_ring[upload_ring_index];
+	if (ring_buffer.fence)
+	{
+		if (glClientWaitSync(ring_buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			if (!wait)
+				return false;
+			while (glClientWaitSync(ring_buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(ring_buffer.fence);
+		ring_buffer.fence = NULL;
+	}
+
+	if (!job.upload_id)
+		glGenTextures(1, &job.upload_id);
+
+	sCompressedLevel& level = job.levels->levels[job.next_level];
+	GLsizeiptr size = (GLsizeiptr)level.data.size();
+	if (!ring_buffer.buffer_id)
+		glGenBuffers(1, &ring_buffer.buffer_id);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring_buffer.buffer_id);
+	if (ring_buffer.size < size)
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		ring_buffer.size = size;
+	}
+
+	const void* data = NULL; //offset 0 of the buffer
+	void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	if (ptr)
+	{
+		memcpy(ptr, &level.data[0], size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	else //straight from memory
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		data = &level.data[0];
+	}
+
+	glBindTexture(GL_TEXTURE_2D, job.upload_id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	uploadLevel(job.levels, job.next_level, data);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (ptr)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		ring_buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		upload_ring_index = (upload_ring_index + 1) % TEXTURE_UPLOAD_RING_SIZE;
+	}
+	job.next_level++;
+	return true;
+}
+
+//called from the main thread once every level is uploaded (or the load failed)
+static void finishAsyncLoad(sAsyncTextureLoad& job)
+{
+	Texture* texture = job.texture;
+	std::cout << " + Texture loading (async): " << texture->filename << " ... " << job.log;
+	if (job.loaded)
+	{
+		//from now on the id is its own
+		texture->load_state = Texture::LOADED;
+		setLevelsInfo(texture, job.levels, job.mipmaps, job.wrap);
+		texture->texture_id = job.upload_id;
+		setLevelsParams(texture, job.levels, job.first_level);
+		std::cout << "Time: " << (getTime() - job.start_time) * 0.001 << "sec" << std::endl;
+	}
+	else
+	{
+		//remove it so it can be requested again, the handle keeps showing the placeholder
+		std::cout << std::endl;
+		texture->load_state = Texture::LOAD_FAILED;
+		auto it = Texture::sTexturesLoaded.find(texture->filename);
+		if (it != Texture::sTexturesLoaded.end() && it->second == texture)
+			Texture::sTexturesLoaded.erase(it);
+	}
+	delete job.levels;
+	job.levels = NULL;
+
+	{
+		std::unique_lock<std::mutex> lock(async_mutex);
+		async_in_flight--;
+	}
+
+	//the callbacks could request more textures
+	std::vector< std::function<void(Texture*)> > callbacks;
+	auto it = async_callbacks.find(texture);
+	if (it == async_callbacks.end())
+		return;
+	callbacks.swap(it->second);
+	async_callbacks.erase(it);
+	if (texture->load_state == Texture::LOADED)
+		for (size_t i = 0; i < callbacks.size(); ++i)
+			callbacks[i](texture);
+}
+
+void Texture::waitAsyncLoad()
+{
+	while (load_state == LOADING)
+	{
+		//the one being streamed, the rest of its levels now
+		if (async_streaming && async_streaming->texture == this)
+		{
+			sAsyncTextureLoad* job = async_streaming;
+			async_streaming = NULL;
+			while (job->next_level < getNumUploadLevels(*job))
+				streamNextLevel(*job, true);
+			finishAsyncLoad(*job);
+			delete job;
+			continue;
+		}
+
+		sAsyncTextureLoad job;
+		{
+			std::unique_lock<std::mutex> lock(async_mutex);
+			std::deque<sAsyncTextureLoad>::iterator it;
+			async_loaded.wait(lock, [this, &it]() {
+				for (it = async_finished.begin(); it != async_finished.end(); ++it)
+					if (it->texture == this)
+						return true;
+				return false;
+			});
+			job = *it;
+			async_finished.erase(it);
+		}
+		if (job.loaded)
+		{
+			beginAsyncUpload(job);
+			while (job.next_level < getNumUploadLevels(job))
+				streamNextLevel(job, true);
+		}
+		finishAsyncLoad(job);
+	}
+}
+
+int Texture::processPendingUploads(float budget_ms)
+{
+	long start = getTime();
+	size_t bytes = 0;
+	int num = 0;
+	while (true)
+	{
+		//the one being streamed goes first, then the next one decoded by the workers
+		if (!async_streaming)
+		{
+			sAsyncTextureLoad job;
+			{
+				std::unique_lock<std::mutex> lock(async_mutex);
+				if (async_finished.empty())
+					break;
+				job = async_finished.front();
+				async_finished.pop_front();
+			}
+			if (!job.loaded)
+			{
+				finishAsyncLoad(job);
+				continue;
+			}
+			async_streaming = new sAsyncTextureLoad(job);
+			beginAsyncUpload(*async_streaming);
+		}
+
+		//at least one level per frame, the rest while they fit in the budget (big textures take several frames)
+		sAsyncTextureLoad& job = *async_streaming;
+		size_t level_bytes = job.levels->levels[job.next_level].data.size();
+		if (bytes && bytes + level_bytes > upload_budget)
+			break;
+		if (!streamNextLevel(job, false))
+			break; //the GPU is still reading every buffer of the ring
+		bytes += level_bytes;
+
+		if (job.next_level == getNumUploadLevels(job))
+		{
+			finishAsyncLoad(job);
+			delete async_streaming;
+			async_streaming = NULL;
+			num++;
+		}
+
+		if ((getTime() - start) >= budget_ms)
+			break;
+	}
+	return num;
+}
+
+int Texture::getNumAsyncLoads()
+{
+	std::unique_lock<std::mutex> lock(async_mutex);
+	return async_in_flight;
+}
+
 void Texture::upload(Image* img)
 {
 	create(img->width, img->height, img->bytes_per_pixel == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, true, img->data);
@@ -443,10 +967,41 @@ void Texture::uploadAsArray(unsigned int texture_size, bool mipmaps)
 
 void Texture::bind()
 {
+	touch();
 	//glEnable(this->texture_type); //enable the textures 
 	glBindTexture(this->texture_type, texture_id );	//enable the id of the texture we are going to use
 }
 
+//estimated from the format, the drivers usually pad the RGB ones to RGBA
+size_t Texture::getGPUBytes()
+{
+	if (!texture_id || load_state != LOADED)
+		return 0;
+
+	TextureStreamer* streamer = TextureStreamer::getGlobal();
+	std::map<Texture*, sStreamedTexture>::iterator it = streamer->textures.find(this);
+	if (it != streamer->textures.end())
+		return it->second.getResidentBytes();
+
+	int bits = 0;
+	switch (internal_format)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: case GL_COMPRESSED_RED_RGTC1: bits = 4; break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: case GL_COMPRESSED_RG_RGTC2: case GL_COMPRESSED_RGBA_BPTC_UNORM_ARB: bits = 8; break;
+	default:
+		int channels = (format == GL_RED || format == GL_ALPHA || format == GL_LUMINANCE || format == GL_DEPTH_COMPONENT) ? 1 : (format == GL_RG || format == GL_LUMINANCE_ALPHA) ? 2 : (format == GL_RGB || format == GL_BGR) ? 3 : 4;
+		int type_bytes = (type == GL_FLOAT || type == GL_UNSIGNED_INT || type == GL_INT) ? 4 : (type == GL_HALF_FLOAT || type == GL_UNSIGNED_SHORT || type == GL_SHORT) ? 2 : 1;
+		bits = channels * type_bytes * 8;
+	}
+
+	size_t bytes = (size_t)width * (size_t)height * (depth > 0 ? (size_t)depth : 1) * bits / 8;
+	if (texture_type == GL_TEXTURE_CUBE_MAP)
+		bytes *= 6;
+	if (mipmaps)
+		bytes += bytes / 3;
+	return bytes;
+}
+
 void Texture::unbind()
 {
 	//glDisable(this->texture_type); //disable the textures 
@@ -508,7 +1063,7 @@ Texture* Texture::getWhiteTexture()
 	static Texture* white = NULL;
 	if (white)
 		return white;
-	const Uint8 data[3] = { 1,1,1 };
+	const Uint8 data[3] = { 255,255,255 };
 	white = new Texture(1, 1, GL_RGB, GL_UNSIGNED_BYTE, true, (Uint8*)data);
 	return white;
 }
@@ -553,117 +1108,141 @@ void Image::fromTexture(Texture* texture)
 	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
 }
 
+//RLE packets: with the high bit one pixel is repeated count times, otherwise count pixels follow as they are
+static bool decodeTGARLE(const uint8* in, const uint8* end, uint8* out, size_t num_pixels, int bytes_per_pixel, const char* order)
+{
+	size_t done = 0;
+	while (done < num_pixels)
+	{
+		if (in >= end)
+			return false;
+		int packet = *in++;
+		size_t count = (packet & 0x7F) + 1;
+		if (count > num_pixels - done)
+			return false;
+		uint8* dst = out + done * bytes_per_pixel;
+		if (packet & 0x80)
+		{
+			if (end - in < bytes_per_pixel)
+				return false;
+			uint8 pixel[4] = { in[2], in[1], in[0], bytes_per_pixel == 4 ? in[3] : (uint8)255 };
+			for (size_t i = 0; i < count; ++i, dst += bytes_per_pixel)
+				memcpy(dst, pixel, bytes_per_pixel);
+			in += bytes_per_pixel;
+		}
+		else
+		{
+			if ((size_t)(end - in) < count * bytes_per_pixel)
+				return false;
+			ImageKernels::swizzle(in, dst, count, bytes_per_pixel, order);
+			in += count * bytes_per_pixel;
+		}
+		done += count;
+	}
+	return true;
+}
+
 //TGA format from: http://www.paulbourke.net/dataformats/tga/
+//the file is mapped and the pixels go from BGR to RGB while they are copied from it (no fread and no second pass)
 bool Image::loadTGA(const char* filename)
 {
-    GLubyte TGAheader[12] = {0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-    GLubyte TGAcompare[12];
-    GLubyte header[6];
-    GLuint bytesPerPixel;
-    GLuint imageSize;
-    //GLuint type = GL_RGBA;
-
-    FILE * file = fopen(filename, "rb");
-    
-    if ( file == NULL || fread(TGAcompare, 1, sizeof(TGAcompare), file) != sizeof(TGAcompare) ||
-        memcmp(TGAheader, TGAcompare, sizeof(TGAheader)) != 0 ||
-        fread(header, 1, sizeof(header), file) != sizeof(header))
-    {
-        if (file == NULL)
-            return NULL;
-        else
-        {
-            fclose(file);
-            return NULL;
-        }
-    }
-
-    width = header[1] * 256 + header[0];
-    height = header[3] * 256 + header[2];
-	bytes_per_pixel = header[4] / 8;
+	MappedFile file;
+	if (!file.open(filename) || file.size < 18)
+		return false;
+
+	const uint8* header = file.data;
+	int id_length = header[0];
+	int color_map_type = header[1];
+	int image_type = header[2];
+	unsigned int w = header[12] | (header[13] << 8);
+	unsigned int h = header[14] | (header[15] << 8);
+	unsigned int bpp = header[16] / 8;
 
 	bool error = false;
+	if (color_map_type != 0 || (image_type != 2 && image_type != 10))
+	{
+		error = true;
+		std::cerr << "File format not supported: TGA type " << image_type << " (only true color, raw or RLE)" << std::endl;
+	}
 
-	if (bytes_per_pixel != 3 && bytes_per_pixel != 4)
+	if (bpp != 3 && bpp != 4)
 	{
 		error = true;
-		std::cerr << "File format not supported: " << bytes_per_pixel << " bytes per pixel" << std::endl;
+		std::cerr << "File format not supported: " << bpp << " bytes per pixel" << std::endl;
 	}
-    
-    if (width <= 0 || height <= 0)
+
+	if (w <= 0 || h <= 0)
 	{
 		error = true;
-		std::cerr << "Wrong texture size: " << width << "x" << height << " pixels" << std::endl;
-	}
-
-	if(error)
-    {
-        fclose(file);
-        return false;
-    }
-
-    imageSize = width * height * bytes_per_pixel;
-    
-    data = new GLubyte[imageSize];
-    if (data == NULL || fread(data, 1, imageSize, file) != imageSize)
-    {
-        if (data != NULL)
-            delete []data;
-        fclose(file);
-        return NULL;
-    }
-
-	if (header[5] & (1 << 4)) //flip
-		origin_topleft = true;
-    
-	//flip BGR to RGB pixels
-	#pragma omp simd
-    for (GLuint i = 0; i < int(imageSize); i += bytes_per_pixel)
-    {
-        uint8 temp = data[i];
-        data[i] = data[i + 2];
-        data[i + 2] = temp;
-    }
-    
-    fclose(file);
+		std::cerr << "Wrong texture size: " << w << "x" << h << " pixels" << std::endl;
+	}
+
+	if (error || file.size < 18 + (size_t)id_length)
+		return false;
+
+	const uint8* pixels = file.data + 18 + id_length;
+	const uint8* end = file.data + file.size;
+	size_t num_pixels = (size_t)w * h;
+	const char* order = bpp == 4 ? "bgra" : "bgr";
+	uint8* new_data = new uint8[num_pixels * bpp];
+	bool loaded = false;
+	if (image_type == 10)
+		loaded = decodeTGARLE(pixels, end, new_data, num_pixels, bpp, order);
+	else if ((size_t)(end - pixels) >= num_pixels * bpp)
+	{
+		ImageKernels::swizzle(pixels, new_data, num_pixels, bpp, order);
+		loaded = true;
+	}
+
+	if (!loaded)
+	{
+		std::cerr << "TGA file truncated or corrupt: " << filename << std::endl;
+		delete[] new_data;
+		return false;
+	}
 
+	if (data)
+		delete[] data;
+	data = new_data;
+	width = w;
+	height = h;
+	bytes_per_pixel = bpp;
+	origin_topleft = (header[17] & (1 << 5)) != 0;
 	return true;
 }
 
 #include <iostream>
 #include <fstream>
 
-bool Image::loadPNG(const char* filename, bool flip_y)
+bool Image::loadPNG(const char* filename, bool flip_y, bool keep_channels)
 {
-	std::ifstream file( filename, std::ios::in | std::ios::binary | std::ios::ate);
-
-	//get filesize
-	std::streamsize size = 0;
-	if (file.seekg(0, std::ios::end).good()) size = file.tellg();
-	if (file.seekg(0, std::ios::beg).good()) size -= file.tellg();
-
-	if (!size)
+	std::string buffer;
+	if (!readFile(filename, buffer) || buffer.empty())
 		return false;
 
-	std::vector<unsigned char> buffer;
+	std::vector<unsigned char> out_image;
+	const unsigned char* in_png = (const unsigned char*)buffer.data();
+	unsigned int channels = 4;
 
-	//read contents of the file into the vector
-	if (size > 0)
+	//fast path, the rows come already flipped
+	if (!decodePNGFast(out_image, width, height, channels, in_png, buffer.size(), flip_y))
 	{
-		buffer.resize((size_t)size);
-		file.read((char*)(&buffer[0]), size);
+		//picoPNG for the formats it doesn't support (less than 8 bits, interlaced, color key)
+		channels = 4;
+		if (decodePNG(out_image, width, height, in_png, (unsigned long)buffer.size(), true) != 0)
+			return false;
 	}
-	else 
-		buffer.clear();
-
-	std::vector<unsigned char> out_image;
-
-	if (decodePNG( out_image, width, height, buffer.empty() ? 0 : &buffer[0], (unsigned long)buffer.size(), true) != 0)
-		return false;
+	else
+		flip_y = false;
 
-	data = new Uint8[ out_image.size() ];
-	memcpy( data, &out_image[0], out_image.size() );
-	bytes_per_pixel = 4;
+	if (data)
+		delete[] data;
+	bytes_per_pixel = keep_channels ? channels : 4;
+	data = new Uint8[width * height * bytes_per_pixel];
+	if (bytes_per_pixel == channels)
+		memcpy(data, &out_image[0], out_image.size());
+	else
+		expandToRGBA(&out_image[0], data, (size_t)width * height, channels);
 
 	//flip pixels in Y
 	if (flip_y)
@@ -694,20 +1273,16 @@ bool Image::saveTGA(const char* filename, bool flip_y)
 	fwrite(TGAheader, 1, sizeof(TGAheader), file);
 	fwrite(header, 1, 6, file);
 
-	//convert pixels to unsigned char
+	//convert pixels to BGRA
 	unsigned char* bytes = new unsigned char[width*height * 4];
 	for (unsigned int y = 0; y < height; ++y)
-		for (unsigned int x = 0; x < width; ++x)
-		{
-			Uint8* p = data + (height - y - 1)*width*4 + x*4;
-			unsigned int pos = (y*width + x) * 4;
-			if(flip_y)
-				pos = ((height - y - 1)*width + x) * 4;
-			bytes[pos + 2] = *p;
-			bytes[pos + 1] = *(p+1);
-			bytes[pos] = *(p+2);
-			bytes[pos + 3] = *(p+3);
-		}
+	{
+		Uint8* p = data + (height - y - 1)*width*4;
+		unsigned int pos = y*width * 4;
+		if(flip_y)
+			pos = (height - y - 1)*width * 4;
+		ImageKernels::swizzle(p, bytes + pos, width, 4, "bgra");
+	}
 
 	fwrite(bytes, 1, width*height * 4, file);
 	fclose(file);
@@ -717,18 +1292,54 @@ bool Image::saveTGA(const char* filename, bool flip_y)
 void Image::flipY()
 {
 	assert(data);
-	int row_size = 4 * width;
-	uint8* temp_row = new uint8[row_size];
-#pragma omp simd
-	for (int y = 0; y < height*0.5; y += 1)
-	{
-		uint8* pos = data + y*row_size;
-		memcpy(temp_row, pos, row_size);
-		uint8* pos2 = data + (height - y - 1)*row_size;
-		memcpy(pos, pos2, row_size);
-		memcpy(pos2, temp_row, row_size);
-	}
-	delete[] temp_row;
+	ImageKernels::flipY(data, width, height, bytes_per_pixel);
+}
+
+void Image::flipX()
+{
+	assert(data);
+	ImageKernels::flipX(data, width, height, bytes_per_pixel);
+}
+
+void Image::swizzle(const char* order)
+{
+	assert(data);
+	int channels = (int)strlen(order);
+	if (channels <= (int)bytes_per_pixel)
+		ImageKernels::swizzle(data, data, (size_t)width * height, bytes_per_pixel, order);
+	else
+	{
+		uint8* new_data = new uint8[(size_t)width * height * channels];
+		ImageKernels::swizzle(data, new_data, (size_t)width * height, bytes_per_pixel, order);
+		delete[] data;
+		data = new_data;
+	}
+	bytes_per_pixel = channels;
+}
+
+void Image::premultiplyAlpha()
+{
+	assert(data && bytes_per_pixel == 4);
+	ImageKernels::premultiplyAlpha(data, (size_t)width * height);
+}
+
+void Image::rescale(int new_width, int new_height, eResizeFilter filter)
+{
+	assert(data);
+	if (new_width == (int)width && new_height == (int)height)
+		return;
+	uint8* new_data = new uint8[(size_t)new_width * new_height * bytes_per_pixel];
+	ImageKernels::resize(data, width, height, bytes_per_pixel, new_data, new_width, new_height, filter);
+	delete[] data;
+	data = new_data;
+	width = new_width;
+	height = new_height;
+}
+
+void Image::getPixelsInterpolated(const Vector2* coords, int count, Vector4* out, bool repeat)
+{
+	assert(data);
+	ImageKernels::sampleBilinear(data, width, height, bytes_per_pixel, coords, count, out, repeat);
 }
 
 bool isPowerOfTwo( int n )
@@ -7,8 +7,11 @@
 #include "includes.h"
 #include "framework.h"
 #include "extra/hdre.h"
+#include "imagekernels.h"
+#include "assetcache.h"
 #include <map>
 #include <string>
+#include <functional>
 #include <cassert>
 
 class Shader;
@@ -16,8 +19,9 @@ class FBO;
 class Texture;
 class HDRE;
 class Volume;
+class TextureCompressor;
 
-//Simple class to handle images (stores RGBA always)
+//Simple class to handle images (1 to 4 bytes per pixel, RGB by default)
 class Image
 {
 public:
@@ -27,13 +31,20 @@ public:
 	bool origin_topleft;
 	Uint8* data; //bytes with the pixel information
 
-	Image() { width = height = 0; data = NULL; bytes_per_pixel = 3; }
-	Image(int w, int h, int bytes_per_pixel = 3) { data = NULL; resize(w, h, bytes_per_pixel); }
+	Image() { width = height = 0; data = NULL; bytes_per_pixel = 3; origin_topleft = false; }
+	Image(int w, int h, int bytes_per_pixel = 3) { data = NULL; origin_topleft = false; resize(w, h, bytes_per_pixel); }
 	~Image() { if (data) delete []data; data = NULL; }
 
 	void resize(int w, int h, int bytes_per_pixel = 3) { if (data) delete[] data; width = w; height = h; this->bytes_per_pixel = bytes_per_pixel; data = new uint8[w*h*bytes_per_pixel]; memset(data, 0, w*h*bytes_per_pixel); }
 	void clear() { if (data) delete[]data; data = NULL; width = height = 0; }
 	void flipY();
+	void flipX();
+
+	//the per pixel work is done with ImageKernels (SSE4.1 / AVX2)
+	void swizzle(const char* order); //ex: "bgra", "rgb1" adds alpha. The number of chars is the new bytes_per_pixel
+	void premultiplyAlpha(); //only RGBA
+	void rescale(int new_width, int new_height, eResizeFilter filter = RESIZE_AREA);
+	void getPixelsInterpolated(const Vector2* coords, int count, Vector4* out, bool repeat = false); //many getPixelInterpolatedHigh at once
 
 	Color getPixel(int x, int y) {
 		assert(x >= 0 && x < (int)width && y >= 0 && y < (int)height && "reading of memory");
@@ -53,18 +64,20 @@ public:
 	void fromScreen(int width, int height);
 
 	bool loadTGA(const char* filename);
-	bool loadPNG(const char* filename, bool flip_y = true);
+	bool loadPNG(const char* filename, bool flip_y = true, bool keep_channels = false); //keep_channels: 1 to 4 bytes per pixel like the file, otherwise RGBA
 	bool saveTGA(const char* filename, bool flip_y = true);
 };
 
 
 // TEXTURE CLASS
-class Texture
+class Texture : public Asset
 {
 public:
 	static int default_mag_filter;
 	static int default_min_filter;
 	static FBO* global_fbo;
+	static bool use_compression; //block compression of the maps of the materials (see TextureCompressor)
+	static size_t upload_budget; //bytes streamed to the GPU per frame from processPendingUploads (at least one level)
 
 	//a general struct to store all the information about a TGA file
 
@@ -83,6 +96,11 @@ public:
 	unsigned int texture_type; //GL_TEXTURE_2D, GL_TEXTURE_CUBE, GL_TEXTURE_2D_ARRAY
 	bool mipmaps;
 
+	//textures requested with GetAsync show a placeholder till all their levels are uploaded
+	enum eLoadState { LOADED, LOADING, LOAD_FAILED };
+	eLoadState load_state;
+	bool isLoaded() { return load_state == LOADED; }
+
 	unsigned int wrapS;
 	unsigned int wrapT;
 	unsigned int wrapR; //depth wrap, unused and undefined in 2D and cubemap textures
@@ -105,6 +123,11 @@ public:
 
 	void create3D(unsigned int width, unsigned int height, unsigned int depth, unsigned int format = GL_RED, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, Uint8* data = NULL, unsigned int internal_format = 0, unsigned int wrap = GL_CLAMP_TO_EDGE);
 	void create3DFromVolume(Volume* volume, unsigned int wrap = GL_CLAMP_TO_EDGE);
+	void createFromLevels(TextureCompressor* source, bool mipmaps = true, unsigned int wrap = GL_REPEAT, int first_level = 0); //the mips of the texture cache from first_level
+	//mip streaming (see TextureStreamer), only for textures made with createFromLevels
+	void uploadLevels(TextureCompressor* source, int first_level, int last_level);
+	void freeLevels(int first_level, int last_level);
+	void setBaseLevel(int level);
 
 	void upload(Image* img);
 	void upload(unsigned int format = GL_RGB, unsigned int type = GL_UNSIGNED_BYTE, bool mipmaps = true, Uint8* data = NULL, unsigned int internal_format = 0);
@@ -115,6 +138,10 @@ public:
 	void bind();
 	void unbind();
 
+	//memory for the AssetCache
+	size_t getCPUBytes() { return image.data ? (size_t)image.width * image.height * image.bytes_per_pixel : 0; }
+	size_t getGPUBytes(); //of the resident levels if it is streamed
+
 	void debugInMenu();
 
 	static void UnbindAll();
@@ -124,8 +151,14 @@ public:
 	//load without using the manager
 	bool load(const char* filename, bool mipmaps = true, unsigned int wrap = GL_REPEAT, unsigned int type = GL_UNSIGNED_BYTE);
 
-	//load using the manager (caching loaded ones to avoid reloading them)
+	//load using the manager (caching loaded ones to avoid reloading them), if it is being loaded async it waits for it
 	static Texture* Get(const char* filename, bool mipmaps = true, unsigned int wrap = GL_REPEAT);
+	//returns the handle immediately using the texture of the white (or black) placeholder, the file is decoded in a worker and
+	//its levels are streamed from processPendingUploads, on_loaded is called from the main thread once the real one is in place
+	static Texture* GetAsync(const char* filename, std::function<void(Texture*)> on_loaded = nullptr, bool mipmaps = true, unsigned int wrap = GL_REPEAT, bool black_placeholder = false);
+	static int processPendingUploads(float budget_ms = 2.0f); //returns the textures finished this frame
+	static int getNumAsyncLoads(); //textures still in flight
+	void waitAsyncLoad();
 	void setName(const char* name) { sTexturesLoaded[name] = this; }
 
 	void generateMipmaps();
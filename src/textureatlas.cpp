@@ -0,0 +1,232 @@
+#include "textureatlas.h"
+#include "texture.h"
+#include "utils.h"
+#include "pngdecoder.h"
+#include "material.h"
+#include "mesh.h"
+#include "camera.h"
+#include "renderqueue.h"
+#include "includes.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <cassert>
+
+//the implementation in imgui_draw.cpp is static
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "extra/imgui/imstb_rectpack.h"
+
+TextureAtlas::TextureAtlas(int page_size, int gutter, bool use_array)
+{
+	assert(isPowerOfTwo(page_size) && isPowerOfTwo(gutter) && gutter < page_size);
+	this->page_size = page_size;
+	this->gutter = gutter;
+	this->use_array = use_array;
+	num_pages = 0;
+}
+
+TextureAtlas::~TextureAtlas()
+{
+	for (size_t i = 0; i < pages.size(); ++i)
+		delete pages[i];
+}
+
+void TextureAtlas::add(const char* name, Image* image)
+{
+	assert(image && image->data && image->bytes_per_pixel >= 1 && image->bytes_per_pixel <= 4);
+	pending.push_back(sPendingImage());
+	sPendingImage& pending_image = pending.back();
+	pending_image.name = name;
+	pending_image.width = image->width;
+	pending_image.height = image->height;
+	pending_image.pixels.resize((size_t)image->width * image->height * 4);
+	expandToRGBA(image->data, &pending_image.pixels[0], (size_t)image->width * image->height, image->bytes_per_pixel);
+}
+
+bool TextureAtlas::addFile(const char* filename)
+{
+	std::string str = filename;
+	std::string ext = str.size() > 4 ? str.substr(str.size() - 4, 4) : "";
+	Image image;
+	bool found = false;
+	if (ext == ".tga" || ext == ".TGA")
+		found = image.loadTGA(filename);
+	else if (ext == ".png" || ext == ".PNG")
+		found = image.loadPNG(filename);
+	if (!found)
+	{
+		std::cout << "[ERROR] Texture atlas, image not found or unsupported: " << filename << std::endl;
+		return false;
+	}
+	add(filename, &image);
+	return true;
+}
+
+sAtlasEntry* TextureAtlas::get(const char* name)
+{
+	std::map<std::string, sAtlasEntry>::iterator it = entries.find(name);
+	return it != entries.end() ? &it->second : NULL;
+}
+
+int TextureAtlas::getMaxLevel()
+{
+	int level = 0;
+	while ((2 << level) <= gutter)
+		level++;
+	return level;
+}
+
+//the border pixels are repeated in the gutter, so the bilinear and the mips only see the image itself
+void TextureAtlas::copyWithGutter(sPendingImage& image, uint8* page, int x, int y)
+{
+	for (int py = -gutter; py < image.height + gutter; ++py)
+	{
+		int src_y = std::min(std::max(py, 0), image.height - 1);
+		uint8* dst = page + ((size_t)(y + py) * page_size + x - gutter) * 4;
+		const uint8* src = &image.pixels[(size_t)src_y * image.width * 4];
+		for (int px = -gutter; px < 0; ++px, dst += 4)
+			memcpy(dst, src, 4);
+		memcpy(dst, src, (size_t)image.width * 4);
+		dst += image.width * 4;
+		for (int px = 0; px < gutter; ++px, dst += 4)
+			memcpy(dst, src + (image.width - 1) * 4, 4);
+	}
+}
+
+bool TextureAtlas::build(bool mipmaps)
+{
+	assert(pages.empty() && "the atlas can only be built once");
+	long time = getTime();
+
+	//the rects are packed in blocks of the size of the gutter, so they start and end where the mips are aligned
+	int blocks = page_size / gutter;
+	bool all_packed = true;
+	std::vector<stbrp_rect> remaining;
+	for (size_t i = 0; i < pending.size(); ++i)
+	{
+		stbrp_rect rect;
+		memset(&rect, 0, sizeof(rect));
+		rect.id = (int)i;
+		rect.w = (pending[i].width + gutter * 2 + gutter - 1) / gutter;
+		rect.h = (pending[i].height + gutter * 2 + gutter - 1) / gutter;
+		if (rect.w > blocks || rect.h > blocks)
+		{
+			std::cout << "[WARN] Texture atlas: " << pending[i].name << " doesn't fit in a page of " << page_size << std::endl;
+			all_packed = false;
+			continue;
+		}
+		remaining.push_back(rect);
+	}
+
+	//one page at a time with the ones that didn't fit in the previous
+	std::vector< std::vector<uint8> > page_pixels;
+	std::vector<stbrp_node> nodes(blocks);
+	while (remaining.size())
+	{
+		stbrp_context context;
+		stbrp_init_target(&context, blocks, blocks, &nodes[0], (int)nodes.size());
+		stbrp_pack_rects(&context, &remaining[0], (int)remaining.size());
+
+		int page = (int)page_pixels.size();
+		page_pixels.push_back(std::vector<uint8>((size_t)page_size * page_size * 4, 0));
+		std::vector<stbrp_rect> next;
+		for (size_t i = 0; i < remaining.size(); ++i)
+		{
+			stbrp_rect& rect = remaining[i];
+			if (!rect.was_packed)
+			{
+				next.push_back(rect);
+				continue;
+			}
+			sPendingImage& image = pending[rect.id];
+			sAtlasEntry entry;
+			entry.page = page;
+			entry.x = rect.x * gutter + gutter;
+			entry.y = rect.y * gutter + gutter;
+			entry.width = image.width;
+			entry.height = image.height;
+			entry.uv_transform = Vector4((float)image.width / page_size, (float)image.height / page_size, (float)entry.x / page_size, (float)entry.y / page_size);
+			copyWithGutter(image, &page_pixels[page][0], entry.x, entry.y);
+			entries[image.name] = entry;
+		}
+		assert(next.size() < remaining.size() && "an empty page must fit one rect");
+		remaining.swap(next);
+	}
+	num_pages = (int)page_pixels.size();
+	pending.clear();
+
+	if (use_array && num_pages)
+	{
+		//the pages one over the other, every one is a layer
+		Texture* array = new Texture();
+		array->image.resize(page_size, page_size * num_pages, 4);
+		for (int i = 0; i < num_pages; ++i)
+			memcpy(array->image.data + (size_t)i * page_size * page_size * 4, &page_pixels[i][0], page_pixels[i].size());
+		array->uploadAsArray(page_size, mipmaps);
+		array->image.clear();
+		pages.push_back(array);
+	}
+	else
+		for (int i = 0; i < num_pages; ++i)
+			pages.push_back(new Texture(page_size, page_size, GL_RGBA, GL_UNSIGNED_BYTE, mipmaps, &page_pixels[i][0]));
+
+	//the deeper mips would mix the images
+	for (size_t i = 0; i < pages.size(); ++i)
+	{
+		Texture* texture = pages[i];
+		glBindTexture(texture->texture_type, texture->texture_id);
+		glTexParameteri(texture->texture_type, GL_TEXTURE_MAX_LEVEL, texture->mipmaps ? getMaxLevel() : 0);
+		glTexParameteri(texture->texture_type, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(texture->texture_type, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(texture->texture_type, 0);
+	}
+
+	std::cout << " + Texture atlas: " << entries.size() << " images in " << num_pages << (use_array ? " layers" : " pages") << " of " << page_size << "x" << page_size
+		<< " Time: " << (getTime() - time) * 0.001 << "sec" << std::endl;
+	return all_packed;
+}
+
+bool TextureAtlas::checkBatching()
+{
+	const char* maps[] = { "data/models/basic/albedo.png", "data/models/basic/normal.png", "data/models/basic/roughness.png", "data/models/basic/metalness.png" };
+	const int num = 4;
+	TextureAtlas atlas(1024, 4);
+	for (int i = 0; i < num; ++i)
+		if (!atlas.addFile(maps[i]))
+			return false;
+	if (!atlas.build() || atlas.getNumPages() != 1)
+		return false;
+
+	Mesh* mesh = Mesh::Get("data/meshes/sphere.obj.mbin");
+	if (!mesh)
+		return false;
+	Camera camera;
+	camera.lookAt(Vector3(0.f, 0.f, 10.f), Vector3(0.f, 0.f, 0.f), Vector3(0.f, 1.f, 0.f));
+	camera.setPerspective(45.f, 1.f, 0.1f, 100.f);
+
+	//a sphere per map, one next to the other
+	TextureMaterial materials[num];
+	RenderQueue queue;
+	for (int i = 0; i < num; ++i)
+	{
+		materials[i].setAtlasTexture(&atlas, maps[i]);
+		Matrix44 model;
+		model.setTranslation(-3.0f + i * 2.0f, 0.0f, 0.0f);
+		queue.add(mesh, &materials[i], model, &camera);
+	}
+
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	camera.enable();
+	queue.sort();
+	queue.execute(&camera);
+	RenderQueue::resetState();
+	Mesh::resetBufferBindings();
+	Mesh::nextInstancesFrame();
+	glFinish();
+
+	std::cout << " + Atlas: " << num << " images in " << atlas.getNumPages() << " pages, " << num << " materials drawn with "
+		<< queue.num_binds << " binds and " << queue.num_batched << " batched (expected " << num - 1 << ")" << std::endl;
+	return queue.num_binds == 1 && queue.num_batched == num - 1;
+}
@@ -0,0 +1,71 @@
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+
+#include "framework.h"
+#include <vector>
+#include <map>
+#include <string>
+
+class Image;
+class Texture;
+
+//where a sub-texture is in the atlas
+struct sAtlasEntry {
+	int page; //index in pages, or the layer of the array
+	int x; //pixels of the image in the page (without the gutter)
+	int y;
+	int width;
+	int height;
+	Vector4 uv_transform; //uv * xy + zw maps the uvs of the image to the page
+};
+
+//TextureAtlas
+//packs many small images (with stb_rect_pack) in a few pages, so the materials that use them share the texture and
+//the RenderQueue can draw them one after another binding it once (see Material::canBatchWith).
+//Every image is surrounded by a gutter with copies of its border pixels, and the rects are aligned to the size of the
+//gutter, so the mips up to log2(gutter) never mix two images (GL_TEXTURE_MAX_LEVEL is limited to that level).
+//The pages can be separated 2D textures or the layers of a GL_TEXTURE_2D_ARRAY (one texture for the whole atlas).
+//The uvs of the sub-textures must stay in 0..1 (no repeat).
+
+class TextureAtlas {
+public:
+	int page_size;
+	int gutter; //pixels copied around every image, power of two
+	bool use_array; //the pages are the layers of a GL_TEXTURE_2D_ARRAY (see Texture::uploadAsArray)
+
+	std::map<std::string, sAtlasEntry> entries;
+	std::vector<Texture*> pages; //one per page, or only the array
+
+	TextureAtlas(int page_size = 1024, int gutter = 4, bool use_array = false);
+	~TextureAtlas();
+
+	//the images are copied (as RGBA) till build
+	void add(const char* name, Image* image);
+	bool addFile(const char* filename); //TGA or PNG, the filename is the name of the entry
+
+	//packs all the images added and uploads the pages, returns false if some of them didn't fit in a page
+	bool build(bool mipmaps = true);
+
+	sAtlasEntry* get(const char* name);
+	Texture* getTexture(sAtlasEntry* entry) { return use_array ? pages[0] : pages[entry->page]; }
+	int getNumPages() { return num_pages; }
+	int getMaxLevel(); //last mip that doesn't mix images
+
+	//packs the maps of data/models/basic and draws a sphere with each one through a RenderQueue, true if the page was
+	//bound once and the other materials were batched: main --bench-atlas (needs the window and the Application)
+	static bool checkBatching();
+
+private:
+	struct sPendingImage {
+		std::string name;
+		int width;
+		int height;
+		std::vector<uint8> pixels; //RGBA
+	};
+	std::vector<sPendingImage> pending;
+	int num_pages;
+
+	void copyWithGutter(sPendingImage& image, uint8* page, int x, int y);
+};
+
+#endif
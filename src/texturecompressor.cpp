@@ -0,0 +1,750 @@
+#include "texturecompressor.h"
+#include "texture.h"
+#include "utils.h"
+#include "workerpool.h"
+#include "mipchain.h"
+#include "includes.h"
+
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define USE_SSE_BC
+	#include <emmintrin.h>
+#endif
+
+bool TextureCompressor::use_bc7 = true;
+
+namespace {
+
+// ENDPOINTS *************************
+
+//line that fits the pixels of the block (first N channels): principal axis of the covariance by power iteration,
+//the endpoints are the extremes of the projections of the pixels on it
+template<int N>
+void computeEndpoints(const uint8* block, float* e0, float* e1)
+{
+	float mean[N];
+	for (int c = 0; c < N; ++c)
+	{
+		mean[c] = 0;
+		for (int i = 0; i < 16; ++i)
+			mean[c] += block[i * 4 + c];
+		mean[c] /= 16.0f;
+	}
+
+	float cov[N][N];
+	memset(cov, 0, sizeof(cov));
+	for (int i = 0; i < 16; ++i)
+	{
+		float d[N];
+		for (int c = 0; c < N; ++c)
+			d[c] = block[i * 4 + c] - mean[c];
+		for (int a = 0; a < N; ++a)
+			for (int b = a; b < N; ++b)
+				cov[a][b] += d[a] * d[b];
+	}
+	for (int a = 0; a < N; ++a)
+		for (int b = 0; b < a; ++b)
+			cov[a][b] = cov[b][a];
+
+	float axis[N];
+	for (int c = 0; c < N; ++c)
+		axis[c] = 1.0f;
+	for (int iteration = 0; iteration < 8; ++iteration)
+	{
+		float next[N];
+		float max_value = 0;
+		for (int a = 0; a < N; ++a)
+		{
+			next[a] = 0;
+			for (int b = 0; b < N; ++b)
+				next[a] += cov[a][b] * axis[b];
+			max_value = std::max(max_value, std::abs(next[a]));
+		}
+		if (max_value < 1e-6f) //flat block, the endpoints are the mean
+			break;
+		for (int c = 0; c < N; ++c)
+			axis[c] = next[c] / max_value;
+	}
+
+	float length = 0;
+	for (int c = 0; c < N; ++c)
+		length += axis[c] * axis[c];
+	length = sqrtf(length);
+	float min_t = 0, max_t = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		float t = 0;
+		for (int c = 0; c < N; ++c)
+			t += (block[i * 4 + c] - mean[c]) * axis[c] / length;
+		min_t = std::min(min_t, t);
+		max_t = std::max(max_t, t);
+	}
+	for (int c = 0; c < N; ++c)
+	{
+		e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] / length * min_t));
+		e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] / length * max_t));
+	}
+}
+
+//least squares endpoints for the current indices, weights[i] is how much of e1 the pixel i takes
+//returns false if every pixel uses the same weight
+template<int N>
+bool refineEndpoints(const uint8* block, const float* weights, float* e0, float* e1)
+{
+	float aa = 0, bb = 0, ab = 0;
+	float ax[N], bx[N];
+	for (int c = 0; c < N; ++c)
+		ax[c] = bx[c] = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		float b = weights[i];
+		float a = 1.0f - b;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for (int c = 0; c < N; ++c)
+		{
+			ax[c] += a * block[i * 4 + c];
+			bx[c] += b * block[i * 4 + c];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if (std::abs(det) < 1e-6f)
+		return false;
+	for (int c = 0; c < N; ++c)
+	{
+		e0[c] = std::min(255.0f, std::max(0.0f, (ax[c] * bb - bx[c] * ab) / det));
+		e1[c] = std::min(255.0f, std::max(0.0f, (bx[c] * aa - ax[c] * ab) / det));
+	}
+	return true;
+}
+
+// BC1 *************************
+
+inline uint16 packRGB565(const float* c)
+{
+	int r = (int)(c[0] * 31.0f / 255.0f + 0.5f);
+	int g = (int)(c[1] * 63.0f / 255.0f + 0.5f);
+	int b = (int)(c[2] * 31.0f / 255.0f + 0.5f);
+	return (uint16)((r << 11) | (g << 5) | b);
+}
+
+inline void unpackRGB565(uint16 v, int* c)
+{
+	int r = (v >> 11) & 31;
+	int g = (v >> 5) & 63;
+	int b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+//closest color of the palette (4 colors mode) for every pixel, returns the squared error of the block
+int matchColors(const uint8* block, uint16 color0, uint16 color1, uint32& indices)
+{
+	int palette[4][3];
+	unpackRGB565(color0, palette[0]);
+	unpackRGB565(color1, palette[1]);
+	for (int c = 0; c < 3; ++c)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	indices = 0;
+	int error = 0;
+#ifdef USE_SSE_BC
+	//4 pixels at a time, the squared distances in 32 bits lanes
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+	__m128i colors[4];
+	for (int k = 0; k < 4; ++k)
+		colors[k] = _mm_setr_epi16((short)palette[k][0], (short)palette[k][1], (short)palette[k][2], 0, (short)palette[k][0], (short)palette[k][1], (short)palette[k][2], 0);
+	for (int i = 0; i < 4; ++i)
+	{
+		__m128i pixels = _mm_and_si128(_mm_loadu_si128((const __m128i*)(block + i * 16)), rgb_mask);
+		__m128i lo = _mm_unpacklo_epi8(pixels, zero);
+		__m128i hi = _mm_unpackhi_epi8(pixels, zero);
+		__m128i best_distance = _mm_set1_epi32(0x7FFFFFFF);
+		__m128i best_index = zero;
+		for (int k = 0; k < 4; ++k)
+		{
+			__m128i d_lo = _mm_sub_epi16(lo, colors[k]);
+			__m128i d_hi = _mm_sub_epi16(hi, colors[k]);
+			d_lo = _mm_madd_epi16(d_lo, d_lo); //r2+g2, b2 of two pixels
+			d_hi = _mm_madd_epi16(d_hi, d_hi);
+			d_lo = _mm_add_epi32(d_lo, _mm_shuffle_epi32(d_lo, _MM_SHUFFLE(2, 3, 0, 1)));
+			d_hi = _mm_add_epi32(d_hi, _mm_shuffle_epi32(d_hi, _MM_SHUFFLE(2, 3, 0, 1)));
+			__m128i distance = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(d_lo), _mm_castsi128_ps(d_hi), _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i closer = _mm_cmplt_epi32(distance, best_distance);
+			best_distance = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best_distance));
+			best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)), _mm_andnot_si128(closer, best_index));
+		}
+		int distances[4], closest[4];
+		_mm_storeu_si128((__m128i*)distances, best_distance);
+		_mm_storeu_si128((__m128i*)closest, best_index);
+		for (int j = 0; j < 4; ++j)
+		{
+			indices |= (uint32)closest[j] << ((i * 4 + j) * 2);
+			error += distances[j];
+		}
+	}
+#else
+	for (int i = 0; i < 16; ++i)
+	{
+		const uint8* p = block + i * 4;
+		int best = 0, best_distance = 0x7FFFFFFF;
+		for (int k = 0; k < 4; ++k)
+		{
+			int dr = p[0] - palette[k][0], dg = p[1] - palette[k][1], db = p[2] - palette[k][2];
+			int distance = dr * dr + dg * dg + db * db;
+			if (distance < best_distance)
+			{
+				best_distance = distance;
+				best = k;
+			}
+		}
+		indices |= (uint32)best << (i * 2);
+		error += best_distance;
+	}
+#endif
+	return error;
+}
+
+// BC7 *************************
+
+const int bc7_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+//7 bits per channel plus a pbit shared by the four channels of the endpoint, the one with less error is chosen
+void quantizeBC7Endpoint(const float* e, int* q, int& pbit)
+{
+	float best_error = 1e30f;
+	for (int p = 0; p < 2; ++p)
+	{
+		int candidate[4];
+		float error = 0;
+		for (int c = 0; c < 4; ++c)
+		{
+			candidate[c] = std::min(127, std::max(0, (int)floorf((e[c] - p) * 0.5f + 0.5f)));
+			float d = (candidate[c] * 2 + p) - e[c];
+			error += d * d;
+		}
+		if (error < best_error)
+		{
+			best_error = error;
+			pbit = p;
+			memcpy(q, candidate, sizeof(candidate));
+		}
+	}
+}
+
+//closest of the 16 levels for every pixel (projection on the line and check of the neighbours), returns the squared error
+int matchBC7(const uint8* block, const int* ep0, const int* ep1, uint8* indices)
+{
+	int palette[16][4];
+	for (int k = 0; k < 16; ++k)
+		for (int c = 0; c < 4; ++c)
+			palette[k][c] = ((64 - bc7_weights[k]) * ep0[c] + bc7_weights[k] * ep1[c] + 32) >> 6;
+
+	int d[4];
+	int length = 0;
+	for (int c = 0; c < 4; ++c)
+	{
+		d[c] = ep1[c] - ep0[c];
+		length += d[c] * d[c];
+	}
+
+	int error = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		const uint8* p = block + i * 4;
+		int guess = 0;
+		if (length)
+		{
+			int dot = 0;
+			for (int c = 0; c < 4; ++c)
+				dot += (p[c] - ep0[c]) * d[c];
+			guess = std::min(15, std::max(0, (int)(dot * 15.0f / length + 0.5f)));
+		}
+		int best = guess, best_distance = 0x7FFFFFFF;
+		for (int k = std::max(0, guess - 1); k <= std::min(15, guess + 1); ++k)
+		{
+			int distance = 0;
+			for (int c = 0; c < 4; ++c)
+				distance += (p[c] - palette[k][c]) * (p[c] - palette[k][c]);
+			if (distance < best_distance)
+			{
+				best_distance = distance;
+				best = k;
+			}
+		}
+		indices[i] = (uint8)best;
+		error += best_distance;
+	}
+	return error;
+}
+
+int encodeBC7Endpoints(const uint8* block, const float* e0, const float* e1, int q[2][4], int* pbits, uint8* indices)
+{
+	quantizeBC7Endpoint(e0, q[0], pbits[0]);
+	quantizeBC7Endpoint(e1, q[1], pbits[1]);
+	int ep[2][4];
+	for (int c = 0; c < 4; ++c)
+	{
+		ep[0][c] = q[0][c] * 2 + pbits[0];
+		ep[1][c] = q[1][c] * 2 + pbits[1];
+	}
+	return matchBC7(block, ep[0], ep[1], indices);
+}
+
+struct sBitWriter {
+	uint8* out;
+	int pos;
+	void write(int value, int bits)
+	{
+		for (int i = 0; i < bits; ++i, ++pos)
+			if ((value >> i) & 1)
+				out[pos >> 3] |= 1 << (pos & 7);
+	}
+};
+
+// BLOCKS *************************
+
+void fetchBlock(const uint8* pixels, int width, int height, int bx, int by, uint8* block)
+{
+	int x = bx * 4;
+	for (int j = 0; j < 4; ++j)
+	{
+		int y = std::min(by * 4 + j, height - 1);
+		const uint8* row = pixels + (size_t)y * width * 4;
+		if (x + 4 <= width)
+			memcpy(block + j * 16, row + x * 4, 16);
+		else //the small mips repeat the last column
+			for (int i = 0; i < 4; ++i)
+				memcpy(block + j * 16 + i * 4, row + std::min(x + i, width - 1) * 4, 4);
+	}
+}
+
+} //namespace
+
+void TextureCompressor::encodeBC1(const uint8* block, uint8* out)
+{
+	float e0[3], e1[3];
+	computeEndpoints<3>(block, e0, e1);
+	uint16 color0 = packRGB565(e1);
+	uint16 color1 = packRGB565(e0);
+	uint32 indices;
+	int error = matchColors(block, color0, color1, indices);
+
+	//one pass of least squares with the indices found
+	const float index_weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	float weights[16];
+	for (int i = 0; i < 16; ++i)
+		weights[i] = index_weights[(indices >> (i * 2)) & 3];
+	if (error && refineEndpoints<3>(block, weights, e0, e1))
+	{
+		uint16 refined0 = packRGB565(e0);
+		uint16 refined1 = packRGB565(e1);
+		uint32 refined_indices;
+		if (matchColors(block, refined0, refined1, refined_indices) < error)
+		{
+			color0 = refined0;
+			color1 = refined1;
+			indices = refined_indices;
+		}
+	}
+
+	//color0 > color1 means 4 colors mode, swapping the endpoints swaps the indices 0-1 and 2-3
+	if (color0 < color1)
+	{
+		std::swap(color0, color1);
+		indices ^= 0x55555555;
+	}
+	else if (color0 == color1)
+		indices = 0;
+
+	out[0] = (uint8)color0;
+	out[1] = (uint8)(color0 >> 8);
+	out[2] = (uint8)color1;
+	out[3] = (uint8)(color1 >> 8);
+	for (int i = 0; i < 4; ++i)
+		out[4 + i] = (uint8)(indices >> (i * 8));
+}
+
+void TextureCompressor::encodeBC4(const uint8* block, int channel, uint8* out)
+{
+	int min_value = 255, max_value = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		min_value = std::min(min_value, (int)block[i * 4 + channel]);
+		max_value = std::max(max_value, (int)block[i * 4 + channel]);
+	}
+
+	//8 values mode (first > second): index 0 is the max, 1 the min and 2..7 the steps from the max to the min
+	unsigned long long bits = 0;
+	int range = max_value - min_value;
+	if (range)
+		for (int i = 0; i < 16; ++i)
+		{
+			int step = ((max_value - block[i * 4 + channel]) * 14 + range) / (2 * range);
+			int index = step == 0 ? 0 : (step == 7 ? 1 : step + 1);
+			bits |= (unsigned long long)index << (i * 3);
+		}
+
+	out[0] = (uint8)max_value;
+	out[1] = (uint8)min_value;
+	for (int i = 0; i < 6; ++i)
+		out[2 + i] = (uint8)(bits >> (i * 8));
+}
+
+void TextureCompressor::encodeBC7(const uint8* block, uint8* out)
+{
+	float e0[4], e1[4];
+	computeEndpoints<4>(block, e0, e1);
+	int q[2][4];
+	int pbits[2];
+	uint8 indices[16];
+	int error = encodeBC7Endpoints(block, e0, e1, q, pbits, indices);
+
+	float weights[16];
+	for (int i = 0; i < 16; ++i)
+		weights[i] = bc7_weights[indices[i]] / 64.0f;
+	if (error && refineEndpoints<4>(block, weights, e0, e1))
+	{
+		int refined_q[2][4];
+		int refined_pbits[2];
+		uint8 refined_indices[16];
+		if (encodeBC7Endpoints(block, e0, e1, refined_q, refined_pbits, refined_indices) < error)
+		{
+			memcpy(q, refined_q, sizeof(q));
+			memcpy(pbits, refined_pbits, sizeof(pbits));
+			memcpy(indices, refined_indices, sizeof(indices));
+		}
+	}
+
+	//the highest bit of the first index is implicit (0), swapping the endpoints inverts the indices
+	if (indices[0] & 8)
+	{
+		for (int c = 0; c < 4; ++c)
+			std::swap(q[0][c], q[1][c]);
+		std::swap(pbits[0], pbits[1]);
+		for (int i = 0; i < 16; ++i)
+			indices[i] = 15 - indices[i];
+	}
+
+	memset(out, 0, 16);
+	sBitWriter writer = { out, 0 };
+	writer.write(1 << 6, 7); //mode 6
+	for (int c = 0; c < 4; ++c)
+	{
+		writer.write(q[0][c], 7);
+		writer.write(q[1][c], 7);
+	}
+	writer.write(pbits[0], 1);
+	writer.write(pbits[1], 1);
+	writer.write(indices[0], 3);
+	for (int i = 1; i < 16; ++i)
+		writer.write(indices[i], 4);
+}
+
+void TextureCompressor::encodeBlock(eTextureCodec codec, const uint8* block, uint8* out)
+{
+	switch (codec)
+	{
+	case CODEC_BC1: encodeBC1(block, out); break;
+	case CODEC_BC3: encodeBC4(block, 3, out); encodeBC1(block, out + 8); break;
+	case CODEC_BC4: encodeBC4(block, 0, out); break;
+	case CODEC_BC5: encodeBC4(block, 0, out); encodeBC4(block, 1, out + 8); break;
+	case CODEC_BC7: encodeBC7(block, out); break;
+	default: assert(0 && "unknown codec");
+	}
+}
+
+eTextureRole TextureCompressor::getRole(const char* filename)
+{
+	std::string name = filename;
+	size_t slash = name.find_last_of("/\\");
+	if (slash != std::string::npos)
+		name = name.substr(slash + 1);
+	name = name.substr(0, name.find_last_of("."));
+	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+	if (name.find("normal") != std::string::npos)
+		return ROLE_NORMAL;
+	const char* colors[] = { "albedo", "basecolor", "diffuse", "emissive" };
+	for (int i = 0; i < 4; ++i)
+		if (name.find(colors[i]) != std::string::npos)
+			return ROLE_COLOR;
+	const char* masks[] = { "rough", "metal", "occlusion", "opacity" };
+	for (int i = 0; i < 4; ++i)
+		if (name.find(masks[i]) != std::string::npos)
+			return ROLE_MASK;
+	if (name == "ao")
+		return ROLE_MASK;
+	return ROLE_NONE;
+}
+
+eTextureCodec TextureCompressor::chooseCodec(eTextureRole role, Image* image)
+{
+	if (role == ROLE_NONE || !image->data || image->width % 4 || image->height % 4)
+		return CODEC_NONE;
+	if (role == ROLE_NORMAL)
+		return CODEC_BC5;
+
+	//the PNGs of the masks are often RGB(A) even if they are gray, but some pack occlusion, roughness and metalness
+	//in different channels (the shaders read them by channel), so the content is checked
+	int channels = image->bytes_per_pixel;
+	bool has_color = channels >= 3;
+	bool has_alpha = channels == 2 || channels == 4;
+	bool gray = true;
+	bool opaque = true;
+	size_t num_pixels = (size_t)image->width * image->height;
+	const uint8* p = image->data;
+	for (size_t i = 0; i < num_pixels && ((gray && has_color) || (opaque && has_alpha)); ++i, p += channels)
+	{
+		if (has_color && (p[0] != p[1] || p[0] != p[2]))
+			gray = false;
+		if (has_alpha && p[channels - 1] != 255)
+			opaque = false;
+	}
+
+	if (role == ROLE_MASK && gray && opaque)
+		return CODEC_BC4;
+	if (use_bc7)
+		return CODEC_BC7;
+	return opaque ? CODEC_BC1 : CODEC_BC3;
+}
+
+const char* TextureCompressor::getCodecName(eTextureCodec codec)
+{
+	const char* names[] = { "raw", "BC1", "BC3", "BC4", "BC5", "BC7" };
+	return names[codec];
+}
+
+unsigned int TextureCompressor::getGLFormat()
+{
+	switch (codec)
+	{
+	case CODEC_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case CODEC_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case CODEC_BC4: return GL_COMPRESSED_RED_RGTC1;
+	case CODEC_BC5: return GL_COMPRESSED_RG_RGTC2;
+	case CODEC_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+	default: return getBaseFormat(); //like Texture::create
+	}
+}
+
+unsigned int TextureCompressor::getBaseFormat()
+{
+	switch (codec)
+	{
+	case CODEC_BC1: return GL_RGB;
+	case CODEC_BC4: return GL_RED;
+	case CODEC_BC5: return GL_RG;
+	case CODEC_NONE: { unsigned int formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA }; return formats[channels - 1]; }
+	default: return GL_RGBA;
+	}
+}
+
+size_t TextureCompressor::getSize()
+{
+	size_t size = 0;
+	for (size_t i = 0; i < levels.size(); ++i)
+		size += levels[i].data.size();
+	return size;
+}
+
+bool TextureCompressor::compress(Image* image, eTextureCodec codec, eTextureRole role, bool repeat)
+{
+	assert(image && image->data);
+	this->codec = codec;
+	this->repeat = repeat;
+	width = image->width;
+	height = image->height;
+	channels = codec == CODEC_NONE ? image->bytes_per_pixel : 4;
+
+	MipChain mips;
+	mips.build(image, role, repeat);
+	levels.resize(mips.getNumLevels());
+	for (int i = 0; i < mips.getNumLevels(); ++i)
+	{
+		sCompressedLevel& level = levels[i];
+		int w = level.width = MipChain::getLevelSize(width, i);
+		int h = level.height = MipChain::getLevelSize(height, i);
+		const uint8* src = &mips.levels[i][0];
+		level.data.resize(getLevelBytes(w, h));
+		uint8* dst = &level.data[0];
+
+		if (codec == CODEC_NONE) //the channels of the source, gray+alpha are R and A of the RGBA
+		{
+			for (size_t j = 0; j < (size_t)w * h; ++j)
+				for (int c = 0; c < channels; ++c)
+					dst[j * channels + c] = src[j * 4 + (channels == 2 && c == 1 ? 3 : c)];
+			continue;
+		}
+
+		//every row of blocks is independent
+		int block_bytes = getBlockBytes(codec);
+		int blocks_x = (w + 3) / 4;
+		WorkerPool::getGlobal()->parallelFor((h + 3) / 4, 4, [&](int start, int end) {
+			uint8 block[64];
+			for (int by = start; by < end; ++by)
+				for (int bx = 0; bx < blocks_x; ++bx)
+				{
+					fetchBlock(src, w, h, bx, by, block);
+					encodeBlock(codec, block, dst + ((size_t)by * blocks_x + bx) * block_bytes);
+				}
+		});
+	}
+	return true;
+}
+
+size_t TextureCompressor::getLevelBytes(int w, int h)
+{
+	if (codec == CODEC_NONE)
+		return (size_t)w * h * channels;
+	return (size_t)((w + 3) / 4) * ((h + 3) / 4) * getBlockBytes(codec);
+}
+
+typedef struct
+{
+	int version;
+	int header_bytes;
+	int codec;
+	int width;
+	int height;
+	int num_levels;
+	int channels; //of the uncompressed levels
+	int repeat; //the mips were filtered wrapping the borders
+	sCacheInfo cache; //size, date and hash of the source used to generate it
+	char extra[8]; //unused
+} sTextureInfo;
+
+bool TextureCompressor::readBin(const char* filename, const char* source)
+{
+	FILE* f = fopen(filename, "rb");
+	if (f == NULL)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	rewind(f);
+	std::vector<uint8> data(size > 0 ? size : 0);
+	if (size > 0)
+		size = (long)fread(&data[0], 1, size, f);
+	fclose(f);
+
+	//watermark
+	if (size < 4 + (long)sizeof(sTextureInfo) || memcmp(&data[0], "TBIN", 4) != 0)
+	{
+		std::cout << "[ERROR] loading TBIN: invalid content: " << filename << std::endl;
+		return false;
+	}
+
+	sTextureInfo info;
+	memcpy(&info, &data[4], sizeof(sTextureInfo));
+	if (info.version != TEXTURE_BIN_VERSION || info.header_bytes != sizeof(sTextureInfo) || info.codec < CODEC_NONE || info.codec > CODEC_BC7 || info.channels < 1 || info.channels > 4)
+	{
+		std::cout << "[WARN] loading TBIN: old version: " << filename << std::endl;
+		return false;
+	}
+
+	//a corrupt header must not ask for huge allocations: up to 16k and the levels of a full mip chain
+	int max_levels = 1;
+	if (info.width >= 1 && info.height >= 1 && info.width <= 16384 && info.height <= 16384)
+		while (std::max(info.width, info.height) >> max_levels)
+			max_levels++;
+	if (info.width < 1 || info.height < 1 || info.width > 16384 || info.height > 16384 || info.num_levels < 1 || info.num_levels > max_levels)
+	{
+		std::cout << "[ERROR] loading TBIN: invalid size: " << filename << std::endl;
+		return false;
+	}
+
+	//check it was generated from the current version of the source
+	bool touched = false;
+	if (source && !isCacheValid(source, info.cache, touched))
+	{
+		std::cout << "[WARN] loading TBIN: outdated: " << filename << std::endl;
+		return false;
+	}
+
+	codec = (eTextureCodec)info.codec;
+	width = info.width;
+	height = info.height;
+	channels = info.channels;
+	repeat = info.repeat != 0;
+	levels.resize(info.num_levels);
+	size_t pos = 4 + sizeof(sTextureInfo);
+	int w = width;
+	int h = height;
+	for (int i = 0; i < info.num_levels; ++i)
+	{
+		sCompressedLevel& level = levels[i];
+		level.width = w;
+		level.height = h;
+		size_t level_size = getLevelBytes(w, h);
+		if (pos + level_size > (size_t)size)
+		{
+			std::cout << "[ERROR] loading TBIN: truncated: " << filename << std::endl;
+			levels.clear();
+			return false;
+		}
+		level.data.assign(data.begin() + pos, data.begin() + pos + level_size);
+		pos += level_size;
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+	}
+
+	if (touched) //same content, store the new date so next time there is no need to hash it
+	{
+		unsigned long long source_size;
+		f = getFileInfo(source, source_size, info.cache.source_mtime) ? fopen(filename, "r+b") : NULL;
+		if (f)
+		{
+			fseek(f, 4, SEEK_SET);
+			fwrite((void*)&info, sizeof(sTextureInfo), 1, f);
+			fclose(f);
+		}
+	}
+	return true;
+}
+
+bool TextureCompressor::writeBin(const char* source)
+{
+	assert(levels.size());
+	std::string filename = getCacheFilename(source, ".tbin");
+
+	FILE* f = fopen(filename.c_str(), "wb");
+	if (f == NULL)
+	{
+		std::cout << "[ERROR] cannot write texture BIN: " << filename << std::endl;
+		return false;
+	}
+
+	//watermark
+	fwrite("TBIN", sizeof(char), 4, f);
+
+	sTextureInfo info;
+	memset(&info, 0, sizeof(info));
+	info.version = TEXTURE_BIN_VERSION;
+	info.header_bytes = sizeof(sTextureInfo);
+	info.codec = codec;
+	info.width = width;
+	info.height = height;
+	info.num_levels = (int)levels.size();
+	info.channels = channels;
+	info.repeat = repeat;
+	computeCacheInfo(source, info.cache);
+	fwrite((void*)&info, sizeof(sTextureInfo), 1, f);
+
+	for (size_t i = 0; i < levels.size(); ++i)
+		fwrite((void*)&levels[i].data[0], levels[i].data.size(), 1, f);
+
+	fclose(f);
+	return true;
+}
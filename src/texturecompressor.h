@@ -0,0 +1,78 @@
+#ifndef TEXTURECOMPRESSOR_H
+#define TEXTURECOMPRESSOR_H
+
+#include "framework.h"
+#include <vector>
+
+class Image;
+
+#define TEXTURE_BIN_VERSION 2 //this is used to regenerate the .tbin if the format or the encoders change
+
+enum eTextureCodec {
+	CODEC_NONE = 0, //the levels are stored as they are
+	CODEC_BC1, //RGB 4 bits per pixel
+	CODEC_BC3, //BC1 color + BC4 alpha, 8 bits per pixel
+	CODEC_BC4, //one channel 4 bits per pixel (gray masks)
+	CODEC_BC5, //two BC4 channels, the XY of the normal maps
+	CODEC_BC7 //only mode 6 (one subset, RGBA 7777+pbit, 16 levels), 8 bits per pixel
+};
+
+enum eTextureRole {
+	ROLE_NONE = 0, //LUTs, noise, transfer functions... stay uncompressed
+	ROLE_COLOR, //albedo, emissive
+	ROLE_NORMAL,
+	ROLE_MASK //roughness, metalness, ao, opacity
+};
+
+struct sCompressedLevel {
+	int width;
+	int height;
+	std::vector<uint8> data;
+};
+
+//TextureCompressor
+//block compression on the CPU of the maps of the materials, with all the mips (see MipChain), stored in a .tbin next to
+//the source (or in the cache folder) so next runs upload every level directly without decoding the PNG.
+//The textures that are not compressed also store their mips this way (CODEC_NONE), so glGenerateMipmap is not needed.
+//The codec depends on the role of the map (from its name) and on its content: BC5 for normals, BC4 for gray masks,
+//BC7 (or BC1/BC3 if the GPU doesn't support it) for the rest. Blocks are encoded in parallel in the WorkerPool.
+
+class TextureCompressor {
+public:
+	static bool use_bc7; //set at startup from GL_ARB_texture_compression_bptc
+
+	eTextureCodec codec;
+	int width;
+	int height;
+	int channels; //bytes per pixel of the CODEC_NONE levels
+	bool repeat; //the mips were filtered wrapping the borders
+	std::vector<sCompressedLevel> levels; //from the full size to 1x1
+
+	TextureCompressor() { codec = CODEC_NONE; width = height = 0; channels = 4; repeat = false; }
+
+	static eTextureRole getRole(const char* filename);
+	//CODEC_NONE if it should stay uncompressed (no role, sizes not multiple of 4)
+	static eTextureCodec chooseCodec(eTextureRole role, Image* image);
+	static const char* getCodecName(eTextureCodec codec);
+	static int getBlockBytes(eTextureCodec codec) { return codec == CODEC_BC1 || codec == CODEC_BC4 ? 8 : 16; }
+
+	//builds the mips of the image (1 to 4 bytes per pixel) and encodes them, CODEC_NONE keeps the channels of the image
+	bool compress(Image* image, eTextureCodec codec, eTextureRole role, bool repeat);
+	bool isSupported() { return codec != CODEC_BC7 || use_bc7; }
+	unsigned int getGLFormat(); //compressed internal format
+	unsigned int getBaseFormat(); //GL_RED, GL_RG, GL_RGB or GL_RGBA
+	size_t getSize(); //bytes of all the levels
+	size_t getLevelBytes(int width, int height);
+
+	//binary cache, rejected if it was generated from another version of the source
+	bool readBin(const char* filename, const char* source);
+	bool writeBin(const char* source); //the bin goes to getCacheFilename(source,".tbin")
+
+	//encoders of a block of 4x4 RGBA pixels (rows of 16 bytes)
+	static void encodeBC1(const uint8* block, uint8* out); //8 bytes, always in 4 colors mode (also valid for BC3)
+	static void encodeBC4(const uint8* block, int channel, uint8* out); //8 bytes
+	static void encodeBC7(const uint8* block, uint8* out); //16 bytes
+	static void encodeBlock(eTextureCodec codec, const uint8* block, uint8* out);
+};
+
+#endif
@@ -0,0 +1,280 @@
+#include "texturestreamer.h"
+#include "texture.h"
+#include "utils.h"
+#include "workerpool.h"
+#include "includes.h"
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+
+size_t sStreamedTexture::getBytes(int first_level, int last_level)
+{
+	size_t bytes = 0;
+	for (int i = first_level; i <= last_level; ++i)
+		bytes += level_bytes[i];
+	return bytes;
+}
+
+TextureStreamer::TextureStreamer()
+{
+	enabled = true;
+	budget = 256 * 1024 * 1024;
+	upload_budget = 16 * 1024 * 1024;
+	tail_size = 128;
+	lod_bias = -1.0f; //the uvs rarely cover the texture only once
+	max_loads = 4;
+	resident_bytes = 0;
+	loading_bytes = 0;
+	num_loading = 0;
+	num_evicted = 0;
+	num_limited = 0;
+	frame = 0;
+}
+
+TextureStreamer* TextureStreamer::getGlobal()
+{
+	static TextureStreamer* streamer = NULL;
+	if (!streamer)
+		streamer = new TextureStreamer();
+	return streamer;
+}
+
+int TextureStreamer::registerTexture(Texture* texture, const char* filename, TextureCompressor* levels)
+{
+	assert(texture && filename && levels);
+	unregisterTexture(texture);
+
+	//only the maps of the materials, they are the ones requested by the nodes
+	if (levels->levels.size() < 2 || TextureCompressor::getRole(filename) == ROLE_NONE)
+		return 0;
+
+	//the levels that are not resident are read again from the cache
+	unsigned long long size;
+	long long mtime;
+	if (!getFileInfo(getCacheFilename(filename, ".tbin").c_str(), size, mtime))
+		return 0;
+
+	sStreamedTexture& t = textures[texture];
+	t.texture = texture;
+	t.filename = filename;
+	t.codec = levels->codec;
+	t.width = levels->width;
+	t.height = levels->height;
+	t.level_bytes.resize(levels->levels.size());
+	t.tail_level = 0;
+	for (size_t i = 0; i < levels->levels.size(); ++i)
+	{
+		sCompressedLevel& level = levels->levels[i];
+		t.level_bytes[i] = level.data.size();
+		if (level.width > tail_size || level.height > tail_size)
+			t.tail_level = (int)i + 1;
+	}
+	t.tail_level = std::min(t.tail_level, (int)t.level_bytes.size() - 1);
+	t.resident_level = enabled ? t.tail_level : 0;
+	t.wanted_level = t.resident_level;
+	t.loading = false;
+	t.last_used = frame;
+	resident_bytes += t.getResidentBytes();
+	return t.resident_level;
+}
+
+void TextureStreamer::unregisterTexture(Texture* texture)
+{
+	std::map<Texture*, sStreamedTexture>::iterator it = textures.find(texture);
+	if (it == textures.end())
+		return;
+	resident_bytes -= it->second.getResidentBytes();
+	textures.erase(it); //if a worker is reading its levels they are discarded
+}
+
+void TextureStreamer::request(Texture* texture, float screen_size)
+{
+	std::map<Texture*, sStreamedTexture>::iterator it = textures.find(texture);
+	if (it == textures.end())
+		return;
+	sStreamedTexture& t = it->second;
+
+	//texels of the first level for every pixel of the node
+	float texels = std::max(t.width, t.height) / std::max(screen_size, 1.0f);
+	int level = (int)floorf(log2f(texels) + lod_bias);
+	level = std::min(std::max(level, 0), t.tail_level);
+
+	//the finest of all the nodes that use it
+	if (t.last_used != frame || level < t.wanted_level)
+		t.wanted_level = level;
+	t.last_used = frame;
+}
+
+//frees the finest resident level of the least recently used texture that doesn't need it
+bool TextureStreamer::evictLevel()
+{
+	sStreamedTexture* victim = NULL;
+	for (std::map<Texture*, sStreamedTexture>::iterator it = textures.begin(); it != textures.end(); ++it)
+	{
+		sStreamedTexture& t = it->second;
+		if (t.loading || t.resident_level >= t.tail_level || !t.texture->isLoaded())
+			continue;
+		if (t.last_used == frame && t.resident_level >= t.wanted_level)
+			continue; //needed this frame
+		if (!victim || t.last_used < victim->last_used)
+			victim = &t;
+	}
+	if (!victim)
+		return false;
+
+	int level = victim->resident_level;
+	victim->texture->setBaseLevel(level + 1);
+	victim->texture->freeLevels(level, level);
+	victim->resident_level++;
+	resident_bytes -= victim->level_bytes[level];
+	return true;
+}
+
+void TextureStreamer::uploadLevels(sStreamedLevels& result)
+{
+	loading_bytes -= result.bytes;
+	num_loading--;
+	std::map<Texture*, sStreamedTexture>::iterator it = textures.find(result.texture);
+	if (it == textures.end())
+		return;
+	sStreamedTexture& t = it->second;
+	t.loading = false;
+
+	if (!result.loaded)
+	{
+		//it stays with the levels it has
+		std::cout << "[WARN] texture streaming: the levels of " << t.filename << " could not be read from the cache" << std::endl;
+		t.tail_level = t.resident_level;
+		return;
+	}
+
+	int last_level = t.resident_level - 1;
+	if (result.first_level > last_level)
+		return;
+	t.texture->uploadLevels(result.levels, result.first_level, last_level);
+	t.texture->setBaseLevel(result.first_level);
+	resident_bytes += t.getBytes(result.first_level, last_level);
+	t.resident_level = result.first_level;
+}
+
+void TextureStreamer::update()
+{
+	num_evicted = 0;
+	num_limited = 0;
+
+	//levels read by the workers, at least one texture per frame
+	size_t uploaded = 0;
+	while (true)
+	{
+		sStreamedLevels result;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (finished.empty() || (uploaded && uploaded + finished.front().bytes > upload_budget))
+				break;
+			result = finished.front();
+			finished.pop_front();
+		}
+		uploadLevels(result);
+		uploaded += result.bytes;
+		delete result.levels;
+	}
+
+	//everything is loaded and nothing is freed
+	if (!enabled)
+		for (std::map<Texture*, sStreamedTexture>::iterator it = textures.begin(); it != textures.end(); ++it)
+		{
+			it->second.wanted_level = 0;
+			it->second.last_used = frame;
+		}
+
+	//over the budget, the levels that were not needed last frame are freed first
+	while (enabled && resident_bytes + loading_bytes > budget && evictLevel())
+		num_evicted++;
+
+	//the textures that need more levels, the ones that lack more first
+	std::vector<sStreamedTexture*> pending;
+	for (std::map<Texture*, sStreamedTexture>::iterator it = textures.begin(); it != textures.end(); ++it)
+	{
+		sStreamedTexture& t = it->second;
+		if (!t.loading && t.last_used == frame && t.wanted_level < t.resident_level && t.texture->isLoaded()) //not while GetAsync uploads it
+			pending.push_back(&t);
+	}
+	std::sort(pending.begin(), pending.end(), [](sStreamedTexture* a, sStreamedTexture* b) {
+		return a->resident_level - a->wanted_level > b->resident_level - b->wanted_level;
+	});
+
+	for (size_t i = 0; i < pending.size() && num_loading < max_loads; ++i)
+	{
+		sStreamedTexture& t = *pending[i];
+		int first_level = t.wanted_level;
+		if (enabled)
+		{
+			//make room with the unused ones, otherwise only the levels that fit
+			while (resident_bytes + loading_bytes + t.getBytes(first_level, t.resident_level - 1) > budget && evictLevel())
+				num_evicted++;
+			while (first_level < t.resident_level && resident_bytes + loading_bytes + t.getBytes(first_level, t.resident_level - 1) > budget)
+				first_level++;
+			if (first_level != t.wanted_level)
+				num_limited++;
+			if (first_level == t.resident_level)
+				continue;
+		}
+
+		sStreamedLevels job;
+		job.texture = t.texture;
+		job.first_level = first_level;
+		job.bytes = t.getBytes(first_level, t.resident_level - 1);
+		job.loaded = false;
+		job.levels = NULL;
+		t.loading = true;
+		num_loading++;
+		loading_bytes += job.bytes;
+
+		std::string filename = t.filename;
+		int last_level = t.resident_level - 1;
+		eTextureCodec codec = t.codec;
+		int width = t.width;
+		int height = t.height;
+		size_t num_levels = t.level_bytes.size();
+		WorkerPool::getGlobal()->addJob([this, job, filename, last_level, codec, width, height, num_levels]() mutable {
+			TextureCompressor* levels = new TextureCompressor();
+			job.levels = levels;
+			job.loaded = levels->readBin(getCacheFilename(filename, ".tbin").c_str(), filename.c_str()) &&
+				levels->codec == codec && levels->width == width && levels->height == height && levels->levels.size() == num_levels;
+			//only the missing ones wait in memory
+			if (job.loaded)
+				for (int i = 0; i < (int)num_levels; ++i)
+					if (i < job.first_level || i > last_level)
+						std::vector<uint8>().swap(levels->levels[i].data);
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.push_back(job);
+		});
+	}
+
+	frame++;
+}
+
+void TextureStreamer::renderInMenu()
+{
+	ImGui::Checkbox("Stream mips", &enabled);
+	int budget_mb = (int)(budget / (1024 * 1024));
+	if (ImGui::SliderInt("VRAM budget (MB)", &budget_mb, 8, 2048))
+		budget = (size_t)budget_mb * 1024 * 1024;
+	ImGui::SliderFloat("LOD bias", &lod_bias, -3.0f, 3.0f);
+
+	//pressure of the budget
+	char overlay[64];
+	sprintf(overlay, "%.1f / %d MB", resident_bytes / (1024.0f * 1024.0f), budget_mb);
+	ImGui::ProgressBar(budget ? std::min(1.0f, (float)resident_bytes / budget) : 1.0f, ImVec2(-1, 0), overlay);
+	ImGui::Text("%d loading, %d levels freed, %d requests over the budget", num_loading, num_evicted, num_limited);
+
+	for (std::map<Texture*, sStreamedTexture>::iterator it = textures.begin(); it != textures.end(); ++it)
+	{
+		sStreamedTexture& t = it->second;
+		ImGui::Text("%s: mip %d (%dx%d) %d KB%s", t.filename.c_str(), t.resident_level,
+			std::max(1, t.width >> t.resident_level), std::max(1, t.height >> t.resident_level), (int)(t.getResidentBytes() / 1024), t.loading ? " loading" : "");
+	}
+}
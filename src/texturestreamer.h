@@ -0,0 +1,91 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include "framework.h"
+#include "texturecompressor.h"
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <string>
+
+class Texture;
+
+//streaming state of one texture, only used from the main thread
+struct sStreamedTexture {
+	Texture* texture;
+	std::string filename; //source of the .tbin where the levels are read again
+	eTextureCodec codec;
+	int width;
+	int height;
+	std::vector<size_t> level_bytes;
+	int tail_level; //this one and the smaller ones are always resident
+	int resident_level; //first level in VRAM (GL_TEXTURE_BASE_LEVEL)
+	int wanted_level; //finest level requested since the last update
+	bool loading; //a worker is reading the levels from the .tbin
+	long last_used; //frame of the streamer
+
+	size_t getBytes(int first_level, int last_level); //from first_level to last_level (included)
+	size_t getResidentBytes() { return getBytes(resident_level, (int)level_bytes.size() - 1); }
+};
+
+//levels read in a worker, waiting for the upload
+struct sStreamedLevels {
+	Texture* texture;
+	int first_level;
+	size_t bytes; //of the levels that will be uploaded
+	bool loaded;
+	TextureCompressor* levels; //only the ones from first_level to the resident one are kept
+};
+
+//TextureStreamer
+//mip streaming of the maps of the materials loaded from the texture cache (.tbin): only the tail of small mips is uploaded
+//when they are loaded, the bigger levels are read again from the .tbin in a worker and uploaded when a visible node
+//needs them, from its size on the screen (see request). When the resident bytes go over the budget the finest levels of
+//the least recently used textures are freed first (GL_TEXTURE_BASE_LEVEL points to the first resident one, so the
+//texture object and its handle never change).
+
+class TextureStreamer {
+public:
+	bool enabled; //off: all the levels are loaded and nothing is freed
+	size_t budget; //bytes of VRAM for all the levels of the streamed textures
+	size_t upload_budget; //bytes uploaded per frame (at least one texture)
+	int tail_size; //the levels up to this size are never streamed
+	float lod_bias; //negative gives sharper levels
+	int max_loads; //reads of the .tbin in flight
+
+	//stats
+	size_t resident_bytes;
+	size_t loading_bytes; //reserved for the reads in flight
+	int num_loading;
+	int num_evicted; //levels freed in the last update
+	int num_limited; //requests that didn't fit in the budget in the last update
+
+	std::map<Texture*, sStreamedTexture> textures;
+
+	TextureStreamer();
+
+	//from the upload of a texture made from the cache, returns the first level that must be uploaded (0 if it is not streamed)
+	int registerTexture(Texture* texture, const char* filename, TextureCompressor* levels);
+	void unregisterTexture(Texture* texture);
+
+	//the texture will be drawn covering about screen_size pixels this frame
+	void request(Texture* texture, float screen_size);
+
+	//once per frame: uploads the levels read by the workers, frees levels over the budget and starts the new reads
+	void update();
+
+	void renderInMenu();
+
+	static TextureStreamer* getGlobal();
+
+private:
+	long frame;
+	std::mutex mutex;
+	std::deque<sStreamedLevels> finished; //from the workers
+
+	void uploadLevels(sStreamedLevels& result);
+	bool evictLevel(); //false if there was nothing that could be freed
+};
+
+#endif
@@ -2,9 +2,17 @@
 
 #ifdef WIN32
 	#include <windows.h>
+	#include <direct.h>
 #else
 	#include <sys/time.h>
+	#include <sys/mman.h>
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <unistd.h>
 #endif
+#include <sys/stat.h>
+#include <cstring>
+#include <chrono>
 
 #include "includes.h"
 
@@ -26,6 +34,11 @@ long getTime()
 	#endif
 }
 
+double getTimeMs()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 float * snapshot()
 {
 	GLint viewport[4];
@@ -308,12 +321,307 @@ std::string getGPUStats()
 		nCurAvailMemoryInKB = 0;
 	}
 
-	std::string str = "FPS: " + std::to_string(Application::instance->fps) + " DCS: " + std::to_string(Mesh::num_meshes_rendered) + " Tris: " + std::to_string(long(Mesh::num_triangles_rendered * 0.001)) + "Ks  VRAM: " + std::to_string(int((nTotalMemoryInKB-nCurAvailMemoryInKB) * 0.001)) + "MBs / " + std::to_string(int(nTotalMemoryInKB * 0.001)) + "MBs";
+	std::string str = "FPS: " + std::to_string(Application::instance->fps) + " DCS: " + std::to_string(Mesh::num_meshes_rendered) + " GL calls: " + std::to_string(Mesh::num_gl_calls) + " Tris: " + std::to_string(long(Mesh::num_triangles_rendered * 0.001)) + "Ks  VRAM: " + std::to_string(int((nTotalMemoryInKB-nCurAvailMemoryInKB) * 0.001)) + "MBs / " + std::to_string(int(nTotalMemoryInKB * 0.001)) + "MBs";
 	Mesh::num_meshes_rendered = 0;
 	Mesh::num_triangles_rendered = 0;
+	Mesh::num_gl_calls = 0;
 	return str;
 }
 
+//files and asset cache ***************************************
+
+bool getFileInfo(const char* filename, unsigned long long& size, long long& mtime)
+{
+	struct stat stbuffer;
+	if (stat(filename, &stbuffer) != 0)
+		return false;
+	size = stbuffer.st_size;
+	mtime = stbuffer.st_mtime;
+	return true;
+}
+
+bool MappedFile::open(const char* filename)
+{
+	close();
+#ifdef WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	HANDLE file_mapping = NULL;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+		file_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	void* view = file_mapping ? MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (!view)
+	{
+		if (file_mapping)
+			CloseHandle(file_mapping);
+		CloseHandle(file);
+		return false;
+	}
+	handle = file;
+	mapping = file_mapping;
+	size = (size_t)file_size.QuadPart;
+#else
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat stbuffer;
+	void* view = MAP_FAILED;
+	if (fstat(fd, &stbuffer) == 0 && stbuffer.st_size > 0)
+		view = mmap(NULL, stbuffer.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); //the mapping keeps the file
+	if (view == MAP_FAILED)
+		return false;
+	size = (size_t)stbuffer.st_size;
+#endif
+	data = (const unsigned char*)view;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (!data)
+		return;
+#ifdef WIN32
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)mapping);
+	CloseHandle((HANDLE)handle);
+#else
+	munmap((void*)data, size);
+#endif
+	data = NULL;
+	size = 0;
+	handle = mapping = NULL;
+}
+
+//xxHash64 by Yann Collet (BSD license), reduced version
+static const unsigned long long PRIME64_1 = 11400714785074694791ULL;
+static const unsigned long long PRIME64_2 = 14029467366897019727ULL;
+static const unsigned long long PRIME64_3 = 1609587929392839161ULL;
+static const unsigned long long PRIME64_4 = 9650029242287828579ULL;
+static const unsigned long long PRIME64_5 = 2870177450012600261ULL;
+
+static inline unsigned long long rotl64(unsigned long long x, int r) { return (x << r) | (x >> (64 - r)); }
+static inline unsigned long long read64(const unsigned char* p) { unsigned long long v; memcpy(&v, p, 8); return v; }
+static inline unsigned int read32(const unsigned char* p) { unsigned int v; memcpy(&v, p, 4); return v; }
+static inline unsigned long long xxhRound(unsigned long long acc, unsigned long long input)
+{
+	acc += input * PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+static inline unsigned long long xxhMerge(unsigned long long acc, unsigned long long val)
+{
+	acc ^= xxhRound(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+unsigned long long hashData(const void* data, size_t size, unsigned long long seed)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + size;
+	unsigned long long h;
+
+	if (size >= 32)
+	{
+		const unsigned char* limit = end - 32;
+		unsigned long long v1 = seed + PRIME64_1 + PRIME64_2;
+		unsigned long long v2 = seed + PRIME64_2;
+		unsigned long long v3 = seed;
+		unsigned long long v4 = seed - PRIME64_1;
+		do {
+			v1 = xxhRound(v1, read64(p)); p += 8;
+			v2 = xxhRound(v2, read64(p)); p += 8;
+			v3 = xxhRound(v3, read64(p)); p += 8;
+			v4 = xxhRound(v4, read64(p)); p += 8;
+		} while (p <= limit);
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = xxhMerge(h, v1);
+		h = xxhMerge(h, v2);
+		h = xxhMerge(h, v3);
+		h = xxhMerge(h, v4);
+	}
+	else
+		h = seed + PRIME64_5;
+
+	h += (unsigned long long)size;
+
+	while (p + 8 <= end)
+	{
+		h ^= xxhRound(0, read64(p));
+		h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end)
+	{
+		h ^= (unsigned long long)read32(p) * PRIME64_1;
+		h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	while (p < end)
+	{
+		h ^= (*p) * PRIME64_5;
+		h = rotl64(h, 11) * PRIME64_1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+bool hashFile(const char* filename, unsigned long long& hash)
+{
+	FILE* f = fopen(filename, "rb");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	rewind(f);
+	std::vector<unsigned char> data(size);
+	if (size > 0 && fread(&data[0], 1, size, f) != (size_t)size)
+	{
+		fclose(f);
+		return false;
+	}
+	fclose(f);
+	hash = hashData(size ? &data[0] : NULL, size);
+	return true;
+}
+
+void listFiles(const std::string& folder, std::vector<std::string>& files, bool recursive)
+{
+#ifdef WIN32
+	WIN32_FIND_DATAA find_data;
+	HANDLE handle = FindFirstFileA((folder + "/*").c_str(), &find_data);
+	if (handle == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		std::string name = find_data.cFileName;
+		if (name == "." || name == "..")
+			continue;
+		std::string path = folder + "/" + name;
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			if (recursive)
+				listFiles(path, files, true);
+		}
+		else
+			files.push_back(path);
+	} while (FindNextFileA(handle, &find_data));
+	FindClose(handle);
+#else
+	DIR* dir = opendir(folder.c_str());
+	if (!dir)
+		return;
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		std::string name = entry->d_name;
+		if (name == "." || name == "..")
+			continue;
+		std::string path = folder + "/" + name;
+		struct stat stbuffer;
+		if (stat(path.c_str(), &stbuffer) != 0)
+			continue;
+		if (S_ISDIR(stbuffer.st_mode))
+		{
+			if (recursive)
+				listFiles(path, files, true);
+		}
+		else
+			files.push_back(path);
+	}
+	closedir(dir);
+#endif
+}
+
+bool createFolder(const char* folder)
+{
+	struct stat stbuffer;
+	if (stat(folder, &stbuffer) == 0)
+		return true;
+#ifdef WIN32
+	return _mkdir(folder) == 0;
+#else
+	return mkdir(folder, 0755) == 0;
+#endif
+}
+
+static std::string cache_folder;
+
+void setCacheFolder(const char* folder)
+{
+	cache_folder = folder ? folder : "";
+	while (cache_folder.size() && (cache_folder.back() == '/' || cache_folder.back() == '\\'))
+		cache_folder.pop_back();
+	if (cache_folder.size() && !createFolder(cache_folder.c_str()))
+		std::cout << "[ERROR] cannot create cache folder: " << cache_folder << std::endl;
+}
+
+std::string getCacheFolder()
+{
+	return cache_folder;
+}
+
+std::string getCacheFilename(const std::string& source, const char* extension)
+{
+	if (cache_folder.empty())
+		return source + extension;
+
+	//flatten the path so every source gets its own file in the cache folder, '_' is escaped too so
+	//data/a_b/c.obj and data/a/b_c.obj don't end in the same file
+	std::string name;
+	name.reserve(source.size() + 8);
+	for (size_t i = 0; i < source.size(); ++i)
+	{
+		char c = source[i];
+		if (c == '/' || c == '\\')
+			name += "_s";
+		else if (c == ':')
+			name += "_c";
+		else if (c == '_')
+			name += "_u";
+		else
+			name += c;
+	}
+	return cache_folder + "/" + name + extension;
+}
+
+bool computeCacheInfo(const char* source, sCacheInfo& info)
+{
+	memset(&info, 0, sizeof(info));
+	if (!getFileInfo(source, info.source_size, info.source_mtime))
+		return false;
+	return hashFile(source, info.source_hash);
+}
+
+bool isCacheValid(const char* source, const sCacheInfo& info, bool& touched)
+{
+	touched = false;
+	unsigned long long size;
+	long long mtime;
+	if (!getFileInfo(source, size, mtime))
+		return true; //no source to compare with, trust the cache
+	if (info.source_hash == 0)
+		return false; //cache without metadata
+	if (size != info.source_size)
+		return false;
+	if (mtime == info.source_mtime)
+		return true;
+
+	//same size but different date, check the content
+	unsigned long long hash;
+	if (!hashFile(source, hash) || hash != info.source_hash)
+		return false;
+	touched = true;
+	return true;
+}
+
 Mesh* grid = NULL;
 
 void drawGrid()
@@ -13,6 +13,7 @@
 
 //General functions **************
 long getTime();
+double getTimeMs(); //high resolution, for the benchmarks (getTime has the resolution of the system ticks)
 float * snapshot();
 bool readFile(const std::string& filename, std::string& content);
 
@@ -35,6 +36,48 @@ std::vector<std::string> split(const std::string &s, char delim);
 std::string getGPUStats();
 void drawGrid();
 
+//files and asset cache ************
+bool getFileInfo(const char* filename, unsigned long long& size, long long& mtime); //false if it doesnt exist
+unsigned long long hashData(const void* data, size_t size, unsigned long long seed = 0); //fast 64 bits hash (xxHash64)
+bool hashFile(const char* filename, unsigned long long& hash);
+void listFiles(const std::string& folder, std::vector<std::string>& files, bool recursive = true);
+bool createFolder(const char* folder);
+
+//read only view of a whole file mapped in memory (no copy to a buffer), unmapped when destroyed
+class MappedFile {
+public:
+	const unsigned char* data;
+	size_t size;
+
+	MappedFile() { data = NULL; size = 0; handle = mapping = NULL; }
+	~MappedFile() { close(); }
+	MappedFile(const MappedFile&) = delete; //a copy would unmap the same view twice
+	MappedFile& operator = (const MappedFile&) = delete;
+
+	bool open(const char* filename); //false if it doesn't exist or it is empty
+	void close();
+
+private:
+	void* handle; //the file and the mapping, only in windows (mmap doesn't need to keep the descriptor)
+	void* mapping;
+};
+
+//binary caches (.mbin, .abin) are stored next to the source unless a cache folder is set
+void setCacheFolder(const char* folder);
+std::string getCacheFolder();
+std::string getCacheFilename(const std::string& source, const char* extension);
+
+//metadata stored in the binary caches to know if they were generated from the current source
+struct sCacheInfo {
+	unsigned long long source_size;
+	long long source_mtime;
+	unsigned long long source_hash;
+};
+bool computeCacheInfo(const char* source, sCacheInfo& info);
+//first compares size and mtime, only if they changed the content hash is computed (touched but not modified)
+//touched is set in that case so the caller can update the stored mtime
+bool isCacheValid(const char* source, const sCacheInfo& info, bool& touched);
+
 //Used in the MESH and ANIM parsers
 char* fetchWord(char* data, char* word);
 char* fetchFloat(char* data, float& f);
@@ -0,0 +1,181 @@
+#include "volumecompositor.h"
+#include "fbo.h"
+#include "shader.h"
+#include "camera.h"
+#include "mesh.h"
+#include "material.h"
+#include "renderqueue.h"
+#include "utils.h"
+
+#include <cstring>
+#include <iostream>
+
+VolumeCompositor::VolumeCompositor()
+{
+	fbo = NULL;
+	sample_fbo = NULL;
+	accumulation_fbo = NULL;
+	composite_shader = NULL;
+	accumulated_composite_shader = NULL;
+	accumulate_shader = NULL;
+	moving_scale = 2;
+	still_frames_to_converge = 4;
+	accumulation_frames = 16;
+	scale = 1;
+	num_accumulated = 0;
+	last_state_hash = 0;
+	still_frames = 0;
+	bound_camera = NULL;
+	full_width = full_height = 0;
+}
+
+VolumeCompositor::~VolumeCompositor()
+{
+	delete fbo;
+	delete sample_fbo;
+	delete accumulation_fbo;
+}
+
+bool VolumeCompositor::update(Camera* camera, RenderQueue* queue, bool reduce, bool accumulate)
+{
+	//any change of the view or the projection (orbit, WASD, resize) counts as movement
+	bool moved = memcmp(&last_viewprojection, &camera->viewprojection_matrix, sizeof(Matrix44)) != 0;
+	last_viewprojection = camera->viewprojection_matrix;
+
+	//the accumulation also restarts when a volume moves or its material changes
+	unsigned long long hash = hashData(&camera->viewprojection_matrix, sizeof(Matrix44));
+	for (size_t i = 0; i < queue->items.size(); ++i)
+	{
+		sDrawItem& item = queue->items[i];
+		if (!item.material->isVolume())
+			continue;
+		hash = hashData(&item.model, sizeof(Matrix44), hash);
+		hash = hashData(&item.mesh, sizeof(Mesh*), hash);
+		hash ^= ((VolumeMaterial*)item.material)->getStateHash();
+	}
+	if (hash != last_state_hash)
+		num_accumulated = 0;
+	last_state_hash = hash;
+
+	if (!reduce)
+		scale = 1;
+	else if (moved)
+	{
+		scale = moving_scale;
+		still_frames = 0;
+	}
+	else if (scale > 1 && ++still_frames >= still_frames_to_converge)
+	{
+		//one step at a time, quarter -> half -> full
+		scale /= 2;
+		still_frames = 0;
+	}
+
+	if (scale > 1 || !accumulate)
+		num_accumulated = 0;
+	return scale > 1 || accumulate;
+}
+
+bool VolumeCompositor::prepareFBO(FBO*& target, int width, int height, int type, int internal_format)
+{
+	if (target && (target->width != width || target->height != height))
+	{
+		delete target;
+		target = NULL;
+		num_accumulated = 0;
+	}
+	if (target)
+		return true;
+	target = new FBO();
+	if (target->create(width, height, GL_RGBA, type, 1, internal_format))
+		return true;
+	std::cout << "[WARN] volume buffer could not be created" << std::endl;
+	delete target;
+	target = NULL;
+	return false;
+}
+
+void VolumeCompositor::render(Camera* camera, RenderQueue* queue, int width, int height)
+{
+	if (!composite_shader)
+	{
+		composite_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/volume_composite.fs");
+		accumulated_composite_shader = Shader::Get("data/shaders/basic.vs", "data/shaders/volume_composite.fs", "#define USE_ACCUMULATION\n");
+		accumulate_shader = Shader::Get("data/shaders/quad.vs", "data/shaders/volume_accumulate.fs");
+	}
+
+	bool ready;
+	if (scale > 1)
+	{
+		//1. ray marching at the reduced resolution, without the depth of the scene (the composite does the occlusion)
+		//half floats because the alpha of a faint volume doesn't fit in 8 bits, and the coverage is alpha > 0
+		int w = width / scale > 0 ? width / scale : 1;
+		int h = height / scale > 0 ? height / scale : 1;
+		ready = composite_shader && prepareFBO(fbo, w, h, GL_HALF_FLOAT, GL_RGBA16F);
+		if (ready)
+		{
+			fbo->bind();
+			glClearColor(0, 0, 0, 0);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			queue->execute(camera, QUEUE_VOLUMES);
+			fbo->unbind();
+		}
+	}
+	else
+	{
+		//1. one more jittered frame in the average, until there are enough
+		ready = accumulated_composite_shader && accumulate_shader && prepareFBO(sample_fbo, width, height, GL_HALF_FLOAT, GL_RGBA16F) &&
+			prepareFBO(accumulation_fbo, width, height, GL_FLOAT, GL_RGBA32F);
+		if (ready && num_accumulated < accumulation_frames)
+			accumulate(camera, queue);
+	}
+	if (!ready)
+	{
+		queue->execute(camera, QUEUE_VOLUMES); //full resolution as fallback
+		return;
+	}
+
+	//2. the volume materials are bound with the composite shader and draw their meshes again
+	bound_camera = camera;
+	full_width = width;
+	full_height = height;
+	VolumeMaterial::compositor = this;
+	queue->execute(camera, QUEUE_VOLUMES);
+	VolumeMaterial::compositor = NULL;
+}
+
+void VolumeCompositor::accumulate(Camera* camera, RenderQueue* queue)
+{
+	VolumeMaterial::accumulation_frame = num_accumulated;
+	sample_fbo->bind();
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	queue->execute(camera, QUEUE_VOLUMES);
+	sample_fbo->unbind();
+	VolumeMaterial::accumulation_frame = -1;
+
+	//running average: the new frame weights 1/(n+1), the first one replaces what was there
+	accumulation_fbo->bind();
+	RenderQueue::invalidateState();
+	RenderQueue::setBlending(true, GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+	RenderQueue::setDepthFunc(GL_ALWAYS);
+	glBlendColor(0, 0, 0, 1.0f / (num_accumulated + 1));
+	accumulate_shader->enable();
+	accumulate_shader->setUniform("u_texture", sample_fbo->color_textures[0], 0);
+	Mesh::getQuad()->render(GL_TRIANGLES);
+	accumulate_shader->disable();
+	RenderQueue::resetState();
+	accumulation_fbo->unbind();
+
+	num_accumulated++;
+}
+
+void VolumeCompositor::setUniforms(Shader* shader)
+{
+	FBO* source = scale > 1 ? fbo : accumulation_fbo;
+	shader->setUniform("u_volume_texture", source->color_textures[0], 0);
+	shader->setUniform("u_volume_depth", source->depth_texture, 1);
+	shader->setUniform("u_volume_size", Vector2((float)source->width, (float)source->height));
+	shader->setUniform("u_viewport_size", Vector2((float)full_width, (float)full_height));
+	shader->setUniform("u_camera_nearfar", Vector2(bound_camera->near_plane, bound_camera->far_plane));
+}
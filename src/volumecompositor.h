@@ -0,0 +1,57 @@
+#ifndef VOLUMECOMPOSITOR_H
+#define VOLUMECOMPOSITOR_H
+
+#include "framework.h"
+
+class FBO;
+class Shader;
+class Camera;
+class RenderQueue;
+
+//VolumeCompositor
+//the ray marching of the volumes is done at half or quarter resolution while the camera moves and composited back
+//with a bilateral upsampling: the four nearest texels are weighted by the distance of their depth to the depth of the
+//full resolution fragment, so the silhouettes of the volumes don't blur. The composite draws the same volume meshes
+//so the occlusion with the scene is done by the depth test at full resolution.
+//When the camera stops the resolution goes back to full in a few frames (and the volumes are drawn directly).
+//With the progressive accumulation, while nothing changes the full resolution frames are rendered with other jitter
+//and averaged in a float buffer, so big steps converge to a clean image in accumulation_frames frames
+
+class VolumeCompositor {
+public:
+	FBO* fbo; //reduced resolution color (RGBA16F) and depth of the volumes
+	FBO* sample_fbo; //full resolution frame of the accumulation
+	FBO* accumulation_fbo; //running average (RGBA32F), the alpha is the coverage
+	Shader* composite_shader;
+	Shader* accumulated_composite_shader;
+	Shader* accumulate_shader;
+	int moving_scale; //2 (half) or 4 (quarter) while the camera moves
+	int still_frames_to_converge; //frames without movement before every step to a higher resolution
+	int accumulation_frames; //samples averaged, after them the result is only composited
+	int scale; //of the current frame, 1 is full resolution
+	int num_accumulated;
+
+	VolumeCompositor();
+	~VolumeCompositor();
+
+	//chooses how the volumes are rendered this frame from the movement of the camera and the state of the volume items,
+	//returns true if they have to be rendered apart with render (reduced resolution or accumulation)
+	bool update(Camera* camera, RenderQueue* queue, bool reduce, bool accumulate);
+	//renders the volume items of the queue and composites them in the current framebuffer
+	void render(Camera* camera, RenderQueue* queue, int width, int height);
+	Shader* getCompositeShader() { return scale > 1 ? composite_shader : accumulated_composite_shader; }
+	void setUniforms(Shader* shader); //of the composite shader, used while the volume materials are bound
+
+private:
+	Matrix44 last_viewprojection;
+	unsigned long long last_state_hash;
+	int still_frames;
+	Camera* bound_camera;
+	int full_width;
+	int full_height;
+
+	bool prepareFBO(FBO*& target, int width, int height, int type, int internal_format);
+	void accumulate(Camera* camera, RenderQueue* queue);
+};
+
+#endif
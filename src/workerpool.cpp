@@ -0,0 +1,138 @@
+#include "workerpool.h"
+#include <atomic>
+#include <memory>
+#include <cassert>
+
+WorkerPool::WorkerPool(int num_threads)
+{
+	pending = 0;
+	must_exit = false;
+	if (num_threads <= 0)
+		num_threads = (int)std::thread::hardware_concurrency() - 1;
+	if (num_threads < 1)
+		num_threads = 1;
+	for (int i = 0; i < num_threads; ++i)
+		threads.push_back(std::thread(&WorkerPool::workerLoop, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		must_exit = true;
+	}
+	job_available.notify_all();
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+WorkerPool* WorkerPool::getGlobal()
+{
+	static WorkerPool pool;
+	return &pool;
+}
+
+void WorkerPool::addJob(std::function<void()> job)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		jobs.push_back(job);
+		pending++;
+	}
+	job_available.notify_one();
+}
+
+void WorkerPool::waitAll()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	jobs_finished.wait(lock, [this] { return pending == 0; });
+}
+
+void WorkerPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_available.wait(lock, [this] { return must_exit || !jobs.empty(); });
+			if (must_exit && jobs.empty())
+				return;
+			job = jobs.front();
+			jobs.pop_front();
+		}
+		job();
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			pending--;
+			if (pending == 0)
+				jobs_finished.notify_all();
+		}
+	}
+}
+
+//state shared between the caller of parallelFor and the helpers,
+//it is refcounted because a helper could start after the loop has finished
+struct sParallelForTask {
+	std::function<void(int, int)> func;
+	int num;
+	int grain_size;
+	int num_chunks;
+	std::atomic<int> next_chunk;
+	std::atomic<int> chunks_done;
+	std::mutex mutex;
+	std::condition_variable finished;
+
+	void run()
+	{
+		int done = 0;
+		while (true)
+		{
+			int chunk = next_chunk++;
+			if (chunk >= num_chunks)
+				break;
+			int start = chunk * grain_size;
+			int end = start + grain_size;
+			func(start, end > num ? num : end);
+			done++;
+		}
+		if (done && (chunks_done += done) == num_chunks)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.notify_all();
+		}
+	}
+};
+
+void WorkerPool::parallelFor(int num, int grain_size, const std::function<void(int start, int end)>& func)
+{
+	if (num <= 0)
+		return;
+	if (grain_size < 1)
+		grain_size = 1;
+	int num_chunks = (num + grain_size - 1) / grain_size;
+	if (num_chunks == 1)
+	{
+		func(0, num);
+		return;
+	}
+
+	std::shared_ptr<sParallelForTask> task(new sParallelForTask());
+	task->func = func;
+	task->num = num;
+	task->grain_size = grain_size;
+	task->num_chunks = num_chunks;
+	task->next_chunk = 0;
+	task->chunks_done = 0;
+
+	int num_helpers = num_chunks - 1;
+	if (num_helpers > (int)threads.size())
+		num_helpers = (int)threads.size();
+	for (int i = 0; i < num_helpers; ++i)
+		addJob([task] { task->run(); });
+
+	task->run();
+
+	std::unique_lock<std::mutex> lock(task->mutex);
+	task->finished.wait(lock, [&task] { return task->chunks_done == task->num_chunks; });
+}
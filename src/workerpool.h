@@ -0,0 +1,46 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//WorkerPool
+//a small pool of threads to run jobs in the background or to split loops in chunks
+
+class WorkerPool {
+public:
+	WorkerPool(int num_threads = 0); //0 means one thread per core (minus the main one)
+	~WorkerPool();
+
+	int getNumThreads() { return (int)threads.size(); }
+
+	//adds a job to the queue, the first free worker will execute it
+	void addJob(std::function<void()> job);
+
+	//blocks till every job in the queue has been executed
+	void waitAll();
+
+	//splits [0,num) in chunks of grain_size and executes func(start,end) for every chunk in parallel
+	//the calling thread also processes chunks, so it can be called from inside a job
+	void parallelFor(int num, int grain_size, const std::function<void(int start, int end)>& func);
+
+	//pool shared by the whole application
+	static WorkerPool* getGlobal();
+
+private:
+	std::vector<std::thread> threads;
+	std::deque< std::function<void()> > jobs;
+	std::mutex mutex;
+	std::condition_variable job_available;
+	std::condition_variable jobs_finished;
+	int pending; //jobs queued or being executed
+	bool must_exit;
+
+	void workerLoop();
+};
+
+#endif